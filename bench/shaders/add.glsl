@@ -0,0 +1,24 @@
+uniform restrict writeonly image2D outputTex;	//@ relativeTo(inputTex1)
+uniform sampler2D inputTex1;	//@ input
+uniform sampler2D inputTex2;	//@ input
+uniform int inputTex1_flipY;
+uniform int inputTex2_flipY;
+uniform vec4 inputTex1_size;
+uniform vec4 inputTex2_size;
+uniform ivec2 inputTex1_origin;
+uniform ivec2 inputTex2_origin;
+uniform vec4 outputTex_size;
+uniform ivec2 outputTex_origin;
+
+#include "../../data/std/sampleFlipped.glsl"
+#include "../../data/std/graphTile.glsl"
+
+layout (local_size_x = 8, local_size_y = 8) in;	//@ tileable
+void main() {
+	ivec2 pix = ivec2(gl_GlobalInvocationID.xy);
+	vec2 uv = (vec2(pix) + 0.5) * outputTex_size.zw;
+
+	vec4 col = sampleFlipped(inputTex1, inputTex1_flipY, tileUv(inputTex1, inputTex1_origin, inputTex1_size, uv), 0);
+	col += sampleFlipped(inputTex2, inputTex2_flipY, tileUv(inputTex2, inputTex2_origin, inputTex2_size, uv), 0);
+	imageStore(outputTex, pix - outputTex_origin, col);
+}
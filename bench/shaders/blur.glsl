@@ -0,0 +1,32 @@
+uniform restrict writeonly image2D outputTex;	//@ relativeTo(inputTex)
+uniform int blurRadius;	//@ max(30)
+uniform ivec2 blurDir;	//@ min(0) max(1)
+uniform sampler2D inputTex;	//@ input apron(blurRadius)
+uniform int inputTex_flipY;
+uniform vec4 inputTex_size;
+uniform ivec2 inputTex_origin;
+uniform vec4 outputTex_size;
+uniform ivec2 outputTex_origin;
+
+#include "../../data/std/sampleFlipped.glsl"
+#include "../../data/std/graphTile.glsl"
+
+vec4 sampleInput(vec2 uv) {
+	return sampleFlipped(inputTex, inputTex_flipY, tileUv(inputTex, inputTex_origin, inputTex_size, uv), 0);
+}
+
+layout (local_size_x = 8, local_size_y = 8) in;	//@ tileable
+void main() {
+	ivec2 pix = ivec2(gl_GlobalInvocationID.xy);
+	vec2 uv = (vec2(pix) + 0.5) * outputTex_size.zw;
+	vec2 delta = blurDir * outputTex_size.zw;
+
+	vec4 col = sampleInput(uv);
+	for (int i = 1; i <= blurRadius; ++i) {
+		col += sampleInput(uv + delta * i);
+		col += sampleInput(uv - delta * i);
+	}
+	col *= 1.0 / (1 + 2 * blurRadius);
+
+	imageStore(outputTex, pix - outputTex_origin, col);
+}
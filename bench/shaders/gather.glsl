@@ -0,0 +1,26 @@
+uniform restrict writeonly image2D outputTex;
+uniform vec4 outputTex_size;
+
+layout(std430, binding = 0) restrict readonly buffer Samples {
+	vec4 samples[];
+};
+
+layout (local_size_x = 8, local_size_y = 8) in;
+void main() {
+	ivec2 pix = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 size = ivec2(outputTex_size.xy);
+	if (any(greaterThanEqual(pix, size))) {
+		return;
+	}
+
+	// 5x5 box filter straight out of the buffer
+	vec4 col = vec4(0);
+	for (int y = -2; y <= 2; ++y) {
+		for (int x = -2; x <= 2; ++x) {
+			ivec2 p = clamp(pix + ivec2(x, y), ivec2(0), size - 1);
+			col += samples[p.y * size.x + p.x];
+		}
+	}
+
+	imageStore(outputTex, pix, col * (1.0 / 25.0));
+}
@@ -0,0 +1,14 @@
+uniform restrict writeonly image2D outputTex;
+uniform vec4 outputTex_size;
+uniform ivec2 outputTex_origin;
+
+layout (local_size_x = 8, local_size_y = 8) in;	//@ tileable
+void main() {
+	ivec2 pix = ivec2(gl_GlobalInvocationID.xy);
+	vec2 uv = (vec2(pix) + 0.5) * outputTex_size.zw;
+
+	// Smooth HDR bands, so that blurs and tone mapping have something to chew on
+	vec3 col = 0.5 + 0.5 * cos(6.2831853 * (uv.xyx * vec3(3.0, 5.0, 7.0) + vec3(0.0, 0.33, 0.67)));
+	col *= 4.0 * uv.x;
+	imageStore(outputTex, pix - outputTex_origin, vec4(col, 1));
+}
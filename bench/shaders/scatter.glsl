@@ -0,0 +1,20 @@
+uniform sampler2D inputTex;	//@ input
+uniform vec4 inputTex_size;
+uniform int inputTex_flipY;
+
+#include "../../data/std/sampleFlipped.glsl"
+
+layout(std430, binding = 0) restrict writeonly buffer Samples {
+	vec4 samples[];
+};
+
+layout (local_size_x = 8, local_size_y = 8) in;
+void main() {
+	ivec2 pix = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 size = ivec2(inputTex_size.xy);
+	if (any(greaterThanEqual(pix, size))) {
+		return;
+	}
+
+	samples[pix.y * size.x + pix.x] = fetchFlipped(inputTex, inputTex_flipY, pix, 0);
+}
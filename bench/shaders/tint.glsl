@@ -0,0 +1,21 @@
+uniform restrict writeonly image2D outputTex;	//@ relativeTo(inputTex)
+uniform float EV;	//@ min(-8) max(8)
+uniform vec3 tint;	//@ color
+uniform sampler2D inputTex;	//@ input
+uniform int inputTex_flipY;
+uniform vec4 inputTex_size;
+uniform ivec2 inputTex_origin;
+uniform vec4 outputTex_size;
+uniform ivec2 outputTex_origin;
+
+#include "../../data/std/sampleFlipped.glsl"
+#include "../../data/std/graphTile.glsl"
+
+layout (local_size_x = 8, local_size_y = 8) in;	//@ tileable
+void main() {
+	ivec2 pix = ivec2(gl_GlobalInvocationID.xy);
+	vec2 uv = (vec2(pix) + 0.5) * outputTex_size.zw;
+	vec4 col = sampleFlipped(inputTex, inputTex_flipY, tileUv(inputTex, inputTex_origin, inputTex_size, uv), 0);
+	col.rgb *= tint * exp(EV);
+	imageStore(outputTex, pix - outputTex_origin, col);
+}
@@ -1,16 +1,19 @@
 uniform restrict writeonly image2D outputTex;	//@ relativeTo(inputImage)
 uniform int blurRadius;	//@ max(30)
 uniform ivec2 blurDir;	//@ min(0) max(1)
-layout(rgba16f) uniform restrict readonly image2D inputImage;	//@ input
+layout(rgba16f) uniform restrict readonly image2D inputImage;	//@ input apron(blurRadius)
+uniform ivec2 outputTex_origin;
+uniform ivec2 inputImage_origin;
 
-layout (local_size_x = 8, local_size_y = 8) in;
+layout (local_size_x = 8, local_size_y = 8) in;	//@ tileable
 void main() {
 	ivec2 pix = ivec2(gl_GlobalInvocationID.xy);
-	vec4 col = imageLoad(inputImage, pix);
+	ivec2 src = pix - inputImage_origin;
+	vec4 col = imageLoad(inputImage, src);
 	for (int i = 1; i <= blurRadius; ++i) {
-		col += imageLoad(inputImage, pix + blurDir * i);
-		col += imageLoad(inputImage, pix - blurDir * i);
+		col += imageLoad(inputImage, src + blurDir * i);
+		col += imageLoad(inputImage, src - blurDir * i);
 	}
 	col *= 1.0 / (1 + 2 * blurRadius);
-	imageStore(outputTex, pix, col);
+	imageStore(outputTex, pix - outputTex_origin, col);
 }
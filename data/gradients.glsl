@@ -1,4 +1,5 @@
 uniform restrict writeonly image2D outputTex;	//@ size(256 256)
+uniform ivec2 outputTex_origin;
 
 vec3 hsv2rgb(vec3 c)
 {
@@ -7,11 +8,11 @@ vec3 hsv2rgb(vec3 c)
     return c.z * mix(K.xxx, clamp(p - K.xxx, 0.0, 1.0), c.y);
 }
 
-layout (local_size_x = 8, local_size_y = 8) in;
+layout (local_size_x = 8, local_size_y = 8) in;	//@ tileable
 void main() {
 	ivec2 pix = ivec2(gl_GlobalInvocationID.xy);
 	vec2 uv = vec2(pix.xy) / 255.0;
 	float hue = fract(int(uv.y * 6) / 6.0 + 0.09);
 	vec4 col = vec4(hsv2rgb(vec3(hue, 1, 1)) * uv.x, 1);
-	imageStore(outputTex, pix, col);
+	imageStore(outputTex, pix - outputTex_origin, col);
 }
@@ -0,0 +1,12 @@
+// Graph tiles render the Created images of a graph a tile at a time, each into a texture covering just the tile,
+// and the apron its consumers read around it. Passes opt in with "//@ tileable" on their layout line, and then:
+//  - write their Created images at their invocation IDs, which stay those of the whole image, as does [texname]_size;
+//  - index images through "uniform ivec2 [texname]_origin;", the texel of the whole image at the texture's (0, 0);
+//  - read their Inputs around the uvs of their invocations; reads further out than a texel need an "apron(N)"
+//    annotation on the Input, N being a texel count or the name of an Int param holding one, e.g. apron(blurRadius).
+// Without graph tiles, the origins are zero, and textures cover whole images.
+
+// Maps the uv of a whole image to the texture holding the current tile of it
+vec2 tileUv(sampler2D tex, ivec2 origin, vec4 size, vec2 uv) {
+	return (uv * size.xy - vec2(origin)) / vec2(textureSize(tex, 0));
+}
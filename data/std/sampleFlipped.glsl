@@ -0,0 +1,13 @@
+// Reads textures which may be stored top-down: block-compressed DDS and KTX files are uploaded as stored.
+// Declare "uniform int [texname]_flipY;" next to the sampler, and pass it in; it's zero for all other textures.
+
+vec4 sampleFlipped(sampler2D tex, int flipY, vec2 uv, float lod) {
+	return textureLod(tex, flipY != 0 ? vec2(uv.x, 1.0 - uv.y) : uv, lod);
+}
+
+vec4 fetchFlipped(sampler2D tex, int flipY, ivec2 pix, int lod) {
+	if (flipY != 0) {
+		pix.y = textureSize(tex, lod).y - 1 - pix.y;
+	}
+	return texelFetch(tex, pix, lod);
+}
@@ -0,0 +1,18 @@
+uniform restrict writeonly image2D outputTex;	//@ relativeTo(inputTex)
+uniform sampler2D inputTex;	//@ input
+uniform sampler2D historyTex;	//@ history(outputTex)
+uniform float blend;	//@ default(0.1)
+uniform int inputTex_flipY;
+uniform vec4 outputTex_size;
+
+#include "std/sampleFlipped.glsl"
+
+layout (local_size_x = 8, local_size_y = 8) in;
+void main() {
+	ivec2 pix = ivec2(gl_GlobalInvocationID.xy);
+	vec2 uv = (vec2(pix) + 0.5) * outputTex_size.zw;
+
+	vec4 col = sampleFlipped(inputTex, inputTex_flipY, uv, 0);
+	vec4 hist = textureLod(historyTex, uv, 0);
+	imageStore(outputTex, pix, mix(hist, col, blend));
+}
@@ -0,0 +1,32 @@
+uniform restrict writeonly image2D outputTex;
+uniform sampler2D inputTex;	//@ input
+uniform usampler2D inputTex_indirection;
+uniform int inputTex_vtLevel;
+uniform vec4 inputTex_size;
+uniform vec4 outputTex_size;
+uniform ivec2 outputTex_origin;
+
+// Reads a Tiled source. 'pool' holds tiles with borders, and the indirection entry of each tile of
+// each level says which pool slot holds it, or its closest resident ancestor: xy slot, z its level.
+const int VT_TILE_SIZE = 128;
+const int VT_TILE_BORDER = 4;
+
+vec4 sampleVirtual(sampler2D pool, usampler2D indirection, vec4 size, int level, vec2 uv) {
+	vec2 levelSize = max(vec2(1.0), floor(size.xy / float(1 << level)));
+	vec2 texel = clamp(uv, 0.0, 1.0) * levelSize;
+	ivec2 tile = min(ivec2(texel) / VT_TILE_SIZE, (ivec2(levelSize) - 1) / VT_TILE_SIZE);
+	uvec4 entry = texelFetch(indirection, tile, level);
+
+	int coarser = int(entry.z) - level;
+	vec2 residentTexel = texel / float(1 << coarser) - vec2((tile >> coarser) * VT_TILE_SIZE);
+	vec2 poolTexel = vec2(entry.xy) * float(VT_TILE_SIZE + 2 * VT_TILE_BORDER) + float(VT_TILE_BORDER) + residentTexel;
+	return textureLod(pool, poolTexel / vec2(textureSize(pool, 0)), 0);
+}
+
+layout (local_size_x = 8, local_size_y = 8) in;	//@ tileable
+void main() {
+	ivec2 pix = ivec2(gl_GlobalInvocationID.xy);
+	vec2 uv = (vec2(pix) + 0.5) * outputTex_size.zw;
+	vec4 col = sampleVirtual(inputTex, inputTex_indirection, inputTex_size, inputTex_vtLevel, uv);
+	imageStore(outputTex, pix - outputTex_origin, col);
+}
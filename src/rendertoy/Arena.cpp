@@ -0,0 +1,81 @@
+#include "Arena.h"
+#include <algorithm>
+#include <new>
+
+
+LinearArena::LinearArena(size_t initialCapacity)
+{
+	addBlock(initialCapacity);
+}
+
+LinearArena::~LinearArena()
+{
+	freeBlocks();
+}
+
+void LinearArena::addBlock(size_t minSize)
+{
+	// Grow geometrically, so that a spike only chains a few blocks
+	const size_t size = std::max(minSize, m_capacity);
+
+	Block* const block = static_cast<Block*>(::operator new(sizeof(Block) + size));
+	block->prev = m_block;
+	block->size = size;
+
+	m_block = block;
+	m_offset = 0;
+	m_capacity += size;
+	++m_blockCount;
+}
+
+void LinearArena::freeBlocks()
+{
+	while (m_block) {
+		Block* const prev = m_block->prev;
+		::operator delete(m_block);
+		m_block = prev;
+	}
+
+	m_capacity = 0;
+	m_blockCount = 0;
+}
+
+void* LinearArena::alloc(size_t size, size_t alignment)
+{
+	// Block data follows the header, which keeps it aligned for any fundamental type
+	static_assert(sizeof(Block) % alignof(std::max_align_t) == 0, "misaligned arena block data");
+	size_t offset = (m_offset + alignment - 1) & ~(alignment - 1);
+
+	if (offset + size > m_block->size) {
+		addBlock(size);
+		offset = 0;
+	}
+
+	m_offset = offset + size;
+	m_used += size;
+	return reinterpret_cast<char*>(m_block + 1) + offset;
+}
+
+void LinearArena::reset()
+{
+	if (m_blockCount > 1) {
+		const size_t capacity = m_capacity;
+		freeBlocks();
+		addBlock(capacity);
+	}
+
+	m_offset = 0;
+	m_lastUsed = m_used;
+	m_used = 0;
+}
+
+namespace FrameArena {
+	LinearArena& get() {
+		static LinearArena arena;
+		return arena;
+	}
+
+	void reset() {
+		get().reset();
+	}
+}
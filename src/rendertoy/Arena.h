@@ -0,0 +1,68 @@
+#pragma once
+#include "Common.h"
+#include <cstddef>
+
+// Bump allocator. Frees are no-ops, and everything is released at once by reset().
+// When a block runs out, another one is chained; on reset, chained blocks are merged into
+// a single one big enough for the whole cycle, so a steady workload stops hitting the heap.
+class LinearArena
+{
+public:
+	explicit LinearArena(size_t initialCapacity = 64 * 1024);
+	~LinearArena();
+
+	LinearArena(const LinearArena&) = delete;
+	LinearArena& operator=(const LinearArena&) = delete;
+
+	void* alloc(size_t size, size_t alignment);
+	void reset();
+
+	size_t used() const { return m_used; }
+	size_t usedBeforeReset() const { return m_lastUsed; }
+	size_t capacity() const { return m_capacity; }
+	u32 blockCount() const { return m_blockCount; }
+
+private:
+	struct Block {
+		Block* prev;
+		size_t size;
+	};
+
+	void addBlock(size_t minSize);
+	void freeBlocks();
+
+	Block* m_block = nullptr;
+	size_t m_offset = 0;		// into the current block's data
+	size_t m_used = 0;			// bytes handed out since the last reset
+	size_t m_lastUsed = 0;
+	size_t m_capacity = 0;		// of all blocks
+	u32 m_blockCount = 0;
+};
+
+// Scratch memory for compiling and rendering a frame; reset by the main loop once the frame is done
+namespace FrameArena {
+	LinearArena& get();
+	void reset();
+}
+
+// STL allocator for frame-lifetime containers. Anything using it must be gone by the end of the frame.
+template <typename T>
+struct FrameAllocator
+{
+	typedef T value_type;
+
+	FrameAllocator() {}
+	template <typename U> FrameAllocator(const FrameAllocator<U>&) {}
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(FrameArena::get().alloc(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T*, size_t) {}
+
+	template <typename U> bool operator==(const FrameAllocator<U>&) const { return true; }
+	template <typename U> bool operator!=(const FrameAllocator<U>&) const { return false; }
+};
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
@@ -0,0 +1,453 @@
+#include "BcEncoder.h"
+
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+
+namespace BcEncoder {
+	// Shared by the 4-bit indices of BC6H and BC7
+	const int indexWeights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// Fields are packed from the least significant bit of the block; 'out' must be zeroed
+	struct BitWriter {
+		u8* out;
+		u32 pos = 0;
+
+		explicit BitWriter(u8 *const out) : out(out) {}
+
+		void write(u32 value, u32 count) {
+			for (u32 i = 0; i < count; ++i, ++pos) {
+				if ((value >> i) & 1) {
+					out[pos >> 3] |= u8(1 << (pos & 7));
+				}
+			}
+		}
+	};
+
+	inline float square(float x) {
+		return x * x;
+	}
+
+	// Endpoints spanning the texels along their principal axis
+	template <int N>
+	void fitEndpoints(const float (*const texels)[N], float *const e0, float *const e1) {
+		float mean[N] = {};
+		for (int i = 0; i < 16; ++i) {
+			for (int c = 0; c < N; ++c) {
+				mean[c] += texels[i][c] * (1.0f / 16);
+			}
+		}
+
+		float cov[N][N] = {};
+		for (int i = 0; i < 16; ++i) {
+			for (int a = 0; a < N; ++a) {
+				for (int b = 0; b < N; ++b) {
+					cov[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+				}
+			}
+		}
+
+		// Power iteration, starting from the row of the channel which varies the most
+		int maxVarChannel = 0;
+		for (int c = 1; c < N; ++c) {
+			if (cov[c][c] > cov[maxVarChannel][maxVarChannel]) {
+				maxVarChannel = c;
+			}
+		}
+
+		float axis[N];
+		memcpy(axis, cov[maxVarChannel], sizeof(axis));
+
+		for (int iter = 0; iter < 8; ++iter) {
+			float next[N] = {};
+			float maxComponent = 0.0f;
+			for (int a = 0; a < N; ++a) {
+				for (int b = 0; b < N; ++b) {
+					next[a] += cov[a][b] * axis[b];
+				}
+				maxComponent = std::max(maxComponent, std::abs(next[a]));
+			}
+
+			if (maxComponent < FLT_MIN) {
+				break;
+			}
+
+			for (int c = 0; c < N; ++c) {
+				axis[c] = next[c] / maxComponent;
+			}
+		}
+
+		float lengthSq = 0.0f;
+		for (int c = 0; c < N; ++c) {
+			lengthSq += square(axis[c]);
+		}
+
+		const float invLength = lengthSq > FLT_MIN ? 1.0f / std::sqrt(lengthSq) : 0.0f;
+		float tMin = 0.0f, tMax = 0.0f;
+		for (int i = 0; i < 16; ++i) {
+			float t = 0.0f;
+			for (int c = 0; c < N; ++c) {
+				t += (texels[i][c] - mean[c]) * axis[c] * invLength;
+			}
+			tMin = std::min(tMin, t);
+			tMax = std::max(tMax, t);
+		}
+
+		for (int c = 0; c < N; ++c) {
+			e0[c] = mean[c] + axis[c] * invLength * tMin;
+			e1[c] = mean[c] + axis[c] * invLength * tMax;
+		}
+	}
+
+	// Least-squares endpoints for the chosen 4-bit indices
+	template <int N>
+	bool refineEndpoints(const float (*const texels)[N], const u8 *const indices, float *const e0, float *const e1) {
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		float ax[N] = {}, bx[N] = {};
+
+		for (int i = 0; i < 16; ++i) {
+			const float b = indexWeights[indices[i]] * (1.0f / 64);
+			const float a = 1.0f - b;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+
+			for (int c = 0; c < N; ++c) {
+				ax[c] += a * texels[i][c];
+				bx[c] += b * texels[i][c];
+			}
+		}
+
+		const float det = aa * bb - ab * ab;
+		if (std::abs(det) < 1e-6f) {
+			return false;
+		}
+
+		for (int c = 0; c < N; ++c) {
+			e0[c] = (ax[c] * bb - bx[c] * ab) / det;
+			e1[c] = (bx[c] * aa - ax[c] * ab) / det;
+		}
+
+		return true;
+	}
+
+	// The first index has an implicit zero high bit; flip the block if it isn't
+	template <int N, typename T>
+	void fixAnchorIndex(T (*const endpoints)[N], u8 *const indices) {
+		if (indices[0] & 8) {
+			for (int c = 0; c < N; ++c) {
+				std::swap(endpoints[0][c], endpoints[1][c]);
+			}
+			for (int i = 0; i < 16; ++i) {
+				indices[i] = u8(15 - indices[i]);
+			}
+		}
+	}
+
+	// ---- BC7, mode 6: one subset, RGBA endpoints of 7 bits plus a p-bit each, 4-bit indices
+
+	struct Bc7Endpoints {
+		u8 color[2][4];
+		u8 pbit[2];
+	};
+
+	void quantizeBc7Endpoint(const float *const e, u8 *const color, u8 *const pbit) {
+		float bestErr = FLT_MAX;
+		for (int p = 0; p < 2; ++p) {
+			u8 candidate[4];
+			float err = 0.0f;
+			for (int c = 0; c < 4; ++c) {
+				const float v = std::min(255.0f, std::max(0.0f, e[c]));
+				candidate[c] = u8(std::min(127, std::max(0, int(std::floor((v - p) * 0.5f + 0.5f)))));
+				err += square(float(candidate[c] * 2 + p) - v);
+			}
+
+			if (err < bestErr) {
+				bestErr = err;
+				memcpy(color, candidate, sizeof(candidate));
+				*pbit = u8(p);
+			}
+		}
+	}
+
+	float pickBc7Indices(const float (*const texels)[4], const Bc7Endpoints& endpoints, u8 *const indices) {
+		int palette[16][4];
+		for (int c = 0; c < 4; ++c) {
+			const int a = (endpoints.color[0][c] << 1) | endpoints.pbit[0];
+			const int b = (endpoints.color[1][c] << 1) | endpoints.pbit[1];
+			for (int i = 0; i < 16; ++i) {
+				palette[i][c] = ((64 - indexWeights[i]) * a + indexWeights[i] * b + 32) >> 6;
+			}
+		}
+
+		float totalErr = 0.0f;
+		for (int t = 0; t < 16; ++t) {
+			float bestErr = FLT_MAX;
+			for (int i = 0; i < 16; ++i) {
+				float err = 0.0f;
+				for (int c = 0; c < 4; ++c) {
+					err += square(texels[t][c] - palette[i][c]);
+				}
+				if (err < bestErr) {
+					bestErr = err;
+					indices[t] = u8(i);
+				}
+			}
+			totalErr += bestErr;
+		}
+
+		return totalErr;
+	}
+
+	void quantizeBc7Endpoints(const float *const e0, const float *const e1, Bc7Endpoints *const res) {
+		quantizeBc7Endpoint(e0, res->color[0], &res->pbit[0]);
+		quantizeBc7Endpoint(e1, res->color[1], &res->pbit[1]);
+	}
+
+	void encodeBc7Block(const u8* const *const texelPtrs, u8 *const out) {
+		float texels[16][4];
+		for (int i = 0; i < 16; ++i) {
+			for (int c = 0; c < 4; ++c) {
+				texels[i][c] = texelPtrs[i][c];
+			}
+		}
+
+		float e0[4], e1[4];
+		fitEndpoints<4>(texels, e0, e1);
+
+		Bc7Endpoints endpoints;
+		u8 indices[16];
+		quantizeBc7Endpoints(e0, e1, &endpoints);
+		float err = pickBc7Indices(texels, endpoints, indices);
+
+		if (err > 0.0f && refineEndpoints<4>(texels, indices, e0, e1)) {
+			Bc7Endpoints refined;
+			u8 refinedIndices[16];
+			quantizeBc7Endpoints(e0, e1, &refined);
+			if (pickBc7Indices(texels, refined, refinedIndices) < err) {
+				endpoints = refined;
+				memcpy(indices, refinedIndices, sizeof(indices));
+			}
+		}
+
+		if (indices[0] & 8) {
+			std::swap(endpoints.pbit[0], endpoints.pbit[1]);
+		}
+		fixAnchorIndex<4>(endpoints.color, indices);
+
+		BitWriter bits(out);
+		bits.write(1 << 6, 7);
+		for (int c = 0; c < 4; ++c) {
+			bits.write(endpoints.color[0][c], 7);
+			bits.write(endpoints.color[1][c], 7);
+		}
+		bits.write(endpoints.pbit[0], 1);
+		bits.write(endpoints.pbit[1], 1);
+		for (int i = 0; i < 16; ++i) {
+			bits.write(indices[i], 0 == i ? 3 : 4);
+		}
+	}
+
+	// ---- BC6H, mode 11: one region, unsigned RGB endpoints of 10 bits without deltas, 4-bit indices.
+	// Fitting happens on the bit patterns of halfs, which are close to logarithmic.
+
+	int unquantizeBc6h(int q) {
+		if (0 == q) return 0;
+		if (1023 == q) return 0xFFFF;
+		return ((q << 16) + 0x8000) >> 10;
+	}
+
+	void quantizeBc6hEndpoint(const float *const e, u16 *const res) {
+		for (int c = 0; c < 3; ++c) {
+			res[c] = u16(std::min(1023, std::max(0, int(std::floor((e[c] - 32.0f) / 64.0f + 0.5f)))));
+		}
+	}
+
+	float pickBc6hIndices(const float (*const halfs)[3], const u16 (*const endpoints)[3], u8 *const indices) {
+		float palette[16][3];
+		for (int c = 0; c < 3; ++c) {
+			const int a = unquantizeBc6h(endpoints[0][c]);
+			const int b = unquantizeBc6h(endpoints[1][c]);
+			for (int i = 0; i < 16; ++i) {
+				palette[i][c] = float(((((64 - indexWeights[i]) * a + indexWeights[i] * b + 32) >> 6) * 31) >> 6);
+			}
+		}
+
+		float totalErr = 0.0f;
+		for (int t = 0; t < 16; ++t) {
+			float bestErr = FLT_MAX;
+			for (int i = 0; i < 16; ++i) {
+				const float err = square(halfs[t][0] - palette[i][0]) + square(halfs[t][1] - palette[i][1]) + square(halfs[t][2] - palette[i][2]);
+				if (err < bestErr) {
+					bestErr = err;
+					indices[t] = u8(i);
+				}
+			}
+			totalErr += bestErr;
+		}
+
+		return totalErr;
+	}
+
+	void encodeBc6hBlock(const u8* const *const texelPtrs, u8 *const out) {
+		// Half bits, and the same scaled to the range endpoints are interpolated in
+		float halfs[16][3];
+		float texels[16][3];
+		for (int i = 0; i < 16; ++i) {
+			const float* const rgb = reinterpret_cast<const float*>(texelPtrs[i]);
+			for (int c = 0; c < 3; ++c) {
+				const float v = rgb[c] > 0.0f ? std::min(rgb[c], 65504.0f) : 0.0f;
+				halfs[i][c] = float(glm::packHalf1x16(v));
+				texels[i][c] = halfs[i][c] * (64.0f / 31.0f);
+			}
+		}
+
+		float e0[3], e1[3];
+		fitEndpoints<3>(texels, e0, e1);
+
+		u16 endpoints[2][3];
+		u8 indices[16];
+		quantizeBc6hEndpoint(e0, endpoints[0]);
+		quantizeBc6hEndpoint(e1, endpoints[1]);
+		float err = pickBc6hIndices(halfs, endpoints, indices);
+
+		if (err > 0.0f && refineEndpoints<3>(texels, indices, e0, e1)) {
+			u16 refined[2][3];
+			u8 refinedIndices[16];
+			quantizeBc6hEndpoint(e0, refined[0]);
+			quantizeBc6hEndpoint(e1, refined[1]);
+			if (pickBc6hIndices(halfs, refined, refinedIndices) < err) {
+				memcpy(endpoints, refined, sizeof(endpoints));
+				memcpy(indices, refinedIndices, sizeof(indices));
+			}
+		}
+
+		fixAnchorIndex<3>(endpoints, indices);
+
+		BitWriter bits(out);
+		bits.write(0x03, 5);
+		for (int e = 0; e < 2; ++e) {
+			for (int c = 0; c < 3; ++c) {
+				bits.write(endpoints[e][c], 10);
+			}
+		}
+		for (int i = 0; i < 16; ++i) {
+			bits.write(indices[i], 0 == i ? 3 : 4);
+		}
+	}
+
+	// ---- BC4: 8-bit endpoints, with the six interpolated values between them
+
+	void encodeBc4Block(const u8* const *const texelPtrs, int channel, u8 *const out) {
+		u8 values[16];
+		u8 minValue = 255, maxValue = 0;
+		for (int i = 0; i < 16; ++i) {
+			values[i] = texelPtrs[i][channel];
+			minValue = std::min(minValue, values[i]);
+			maxValue = std::max(maxValue, values[i]);
+		}
+
+		out[0] = maxValue;
+		out[1] = minValue;
+		if (maxValue == minValue) {
+			return;
+		}
+
+		int palette[8] = { maxValue, minValue };
+		for (int i = 1; i < 7; ++i) {
+			palette[i + 1] = ((7 - i) * maxValue + i * minValue + 3) / 7;
+		}
+
+		BitWriter bits(out + 2);
+		for (int t = 0; t < 16; ++t) {
+			int best = 0;
+			for (int i = 1; i < 8; ++i) {
+				if (std::abs(values[t] - palette[i]) < std::abs(values[t] - palette[best])) {
+					best = i;
+				}
+			}
+			bits.write(u32(best), 3);
+		}
+	}
+
+	u32 getBlockBytes(Format format) {
+		return Format::Bc4 == format ? 8 : 16;
+	}
+
+	u32 getTexelBytes(Format format) {
+		switch (format) {
+			case Format::Bc4: return 1;
+			case Format::Bc5: return 2;
+			case Format::Bc6h: return 16;
+			default: return 4;
+		}
+	}
+
+	size_t getEncodedSize(Format format, u32 width, u32 height) {
+		return size_t((width + 3) / 4) * ((height + 3) / 4) * getBlockBytes(format);
+	}
+
+	void encodeImage(Format format, const u8* const texels, u32 width, u32 height, size_t rowPitch, u8 *const blocks) {
+		const u32 blocksX = (width + 3) / 4;
+		const u32 blocksY = (height + 3) / 4;
+		const u32 blockBytes = getBlockBytes(format);
+		const u32 texelBytes = getTexelBytes(format);
+
+		auto encodeRow = [&](u32 by) {
+			for (u32 bx = 0; bx < blocksX; ++bx) {
+				// Blocks hanging over the edge repeat the last row and column
+				const u8* texelPtrs[16];
+				for (u32 y = 0; y < 4; ++y) {
+					for (u32 x = 0; x < 4; ++x) {
+						const u32 sx = std::min(bx * 4 + x, width - 1);
+						const u32 sy = std::min(by * 4 + y, height - 1);
+						texelPtrs[y * 4 + x] = texels + sy * rowPitch + sx * texelBytes;
+					}
+				}
+
+				u8* const out = blocks + (size_t(by) * blocksX + bx) * blockBytes;
+				memset(out, 0, blockBytes);
+
+				switch (format) {
+					case Format::Bc4:
+						encodeBc4Block(texelPtrs, 0, out);
+						break;
+					case Format::Bc5:
+						encodeBc4Block(texelPtrs, 0, out);
+						encodeBc4Block(texelPtrs, 1, out + 8);
+						break;
+					case Format::Bc6h:
+						encodeBc6hBlock(texelPtrs, out);
+						break;
+					case Format::Bc7:
+						encodeBc7Block(texelPtrs, out);
+						break;
+				}
+			}
+		};
+
+		std::atomic<u32> nextRow(0);
+		auto worker = [&]() {
+			for (u32 by; (by = nextRow++) < blocksY; ) {
+				encodeRow(by);
+			}
+		};
+
+		// Small mips aren't worth a thread
+		const u32 threadCount = blocksX * blocksY < 256 ? 1u : std::min(std::max(1u, std::thread::hardware_concurrency()), blocksY);
+		vector<std::thread> threads;
+		for (u32 i = 1; i < threadCount; ++i) {
+			threads.emplace_back(worker);
+		}
+
+		worker();
+		for (auto& thread : threads) {
+			thread.join();
+		}
+	}
+}
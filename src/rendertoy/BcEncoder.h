@@ -0,0 +1,18 @@
+#pragma once
+#include "Common.h"
+
+// CPU block compression for static source images. Each block is fitted along the principal axis of
+// its texels, then refined once by least squares. Rows of blocks are spread over all cores.
+namespace BcEncoder {
+	enum class Format {
+		Bc4,	// from R8 texels
+		Bc5,	// from RG8 texels
+		Bc6h,	// from RGBA32F texels; unsigned, alpha is dropped
+		Bc7,	// from RGBA8 texels
+	};
+
+	size_t getEncodedSize(Format format, u32 width, u32 height);
+
+	// 'texels' are rows of 'rowPitch' bytes, and 'blocks' receives getEncodedSize() bytes
+	void encodeImage(Format format, const u8* const texels, u32 width, u32 height, size_t rowPitch, u8 *const blocks);
+}
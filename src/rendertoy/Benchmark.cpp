@@ -0,0 +1,195 @@
+#include "Benchmark.h"
+
+#include <rapidjson/prettywriter.h>
+#include <algorithm>
+#include <fstream>
+#include <cmath>
+
+using JsonWriter = rapidjson::PrettyWriter<rapidjson::StringBuffer>;
+
+BenchmarkStats computeBenchmarkStats(vector<double> samples)
+{
+	BenchmarkStats res;
+	if (samples.empty()) {
+		return res;
+	}
+
+	std::sort(samples.begin(), samples.end());
+
+	// Nearest-rank percentiles
+	auto percentile = [&samples](double p) {
+		const size_t rank = size_t(std::ceil(p / 100.0 * samples.size()));
+		return samples[std::min(samples.size() - 1, std::max(size_t(1), rank) - 1)];
+	};
+
+	double sum = 0.0;
+	for (double s : samples) {
+		sum += s;
+	}
+
+	res.min = samples.front();
+	res.avg = sum / samples.size();
+	res.p50 = percentile(50.0);
+	res.p95 = percentile(95.0);
+	res.p99 = percentile(99.0);
+	return res;
+}
+
+void Benchmark::start(const BenchmarkSettings& settings)
+{
+	*this = Benchmark();
+	m_settings = settings;
+	m_active = true;
+
+	// Make sure the profiler is running before the first frame, so that its frame indices are known
+	GpuProfiler::setEnabled(true);
+
+	if (0 == m_settings.warmupFrames) {
+		beginMeasurement();
+	}
+}
+
+void Benchmark::beginMeasurement()
+{
+	m_firstMeasuredGpuFrame = GpuProfiler::frameIndex() + 1;
+	m_measureStart = std::chrono::high_resolution_clock::now();
+}
+
+void Benchmark::endFrame(double cpuMs)
+{
+	if (!m_active) {
+		return;
+	}
+
+	if (m_frame >= m_settings.warmupFrames) {
+		m_cpuFrameMs.push_back(cpuMs);
+	}
+
+	++m_frame;
+	if (m_frame == m_settings.warmupFrames) {
+		beginMeasurement();
+	}
+
+	if (m_cpuFrameMs.size() >= m_settings.measuredFrames) {
+		const auto measureEnd = std::chrono::high_resolution_clock::now();
+		m_measuredWallMs = std::chrono::duration<double, std::milli>(measureEnd - m_measureStart).count();
+
+		collectGpuTimings(true);
+		m_active = false;
+		m_finished = true;
+	} else {
+		collectGpuTimings(false);
+	}
+}
+
+void Benchmark::collectGpuTimings(bool wait)
+{
+	vector<GpuFrameTimings> timings;
+	GpuProfiler::collect(&timings, wait);
+
+	if (0 == m_firstMeasuredGpuFrame) {
+		return;
+	}
+
+	const u64 measureEnd = m_firstMeasuredGpuFrame + m_settings.measuredFrames;
+
+	for (const GpuFrameTimings& frame : timings) {
+		if (frame.frameIndex < m_firstMeasuredGpuFrame || frame.frameIndex >= measureEnd) {
+			continue;
+		}
+
+		m_gpuFrameMs.push_back(frame.frameMs);
+
+		for (const GpuScopeTiming& scope : frame.scopes) {
+			auto pass = std::find_if(m_passes.begin(), m_passes.end(), [&](const PassSamples& p) { return p.name == scope.name; });
+			if (pass == m_passes.end()) {
+				m_passes.push_back(PassSamples{ scope.name, vector<double>() });
+				pass = m_passes.end() - 1;
+			}
+			pass->ms.push_back(scope.ms);
+		}
+	}
+}
+
+static void writeStats(JsonWriter& writer, const BenchmarkStats& stats)
+{
+	writer.StartObject();
+	writer.String("min");
+	writer.Double(stats.min);
+	writer.String("avg");
+	writer.Double(stats.avg);
+	writer.String("p50");
+	writer.Double(stats.p50);
+	writer.String("p95");
+	writer.Double(stats.p95);
+	writer.String("p99");
+	writer.Double(stats.p99);
+	writer.EndObject();
+}
+
+bool Benchmark::writeResults(const char* const renderer) const
+{
+	rapidjson::StringBuffer sb;
+	JsonWriter writer(sb);
+	writer.StartObject();
+
+	writer.String("project");
+	writer.String(m_settings.projectPath.c_str());
+
+	writer.String("renderer");
+	writer.String(renderer);
+
+	writer.String("resolution");
+	writer.StartArray();
+	writer.Int(m_settings.resolution.x);
+	writer.Int(m_settings.resolution.y);
+	writer.EndArray();
+
+	writer.String("warmupFrames");
+	writer.Uint(m_settings.warmupFrames);
+
+	writer.String("measuredFrames");
+	writer.Uint(u32(m_cpuFrameMs.size()));
+
+	writer.String("fps");
+	writer.Double(m_measuredWallMs > 0.0 ? 1000.0 * m_cpuFrameMs.size() / m_measuredWallMs : 0.0);
+
+	writer.String("cpuFrameMs");
+	writeStats(writer, computeBenchmarkStats(m_cpuFrameMs));
+
+	writer.String("gpuFrameMs");
+	writeStats(writer, computeBenchmarkStats(m_gpuFrameMs));
+
+	writer.String("passes");
+	writer.StartArray();
+	for (const PassSamples& pass : m_passes) {
+		writer.StartObject();
+		writer.String("name");
+		writer.String(pass.name.c_str());
+		writer.String("gpuMs");
+		writeStats(writer, computeBenchmarkStats(pass.ms));
+		writer.EndObject();
+	}
+	writer.EndArray();
+
+	writer.EndObject();
+
+	std::ofstream f(m_settings.resultPath);
+	f.write(sb.GetString(), sb.GetLength());
+	return f.good();
+}
+
+void Benchmark::printSummary() const
+{
+	auto printStats = [](const char* const name, const BenchmarkStats& stats) {
+		printf("%-32s min %8.3f  avg %8.3f  p50 %8.3f  p95 %8.3f  p99 %8.3f\n", name, stats.min, stats.avg, stats.p50, stats.p95, stats.p99);
+	};
+
+	printf("Benchmark: %s (%dx%d, %u frames)\n", m_settings.projectPath.c_str(), m_settings.resolution.x, m_settings.resolution.y, u32(m_cpuFrameMs.size()));
+	printStats("CPU frame (ms)", computeBenchmarkStats(m_cpuFrameMs));
+	printStats("GPU frame (ms)", computeBenchmarkStats(m_gpuFrameMs));
+
+	for (const PassSamples& pass : m_passes) {
+		printStats(pass.name.c_str(), computeBenchmarkStats(pass.ms));
+	}
+}
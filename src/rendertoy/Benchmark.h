@@ -0,0 +1,61 @@
+#pragma once
+#include "Common.h"
+#include "Math.h"
+#include "GpuProfiler.h"
+#include <string>
+#include <chrono>
+
+struct BenchmarkSettings {
+	std::string projectPath;
+	std::string resultPath = "benchmark.json";
+	u32 warmupFrames = 60;
+	u32 measuredFrames = 300;
+	ivec2 resolution = ivec2(1920, 1080);
+};
+
+struct BenchmarkStats {
+	double min = 0.0;
+	double avg = 0.0;
+	double p50 = 0.0;
+	double p95 = 0.0;
+	double p99 = 0.0;
+};
+
+BenchmarkStats computeBenchmarkStats(vector<double> samples);
+
+// Records frame times over a benchmark run. The main loop is responsible for uncapping
+// the frame rate, rendering at the fixed resolution, and calling endFrame once per frame.
+struct Benchmark {
+	void start(const BenchmarkSettings& settings);
+	bool active() const { return m_active; }
+	bool finished() const { return m_finished; }
+	const BenchmarkSettings& settings() const { return m_settings; }
+
+	// 'cpuMs' is the time the CPU spent on the frame, up to the buffer swap.
+	// After the last measured frame, blocks until the GPU timings of all measured frames are known.
+	void endFrame(double cpuMs);
+
+	bool writeResults(const char* const renderer) const;
+	void printSummary() const;
+
+private:
+	void beginMeasurement();
+	void collectGpuTimings(bool wait);
+
+	struct PassSamples {
+		std::string name;
+		vector<double> ms;
+	};
+
+	BenchmarkSettings m_settings;
+	bool m_active = false;
+	bool m_finished = false;
+	u32 m_frame = 0;
+	u64 m_firstMeasuredGpuFrame = 0;
+	double m_measuredWallMs = 0.0;
+	std::chrono::high_resolution_clock::time_point m_measureStart;
+
+	vector<double> m_cpuFrameMs;
+	vector<double> m_gpuFrameMs;
+	vector<PassSamples> m_passes;
+};
@@ -0,0 +1,125 @@
+#include "EventServer.h"
+
+#ifdef _WIN32
+	#define VC_EXTRALEAN
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+	typedef SOCKET Socket;
+	#define closeSocket closesocket
+	const int sendFlags = 0;
+#else
+	#include <sys/socket.h>
+	#include <netinet/in.h>
+	#include <arpa/inet.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	typedef int Socket;
+	#define INVALID_SOCKET (-1)
+	#define closeSocket close
+	const int sendFlags = MSG_NOSIGNAL;	// report disconnects as errors instead of SIGPIPE
+#endif
+
+#include <cstdio>
+
+namespace EventServer {
+	Socket listenSocket = INVALID_SOCKET;
+	vector<Socket> clients;
+
+	static bool setNonBlocking(Socket s) {
+#ifdef _WIN32
+		u_long nonBlocking = 1;
+		return 0 == ioctlsocket(s, FIONBIO, &nonBlocking);
+#else
+		return 0 == fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+#endif
+	}
+
+	bool start(u16 port) {
+#ifdef _WIN32
+		WSADATA wsaData;
+		if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+			fprintf(stderr, "Event server: WSAStartup failed\n");
+			return false;
+		}
+#endif
+
+		listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (INVALID_SOCKET == listenSocket) {
+			fprintf(stderr, "Event server: could not create a socket\n");
+			return false;
+		}
+
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		if (bind(listenSocket, (const sockaddr*)&addr, sizeof(addr)) != 0
+			|| listen(listenSocket, 8) != 0
+			|| !setNonBlocking(listenSocket))
+		{
+			// Most likely another instance owns the port
+			fprintf(stderr, "Event server: could not listen on port %d\n", int(port));
+			stop();
+			return false;
+		}
+
+		return true;
+	}
+
+	void stop() {
+		for (Socket client : clients) {
+			closeSocket(client);
+		}
+		clients.clear();
+
+		if (listenSocket != INVALID_SOCKET) {
+			closeSocket(listenSocket);
+			listenSocket = INVALID_SOCKET;
+		}
+	}
+
+	void update() {
+		if (INVALID_SOCKET == listenSocket) {
+			return;
+		}
+
+		for (;;) {
+			const Socket client = accept(listenSocket, nullptr, nullptr);
+			if (INVALID_SOCKET == client) {
+				break;
+			}
+
+			if (setNonBlocking(client)) {
+				clients.push_back(client);
+			} else {
+				closeSocket(client);
+			}
+		}
+	}
+
+	bool hasClients() {
+		return !clients.empty();
+	}
+
+	bool send(const std::string& json) {
+		// Catch clients which connected since the last update
+		update();
+
+		const std::string line = json + "\n";
+		for (size_t i = 0; i < clients.size();) {
+			// A partial send would corrupt the stream, so a client which can't take a whole line is dropped
+			const int sent = ::send(clients[i], line.data(), int(line.size()), sendFlags);
+			if (sent != int(line.size())) {
+				closeSocket(clients[i]);
+				clients.erase(clients.begin() + i);
+			} else {
+				++i;
+			}
+		}
+
+		return !clients.empty();
+	}
+}
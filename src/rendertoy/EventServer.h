@@ -0,0 +1,21 @@
+#pragma once
+#include "Common.h"
+#include <string>
+
+// Pushes events such as shader build results to local tools (e.g. the Sublime plugin), so that they
+// don't have to poll files. Events are JSON objects, one per line, sent over TCP on the loopback
+// interface to every connected client. Sends never block; clients which can't keep up are dropped.
+namespace EventServer {
+	enum { DefaultPort = 47321 };
+
+	bool start(u16 port = DefaultPort);
+	void stop();
+
+	// Accepts new clients
+	void update();
+
+	bool hasClients();
+
+	// 'json' must be a single line. Returns whether any client received it.
+	bool send(const std::string& json);
+}
@@ -0,0 +1,639 @@
+#include "ExrLoader.h"
+#include "FileUtil.h"
+
+#include <tinyexr.h>
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+
+
+namespace ExrLoader {
+	// Where the chunks of one part are, and which pixels each one holds
+	struct PartLayout {
+		const u8* offsetTable = nullptr;	// a u64 file offset per chunk
+		u32 chunkCount = 0;
+		bool multipart = false;				// chunks start with their part number
+		bool tiled = false;
+		u32 tileWidth = 0;
+		u32 tileHeight = 0;
+		int levelMode = TINYEXR_TILE_ONE_LEVEL;
+		int roundingMode = TINYEXR_TILE_ROUND_DOWN;
+		u32 linesPerChunk = 1;
+	};
+
+	// Where decoded chunks go: rows [firstRow, firstRow + rowCount) of a level, counted bottom-up.
+	// Rows of chunks outside these are skipped.
+	struct RowTarget {
+		u16* texels;
+		u32 width;
+		u32 height;
+		u32 firstRow;
+		u32 rowCount;
+
+		// 'y' counted from the top of the level, as in the file; nullptr outside the target's rows
+		u16* getRow(u32 y) const {
+			const u32 row = height - 1 - y;
+			return row >= firstRow && row - firstRow < rowCount ? texels + 4 * size_t(row - firstRow) * width : nullptr;
+		}
+	};
+
+	const EXRAttribute* findAttribute(const EXRHeader& header, const char* const name) {
+		for (int i = 0; i < header.num_custom_attributes; ++i) {
+			if (0 == strcmp(header.custom_attributes[i].name, name)) {
+				return &header.custom_attributes[i];
+			}
+		}
+
+		return nullptr;
+	}
+
+	u32 getLevelSize(u32 size, u32 level, int roundingMode) {
+		const u32 res = TINYEXR_TILE_ROUND_UP == roundingMode ? (size + (1u << level) - 1) >> level : size >> level;
+		return std::max(1u, res);
+	}
+
+	u32 getLevelCount(u32 size, int roundingMode) {
+		u32 levels = 1;
+		while (getLevelSize(size, levels - 1, roundingMode) > 1) {
+			++levels;
+		}
+		return levels;
+	}
+
+	u32 getTileCount(const PartLayout& layout, u32 width, u32 height, u32 levelX, u32 levelY) {
+		const u32 levelWidth = getLevelSize(width, levelX, layout.roundingMode);
+		const u32 levelHeight = getLevelSize(height, levelY, layout.roundingMode);
+		return ((levelWidth + layout.tileWidth - 1) / layout.tileWidth) * ((levelHeight + layout.tileHeight - 1) / layout.tileHeight);
+	}
+
+	// Finds the first chunk of level (level, level), and the chunk count of the part.
+	// Offset tables list mip levels in order, and rip levels row by row.
+	void getLevelChunks(const PartLayout& layout, u32 width, u32 height, u32 level, u32 *const firstChunk, u32 *const chunkCount) {
+		*firstChunk = 0;
+		*chunkCount = 0;
+
+		if (TINYEXR_TILE_RIPMAP_LEVELS == layout.levelMode) {
+			const u32 levelsX = getLevelCount(width, layout.roundingMode);
+			const u32 levelsY = getLevelCount(height, layout.roundingMode);
+			for (u32 ly = 0; ly < levelsY; ++ly) {
+				for (u32 lx = 0; lx < levelsX; ++lx) {
+					if (lx == level && ly == level) {
+						*firstChunk = *chunkCount;
+					}
+					*chunkCount += getTileCount(layout, width, height, lx, ly);
+				}
+			}
+		} else {
+			const u32 levels = TINYEXR_TILE_MIPMAP_LEVELS == layout.levelMode ? getLevelCount(std::max(width, height), layout.roundingMode) : 1;
+			for (u32 l = 0; l < levels; ++l) {
+				if (l == level) {
+					*firstChunk = *chunkCount;
+				}
+				*chunkCount += getTileCount(layout, width, height, l, l);
+			}
+		}
+	}
+
+	u32 getUsableLevelCount(const PartLayout& layout, u32 width, u32 height) {
+		switch (layout.levelMode) {
+			case TINYEXR_TILE_MIPMAP_LEVELS:
+				return getLevelCount(std::max(width, height), layout.roundingMode);
+			case TINYEXR_TILE_RIPMAP_LEVELS:
+				// Only the levels scaled equally in both directions
+				return std::min(getLevelCount(width, layout.roundingMode), getLevelCount(height, layout.roundingMode));
+			default:
+				return 1;
+		}
+	}
+
+	// Multipart headers keep "type" and "tiles" among the custom attributes, as tinyexr
+	// only parses tile descriptions when the whole file is flagged as tiled
+	bool getPartLayout(const EXRVersion& version, const EXRHeader& header, PartLayout *const layout) {
+		layout->multipart = version.multipart != 0;
+		layout->tiled = version.tiled != 0;
+		layout->tileWidth = u32(header.tile_size_x);
+		layout->tileHeight = u32(header.tile_size_y);
+		layout->levelMode = header.tile_level_mode;
+		layout->roundingMode = header.tile_rounding_mode;
+
+		if (const EXRAttribute* const type = findAttribute(header, "type")) {
+			const char* const typeName = reinterpret_cast<const char*>(type->value);
+			if (0 == strncmp(typeName, "tiledimage", type->size)) {
+				layout->tiled = true;
+			} else if (0 == strncmp(typeName, "scanlineimage", type->size)) {
+				layout->tiled = false;
+			} else {
+				fprintf(stderr, "Deep EXR parts are not supported\n");
+				return false;
+			}
+		}
+
+		if (const EXRAttribute* const tiles = findAttribute(header, "tiles")) {
+			if (tiles->size != 9) {
+				return false;
+			}
+
+			memcpy(&layout->tileWidth, tiles->value, sizeof(u32));
+			memcpy(&layout->tileHeight, tiles->value + 4, sizeof(u32));
+			layout->levelMode = tiles->value[8] & 0x3;
+			layout->roundingMode = (tiles->value[8] >> 4) & 0x1;
+		}
+
+		if (layout->tiled && (0 == layout->tileWidth || 0 == layout->tileHeight)) {
+			return false;
+		}
+
+		switch (header.compression_type) {
+			case TINYEXR_COMPRESSIONTYPE_ZIP:
+			case TINYEXR_COMPRESSIONTYPE_ZFP:
+				layout->linesPerChunk = 16;
+				break;
+			case TINYEXR_COMPRESSIONTYPE_PIZ:
+				layout->linesPerChunk = 32;
+				break;
+			default:
+				layout->linesPerChunk = 1;
+				break;
+		}
+
+		return true;
+	}
+
+	// Chunks are decoded one at a time by handing tinyexr a single-chunk image, with the data window
+	// shrunk to the chunk. An edge tile which is narrower than the tile size becomes the second one
+	// in its row, as tinyexr writes whole tile rows into buffers sized by the data window.
+	class ChunkDecoder {
+	public:
+		ChunkDecoder(const EXRHeader& partHeader, const PartLayout& layout)
+			: m_header(partHeader)
+			, m_layout(layout)
+			, m_pixelTypes(partHeader.pixel_types, partHeader.pixel_types + partHeader.num_channels)
+			, m_requestedTypes(partHeader.num_channels, TINYEXR_PIXELTYPE_HALF)
+		{
+			// Only the order of chunks in the file depends on the line order
+			m_header.line_order = 0;
+			m_header.tiled = layout.tiled ? 1 : 0;
+			m_header.tile_size_x = int(layout.tileWidth);
+			m_header.tile_size_y = int(layout.tileHeight);
+			m_header.tile_level_mode = TINYEXR_TILE_ONE_LEVEL;
+			m_header.chunk_count = 1;
+			m_header.header_len = headerBytes;
+			m_header.pixel_types = m_pixelTypes.data();
+			m_header.requested_pixel_types = m_requestedTypes.data();
+		}
+
+		// 'chunk' and 'chunkBytes' exclude the part number
+		bool decode(const u8* const chunk, size_t chunkBytes, const EXRHeader& partHeader, u32 level, const RowTarget& res) {
+			const size_t coordBytes = m_layout.tiled ? 4 * sizeof(int) : sizeof(int);
+			if (chunkBytes < coordBytes + sizeof(int)) {
+				return false;
+			}
+
+			int coords[4] = {};
+			int dataBytes;
+			memcpy(coords, chunk, coordBytes);
+			memcpy(&dataBytes, chunk + coordBytes, sizeof(int));
+			if (dataBytes < 0 || size_t(dataBytes) > chunkBytes - coordBytes - sizeof(int)) {
+				return false;
+			}
+
+			u32 x0 = 0;
+			u32 y0 = 0;
+			u32 width, height;
+			if (m_layout.tiled) {
+				if (coords[0] < 0 || coords[1] < 0 || u32(coords[2]) != level || u32(coords[3]) != level) {
+					return false;
+				}
+
+				x0 = u32(coords[0]) * m_layout.tileWidth;
+				y0 = u32(coords[1]) * m_layout.tileHeight;
+				if (x0 >= res.width || y0 >= res.height) {
+					return false;
+				}
+
+				width = std::min(m_layout.tileWidth, res.width - x0);
+				height = std::min(m_layout.tileHeight, res.height - y0);
+				coords[0] = width < m_layout.tileWidth ? 1 : 0;
+				coords[1] = height < m_layout.tileHeight ? 1 : 0;
+				coords[2] = 0;
+				coords[3] = 0;
+
+				m_header.data_window[0] = 0;
+				m_header.data_window[1] = 0;
+				m_header.data_window[2] = int(coords[0] * m_layout.tileWidth + width) - 1;
+				m_header.data_window[3] = int(coords[1] * m_layout.tileHeight + height) - 1;
+			} else {
+				if (coords[0] < partHeader.data_window[1] || coords[0] > partHeader.data_window[3]) {
+					return false;
+				}
+
+				y0 = u32(coords[0] - partHeader.data_window[1]);
+				width = res.width;
+				height = std::min(m_layout.linesPerChunk, res.height - y0);
+				m_header.data_window[0] = partHeader.data_window[0];
+				m_header.data_window[1] = coords[0];
+				m_header.data_window[2] = partHeader.data_window[2];
+				m_header.data_window[3] = coords[0] + int(height) - 1;
+			}
+
+			if (TINYEXR_COMPRESSIONTYPE_NONE == m_header.compression_type) {
+				return copyUncompressed(chunk + coordBytes + sizeof(int), size_t(dataBytes), width, height, x0, y0, res);
+			}
+
+			// Version, header, a single-entry offset table and the chunk
+			const u64 chunkOffset = 8 + headerBytes + sizeof(u64);
+			m_buffer.resize(size_t(chunkOffset) + coordBytes + sizeof(int) + size_t(dataBytes));
+			memcpy(m_buffer.data() + 8 + headerBytes, &chunkOffset, sizeof(chunkOffset));
+			memcpy(m_buffer.data() + chunkOffset, coords, coordBytes);
+			memcpy(m_buffer.data() + chunkOffset + coordBytes, chunk + coordBytes, sizeof(int) + size_t(dataBytes));
+
+			EXRImage image;
+			InitEXRImage(&image);
+
+			const char* err = nullptr;
+			if (LoadEXRImageFromMemory(&image, &m_header, m_buffer.data(), m_buffer.size(), &err) != TINYEXR_SUCCESS) {
+				fprintf(stderr, "Load EXR err: %s\n", err ? err : "");
+				FreeEXRImage(&image);
+				free(image.tiles);
+				return false;
+			}
+
+			if (m_layout.tiled) {
+				copyToImage(reinterpret_cast<const u16* const*>(image.tiles[0].images), width, height, m_layout.tileWidth, x0, y0, res);
+			} else {
+				copyToImage(reinterpret_cast<const u16* const*>(image.images), width, height, width, x0, y0, res);
+			}
+
+			FreeEXRImage(&image);
+			free(image.tiles);
+			return true;
+		}
+
+		int channelIdx[4] = { -1, -1, -1, -1 };	// R, G, B and A
+
+	private:
+		u16 getDefaultValue(int component) const {
+			return 3 == component ? u16(15 << 10) : u16(0);
+		}
+
+		void copyToImage(const u16* const* planes, u32 width, u32 height, u32 stride, u32 x0, u32 y0, const RowTarget& res) const {
+			for (u32 y = 0; y < height; ++y) {
+				u16* dst = res.getRow(y0 + y);
+				if (!dst) {
+					continue;
+				}
+
+				dst += 4 * x0;
+				for (u32 x = 0; x < width; ++x, dst += 4) {
+					for (int c = 0; c < 4; ++c) {
+						dst[c] = channelIdx[c] != -1 ? planes[channelIdx[c]][y * stride + x] : getDefaultValue(c);
+					}
+				}
+			}
+		}
+
+		// Rows hold each channel in turn. tinyexr only reads the first row of uncompressed chunks,
+		// which is all there is in scanline files, but not in tiles.
+		bool copyUncompressed(const u8* const data, size_t dataBytes, u32 width, u32 height, u32 x0, u32 y0, const RowTarget& res) const {
+			size_t rowBytes = 0;
+			for (int i = 0; i < m_header.num_channels; ++i) {
+				rowBytes += width * (TINYEXR_PIXELTYPE_HALF == m_pixelTypes[i] ? sizeof(u16) : sizeof(u32));
+			}
+
+			if (dataBytes < rowBytes * height) {
+				return false;
+			}
+
+			for (u32 y = 0; y < height; ++y) {
+				u16* const row = res.getRow(y0 + y);
+				if (!row) {
+					continue;
+				}
+
+				u16* const dst = row + 4 * x0;
+				for (u32 x = 0; x < width; ++x) {
+					for (int c = 0; c < 4; ++c) {
+						dst[x * 4 + c] = getDefaultValue(c);
+					}
+				}
+
+				const u8* src = data + rowBytes * y;
+				for (int i = 0; i < m_header.num_channels; ++i) {
+					const int pixelType = m_pixelTypes[i];
+					const int component = int(std::find(channelIdx, channelIdx + 4, i) - channelIdx);
+
+					for (u32 x = 0; x < width && component < 4; ++x) {
+						u16& texel = dst[x * 4 + component];
+						if (TINYEXR_PIXELTYPE_HALF == pixelType) {
+							memcpy(&texel, src + x * sizeof(u16), sizeof(u16));
+						} else if (TINYEXR_PIXELTYPE_FLOAT == pixelType) {
+							float value;
+							memcpy(&value, src + x * sizeof(float), sizeof(float));
+							texel = glm::packHalf1x16(value);
+						} else {
+							u32 value;
+							memcpy(&value, src + x * sizeof(u32), sizeof(u32));
+							texel = glm::packHalf1x16(float(value));
+						}
+					}
+
+					src += width * (TINYEXR_PIXELTYPE_HALF == pixelType ? sizeof(u16) : sizeof(u32));
+				}
+			}
+
+			return true;
+		}
+
+		static const u32 headerBytes = 8;	// anything non-zero; tinyexr reads the header from m_header
+
+		EXRHeader m_header;
+		PartLayout m_layout;
+		vector<int> m_pixelTypes;
+		vector<int> m_requestedTypes;
+		vector<u8> m_buffer;
+	};
+
+	void getChannelIndices(const EXRHeader& header, int channelIdx[4]) {
+		const char* const channelNames[4] = { "R", "G", "B", "A" };
+		for (int c = 0; c < header.num_channels; ++c) {
+			for (int i = 0; i < 4; ++i) {
+				if (0 == strcmp(header.channels[c].name, channelNames[i])) {
+					channelIdx[i] = c;
+				}
+			}
+		}
+	}
+
+	// Decodes chunks [firstChunk, firstChunk + chunkCount) of the part's offset table into 'res'
+	bool decodeChunks(const MappedFile& file, const EXRHeader& header, const PartLayout& layout, u32 part, u32 level, u32 firstChunk, u32 chunkCount, u32 maxThreads, const RowTarget& res) {
+		int channelIdx[4] = { -1, -1, -1, -1 };
+		getChannelIndices(header, channelIdx);
+
+		std::atomic<u32> nextChunk(0);
+		std::atomic<bool> failed(false);
+		auto worker = [&]() {
+			ChunkDecoder decoder(header, layout);
+			memcpy(decoder.channelIdx, channelIdx, sizeof(channelIdx));
+
+			for (u32 i; !failed && (i = nextChunk++) < chunkCount; ) {
+				u64 offset;
+				memcpy(&offset, layout.offsetTable + sizeof(u64) * (firstChunk + i), sizeof(offset));
+				if (offset >= file.size()) {
+					failed = true;
+					break;
+				}
+
+				const u8* chunk = file.data() + offset;
+				size_t chunkBytes = file.size() - size_t(offset);
+				if (layout.multipart) {
+					int chunkPart;
+					if (chunkBytes < sizeof(chunkPart)) {
+						failed = true;
+						break;
+					}
+
+					memcpy(&chunkPart, chunk, sizeof(chunkPart));
+					if (u32(chunkPart) != part) {
+						failed = true;
+						break;
+					}
+
+					chunk += sizeof(chunkPart);
+					chunkBytes -= sizeof(chunkPart);
+				}
+
+				if (!decoder.decode(chunk, chunkBytes, header, level, res)) {
+					failed = true;
+				}
+			}
+		};
+
+		// Small images aren't worth a thread
+		const u32 threadBudget = maxThreads > 0 ? maxThreads : std::max(1u, std::thread::hardware_concurrency());
+		const u32 threadCount = size_t(res.width) * res.rowCount < 256 * 256 ? 1u : std::min(threadBudget, chunkCount);
+		vector<std::thread> threads;
+		for (u32 i = 1; i < threadCount; ++i) {
+			threads.emplace_back(worker);
+		}
+		worker();
+		for (auto& thread : threads) {
+			thread.join();
+		}
+
+		return !failed;
+	}
+
+	bool loadPart(const MappedFile& file, const EXRHeader& header, const PartLayout& layout, u32 part, u32 maxSize, u32 maxThreads, Image *const res) {
+		const u32 width = u32(header.data_window[2] - header.data_window[0] + 1);
+		const u32 height = u32(header.data_window[3] - header.data_window[1] + 1);
+
+		u32 level = 0;
+		u32 firstChunk = 0;
+		u32 chunkCount = layout.chunkCount;
+		if (layout.tiled) {
+			const u32 levels = getUsableLevelCount(layout, width, height);
+			while (maxSize > 0 && level + 1 < levels
+				&& std::max(getLevelSize(width, level, layout.roundingMode), getLevelSize(height, level, layout.roundingMode)) > maxSize)
+			{
+				++level;
+			}
+
+			u32 partChunkCount;
+			getLevelChunks(layout, width, height, level, &firstChunk, &partChunkCount);
+			chunkCount = getTileCount(layout, width, height, level, level);
+			if (firstChunk + chunkCount > layout.chunkCount) {
+				return false;
+			}
+		}
+
+		res->level = level;
+		res->width = layout.tiled ? getLevelSize(width, level, layout.roundingMode) : width;
+		res->height = layout.tiled ? getLevelSize(height, level, layout.roundingMode) : height;
+		res->texels.assign(size_t(res->width) * res->height * 4, 0);
+
+		const RowTarget target = { res->texels.data(), res->width, res->height, 0, res->height };
+		return decodeChunks(file, header, layout, part, level, firstChunk, chunkCount, maxThreads, target);
+	}
+
+	// The headers of a file, and where the chunks of one of its parts are
+	struct PartFile {
+		MappedFile file;
+		EXRVersion version;
+		EXRHeader** headers = nullptr;
+		int headerCount = 0;
+		EXRHeader singleHeader;
+		EXRHeader* singleHeaderPtr = &singleHeader;
+		PartLayout layout;
+		u32 part = 0;
+
+		PartFile() {}
+		PartFile(const PartFile&) = delete;
+		PartFile& operator=(const PartFile&) = delete;
+
+		~PartFile() {
+			if (!headers) {
+				return;
+			}
+
+			if (version.multipart) {
+				for (int i = 0; i < headerCount; ++i) {
+					FreeEXRHeader(headers[i]);
+					free(headers[i]);
+				}
+				free(headers);
+			} else {
+				FreeEXRHeader(&singleHeader);
+			}
+		}
+
+		const EXRHeader& header() const { return *headers[part]; }
+
+		bool open(const char* const path, u32 partIdx) {
+			part = partIdx;
+			if (!file.open(path)) {
+				fprintf(stderr, "Could not open %s\n", path);
+				return false;
+			}
+
+			if (ParseEXRVersionFromMemory(&version, file.data(), file.size()) != TINYEXR_SUCCESS || version.non_image) {
+				fprintf(stderr, "Invalid or deep EXR file: %s\n", path);
+				return false;
+			}
+
+			const char* err = nullptr;
+			size_t offsetTableStart = 8;
+			if (version.multipart) {
+				if (ParseEXRMultipartHeaderFromMemory(&headers, &headerCount, &version, file.data(), file.size(), &err) != TINYEXR_SUCCESS) {
+					fprintf(stderr, "Parse EXR err: %s\n", err ? err : "");
+					headers = nullptr;
+					return false;
+				}
+
+				for (int i = 0; i < headerCount; ++i) {
+					offsetTableStart += headers[i]->header_len;
+				}
+
+				// Past the empty header ending the list
+				offsetTableStart += 1;
+			} else {
+				InitEXRHeader(&singleHeader);
+				if (ParseEXRHeaderFromMemory(&singleHeader, &version, file.data(), file.size(), &err) != TINYEXR_SUCCESS) {
+					fprintf(stderr, "Parse EXR err: %s\n", err ? err : "");
+					FreeEXRHeader(&singleHeader);
+					return false;
+				}
+
+				headers = &singleHeaderPtr;
+				headerCount = 1;
+				offsetTableStart += singleHeader.header_len;
+			}
+
+			if (part >= u32(headerCount)) {
+				fprintf(stderr, "%s has no part %u\n", path, part);
+				return false;
+			}
+
+			// Each part's offset table follows the previous one
+			for (u32 i = 0; i <= part; ++i) {
+				const EXRHeader& partHeader = *headers[i];
+				if (!getPartLayout(version, partHeader, &layout)) {
+					return false;
+				}
+
+				if (partHeader.chunk_count > 0) {
+					layout.chunkCount = u32(partHeader.chunk_count);
+				} else if (layout.tiled) {
+					u32 firstChunk;
+					getLevelChunks(
+						layout,
+						u32(partHeader.data_window[2] - partHeader.data_window[0] + 1),
+						u32(partHeader.data_window[3] - partHeader.data_window[1] + 1),
+						0, &firstChunk, &layout.chunkCount);
+				} else {
+					layout.chunkCount = (u32(partHeader.data_window[3] - partHeader.data_window[1]) + layout.linesPerChunk) / layout.linesPerChunk;
+				}
+
+				layout.offsetTable = file.data() + offsetTableStart;
+				offsetTableStart += sizeof(u64) * layout.chunkCount;
+				if (offsetTableStart > file.size()) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+	};
+
+	bool load(const char* const path, u32 part, u32 maxSize, Image *const res, u32 maxThreads) {
+		PartFile partFile;
+		if (!partFile.open(path, part)) {
+			return false;
+		}
+
+		if (!loadPart(partFile.file, partFile.header(), partFile.layout, part, maxSize, maxThreads, res)) {
+			fprintf(stderr, "Invalid EXR data in %s\n", path);
+			return false;
+		}
+
+		return true;
+	}
+
+	Reader::Reader()
+	{
+	}
+
+	Reader::~Reader()
+	{
+	}
+
+	bool Reader::open(const char* const path, u32 part)
+	{
+		m_path = path;
+		m_file.reset(new PartFile());
+		if (!m_file->open(path, part)) {
+			m_file.reset();
+			return false;
+		}
+
+		const EXRHeader& header = m_file->header();
+		m_width = u32(header.data_window[2] - header.data_window[0] + 1);
+		m_height = u32(header.data_window[3] - header.data_window[1] + 1);
+		return true;
+	}
+
+	// Scanline chunks and tiles of level 0 are listed top to bottom in offset tables, whatever the line order
+	bool Reader::readRows(u32 firstRow, u32 rowCount, vector<u16> *const texels)
+	{
+		if (!m_file || firstRow + rowCount > m_height || 0 == rowCount) {
+			return false;
+		}
+
+		const PartLayout& layout = m_file->layout;
+		const u32 top = m_height - firstRow - rowCount;
+		const u32 bottom = m_height - 1 - firstRow;
+
+		u32 firstChunk, chunkCount;
+		if (layout.tiled) {
+			const u32 tilesX = (m_width + layout.tileWidth - 1) / layout.tileWidth;
+			firstChunk = top / layout.tileHeight * tilesX;
+			chunkCount = (bottom / layout.tileHeight - top / layout.tileHeight + 1) * tilesX;
+		} else {
+			firstChunk = top / layout.linesPerChunk;
+			chunkCount = bottom / layout.linesPerChunk - firstChunk + 1;
+		}
+
+		texels->assign(size_t(m_width) * rowCount * 4, 0);
+		const RowTarget target = { texels->data(), m_width, m_height, firstRow, rowCount };
+		const bool succeeded = firstChunk + chunkCount <= layout.chunkCount
+			&& decodeChunks(m_file->file, m_file->header(), layout, m_file->part, 0, firstChunk, chunkCount, 0, target);
+
+		if (!succeeded) {
+			fprintf(stderr, "Invalid EXR data in %s\n", m_path.c_str());
+		}
+
+		return succeeded;
+	}
+}
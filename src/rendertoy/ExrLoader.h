@@ -0,0 +1,47 @@
+#pragma once
+#include "Common.h"
+
+#include <string>
+
+// Reads one level of one part of an EXR file as RGBA half texels. Only the chunks of that level are
+// touched, so a preview of a large tiled file with mip (or rip) levels costs as much as the preview size.
+// Chunks are decoded on all cores; channels other than R, G, B and A are decompressed but not converted.
+namespace ExrLoader {
+	struct Image {
+		u32 width = 0;
+		u32 height = 0;
+		u32 level = 0;				// in the file's mip chain; always 0 for files without levels
+		vector<u16> texels;			// rows bottom-up
+	};
+
+	// Picks the largest level no larger than a non-zero 'maxSize'. A non-zero 'maxThreads' caps the threads
+	// decoding chunks, for callers which already decode several images at once.
+	bool load(const char* const path, u32 part, u32 maxSize, Image *const res, u32 maxThreads = 0);
+
+	struct PartFile;
+
+	// Decodes level 0 of a part a band of rows at a time, for images too large to decode whole.
+	// Only the chunks overlapping a band are read; those straddling two bands are decoded for both.
+	class Reader {
+	public:
+		Reader();
+		~Reader();
+
+		Reader(const Reader&) = delete;
+		Reader& operator=(const Reader&) = delete;
+
+		bool open(const char* const path, u32 part);
+
+		u32 width() const { return m_width; }
+		u32 height() const { return m_height; }
+
+		// Rows [firstRow, firstRow + rowCount), counted bottom-up like Image::texels; 'texels' is resized to fit
+		bool readRows(u32 firstRow, u32 rowCount, vector<u16> *const texels);
+
+	private:
+		std::unique_ptr<PartFile> m_file;
+		std::string m_path;
+		u32 m_width = 0;
+		u32 m_height = 0;
+	};
+}
@@ -1,5 +1,17 @@
 #include "FileUtil.h"
 
+#ifdef _WIN32
+	#define VC_EXTRALEAN
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
 
 void getFilesMatchingExtension(const fs::path& root, const std::string& ext, vector<fs::path>& ret)
 {
@@ -29,3 +41,82 @@ vector<char> loadTextFileZ(const char* path)
 	programSource.back() = '\0';
 	return programSource;
 }
+
+bool MappedFile::open(const char* path)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (INVALID_HANDLE_VALUE == file) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || 0 == size.QuadPart) {
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) {
+		CloseHandle(file);
+		return false;
+	}
+
+	const void* const data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	m_file = file;
+	m_mapping = mapping;
+	m_data = static_cast<const u8*>(data);
+	m_size = size_t(size.QuadPart);
+#else
+	const int fd = ::open(path, O_RDONLY);
+	if (-1 == fd) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || 0 == st.st_size) {
+		::close(fd);
+		return false;
+	}
+
+	void* const data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);	// the mapping keeps the file open
+	if (MAP_FAILED == data) {
+		return false;
+	}
+
+	madvise(data, size_t(st.st_size), MADV_SEQUENTIAL);
+	m_data = static_cast<const u8*>(data);
+	m_size = size_t(st.st_size);
+#endif
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (!m_data) {
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(m_data);
+	CloseHandle(m_mapping);
+	CloseHandle(m_file);
+#else
+	munmap(const_cast<u8*>(m_data), m_size);
+#endif
+
+	m_data = nullptr;
+	m_size = 0;
+	m_file = nullptr;
+	m_mapping = nullptr;
+}
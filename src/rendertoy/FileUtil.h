@@ -9,4 +9,28 @@ namespace fs = ::std::experimental::filesystem;
 // in the specified directory and all subdirectories
 void getFilesMatchingExtension(const fs::path& root, const std::string& ext, vector<fs::path>& ret);
 
-vector<char> loadTextFileZ(const char* path);
\ No newline at end of file
+vector<char> loadTextFileZ(const char* path);
+
+// Read-only view of a whole file. The OS pages it in on access, so nothing is read up front
+// and no heap copy is made.
+class MappedFile
+{
+public:
+	MappedFile() {}
+	~MappedFile() { close(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const char* path);
+	void close();
+
+	const u8* data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+private:
+	const u8* m_data = nullptr;
+	size_t m_size = 0;
+	void* m_file = nullptr;		// HANDLEs; only used on Windows
+	void* m_mapping = nullptr;
+};
\ No newline at end of file
@@ -1,10 +1,19 @@
 #pragma once
 
 #include <functional>
+#include <chrono>
 
 namespace FileWatcher {
 	typedef std::function<void()> Callback;
 
+	struct ChangeInfo {
+		double detectionDelayMs = 0.0;	// from the file's modification time to the watcher noticing
+		std::chrono::steady_clock::time_point detectedTime;
+	};
+
+	// Describes the change being dispatched; only valid within callbacks
+	const ChangeInfo& currentChange();
+
 	void watchFile(const char* const path, const Callback& callback);
 	void stopWatchingFile(const char* const path);
 	void update();
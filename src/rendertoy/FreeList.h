@@ -1,4 +1,6 @@
 #pragma once
+#include <new>
+#include <cstddef>
 
 
 template <typename T>
@@ -6,18 +8,45 @@ struct FreeList
 {
 	union FreeItem {
 		FreeItem() {}
-		char item[sizeof(T)];
+		alignas(T) char item[sizeof(T)];
 		FreeItem* next;
 	};
 
 	struct ItemChunk {
 		enum { Capacity = 8 };
 		FreeItem items[Capacity];
+		ItemChunk* next;
 	};
 
+	FreeList() {}
+	FreeList(const FreeList&) = delete;
+	FreeList& operator=(const FreeList&) = delete;
+
+	// Items still allocated at this point are freed without being destroyed
+	~FreeList() {
+		while (chunks) {
+			ItemChunk* const next = chunks->next;
+			delete chunks;
+			chunks = next;
+		}
+	}
+
 	T* alloc() {
+		return new(allocItem()) T;
+	}
+
+	void free(T* it) {
+		it->~T();
+		freeItem(it);
+	}
+
+	// Uninitialized storage for one T
+	void* allocItem() {
 		if (!nextFree) {
 			ItemChunk& chunk = *new ItemChunk;
+			chunk.next = chunks;
+			chunks = &chunk;
+
 			nextFree = &chunk.items[0];
 			for (int i = 0; i < ItemChunk::Capacity - 1; ++i) {
 				chunk.items[i].next = &chunk.items[i + 1];
@@ -27,10 +56,10 @@ struct FreeList
 
 		char* res = &nextFree->item[0];
 		nextFree = nextFree->next;
-		return new(res) T;
+		return res;
 	}
 
-	void free(T* it) {
+	void freeItem(void* it) {
 		FreeItem* item = reinterpret_cast<FreeItem*>(it);
 		item->next = nextFree;
 		nextFree = item;
@@ -38,4 +67,42 @@ struct FreeList
 
 private:
 	FreeItem* nextFree = nullptr;
+	ItemChunk* chunks = nullptr;
+};
+
+// Stateless STL allocator which takes single objects, such as the nodes of lists and hash maps,
+// from a FreeList per type; freed nodes are reused instead of going back to the heap.
+// Arrays, e.g. hash buckets, still come from the heap. Not thread-safe.
+template <typename T>
+struct PoolAllocator
+{
+	typedef T value_type;
+
+	// Touching the pool here makes it outlive any static container which uses it
+	PoolAllocator() { pool(); }
+	template <typename U> PoolAllocator(const PoolAllocator<U>&) { pool(); }
+
+	T* allocate(size_t n) {
+		if (1 == n) {
+			return static_cast<T*>(pool().allocItem());
+		} else {
+			return static_cast<T*>(::operator new(n * sizeof(T)));
+		}
+	}
+
+	void deallocate(T* p, size_t n) {
+		if (1 == n) {
+			pool().freeItem(p);
+		} else {
+			::operator delete(p);
+		}
+	}
+
+	template <typename U> bool operator==(const PoolAllocator<U>&) const { return true; }
+	template <typename U> bool operator!=(const PoolAllocator<U>&) const { return false; }
+
+	static FreeList<T>& pool() {
+		static FreeList<T> list;
+		return list;
+	}
 };
@@ -0,0 +1,262 @@
+#include "GlState.h"
+
+#define NOMINMAX
+#include <glad/glad.h>
+#include <unordered_map>
+
+namespace GlState {
+	// Units beyond these limits are still bound, just not cached
+	enum {
+		MaxTextureUnits = 32,
+		MaxImageUnits = 8,
+		MaxBufferBindings = 16,
+	};
+
+	// Cached values of this are unknown, and will be set on first use
+	const GLuint unknown = GLuint(-1);
+
+	struct ImageBinding {
+		GLuint texture = unknown;
+		GLint level = 0;
+		GLboolean layered = GL_FALSE;
+		GLint layer = 0;
+		GLenum access = 0;
+		GLenum format = 0;
+	};
+
+	struct Viewport {
+		GLint x, y;
+		GLsizei width, height;
+
+		bool operator==(const Viewport& other) const {
+			return x == other.x && y == other.y && width == other.width && height == other.height;
+		}
+	};
+
+	GLuint program;
+	GLuint vertexArray;
+	u32 activeTextureUnit;
+	GLuint textures2d[MaxTextureUnits];
+	GLuint samplers[MaxTextureUnits];
+	ImageBinding images[MaxImageUnits];
+	GLuint ssbos[MaxBufferBindings];
+	GLuint arrayBuffer;
+	GLuint elementArrayBuffer;
+	GLuint shaderStorageBuffer;
+	Viewport viewportRect;
+	Viewport scissorRect;
+	std::unordered_map<GLenum, bool> caps;
+	Stats frameStats;
+
+	// Returns true if 'cached' needs to be changed to 'value'; updates the cache and counters
+	template <typename T>
+	static bool update(T& cached, const T& value) {
+		if (cached == value) {
+			++frameStats.skipped;
+			return false;
+		}
+
+		cached = value;
+		++frameStats.issued;
+		return true;
+	}
+
+	void invalidate() {
+		program = unknown;
+		vertexArray = unknown;
+		activeTextureUnit = u32(-1);
+		for (GLuint& t : textures2d) t = unknown;
+		for (GLuint& s : samplers) s = unknown;
+		for (ImageBinding& img : images) img = ImageBinding();
+		for (GLuint& b : ssbos) b = unknown;
+		arrayBuffer = unknown;
+		elementArrayBuffer = unknown;
+		shaderStorageBuffer = unknown;
+		viewportRect = Viewport { -1, -1, -1, -1 };
+		scissorRect = Viewport { -1, -1, -1, -1 };
+		caps.clear();
+	}
+
+	void useProgram(unsigned int prog) {
+		if (update(program, GLuint(prog))) {
+			glUseProgram(prog);
+		}
+	}
+
+	static void activeTexture(u32 unit) {
+		if (activeTextureUnit != unit) {
+			activeTextureUnit = unit;
+			++frameStats.issued;
+			glActiveTexture(GL_TEXTURE0 + unit);
+		}
+	}
+
+	void bindTexture(unsigned int target, unsigned int texture) {
+		if (target == GL_TEXTURE_2D && activeTextureUnit < MaxTextureUnits) {
+			if (!update(textures2d[activeTextureUnit], GLuint(texture))) {
+				return;
+			}
+		} else {
+			++frameStats.issued;
+		}
+
+		glBindTexture(target, texture);
+	}
+
+	void bindTexture(u32 unit, unsigned int target, unsigned int texture) {
+		if (target == GL_TEXTURE_2D && unit < MaxTextureUnits && textures2d[unit] == texture) {
+			++frameStats.skipped;
+			return;
+		}
+
+		activeTexture(unit);
+		bindTexture(target, texture);
+	}
+
+	void bindSampler(u32 unit, unsigned int sampler) {
+		if (unit < MaxTextureUnits) {
+			if (!update(samplers[unit], GLuint(sampler))) {
+				return;
+			}
+		} else {
+			++frameStats.issued;
+		}
+
+		glBindSampler(unit, sampler);
+	}
+
+	void bindImageTexture(u32 unit, unsigned int texture, int level, bool layered, int layer, unsigned int access, unsigned int format) {
+		if (unit < MaxImageUnits) {
+			ImageBinding& cached = images[unit];
+			if (cached.texture == texture && cached.level == level && cached.layered == GLboolean(layered)
+				&& cached.layer == layer && cached.access == access && cached.format == format)
+			{
+				++frameStats.skipped;
+				return;
+			}
+
+			cached.texture = texture;
+			cached.level = level;
+			cached.layered = layered;
+			cached.layer = layer;
+			cached.access = access;
+			cached.format = format;
+		}
+
+		++frameStats.issued;
+		glBindImageTexture(unit, texture, level, layered ? GL_TRUE : GL_FALSE, layer, access, format);
+	}
+
+	static GLuint* findBufferBinding(unsigned int target) {
+		switch (target) {
+		case GL_ARRAY_BUFFER: return &arrayBuffer;
+		case GL_ELEMENT_ARRAY_BUFFER: return &elementArrayBuffer;
+		case GL_SHADER_STORAGE_BUFFER: return &shaderStorageBuffer;
+		default: return nullptr;
+		}
+	}
+
+	void bindBuffer(unsigned int target, unsigned int buffer) {
+		if (GLuint* const cached = findBufferBinding(target)) {
+			if (!update(*cached, GLuint(buffer))) {
+				return;
+			}
+		} else {
+			++frameStats.issued;
+		}
+
+		glBindBuffer(target, buffer);
+	}
+
+	void bindBufferBase(unsigned int target, u32 index, unsigned int buffer) {
+		if (target == GL_SHADER_STORAGE_BUFFER && index < MaxBufferBindings) {
+			if (!update(ssbos[index], GLuint(buffer))) {
+				return;
+			}
+		} else {
+			++frameStats.issued;
+		}
+
+		glBindBufferBase(target, index, buffer);
+
+		// Also binds to the generic binding point
+		if (GLuint* const cached = findBufferBinding(target)) {
+			*cached = buffer;
+		}
+	}
+
+	void bindVertexArray(unsigned int vao) {
+		if (update(vertexArray, GLuint(vao))) {
+			glBindVertexArray(vao);
+
+			// The element array binding is part of the vertex array object
+			elementArrayBuffer = unknown;
+		}
+	}
+
+	void setEnabled(unsigned int cap, bool enabled) {
+		auto found = caps.find(cap);
+		if (found != caps.end() && found->second == enabled) {
+			++frameStats.skipped;
+			return;
+		}
+
+		caps[cap] = enabled;
+		++frameStats.issued;
+
+		if (enabled) {
+			glEnable(cap);
+		} else {
+			glDisable(cap);
+		}
+	}
+
+	bool isEnabled(unsigned int cap) {
+		auto found = caps.find(cap);
+		if (found != caps.end()) {
+			return found->second;
+		}
+
+		const bool enabled = glIsEnabled(cap) != GL_FALSE;
+		caps[cap] = enabled;
+		return enabled;
+	}
+
+	void viewport(int x, int y, int width, int height) {
+		if (update(viewportRect, Viewport { x, y, width, height })) {
+			glViewport(x, y, width, height);
+		}
+	}
+
+	void scissor(int x, int y, int width, int height) {
+		if (update(scissorRect, Viewport { x, y, width, height })) {
+			glScissor(x, y, width, height);
+		}
+	}
+
+	void textureDeleted(unsigned int texture) {
+		for (GLuint& t : textures2d) {
+			if (t == texture) t = 0;
+		}
+		for (ImageBinding& img : images) {
+			if (img.texture == texture) img = ImageBinding();
+		}
+	}
+
+	void bufferDeleted(unsigned int buffer) {
+		for (GLuint& b : ssbos) {
+			if (b == buffer) b = 0;
+		}
+		if (arrayBuffer == buffer) arrayBuffer = 0;
+		if (elementArrayBuffer == buffer) elementArrayBuffer = 0;
+		if (shaderStorageBuffer == buffer) shaderStorageBuffer = 0;
+	}
+
+	const Stats& stats() {
+		return frameStats;
+	}
+
+	void resetStats() {
+		frameStats = Stats();
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "Common.h"
+
+// Shadow copy of the GL binding state. All of RenderToy's state changes go through here,
+// so that redundant binds are skipped instead of reaching the driver.
+//
+// The cache assumes nothing else touches the state it tracks. Code which does (or which
+// leaves the state unknown, e.g. after context creation) must call invalidate().
+namespace GlState {
+	struct Stats {
+		u32 issued = 0;		// state changes which were passed on to GL
+		u32 skipped = 0;	// state changes which matched the cached state
+	};
+
+	void invalidate();
+
+	void useProgram(unsigned int program);
+
+	// Binds to the currently active texture unit
+	void bindTexture(unsigned int target, unsigned int texture);
+	void bindTexture(u32 unit, unsigned int target, unsigned int texture);
+	void bindSampler(u32 unit, unsigned int sampler);
+	void bindImageTexture(u32 unit, unsigned int texture, int level, bool layered, int layer, unsigned int access, unsigned int format);
+
+	void bindBuffer(unsigned int target, unsigned int buffer);
+	void bindBufferBase(unsigned int target, u32 index, unsigned int buffer);
+	void bindVertexArray(unsigned int vao);
+
+	void setEnabled(unsigned int cap, bool enabled);
+	bool isEnabled(unsigned int cap);
+
+	void viewport(int x, int y, int width, int height);
+	void scissor(int x, int y, int width, int height);
+
+	// GL resets bindings of deleted objects, and names get reused; these keep the cache in sync
+	void textureDeleted(unsigned int texture);
+	void bufferDeleted(unsigned int buffer);
+
+	const Stats& stats();
+	void resetStats();
+}
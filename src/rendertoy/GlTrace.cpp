@@ -0,0 +1,502 @@
+#include "GlTrace.h"
+#include "GlState.h"
+
+#define NOMINMAX
+#include <glad/glad.h>
+#ifndef RENDERTOY_RUNTIME
+#include <imgui.h>
+#endif
+#include <unordered_map>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace GlTrace {
+	enum { MaxFunctions = 128 };
+
+	struct FunctionInfo {
+		const char* name = nullptr;
+		bool expensive = false;		// flagged when called within a frame
+		void (*uninstall)() = nullptr;
+	};
+
+	struct ScopeCounters {
+		Subsystem subsystem;
+		std::string label;
+		u32 calls[MaxFunctions];
+		u64 bytesUploaded = 0;
+		u64 bytesDownloaded = 0;
+
+		ScopeCounters(Subsystem subsystem, const std::string& label)
+			: subsystem(subsystem)
+			, label(label)
+		{
+			memset(calls, 0, sizeof(calls));
+		}
+	};
+
+	struct FrameCounters {
+		vector<ScopeCounters> scopes;
+		u32 expensiveCalls = 0;
+		GlState::Stats stateStats;
+	};
+
+	FunctionInfo functions[MaxFunctions];
+	u32 functionCount = 0;
+	bool isEnabled = false;
+	bool inFrame = false;
+
+	FrameCounters current;
+	FrameCounters lastFrame;
+	std::unordered_map<std::string, u32> scopeIndices;
+	u32 currentScope = 0;
+
+	const char* getSubsystemName(Subsystem subsystem) {
+		switch (subsystem) {
+		case Subsystem::Other: return "Other";
+		case Subsystem::Compile: return "Compile";
+		case Subsystem::Render: return "Render";
+		case Subsystem::Clear: return "Clear";
+		case Subsystem::Gui: return "Gui";
+		case Subsystem::Upload: return "Upload";
+		default: return "?";
+		}
+	}
+
+	static u32 findScope(Subsystem subsystem, const std::string& label) {
+		const std::string key = std::string(1, char('0' + int(subsystem))) + label;
+		auto found = scopeIndices.find(key);
+		if (found != scopeIndices.end()) {
+			return found->second;
+		}
+
+		const u32 idx = u32(current.scopes.size());
+		current.scopes.emplace_back(subsystem, label);
+		scopeIndices[key] = idx;
+		return idx;
+	}
+
+	static void resetCounters() {
+		current = FrameCounters();
+		scopeIndices.clear();
+		currentScope = findScope(Subsystem::Other, "");
+	}
+
+	static void recordCall(u32 id) {
+		++current.scopes[currentScope].calls[id];
+		if (inFrame && functions[id].expensive) {
+			++current.expensiveCalls;
+		}
+	}
+
+	static void recordUpload(u64 bytes) {
+		current.scopes[currentScope].bytesUploaded += bytes;
+	}
+
+	static void recordDownload(u64 bytes) {
+		current.scopes[currentScope].bytesDownloaded += bytes;
+	}
+
+	static u32 bytesPerPixel(GLenum format, GLenum type) {
+		u32 components = 4;
+		switch (format) {
+		case GL_RED: case GL_RED_INTEGER: case GL_DEPTH_COMPONENT: components = 1; break;
+		case GL_RG: case GL_RG_INTEGER: components = 2; break;
+		case GL_RGB: case GL_BGR: case GL_RGB_INTEGER: components = 3; break;
+		}
+
+		switch (type) {
+		case GL_UNSIGNED_BYTE: case GL_BYTE: return components;
+		case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT: return components * 2;
+		default: return components * 4;
+		}
+	}
+
+	// Byte counting for the calls which move data. The rest only get counted.
+	struct NoTransfer {
+		template <typename... Args>
+		static void record(Args...) {}
+	};
+
+	struct BufferDataTransfer {
+		static void record(GLenum, GLsizeiptr size, const void* data, GLenum) {
+			if (data) recordUpload(size);
+		}
+	};
+
+	struct BufferSubDataTransfer {
+		static void record(GLenum, GLintptr, GLsizeiptr size, const void*) {
+			recordUpload(size);
+		}
+	};
+
+	struct TexImage2dTransfer {
+		static void record(GLenum, GLint, GLint, GLsizei width, GLsizei height, GLint, GLenum format, GLenum type, const void* pixels) {
+			if (pixels) recordUpload(u64(width) * height * bytesPerPixel(format, type));
+		}
+	};
+
+	struct TexSubImage2dTransfer {
+		static void record(GLenum, GLint, GLint, GLint, GLsizei width, GLsizei height, GLenum format, GLenum type, const void*) {
+			recordUpload(u64(width) * height * bytesPerPixel(format, type));
+		}
+	};
+
+	struct CompressedTexSubImage2dTransfer {
+		static void record(GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLsizei imageSize, const void*) {
+			recordUpload(imageSize);
+		}
+	};
+
+	struct GetTexImageTransfer {
+		static void record(GLenum target, GLint level, GLenum format, GLenum type, void*) {
+			// Not a traced function, so this doesn't show up in the counts
+			GLint width = 0, height = 0;
+			glad_glGetTexLevelParameteriv(target, level, GL_TEXTURE_WIDTH, &width);
+			glad_glGetTexLevelParameteriv(target, level, GL_TEXTURE_HEIGHT, &height);
+			recordDownload(u64(width) * height * bytesPerPixel(format, type));
+		}
+	};
+
+	struct ReadPixelsTransfer {
+		static void record(GLint, GLint, GLsizei width, GLsizei height, GLenum format, GLenum type, void*) {
+			recordDownload(u64(width) * height * bytesPerPixel(format, type));
+		}
+	};
+
+	struct GetBufferSubDataTransfer {
+		static void record(GLenum, GLintptr, GLsizeiptr size, void*) {
+			recordDownload(size);
+		}
+	};
+
+	template <int Id, typename Transfer, typename Ret, typename... Args>
+	struct Hook {
+		static Ret (APIENTRY **slot)(Args...);
+		static Ret (APIENTRY *original)(Args...);
+
+		static Ret APIENTRY call(Args... args) {
+			recordCall(Id);
+			Transfer::record(args...);
+			return original(args...);
+		}
+
+		static void uninstall() {
+			*slot = original;
+		}
+	};
+
+	template <int Id, typename Transfer, typename Ret, typename... Args>
+	Ret (APIENTRY **Hook<Id, Transfer, Ret, Args...>::slot)(Args...) = nullptr;
+
+	template <int Id, typename Transfer, typename Ret, typename... Args>
+	Ret (APIENTRY *Hook<Id, Transfer, Ret, Args...>::original)(Args...) = nullptr;
+
+	template <int Id, typename Transfer, typename Ret, typename... Args>
+	static void install(Ret (APIENTRY **slot)(Args...), const char* const name, bool expensive) {
+		static_assert(Id < MaxFunctions, "Increase MaxFunctions");
+		typedef Hook<Id, Transfer, Ret, Args...> HookType;
+
+		// Functions missing from the context stay missing
+		if (!*slot) {
+			return;
+		}
+
+		HookType::slot = slot;
+		HookType::original = *slot;
+		*slot = &HookType::call;
+
+		FunctionInfo& info = functions[Id];
+		info.name = name;
+		info.expensive = expensive;
+		info.uninstall = &HookType::uninstall;
+		functionCount = std::max(functionCount, u32(Id + 1));
+	}
+
+	enum { CounterBase = __COUNTER__ + 1 };
+
+	#define TRACE_GL(fn, transfer, expensive) install<__COUNTER__ - CounterBase, transfer>(&glad_##fn, #fn, expensive)
+
+	static void installAll() {
+		// Binding and state
+		TRACE_GL(glUseProgram, NoTransfer, false);
+		TRACE_GL(glActiveTexture, NoTransfer, false);
+		TRACE_GL(glBindTexture, NoTransfer, false);
+		TRACE_GL(glBindSampler, NoTransfer, false);
+		TRACE_GL(glBindImageTexture, NoTransfer, false);
+		TRACE_GL(glBindBuffer, NoTransfer, false);
+		TRACE_GL(glBindBufferBase, NoTransfer, false);
+		TRACE_GL(glBindVertexArray, NoTransfer, false);
+		TRACE_GL(glEnable, NoTransfer, false);
+		TRACE_GL(glDisable, NoTransfer, false);
+		TRACE_GL(glViewport, NoTransfer, false);
+		TRACE_GL(glScissor, NoTransfer, false);
+		TRACE_GL(glBlendEquation, NoTransfer, false);
+		TRACE_GL(glBlendFunc, NoTransfer, false);
+		TRACE_GL(glClearColor, NoTransfer, false);
+		TRACE_GL(glSamplerParameteri, NoTransfer, false);
+		TRACE_GL(glSamplerParameterf, NoTransfer, false);
+		TRACE_GL(glTexParameteri, NoTransfer, false);
+
+		// Uniforms
+		TRACE_GL(glUniform1f, NoTransfer, false);
+		TRACE_GL(glUniform2f, NoTransfer, false);
+		TRACE_GL(glUniform3f, NoTransfer, false);
+		TRACE_GL(glUniform4f, NoTransfer, false);
+		TRACE_GL(glUniform1i, NoTransfer, false);
+		TRACE_GL(glUniform2i, NoTransfer, false);
+		TRACE_GL(glUniform3i, NoTransfer, false);
+		TRACE_GL(glUniform4i, NoTransfer, false);
+		TRACE_GL(glUniform4fv, NoTransfer, false);
+		TRACE_GL(glUniformMatrix4fv, NoTransfer, false);
+
+		// Work
+		TRACE_GL(glDispatchCompute, NoTransfer, false);
+		TRACE_GL(glDrawArrays, NoTransfer, false);
+		TRACE_GL(glDrawElements, NoTransfer, false);
+		TRACE_GL(glClear, NoTransfer, false);
+		TRACE_GL(glFlush, NoTransfer, false);
+		TRACE_GL(glQueryCounter, NoTransfer, false);
+
+		// Object creation
+		TRACE_GL(glGenTextures, NoTransfer, false);
+		TRACE_GL(glDeleteTextures, NoTransfer, false);
+		TRACE_GL(glTexStorage2D, NoTransfer, false);
+		TRACE_GL(glGenBuffers, NoTransfer, false);
+		TRACE_GL(glDeleteBuffers, NoTransfer, false);
+		TRACE_GL(glGenSamplers, NoTransfer, false);
+		TRACE_GL(glCreateShader, NoTransfer, false);
+		TRACE_GL(glCompileShader, NoTransfer, false);
+		TRACE_GL(glCreateProgram, NoTransfer, false);
+		TRACE_GL(glLinkProgram, NoTransfer, false);
+		TRACE_GL(glDeleteProgram, NoTransfer, false);
+
+		// Data transfer
+		TRACE_GL(glBufferData, BufferDataTransfer, false);
+		TRACE_GL(glBufferSubData, BufferSubDataTransfer, false);
+		TRACE_GL(glTexImage2D, TexImage2dTransfer, false);
+		TRACE_GL(glTexSubImage2D, TexSubImage2dTransfer, false);
+		TRACE_GL(glCompressedTexSubImage2D, CompressedTexSubImage2dTransfer, false);
+		TRACE_GL(glGetTexImage, GetTexImageTransfer, true);
+		TRACE_GL(glReadPixels, ReadPixelsTransfer, true);
+		TRACE_GL(glGetBufferSubData, GetBufferSubDataTransfer, true);
+
+		// Queries which can stall or go through slow driver paths
+		TRACE_GL(glGetUniformLocation, NoTransfer, true);
+		TRACE_GL(glGetAttribLocation, NoTransfer, true);
+		TRACE_GL(glGetProgramiv, NoTransfer, true);
+		TRACE_GL(glGetProgramResourceiv, NoTransfer, true);
+		TRACE_GL(glGetProgramResourceName, NoTransfer, true);
+		TRACE_GL(glGetProgramInterfaceiv, NoTransfer, true);
+		TRACE_GL(glGetActiveUniform, NoTransfer, true);
+		TRACE_GL(glGetIntegerv, NoTransfer, true);
+		TRACE_GL(glIsEnabled, NoTransfer, true);
+		TRACE_GL(glGetQueryObjectiv, NoTransfer, false);
+		TRACE_GL(glGetQueryObjectui64v, NoTransfer, false);
+		TRACE_GL(glFinish, NoTransfer, true);
+	}
+
+	#undef TRACE_GL
+
+	void setEnabled(bool enable) {
+		if (enable == isEnabled) {
+			return;
+		}
+
+		if (enable) {
+			installAll();
+			resetCounters();
+			lastFrame = FrameCounters();
+		} else {
+			for (u32 i = 0; i < functionCount; ++i) {
+				if (functions[i].uninstall) {
+					functions[i].uninstall();
+				}
+				functions[i] = FunctionInfo();
+			}
+			functionCount = 0;
+		}
+
+		isEnabled = enable;
+	}
+
+	bool enabled() {
+		return isEnabled;
+	}
+
+	void beginFrame() {
+		if (!isEnabled) {
+			return;
+		}
+
+		resetCounters();
+		inFrame = true;
+	}
+
+	void endFrame() {
+		if (!isEnabled) {
+			return;
+		}
+
+		current.stateStats = GlState::stats();
+		lastFrame = current;
+		inFrame = false;
+	}
+
+	Scope::Scope(Subsystem subsystem, const char* const label)
+		: m_prevScope(u32(-1))
+	{
+		if (!isEnabled) {
+			return;
+		}
+
+		m_prevScope = currentScope;
+		currentScope = findScope(subsystem, label ? std::string(label) : current.scopes[currentScope].label);
+	}
+
+	Scope::~Scope() {
+		if (m_prevScope != u32(-1) && m_prevScope < current.scopes.size()) {
+			currentScope = m_prevScope;
+		}
+	}
+
+	static u32 totalCalls(const ScopeCounters& scope) {
+		u32 total = 0;
+		for (u32 i = 0; i < functionCount; ++i) {
+			total += scope.calls[i];
+		}
+		return total;
+	}
+
+	bool exportCsv(const char* const path) {
+		FILE* f = fopen(path, "w");
+		if (!f) {
+			return false;
+		}
+
+		fprintf(f, "subsystem,scope,function,calls,expensive,bytesUploaded,bytesDownloaded\n");
+		for (const ScopeCounters& scope : lastFrame.scopes) {
+			const char* const subsystem = getSubsystemName(scope.subsystem);
+
+			// Per-scope totals first, under the function name "*"
+			fprintf(f, "%s,\"%s\",*,%u,,%llu,%llu\n", subsystem, scope.label.c_str(), totalCalls(scope),
+				(unsigned long long)scope.bytesUploaded, (unsigned long long)scope.bytesDownloaded);
+
+			for (u32 i = 0; i < functionCount; ++i) {
+				if (scope.calls[i] > 0) {
+					fprintf(f, "%s,\"%s\",%s,%u,%d,,\n", subsystem, scope.label.c_str(), functions[i].name, scope.calls[i], functions[i].expensive ? 1 : 0);
+				}
+			}
+		}
+
+		fclose(f);
+		return true;
+	}
+
+#ifndef RENDERTOY_RUNTIME
+	static const ImVec4 expensiveColor = ImVec4(1.0f, 0.4f, 0.3f, 1.0f);
+
+	void doGui(bool *const open) {
+		ImGui::SetNextWindowSize(ImVec2(480, 560), ImGuiSetCond_FirstUseEver);
+		if (!ImGui::Begin("GL calls", open)) {
+			ImGui::End();
+			return;
+		}
+
+		bool enable = isEnabled;
+		if (ImGui::Checkbox("Trace GL calls", &enable)) {
+			setEnabled(enable);
+		}
+
+		if (!isEnabled) {
+			ImGui::TextWrapped("Tracing swaps the GL entry points for counting wrappers. Enable it to see the calls made each frame.");
+			ImGui::End();
+			return;
+		}
+
+		ImGui::SameLine();
+		static char csvPath[256] = "glcalls.csv";
+		if (ImGui::Button("Export CSV")) {
+			if (exportCsv(csvPath)) {
+				printf("GL call counters written to %s\n", csvPath);
+			} else {
+				fprintf(stderr, "Could not write %s\n", csvPath);
+			}
+		}
+		ImGui::SameLine();
+		ImGui::PushItemWidth(-1);
+		ImGui::InputText("##csvPath", csvPath, sizeof(csvPath));
+		ImGui::PopItemWidth();
+
+		u32 functionTotals[MaxFunctions] = {};
+		u32 total = 0;
+		u64 uploaded = 0, downloaded = 0;
+		for (const ScopeCounters& scope : lastFrame.scopes) {
+			for (u32 i = 0; i < functionCount; ++i) {
+				functionTotals[i] += scope.calls[i];
+				total += scope.calls[i];
+			}
+			uploaded += scope.bytesUploaded;
+			downloaded += scope.bytesDownloaded;
+		}
+
+		ImGui::Text("Calls: %u", total);
+		ImGui::Text("Uploaded: %.1f KB, downloaded: %.1f KB", uploaded / 1024.0, downloaded / 1024.0);
+		ImGui::Text("State changes: %u issued, %u skipped", lastFrame.stateStats.issued, lastFrame.stateStats.skipped);
+		if (lastFrame.expensiveCalls > 0) {
+			ImGui::TextColored(expensiveColor, "Expensive calls in the frame loop: %u", lastFrame.expensiveCalls);
+		}
+
+		if (ImGui::CollapsingHeader("By function", ImGuiTreeNodeFlags_DefaultOpen)) {
+			vector<u32> order;
+			for (u32 i = 0; i < functionCount; ++i) {
+				if (functionTotals[i] > 0) {
+					order.push_back(i);
+				}
+			}
+			std::sort(order.begin(), order.end(), [&](u32 a, u32 b) { return functionTotals[a] > functionTotals[b]; });
+
+			ImGui::Columns(2, "functions");
+			for (u32 i : order) {
+				if (functions[i].expensive) {
+					ImGui::TextColored(expensiveColor, "%s", functions[i].name);
+				} else {
+					ImGui::Text("%s", functions[i].name);
+				}
+				ImGui::NextColumn();
+				ImGui::Text("%u", functionTotals[i]);
+				ImGui::NextColumn();
+			}
+			ImGui::Columns(1);
+		}
+
+		if (ImGui::CollapsingHeader("By scope")) {
+			for (size_t scopeIdx = 0; scopeIdx < lastFrame.scopes.size(); ++scopeIdx) {
+				const ScopeCounters& scope = lastFrame.scopes[scopeIdx];
+				const u32 scopeTotal = totalCalls(scope);
+				if (0 == scopeTotal) {
+					continue;
+				}
+
+				if (ImGui::TreeNode((void*)scopeIdx, "%s %s: %u calls, %.1f KB up, %.1f KB down",
+					getSubsystemName(scope.subsystem), scope.label.c_str(), scopeTotal,
+					scope.bytesUploaded / 1024.0, scope.bytesDownloaded / 1024.0))
+				{
+					for (u32 i = 0; i < functionCount; ++i) {
+						if (scope.calls[i] > 0) {
+							if (functions[i].expensive) {
+								ImGui::TextColored(expensiveColor, "%s: %u", functions[i].name, scope.calls[i]);
+							} else {
+								ImGui::Text("%s: %u", functions[i].name, scope.calls[i]);
+							}
+						}
+					}
+					ImGui::TreePop();
+				}
+			}
+		}
+
+		ImGui::End();
+	}
+#endif
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "Common.h"
+#include <string>
+
+// Optional instrumentation of the GL entry points. While enabled, the glad function pointers
+// are swapped for wrappers which count calls per function, attribute them to the current scope,
+// and tally bytes moved between the CPU and the GPU. Disabled, it costs nothing.
+namespace GlTrace {
+	enum class Subsystem {
+		Other,
+		Compile,
+		Render,
+		Clear,
+		Gui,
+		Upload,
+		Count
+	};
+
+	const char* getSubsystemName(Subsystem subsystem);
+
+	void setEnabled(bool enabled);
+	bool enabled();
+
+	// Calls are accumulated between these, and the results of the last finished frame are kept for display
+	void beginFrame();
+	void endFrame();
+
+	// Attributes calls to a subsystem, and optionally a label such as a pass name, until destroyed.
+	// Without a label, the enclosing scope's label is kept.
+	struct Scope {
+		Scope(Subsystem subsystem, const char* const label = nullptr);
+		Scope(Subsystem subsystem, const std::string& label) : Scope(subsystem, label.c_str()) {}
+		~Scope();
+
+	private:
+		u32 m_prevScope;
+	};
+
+	// Writes the last finished frame's counters
+	bool exportCsv(const char* const path);
+
+#ifndef RENDERTOY_RUNTIME
+	void doGui(bool *const open);
+#endif
+}
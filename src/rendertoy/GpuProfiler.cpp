@@ -0,0 +1,126 @@
+#include "GpuProfiler.h"
+
+#define NOMINMAX
+#include <glad/glad.h>
+
+namespace GpuProfiler {
+	enum { MaxFramesInFlight = 4 };
+
+	struct FrameQueries {
+		// [0] is the start of the frame, then one per scope, and finally the end of the frame
+		vector<GLuint> queries;
+		vector<std::string> scopeNames;
+		u32 usedQueries = 0;
+		u64 frameIndex = 0;
+		bool pending = false;
+	};
+
+	FrameQueries frames[MaxFramesInFlight];
+	vector<GpuFrameTimings> finishedFrames;
+	u64 frameCounter = 0;
+	bool isEnabled = false;
+	bool inFrame = false;
+
+	static GLuint allocQuery(FrameQueries& frame) {
+		if (frame.usedQueries == frame.queries.size()) {
+			GLuint query;
+			glGenQueries(1, &query);
+			frame.queries.push_back(query);
+		}
+
+		return frame.queries[frame.usedQueries++];
+	}
+
+	static bool isFinished(const FrameQueries& frame) {
+		GLint available = 0;
+		glGetQueryObjectiv(frame.queries[frame.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		return available != 0;
+	}
+
+	static void resolve(FrameQueries& frame) {
+		vector<GLuint64> timestamps(frame.usedQueries);
+		for (u32 i = 0; i < frame.usedQueries; ++i) {
+			glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &timestamps[i]);
+		}
+
+		GpuFrameTimings timings;
+		timings.frameIndex = frame.frameIndex;
+		timings.frameMs = double(timestamps.back() - timestamps.front()) * 1e-6;
+
+		for (u32 i = 0; i < frame.scopeNames.size(); ++i) {
+			GpuScopeTiming scope;
+			scope.name = frame.scopeNames[i];
+			scope.ms = double(timestamps[i + 1] - timestamps[i]) * 1e-6;
+			timings.scopes.push_back(scope);
+		}
+
+		finishedFrames.push_back(timings);
+		frame.pending = false;
+	}
+
+	void setEnabled(bool enabled) {
+		isEnabled = enabled;
+	}
+
+	bool enabled() {
+		return isEnabled;
+	}
+
+	u64 frameIndex() {
+		return frameCounter;
+	}
+
+	void beginFrame() {
+		if (!isEnabled) {
+			return;
+		}
+
+		++frameCounter;
+		FrameQueries& frame = frames[frameCounter % MaxFramesInFlight];
+
+		// The slot is only reused after MaxFramesInFlight frames, so this rarely waits
+		if (frame.pending) {
+			resolve(frame);
+		}
+
+		frame.usedQueries = 0;
+		frame.scopeNames.clear();
+		frame.frameIndex = frameCounter;
+		glQueryCounter(allocQuery(frame), GL_TIMESTAMP);
+		inFrame = true;
+	}
+
+	void endScope(const char* const name) {
+		if (!inFrame) {
+			return;
+		}
+
+		FrameQueries& frame = frames[frameCounter % MaxFramesInFlight];
+		frame.scopeNames.push_back(name);
+		glQueryCounter(allocQuery(frame), GL_TIMESTAMP);
+	}
+
+	void endFrame() {
+		if (!inFrame) {
+			return;
+		}
+
+		FrameQueries& frame = frames[frameCounter % MaxFramesInFlight];
+		glQueryCounter(allocQuery(frame), GL_TIMESTAMP);
+		frame.pending = true;
+		inFrame = false;
+	}
+
+	void collect(vector<GpuFrameTimings> *const results, bool wait) {
+		// Resolve in submission order, oldest first
+		for (u64 i = frameCounter + 1; i <= frameCounter + MaxFramesInFlight; ++i) {
+			FrameQueries& frame = frames[i % MaxFramesInFlight];
+			if (frame.pending && (wait || isFinished(frame))) {
+				resolve(frame);
+			}
+		}
+
+		results->insert(results->end(), finishedFrames.begin(), finishedFrames.end());
+		finishedFrames.clear();
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "Common.h"
+#include <string>
+
+struct GpuScopeTiming {
+	std::string name;
+	double ms = 0.0;
+};
+
+struct GpuFrameTimings {
+	u64 frameIndex = 0;
+	double frameMs = 0.0;
+	vector<GpuScopeTiming> scopes;
+};
+
+// GPU timing via timestamp queries. Results are read back a few frames late,
+// so that the profiler doesn't stall the pipeline.
+namespace GpuProfiler {
+	void setEnabled(bool enabled);
+	bool enabled();
+
+	// Index of the frame started by the last beginFrame call
+	u64 frameIndex();
+
+	void beginFrame();
+	// Ends the scope which started at the previous endScope call, or at the start of the frame
+	void endScope(const char* const name);
+	void endFrame();
+
+	// Append timings of frames which have finished on the GPU.
+	// If 'wait' is set, blocks until all the frames in flight finish.
+	void collect(vector<GpuFrameTimings> *const results, bool wait);
+}
@@ -0,0 +1,136 @@
+#include "HeapStats.h"
+#include "Arena.h"
+
+#include <imgui.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<u64> g_allocationCount(0);
+static std::atomic<u64> g_allocationBytes(0);
+
+static void* countedAlloc(size_t size)
+{
+	++g_allocationCount;
+	g_allocationBytes += size;
+	return malloc(size ? size : 1);
+}
+
+void* operator new(size_t size)
+{
+	if (void* const res = countedAlloc(size)) {
+		return res;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return countedAlloc(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+namespace HeapStats {
+	Counters frameStart;
+	Counters renderStart;
+
+	// Results of the last finished frame
+	Counters lastFrame;
+	Counters lastRender;
+	Counters currentRender;
+
+	// Consecutive frames in which compiling and rendering didn't allocate
+	u64 cleanRenderFrames = 0;
+
+	static Counters operator-(const Counters& a, const Counters& b) {
+		Counters res;
+		res.allocations = a.allocations - b.allocations;
+		res.bytes = a.bytes - b.bytes;
+		return res;
+	}
+
+	Counters total() {
+		Counters res;
+		res.allocations = g_allocationCount;
+		res.bytes = g_allocationBytes;
+		return res;
+	}
+
+	void beginFrame() {
+		frameStart = total();
+		currentRender = Counters();
+	}
+
+	void endFrame() {
+		lastFrame = total() - frameStart;
+		lastRender = currentRender;
+		cleanRenderFrames = (0 == lastRender.allocations) ? cleanRenderFrames + 1 : 0;
+	}
+
+	void beginRender() {
+		renderStart = total();
+	}
+
+	void endRender() {
+		const Counters render = total() - renderStart;
+		currentRender.allocations += render.allocations;
+		currentRender.bytes += render.bytes;
+	}
+
+	void doGui(bool *const open) {
+		ImGui::SetNextWindowSize(ImVec2(360, 160), ImGuiSetCond_FirstUseEver);
+		if (!ImGui::Begin("Heap allocations", open)) {
+			ImGui::End();
+			return;
+		}
+
+		const LinearArena& arena = FrameArena::get();
+
+		ImGui::Text("Frame: %llu allocations, %llu bytes", lastFrame.allocations, lastFrame.bytes);
+		ImGui::Text("Compile and render: %llu allocations, %llu bytes", lastRender.allocations, lastRender.bytes);
+		ImGui::Text("Frames without render allocations: %llu", cleanRenderFrames);
+		ImGui::Separator();
+		ImGui::Text("Frame arena: %u KB used of %u KB in %u block(s)", u32(arena.usedBeforeReset() / 1024), u32(arena.capacity() / 1024), arena.blockCount());
+
+		ImGui::End();
+	}
+}
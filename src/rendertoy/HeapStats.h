@@ -0,0 +1,24 @@
+#pragma once
+#include "Common.h"
+
+// Counts allocations made through the global operator new, which this module replaces.
+// Used to check that steady-state frames don't touch the heap.
+namespace HeapStats {
+	struct Counters {
+		u64 allocations = 0;
+		u64 bytes = 0;
+	};
+
+	// Since startup, across all threads
+	Counters total();
+
+	void beginFrame();
+	void endFrame();
+
+	// Allocations between these are also reported on their own. Used around compiling and rendering the project,
+	// which should allocate nothing once the project is loaded and no shaders change.
+	void beginRender();
+	void endRender();
+
+	void doGui(bool *const open);
+}
@@ -0,0 +1,415 @@
+#include "ImageSequence.h"
+#include "ExrLoader.h"
+#include "FileUtil.h"
+#include "GlState.h"
+#include "UploadRing.h"
+
+#define NOMINMAX
+#include <glad/glad.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+
+namespace {
+	struct OpenSequence {
+		u32 firstFrame = 0;
+		u32 lastFrame = 0;
+		bool tried = false;
+		ImageSequence* seq = nullptr;		// if it opened
+	};
+
+	// Not deleted at exit, like loaded textures; the workers are left to the OS
+	std::unordered_map<std::string, OpenSequence> g_imageSequences;
+
+	// Replaced by a reopen, and waiting for their workers to quit
+	vector<ImageSequence*> g_stoppingImageSequences;
+
+	// Looked up on every compile and UI frame, so the key's storage is reused; valid until the next call
+	const std::string& getSequenceKey(const TextureDesc& desc) {
+		static std::string key;
+		key = desc.path;
+		if (desc.exrPart > 0) {
+			char partSuffix[16];
+			snprintf(partSuffix, sizeof(partSuffix), "#part%u", desc.exrPart);
+			key += partSuffix;
+		}
+		return key;
+	}
+
+	// Exactly one integer conversion, such as %d or %04d; '%' is otherwise escaped as %%
+	bool isValidFramePattern(const std::string& pattern) {
+		u32 conversions = 0;
+		for (size_t i = 0; i < pattern.size(); ++i) {
+			if (pattern[i] != '%') {
+				continue;
+			}
+
+			if (i + 1 < pattern.size() && '%' == pattern[i + 1]) {
+				++i;
+				continue;
+			}
+
+			size_t end = i + 1;
+			while (end < pattern.size() && isdigit(u8(pattern[end]))) {
+				++end;
+			}
+
+			if (end == pattern.size() || pattern[end] != 'd') {
+				return false;
+			}
+
+			++conversions;
+			i = end;
+		}
+
+		return 1 == conversions;
+	}
+
+	std::string escapePercents(const std::string& s) {
+		std::string res;
+		for (char c : s) {
+			res += c;
+			if ('%' == c) {
+				res += '%';
+			}
+		}
+		return res;
+	}
+
+	std::string formatFramePath(const std::string& pattern, u32 frame) {
+		char path[1024];
+		snprintf(path, sizeof(path), pattern.c_str(), int(frame));
+		return path;
+	}
+}
+
+ImageSequence::~ImageSequence()
+{
+	stop();
+	for (std::thread& worker : m_workers) {
+		worker.join();
+	}
+
+	for (Slot& slot : m_slots) {
+		Resources::release(slot.tex);
+	}
+}
+
+void ImageSequence::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+
+	m_queued.notify_all();
+}
+
+bool ImageSequence::stopped()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return 0 == m_runningWorkers;
+}
+
+bool ImageSequence::open(const TextureDesc& desc)
+{
+	if (!isValidFramePattern(desc.path) || desc.lastFrame < desc.firstFrame || desc.frameRate <= 0.0f) {
+		fprintf(stderr, "Not a valid image sequence: %s, frames %u to %u\n", desc.path.c_str(), desc.firstFrame, desc.lastFrame);
+		return false;
+	}
+
+	m_desc = desc;
+	m_frameCount = desc.lastFrame - desc.firstFrame + 1;
+
+	ExrLoader::Image image;
+	if (!decodeTextureRgba16f(getFramePath(desc.firstFrame), desc.exrPart, &image)) {
+		fprintf(stderr, "Could not load %s\n", getFramePath(desc.firstFrame).c_str());
+		return false;
+	}
+
+	m_width = image.width;
+	m_height = image.height;
+
+	for (Slot& slot : m_slots) {
+		slot.tex = createTexture(desc, TextureKey{ m_width, m_height, GL_RGBA16F });
+	}
+
+	Slot& first = m_slots[0];
+	first.frame = desc.firstFrame;
+	first.texels.swap(image.texels);
+	upload(first);
+	first.state = SlotState::Uploaded;
+	m_shownSlot = 0;
+	m_targetFrame = desc.firstFrame;
+
+	// Frames are decoded whole by each worker; EXR chunks go wide within a frame too, on the worker's share of the cores
+	const u32 coreCount = std::max(1u, std::thread::hardware_concurrency());
+	const u32 workerCount = std::max(1u, std::min(4u, coreCount / 2));
+	m_decodeThreads = std::max(1u, coreCount / workerCount);
+	m_runningWorkers = workerCount;
+	for (u32 i = 0; i < workerCount; ++i) {
+		m_workers.emplace_back([this]() { workerMain(); });
+	}
+
+	return true;
+}
+
+std::string ImageSequence::getFramePath(u32 frame) const
+{
+	return formatFramePath(m_desc.path, frame);
+}
+
+u32 ImageSequence::getFrameDistance(u32 frame, u32 from) const
+{
+	return (frame + m_frameCount - from) % m_frameCount;
+}
+
+// The next one due; under the mutex
+ImageSequence::Slot* ImageSequence::findQueuedSlot()
+{
+	Slot* res = nullptr;
+	for (Slot& slot : m_slots) {
+		if (SlotState::Queued == slot.state && (!res || getFrameDistance(slot.frame, m_targetFrame) < getFrameDistance(res->frame, m_targetFrame))) {
+			res = &slot;
+		}
+	}
+	return res;
+}
+
+void ImageSequence::workerMain()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;) {
+		Slot* slot = nullptr;
+		m_queued.wait(lock, [&]() { return m_quit || (slot = findQueuedSlot()) != nullptr; });
+		if (m_quit) {
+			--m_runningWorkers;
+			return;
+		}
+
+		slot->state = SlotState::Decoding;
+		const std::string path = getFramePath(slot->frame);
+		ExrLoader::Image image;
+		image.texels.swap(slot->texels);
+		lock.unlock();
+
+		const bool decoded = decodeTextureRgba16f(path, m_desc.exrPart, &image, m_decodeThreads);
+		const bool matches = decoded && image.width == m_width && image.height == m_height;
+		if (!decoded) {
+			fprintf(stderr, "Could not load %s\n", path.c_str());
+		} else if (!matches) {
+			fprintf(stderr, "%s is %ux%u, but the sequence is %ux%u\n", path.c_str(), image.width, image.height, m_width, m_height);
+		}
+
+		lock.lock();
+		slot->texels.swap(image.texels);
+		slot->state = matches ? SlotState::Decoded : SlotState::Failed;
+	}
+}
+
+// Texels go through the upload ring in bands of rows; without the ring, straight from the slot
+void ImageSequence::upload(Slot& slot)
+{
+	const size_t rowBytes = size_t(m_width) * 4 * sizeof(u16);
+	const u8* const texels = reinterpret_cast<const u8*>(slot.texels.data());
+
+	GlState::bindTexture(GL_TEXTURE_2D, Resources::get(slot.tex).texId);
+
+	for (u32 row = 0; row < m_height; ) {
+		UploadRing::Segment segment;
+		const bool staged = rowBytes <= UploadRing::segmentSize() && UploadRing::begin(&segment);
+		if (!staged) {
+			segment.offset = reinterpret_cast<size_t>(texels + row * rowBytes);
+			segment.size = rowBytes * (m_height - row);
+		}
+
+		const u32 rowCount = std::min(m_height - row, u32(segment.size / rowBytes));
+		if (staged) {
+			memcpy(segment.data, texels + row * rowBytes, rowCount * rowBytes);
+		}
+
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, GLint(row), m_width, rowCount, GL_RGBA, GL_HALF_FLOAT, reinterpret_cast<const void*>(segment.offset));
+		if (staged) {
+			UploadRing::end();
+		}
+
+		row += rowCount;
+	}
+}
+
+TextureHandle ImageSequence::update(double time)
+{
+	const u32 target = m_desc.firstFrame + u32(u64(std::max(0.0, time * m_desc.frameRate)) % m_frameCount);
+	const u32 aheadCount = std::min(u32(RingSize), m_frameCount);
+
+	Slot* uploads[UploadsPerUpdate];
+	u32 uploadCount = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_targetFrame = target;
+
+		// Slots which fell behind the clock are reused for the frames coming up. The shown one stays until replaced,
+		// and ones being decoded until they're done.
+		bool covered[RingSize] = {};
+		for (u32 i = 0; i < RingSize; ++i) {
+			Slot& slot = m_slots[i];
+			if (SlotState::Free == slot.state) {
+				continue;
+			}
+
+			const u32 distance = getFrameDistance(slot.frame, target);
+			if (distance < aheadCount && !covered[distance]) {
+				covered[distance] = true;
+			} else if (slot.state != SlotState::Decoding && i != m_shownSlot) {
+				slot.state = SlotState::Free;
+			}
+		}
+
+		u32 freeSlot = 0;
+		for (u32 distance = 0; distance < aheadCount; ++distance) {
+			if (covered[distance]) {
+				continue;
+			}
+
+			while (freeSlot < RingSize && m_slots[freeSlot].state != SlotState::Free) {
+				++freeSlot;
+			}
+			if (RingSize == freeSlot) {
+				break;
+			}
+
+			m_slots[freeSlot].state = SlotState::Queued;
+			m_slots[freeSlot].frame = m_desc.firstFrame + (target - m_desc.firstFrame + distance) % m_frameCount;
+		}
+
+		// The frames due soonest go first
+		for (u32 distance = 0; distance < aheadCount && uploadCount < UploadsPerUpdate; ++distance) {
+			for (Slot& slot : m_slots) {
+				if (SlotState::Decoded == slot.state && getFrameDistance(slot.frame, target) == distance) {
+					uploads[uploadCount++] = &slot;
+					break;
+				}
+			}
+		}
+	}
+
+	m_queued.notify_all();
+
+	// Decoded slots are left alone by the workers
+	for (u32 i = 0; i < uploadCount; ++i) {
+		upload(*uploads[i]);
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (u32 i = 0; i < uploadCount; ++i) {
+		uploads[i]->state = SlotState::Uploaded;
+	}
+
+	bool failed = false;
+	bool ready = false;
+	for (u32 i = 0; i < RingSize; ++i) {
+		if (m_slots[i].frame == target && SlotState::Uploaded == m_slots[i].state) {
+			m_shownSlot = i;
+			ready = true;
+		}
+		failed = failed || (m_slots[i].frame == target && SlotState::Failed == m_slots[i].state);
+	}
+
+	// Frames which can't be loaded were reported by the worker
+	if (!ready && !failed && target != m_lastUnderrunFrame) {
+		m_lastUnderrunFrame = target;
+		++m_underrunCount;
+		fprintf(stderr, "Underrun: frame %u of %s wasn't decoded in time (%u so far)\n", target, m_desc.path.c_str(), m_underrunCount);
+	}
+
+	return m_slots[m_shownSlot].tex;
+}
+
+ImageSequence* loadImageSequence(const TextureDesc& desc)
+{
+	g_stoppingImageSequences.erase(
+		std::remove_if(g_stoppingImageSequences.begin(), g_stoppingImageSequences.end(), [](ImageSequence* seq) {
+			if (seq->stopped()) {
+				delete seq;
+				return true;
+			}
+			return false;
+		}),
+		g_stoppingImageSequences.end());
+
+	OpenSequence& open = g_imageSequences[getSequenceKey(desc)];
+
+	// Failures are remembered too, so that a broken sequence isn't retried every frame
+	if (open.tried && open.firstFrame == desc.firstFrame && open.lastFrame == desc.lastFrame) {
+		if (open.seq) {
+			open.seq->setFrameRate(desc.frameRate);
+		}
+		return open.seq;
+	}
+
+	// Decodes in flight can take a while, so the old sequence isn't deleted until its workers are done with them
+	if (open.seq) {
+		open.seq->stop();
+		g_stoppingImageSequences.push_back(open.seq);
+	}
+
+	open.firstFrame = desc.firstFrame;
+	open.lastFrame = desc.lastFrame;
+	open.tried = true;
+	open.seq = new ImageSequence();
+	if (!open.seq->open(desc)) {
+		delete open.seq;
+		open.seq = nullptr;
+	}
+
+	return open.seq;
+}
+
+ImageSequence* findOpenImageSequence(const TextureDesc& desc)
+{
+	auto found = g_imageSequences.find(getSequenceKey(desc));
+	if (found != g_imageSequences.end() && found->second.firstFrame == desc.firstFrame && found->second.lastFrame == desc.lastFrame) {
+		return found->second.seq;
+	}
+	return nullptr;
+}
+
+bool detectImageSequence(const std::string& framePath, std::string *const pattern, u32 *const firstFrame, u32 *const lastFrame)
+{
+	const std::string name = fs::path(framePath).filename().string();
+	const std::string dir = framePath.substr(0, framePath.size() - name.size());
+
+	// The last number in the file name
+	const size_t last = name.find_last_of("0123456789");
+	if (std::string::npos == last) {
+		return false;
+	}
+
+	const size_t notDigit = name.find_last_not_of("0123456789", last);
+	const size_t first = (std::string::npos == notDigit) ? 0 : notDigit + 1;
+	const size_t digits = last - first + 1;
+	if (digits > 9) {
+		return false;
+	}
+
+	// Zero-padded numbers keep their width
+	const std::string conversion = ('0' == name[first] && digits > 1) ? "%0" + std::to_string(digits) + "d" : "%d";
+	*pattern = escapePercents(dir + name.substr(0, first)) + conversion + escapePercents(name.substr(last + 1));
+
+	const u32 frame = u32(std::stoul(name.substr(first, digits)));
+	*firstFrame = frame;
+	*lastFrame = frame;
+
+	std::error_code err;
+	while (*firstFrame > 0 && fs::exists(formatFramePath(*pattern, *firstFrame - 1), err)) {
+		--*firstFrame;
+	}
+	while (fs::exists(formatFramePath(*pattern, *lastFrame + 1), err)) {
+		++*lastFrame;
+	}
+
+	return true;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include "Common.h"
+#include "Texture.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Numbered image files played back as one texture. Worker threads decode the frames coming up on the
+// playback clock into a ring of slots, each with its own texture, and the render thread uploads them
+// through the upload ring once they're decoded. A frame which isn't ready when due is an underrun:
+// the previous frame stays up, and the render thread never waits for a decode.
+class ImageSequence
+{
+public:
+	enum {
+		RingSize = 8,			// frames in flight, including the one shown
+		UploadsPerUpdate = 2,	// spreads the uploads of a burst of decoded frames over several updates
+	};
+
+	ImageSequence() {}
+	~ImageSequence();
+
+	ImageSequence(const ImageSequence&) = delete;
+	ImageSequence& operator=(const ImageSequence&) = delete;
+
+	// Decodes the first frame right away, as it decides the size of the textures
+	bool open(const TextureDesc& desc);
+
+	// The texture of the frame due 'time' seconds into playback, looping over the range;
+	// or of the last frame shown, if that one isn't ready yet
+	TextureHandle update(double time);
+
+	// Takes effect from the next update; other changes to the desc need the sequence reopened
+	void setFrameRate(float frameRate) { m_desc.frameRate = frameRate; }
+
+	// Asks the workers to quit once they're done with the frames they're decoding, without waiting for them
+	void stop();
+
+	// True once every worker has quit, so that deleting the sequence doesn't block
+	bool stopped();
+
+	u32 width() const { return m_width; }
+	u32 height() const { return m_height; }
+	u32 underrunCount() const { return m_underrunCount; }
+
+private:
+	enum class SlotState {
+		Free,
+		Queued,
+		Decoding,		// the texels belong to a worker
+		Decoded,
+		Failed,
+		Uploaded,
+	};
+
+	struct Slot {
+		SlotState state = SlotState::Free;
+		u32 frame = 0;
+		vector<u16> texels;		// RGBA16F, kept around for the next frame decoded into the slot
+		TextureHandle tex;
+	};
+
+	std::string getFramePath(u32 frame) const;
+	u32 getFrameDistance(u32 frame, u32 from) const;	// frames ahead of 'from', wrapping around the range
+	Slot* findQueuedSlot();
+	void upload(Slot& slot);
+	void workerMain();
+
+	TextureDesc m_desc;
+	u32 m_frameCount = 0;
+	u32 m_width = 0;
+	u32 m_height = 0;
+	u32 m_underrunCount = 0;
+	u32 m_lastUnderrunFrame = ~0u;
+	u32 m_decodeThreads = 1;	// per worker
+
+	// Slot states and the target frame are shared with the workers, under the mutex
+	Slot m_slots[RingSize];
+	u32 m_shownSlot = 0;
+	u32 m_targetFrame = 0;
+	bool m_quit = false;
+	u32 m_runningWorkers = 0;
+	std::mutex m_mutex;
+	std::condition_variable m_queued;
+	vector<std::thread> m_workers;
+};
+
+// Sequences stay open until exit, keyed by path pattern and EXR part; changing the frame range reopens them,
+// and the old one is deleted once its workers have quit.
+// Returns nullptr if the pattern is malformed or the first frame can't be read.
+ImageSequence* loadImageSequence(const TextureDesc& desc);
+
+// Doesn't open anything; nullptr if the sequence isn't open with this frame range
+ImageSequence* findOpenImageSequence(const TextureDesc& desc);
+
+// Turns the path of one frame into a pattern, e.g. shot.0042.exr into shot.%04d.exr, and finds the
+// unbroken range of frames around it on disk. False if the file name has no number.
+bool detectImageSequence(const std::string& framePath, std::string *const pattern, u32 *const firstFrame, u32 *const lastFrame);
@@ -7,7 +7,17 @@
 #include "FileUtil.h"
 #include "Shader.h"
 #include "Texture.h"
+#include "Package.h"
 #include "OsUtil.h"
+#include "GpuProfiler.h"
+#include "GlState.h"
+#include "GlTrace.h"
+#include "EventServer.h"
+#include "ReloadLatency.h"
+#include "HeapStats.h"
+#include "Arena.h"
+#include "Benchmark.h"
+#include "ImageSequence.h"
 
 #include <imgui.h>
 #include "imgui_impl_glfw_gl3.h"
@@ -23,1574 +33,125 @@
 #include <unordered_set>
 #include <fstream>
 #include <algorithm>
+#include <chrono>
 
 
-using JsonWriter = rapidjson::PrettyWriter<rapidjson::StringBuffer>;
-
-struct RenderPass;
-std::shared_ptr<RenderPass> g_editedPass = nullptr;
-
-
-struct BufferKey {
-	u32 sizeBytes;
-
-	bool operator==(const BufferKey& other) const {
-		return sizeBytes == other.sizeBytes;
-	}
-};
-
-
-namespace std {
-	template <>
-	struct hash<TextureKey>
-	{
-		size_t operator()(const TextureKey& k) const {
-			size_t res = 17;
-			res = res * 31u + hash<u32>()(k.width);
-			res = res * 31u + hash<u32>()(k.height);
-			res = res * 31u + hash<GLenum>()(k.format);
-			return res;
-		}
-	};
-
-	template <>
-	struct hash<BufferKey>
-	{
-		size_t operator()(const BufferKey& k) const {
-			size_t res = 17;
-			res = res * 31u + hash<u32>()(k.sizeBytes);
-			return res;
-		}
-	};
-}
-
-namespace std {
-	template <>
-	struct hash<nodegraph::node_handle>
-	{
-		size_t operator()(const nodegraph::node_handle& k) const {
-			return size_t(k.idx) | (size_t(k.fingerprint) << 16);
-		}
-	};
-}
-
-
-std::unordered_map<TextureKey, shared_ptr<CreatedTexture>> g_transientTextureCache;
-
-struct CompiledImage
-{
-	shared_ptr<CreatedTexture> tex;
-	bool owned = false;
-	bool clear = false;
-
-	bool valid() const {
-		return tex && tex->texId != 0;
-	}
-
-	void release() {
-		g_transientTextureCache[tex->key] = tex;
-		tex = nullptr;
-		owned = false;
-		clear = false;
-	}
-};
-
-
-struct CreatedBuffer {
-	unsigned int id = 0;			// GLuint
-	BufferKey key;
-
-	~CreatedBuffer() {
-		if (id != 0) glDeleteBuffers(1, &id);
-	}
-};
-
-std::unordered_map<BufferKey, shared_ptr<CreatedBuffer>> g_transientBufferCache;
-
-struct CompiledBuffer
-{
-	shared_ptr<CreatedBuffer> buf;
-	bool owned = false;
-
-	bool valid() const {
-		return buf && buf->id != 0;
-	}
-
-	void release() {
-		g_transientBufferCache[buf->key] = buf;
-		buf = nullptr;
-		owned = false;
-	}
-};
-
-
-struct CompiledPass
-{
-	vector<GLuint> paramLocations;
-	vector<CompiledImage> compiledImages;
-	vector<CompiledBuffer> compiledBuffers;
-	ShaderParamIterProxy params;
-	ivec2 dispatchSize = ivec2(0, 0);
-	ComputeShader* shader = nullptr;
-
-	void clearImages()
-	{
-		for (const auto& param : params) {
-			const auto& refl = param.refl;
-			const auto& value = param.value;
-
-			if (-1 == refl.location) {
-				continue;
-			}
-
-			if (refl.type == ShaderParamType::Image2d) {
-				CompiledImage& img = compiledImages[param.idx];
-				if (img.valid() && img.clear) {
-					static ComputeShader clearFloat("data/std/clearFloat.glsl");
-					static ComputeShader clearUint("data/std/clearUint.glsl");
-
-					// HACK
-					ComputeShader& sh = (img.tex->key.format == GL_RGBA16F) ? clearFloat : clearUint;
-
-					glUseProgram(sh.m_programHandle);
-					const GLenum layered = GL_FALSE;
-					glBindImageTexture(0, img.tex->texId, 0, layered, 0, GL_WRITE_ONLY, img.tex->key.format);
-					glUniform1i(glGetUniformLocation(sh.m_programHandle, "outputImage"), 0);
-
-					GLint workGroupSize[3];
-					glGetProgramiv(sh.m_programHandle, GL_COMPUTE_WORK_GROUP_SIZE, workGroupSize);
-					glDispatchCompute(
-						(img.tex->key.width + workGroupSize[0] - 1) / workGroupSize[0],
-						(img.tex->key.height + workGroupSize[1] - 1) / workGroupSize[1],
-						1);
-				}
-			}
-		}
-	}
-
-	void render()
-	{
-		// TODO: clean up. this is only there for the Output node which doesn't have a shader
-		if (!shader) {
-			return;
-		}
-
-		clearImages();
-
-		glUseProgram(shader->m_programHandle);
-		u32 imgUnit = 0;
-		u32 texUnit = 0;
-
-		for (const auto& param : params) {
-			const auto& refl = param.refl;
-			const auto& value = param.value;
-
-			if (-1 == refl.location) {
-				continue;
-			}
-
-			if (refl.type == ShaderParamType::Float) {
-				glUniform1f(refl.location, value.floatValue);
-			}
-			else if (refl.type == ShaderParamType::Float2) {
-				glUniform2f(refl.location, value.float2Value.x, value.float2Value.y);
-			}
-			else if (refl.type == ShaderParamType::Float3) {
-				glUniform3f(refl.location, value.float3Value.x, value.float3Value.y, value.float3Value.z);
-			}
-			else if (refl.type == ShaderParamType::Float4) {
-				glUniform4f(refl.location, value.float4Value.x, value.float4Value.y, value.float4Value.z, value.float4Value.w);
-			}
-			else if (refl.type == ShaderParamType::Int) {
-				glUniform1i(refl.location, value.intValue);
-			}
-			else if (refl.type == ShaderParamType::Int2) {
-				glUniform2i(refl.location, value.int2Value.x, value.int2Value.y);
-			}
-			else if (refl.type == ShaderParamType::Int3) {
-				glUniform3i(refl.location, value.int3Value.x, value.int3Value.y, value.int3Value.z);
-			}
-			else if (refl.type == ShaderParamType::Int4) {
-				glUniform4i(refl.location, value.int4Value.x, value.int4Value.y, value.int4Value.z, value.int4Value.w);
-			}
-			else if (refl.type == ShaderParamType::Image2d) {
-				CompiledImage& img = compiledImages[param.idx];
-				if (img.valid()) {
-					const GLint level = 0;
-					const GLenum layered = GL_FALSE;
-					glBindImageTexture(imgUnit, img.tex->texId, level, layered, 0, GL_READ_WRITE, img.tex->key.format);
-					glUniform1i(refl.location, imgUnit);
-					++imgUnit;
-				}
-			}
-			else if (refl.type == ShaderParamType::Sampler2d) {
-				CompiledImage& img = compiledImages[param.idx];
-				if (img.valid()) {
-					const GLint level = 0;
-					const GLenum layered = GL_FALSE;
-					glActiveTexture(GL_TEXTURE0 + texUnit);
-					glBindTexture(GL_TEXTURE_2D, img.tex->texId);
-					glUniform1i(refl.location, texUnit);
-
-					const GLuint samplerId = img.tex->samplerId;
-					glSamplerParameteri(samplerId, GL_TEXTURE_WRAP_S, value.textureValue.wrapS ? GL_REPEAT : GL_CLAMP_TO_EDGE);
-					glSamplerParameteri(samplerId, GL_TEXTURE_WRAP_T, value.textureValue.wrapT ? GL_REPEAT : GL_CLAMP_TO_EDGE);
-					glBindSampler(texUnit, samplerId);
-					++texUnit;
-				}
-			}
-			else if (refl.type == ShaderParamType::Buffer) {
-				CompiledBuffer& buf = compiledBuffers[param.idx];
-				if (buf.valid()) {
-					glBindBufferBase(GL_SHADER_STORAGE_BUFFER, refl.location, buf.buf->id);
-				}
-			}
-
-			// Upload hardcoded [texname]_size uniform; xy: resolution, zw: 1/resolution
-			if (refl.type == ShaderParamType::Image2d || refl.type == ShaderParamType::Sampler2d) {
-				CompiledImage& img = compiledImages[param.idx];
-				const GLint sizeLoc = glGetUniformLocation(shader->m_programHandle, (refl.name + "_size").c_str());
-				if (sizeLoc != -1) {
-					vec2 reso = vec2(img.tex->key.width, img.tex->key.height);
-					vec4 size = vec4(reso.x, reso.y, 1.f / reso.x, 1.f / reso.y);
-					glUniform4fv(sizeLoc, 1, &size.x);
-				}
-			}
-		}
-
-		GLint workGroupSize[3];
-		glGetProgramiv(shader->m_programHandle, GL_COMPUTE_WORK_GROUP_SIZE, workGroupSize);
-		glDispatchCompute(
-			(dispatchSize.x + workGroupSize[0] - 1) / workGroupSize[0],
-			(dispatchSize.y + workGroupSize[1] - 1) / workGroupSize[1],
-			1);
-	}
-};
-
-shared_ptr<CreatedTexture> createTransientTexture(const TextureDesc& desc, const TextureKey& key)
-{
-	auto existing = g_transientTextureCache.find(key);
-	if (existing != g_transientTextureCache.end()) {
-		auto res = existing->second;
-		g_transientTextureCache.erase(existing);
-		return res;
-	}
-	else {
-		return createTexture(desc, key);
-	}
-}
-
-shared_ptr<CreatedBuffer> createBuffer(const BufferDesc& desc, const BufferKey& key)
-{
-	GLuint id;
-	glGenBuffers(1, &id);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, id);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, key.sizeBytes, nullptr, GL_STATIC_COPY);
-	auto res = std::make_shared<CreatedBuffer>();
-	res->key = key;
-	res->id = id;
-	return res;
-}
-
-
-shared_ptr<CreatedBuffer> createTransientBuffer(const BufferDesc& desc, const BufferKey& key)
-{
-	auto existing = g_transientBufferCache.find(key);
-	if (existing != g_transientBufferCache.end()) {
-		auto res = existing->second;
-		g_transientBufferCache.erase(existing);
-		return res;
-	}
-	else {
-		return createBuffer(desc, key);
-	}
-}
-
-
-struct PassCompilerSettings
-{
-	ivec2 windowSize;
-};
-
-struct DeserializationContext
-{
-	std::unordered_map<int, nodegraph::node_handle> nodeMap;
-	std::unordered_map<u32, u32> uidMap;
-};
-
-const char* const getShaderParamTypeName(ShaderParamType type)
-{
-	switch (type) {
-	case ShaderParamType::Float: return "Float";
-	case ShaderParamType::Float2: return "Float2";
-	case ShaderParamType::Float3: return "Float3";
-	case ShaderParamType::Float4: return "Float4";
-	case ShaderParamType::Int: return "Int";
-	case ShaderParamType::Int2: return "Int2";
-	case ShaderParamType::Int3: return "Int3";
-	case ShaderParamType::Int4: return "Int4";
-	case ShaderParamType::Sampler2d: return "Sampler2d";
-	case ShaderParamType::Image2d: return "Image2d";
-	case ShaderParamType::Buffer: return "Buffer";
-	default: assert(false);
-	}
-
-	return "Unknown";
-}
-
-ShaderParamType parseShaderParamTypeName(const char* const str)
-{
-	if (0 == strcmp("Float", str)) return ShaderParamType::Float;
-	if (0 == strcmp("Float2", str)) return ShaderParamType::Float2;
-	if (0 == strcmp("Float3", str)) return ShaderParamType::Float3;
-	if (0 == strcmp("Float4", str)) return ShaderParamType::Float4;
-	if (0 == strcmp("Int", str)) return ShaderParamType::Int;
-	if (0 == strcmp("Int2", str)) return ShaderParamType::Int2;
-	if (0 == strcmp("Int3", str)) return ShaderParamType::Int3;
-	if (0 == strcmp("Int4", str)) return ShaderParamType::Int4;
-	if (0 == strcmp("Sampler2d", str)) return ShaderParamType::Sampler2d;
-	if (0 == strcmp("Image2d", str)) return ShaderParamType::Image2d;
-	if (0 == strcmp("Buffer", str)) return ShaderParamType::Buffer;
-	return ShaderParamType::Unknown;
-}
-
-void serializeShaderParamRefl(const ShaderParamRefl& refl, JsonWriter& writer)
-{
-	writer.String("name");
-	writer.String(refl.name.c_str());
-
-	writer.String("type");
-	writer.String(getShaderParamTypeName(refl.type));
-
-	if (!refl.annotation.empty()) {
-		writer.String("annotation");
-		writer.StartObject();
-		for (auto& annot : refl.annotation.items) {
-			writer.String(annot.first.c_str());
-			writer.String(annot.second.c_str());
-		}
-		writer.EndObject();
-	}
-}
-
-void writeVec(JsonWriter& writer, const vec2& v) {
-	writer.StartArray();
-	writer.Double(v.x);
-	writer.Double(v.y);
-	writer.EndArray();
-}
-
-void writeVec(JsonWriter& writer, const vec3& v) {
-	writer.StartArray();
-	writer.Double(v.x);
-	writer.Double(v.y);
-	writer.Double(v.z);
-	writer.EndArray();
-}
-
-void writeVec(JsonWriter& writer, const vec4& v) {
-	writer.StartArray();
-	writer.Double(v.x);
-	writer.Double(v.y);
-	writer.Double(v.z);
-	writer.Double(v.w);
-	writer.EndArray();
-}
-
-void writeVec(JsonWriter& writer, const ivec2& v) {
-	writer.StartArray();
-	writer.Int(v.x);
-	writer.Int(v.y);
-	writer.EndArray();
-}
-
-void writeVec(JsonWriter& writer, const ivec3& v) {
-	writer.StartArray();
-	writer.Int(v.x);
-	writer.Int(v.y);
-	writer.Int(v.z);
-	writer.EndArray();
-}
-
-void writeVec(JsonWriter& writer, const ivec4& v) {
-	writer.StartArray();
-	writer.Int(v.x);
-	writer.Int(v.y);
-	writer.Int(v.z);
-	writer.Int(v.w);
-	writer.EndArray();
-}
-
-void readVec(rapidjson::Value& json, vec2 *const result)
-{
-	auto& v = json.GetArray();
-	*result = vec2(v[0].GetFloat(), v[1].GetFloat());
-}
-
-void readVec(rapidjson::Value& json, vec3 *const result)
-{
-	auto& v = json.GetArray();
-	*result = vec3(v[0].GetFloat(), v[1].GetFloat(), v[2].GetFloat());
-}
-
-void readVec(rapidjson::Value& json, vec4 *const result)
-{
-	auto& v = json.GetArray();
-	*result = vec4(v[0].GetFloat(), v[1].GetFloat(), v[2].GetFloat(), v[3].GetFloat());
-}
-
-void readVec(rapidjson::Value& json, ivec2 *const result)
-{
-	auto& v = json.GetArray();
-	*result = ivec2(v[0].GetInt(), v[1].GetInt());
-}
-
-void readVec(rapidjson::Value& json, ivec3 *const result)
-{
-	auto& v = json.GetArray();
-	*result = ivec3(v[0].GetInt(), v[1].GetInt(), v[2].GetInt());
-}
-
-void readVec(rapidjson::Value& json, ivec4 *const result)
-{
-	auto& v = json.GetArray();
-	*result = ivec4(v[0].GetInt(), v[1].GetInt(), v[2].GetInt(), v[3].GetInt());
-}
-
-void writeTextureSize(const TextureSize& size, JsonWriter& writer)
-{
-	writer.String("useRelativeScale");
-	writer.Bool(size.useRelativeScale);
-
-	if (size.useRelativeScale) {
-		writer.String("scaleRelativeTo");
-		writer.String(size.scaleRelativeTo.c_str());
-
-		writer.String("relativeScale");
-		writeVec(writer, size.relativeScale);
-	}
-	else {
-		writer.String("resolution");
-		writeVec(writer, size.resolution);
-	}
-}
-
-void readTextureSize(rapidjson::Value& json, TextureSize *const result)
-{
-	if (true == (result->useRelativeScale = json["useRelativeScale"].GetBool())) {
-		result->scaleRelativeTo = json["scaleRelativeTo"].GetString();
-		readVec(json["relativeScale"], &result->relativeScale);
-	}
-	else {
-		readVec(json["resolution"], &result->resolution);
-	}
-}
-
-void serializeShaderParamValue(const ShaderParamValue& value, const ShaderParamRefl& refl, JsonWriter& writer)
-{
-	if (refl.type == ShaderParamType::Float) {
-		writer.Double(value.floatValue);
-	}
-	else if (refl.type == ShaderParamType::Float2) {
-		writeVec(writer, value.float2Value);
-	}
-	else if (refl.type == ShaderParamType::Float3) {
-		writeVec(writer, value.float3Value);
-	}
-	else if (refl.type == ShaderParamType::Float4) {
-		writeVec(writer, value.float4Value);
-	}
-	else if (refl.type == ShaderParamType::Int) {
-		writer.Int(value.intValue);
-	}
-	else if (refl.type == ShaderParamType::Int2) {
-		writeVec(writer, value.int2Value);
-	}
-	else if (refl.type == ShaderParamType::Int3) {
-		writeVec(writer, value.int3Value);
-	}
-	else if (refl.type == ShaderParamType::Int4) {
-		writeVec(writer, value.int4Value);
-	}
-	else if (refl.type == ShaderParamType::Image2d || refl.type == ShaderParamType::Sampler2d) {
-		writer.StartObject();
-		{
-			writer.String("source");
-
-			switch (value.textureValue.source) {
-			case TextureDesc::Source::Load: {
-				writer.String("Load");
-
-				writer.String("path");
-				writer.String(value.textureValue.path.c_str());
-				break;
-			}
-
-			case TextureDesc::Source::Create: {
-				writer.String("Create");
-				writeTextureSize(value.textureValue.size, writer);
-
-				writer.String("createFormat");
-				writer.String(textureFormatToString(value.textureValue.createFormat));
-				break;
-			}
-
-			case TextureDesc::Source::Input: {
-				writer.String("Input");
-				break;
-			}
-			}
-
-			if (refl.type == ShaderParamType::Sampler2d)
-			{
-				writer.String("wrapS");
-				writer.Bool(value.textureValue.wrapS);
-
-				writer.String("wrapT");
-				writer.Bool(value.textureValue.wrapT);
-			}
-		}
-		writer.EndObject();
-	}
-	else if (refl.type == ShaderParamType::Buffer) {
-		writer.StartObject();
-		{
-			writer.String("source");
-
-			switch (value.bufferValue.source) {
-				case BufferDesc::Source::Create: {
-					writer.String("Create");
-					writeTextureSize(value.bufferValue.size, writer);
-					break;
-				}
-
-				case BufferDesc::Source::Input: {
-					writer.String("Input");
-					break;
-				}
-			}
-		}
-		writer.EndObject();
-	}
-	else {
-		assert(false);
-		writer.StartObject();
-		writer.EndObject();
-	}
-}
-
-void deserializeShaderParamRefl(rapidjson::Value& json, ShaderParamRefl *const refl)
-{
-	refl->name = json["name"].GetString();
-	refl->type = parseShaderParamTypeName(json["type"].GetString());
-	assert(refl->type != ShaderParamType::Unknown);
-	// TODO(?): annotation
-}
-
-void deserializeShaderParamValue(rapidjson::Value& json, const ShaderParamRefl& refl, ShaderParamValue *const value)
-{
-	if (refl.type == ShaderParamType::Float) {
-		value->floatValue = json.GetFloat();
-	}
-	else if (refl.type == ShaderParamType::Float2) {
-		auto& v = json.GetArray();
-		value->float2Value = vec2(v[0].GetFloat(), v[1].GetFloat());
-	}
-	else if (refl.type == ShaderParamType::Float3) {
-		auto& v = json.GetArray();
-		value->float3Value = vec3(v[0].GetFloat(), v[1].GetFloat(), v[2].GetFloat());
-	}
-	else if (refl.type == ShaderParamType::Float4) {
-		auto& v = json.GetArray();
-		value->float4Value = vec4(v[0].GetFloat(), v[1].GetFloat(), v[2].GetFloat(), v[3].GetFloat());
-	}
-	else if (refl.type == ShaderParamType::Int) {
-		value->intValue = json.GetInt();
-	}
-	else if (refl.type == ShaderParamType::Int2) {
-		auto& v = json.GetArray();
-		value->int2Value = ivec2(v[0].GetInt(), v[1].GetInt());
-	}
-	else if (refl.type == ShaderParamType::Int3) {
-		auto& v = json.GetArray();
-		value->int3Value = ivec3(v[0].GetInt(), v[1].GetInt(), v[2].GetInt());
-	}
-	else if (refl.type == ShaderParamType::Int4) {
-		auto& v = json.GetArray();
-		value->int4Value = ivec4(v[0].GetInt(), v[1].GetInt(), v[2].GetInt(), v[3].GetInt());
-	}
-	else if (refl.type == ShaderParamType::Image2d || refl.type == ShaderParamType::Sampler2d) {
-		value->textureValue.source = TextureDesc::Source::Input;
-		if (0 == strcmp("Load", json["source"].GetString())) value->textureValue.source = TextureDesc::Source::Load;
-		else if (0 == strcmp("Create", json["source"].GetString())) value->textureValue.source = TextureDesc::Source::Create;
-
-		switch (value->textureValue.source) {
-		case TextureDesc::Source::Load: {
-			value->textureValue.path = json["path"].GetString();
-			break;
-		}
-
-		case TextureDesc::Source::Create: {
-			readTextureSize(json, &value->textureValue.size);
-			if (json.HasMember("createFormat")) {
-				parseTextureFormat(json["createFormat"].GetString(), &value->textureValue.createFormat);
-			}
-			break;
-		}
-
-		case TextureDesc::Source::Input: {
-			break;
-		}
-		}
-
-		if (refl.type == ShaderParamType::Sampler2d)
-		{
-			value->textureValue.source = TextureDesc::Source::Input;
-
-			if (0 == strcmp("Load", json["source"].GetString())) {
-				value->textureValue.source = TextureDesc::Source::Load;
-				value->textureValue.path = json["path"].GetString();
-			}
-
-			value->textureValue.wrapS = json["wrapS"].GetBool();
-			value->textureValue.wrapT = json["wrapT"].GetBool();
-		}
-	}
-	else if (refl.type == ShaderParamType::Buffer) {
-		value->bufferValue.source = BufferDesc::Source::Input;
-		if (0 == strcmp("Create", json["source"].GetString())) value->bufferValue.source = BufferDesc::Source::Create;
-
-		switch (value->bufferValue.source) {
-			case BufferDesc::Source::Create: {
-				readTextureSize(json, &value->bufferValue.size);
-				break;
-			}
-
-			case BufferDesc::Source::Input: {
-				break;
-			}
-		}
-	}
-}
-
-
-struct RenderPass
-{
-	virtual ~RenderPass() {}
-	virtual ShaderParamIterProxy params() = 0;
-	virtual bool compile(const PassCompilerSettings& settings, CompiledPass *const compiled) = 0;
-	virtual int findParamByPortUid(nodegraph::port_uid uid) const = 0;
-	virtual std::string getDisplayName() const = 0;
-	virtual bool canBeRemoved() const = 0;
-	virtual void serialize(JsonWriter& writer) = 0;
-	virtual void deserialize(rapidjson::Value& json, DeserializationContext& ctx) = 0;
-	virtual void findInvalidParamNameByUid(nodegraph::port_uid uid, std::string *const name) {}
-
-	static u32 nextParamUid() {
-		static u32 i = 0;
-		return ++i;
-	}
-
-protected:
-	void serializeParams(JsonWriter& writer)
-	{
-		auto serializeParam = [&writer](const ShaderParamProxy& param) {
-			writer.StartObject();
-			{
-				writer.String("refl");
-				writer.StartObject();
-				serializeShaderParamRefl(param.refl, writer);
-				writer.EndObject();
-
-				writer.String("value");
-				serializeShaderParamValue(param.value, param.refl, writer);
-
-				writer.String("uid");
-				writer.Int(param.uid);
-			}
-			writer.EndObject();
-		};
-
-		for (const auto& param : params()) {
-			serializeParam(param);
-		}
-	}
-};
-
-bool compileTextureSize(
-	const PassCompilerSettings& settings,
-	RenderPass& pass,	// TODO: should be const
-	const CompiledPass& compiledPass,
-	const TextureSize& size,
-	bool allowRelativeToCreated,
-	ivec2 *const res)
-{
-	*res = size.resolution;
-
-	if (size.useRelativeScale) {
-		if (size.scaleRelativeTo == "#window") {
-			res->x = s32(std::max(0.0f, size.relativeScale.x) * settings.windowSize.x);
-			res->y = s32(std::max(0.0f, size.relativeScale.y) * settings.windowSize.y);
-		}
-		else {
-			u32 otherParamIdx = 0;
-			for (const auto& param : pass.params()) {
-				if (param.refl.name == size.scaleRelativeTo) {
-					const bool isImage = param.refl.type == ShaderParamType::Sampler2d || param.refl.type == ShaderParamType::Image2d;
-					const bool isAllowedImage = isImage && (allowRelativeToCreated || param.value.textureValue.source != TextureDesc::Source::Create);
-
-					if (isAllowedImage) {
-						auto& otherImg = compiledPass.compiledImages[otherParamIdx].tex;
-						if (!otherImg) {
-							// TODO: report an error; a required input isn't these, thus we can't compile this graph
-							return false;
-						}
-						res->x = s32(std::max(0.0f, size.relativeScale.x) * otherImg->key.width);
-						res->y = s32(std::max(0.0f, size.relativeScale.y) * otherImg->key.height);
-					}
-					else {
-						// TODO: report an error. can only have scale relative to non-created textures
-					}
-				}
-
-				++otherParamIdx;
-			}
-		}
-	}
-
-	return true;
-}
-
-inline unsigned int textureFormatToGl(TextureFormat fmt) {
-	switch (fmt) {
-	case TextureFormat::rgba16f: return GL_RGBA16F;
-	case TextureFormat::r32ui: return GL_R32UI;
-	default: assert(false); return GL_RGBA16F;
-	}
-}
-
-// Create or load the image
-bool compileImage(const PassCompilerSettings& settings, RenderPass& pass, const TextureDesc& desc, CompiledImage *const compiled, const CompiledPass *const compiledPass)
-{
-	if (desc.source == TextureDesc::Source::Create) {
-		ivec2 imgSize;
-		if (!compileTextureSize(settings, pass, *compiledPass, desc.size, false, &imgSize)) {
-			return false;
-		}
-
-		TextureKey key = { 1, 1, textureFormatToGl(desc.createFormat) };
-
-		key.width = std::max(1, imgSize.x);
-		key.height = std::max(1, imgSize.y);
-
-		compiled->tex = createTransientTexture(desc, key);
-		compiled->owned = true;
-		compiled->clear = true;	// TODO: initial state handling
-	}
-	else if (desc.source == TextureDesc::Source::Load) {
-		compiled->tex = loadTexture(desc);
-	}
-
-	return true;
-}
-
-bool compileBuffer(const PassCompilerSettings& settings, RenderPass& pass, const BufferSize& sizeDesc, const BufferDesc& desc, CompiledBuffer *const compiled, const CompiledPass *const compiledPass)
-{
-	if (desc.source != BufferDesc::Source::Create) {
-		return true;
-	}
-
-	ivec2 bufSize;
-	if (!compileTextureSize(settings, pass, *compiledPass, desc.size, false, &bufSize)) {
-		return false;
-	}
-
-	BufferKey key = { bufSize.x * bufSize.y * sizeDesc.tailArrayStrideBytes + sizeDesc.baseSizeBytes };
-	key.sizeBytes = std::max(4u, key.sizeBytes);
-
-	compiled->buf = createTransientBuffer(desc, key);
-	compiled->owned = true;
-
-	return true;
-}
-
-struct OutputPass : RenderPass
-{
-	OutputPass()
-	{
-		ShaderParamBindingRefl param;
-		param.name = "image";
-		param.type = ShaderParamType::Sampler2d;
-		m_paramRefl.push_back(param);
-		ShaderParamValue value;
-		value.textureValue.source = TextureDesc::Source::Input;
-		m_paramValues.push_back(value);
-		m_paramUids.push_back(nextParamUid());
-	}
-
-	ShaderParamIterProxy params() override {
-		return ShaderParamIterProxy(m_paramRefl, m_paramValues, m_paramUids);
-	}
-
-	bool compile(const PassCompilerSettings& settings, CompiledPass *const compiled) override {
-		return compileImage(settings, *this, m_paramValues[0].textureValue, &compiled->compiledImages[0], compiled);
-	}
-
-	int findParamByPortUid(nodegraph::port_uid uid) const override {
-		assert(uid == m_paramUids[0]);
-		return 0;
-	}
-
-	std::string getDisplayName() const override {
-		return "Output";
-	}
-
-	bool canBeRemoved() const override {
-		return false;
-	}
-
-	void serialize(JsonWriter& writer) override
-	{
-		writer.String("type");
-		writer.String("Output");
-
-		writer.String("params");
-		writer.StartArray();
-		serializeParams(writer);
-		writer.EndArray();
-	}
-
-	void deserialize(rapidjson::Value& json, DeserializationContext& ctx) override
-	{
-		assert(0 == strcmp(json["type"].GetString(), "Output"));
-
-		m_paramRefl.clear();
-		m_paramValues.clear();
-		m_paramUids.clear();
-
-		auto& params = json["params"].GetArray();
-		m_paramRefl.resize(params.Size());
-		m_paramValues.resize(params.Size());
-		m_paramUids.resize(params.Size());
-
-		for (size_t i = 0; i < params.Size(); ++i) {
-			m_paramUids[i] = nextParamUid();
-			ctx.uidMap[params[i]["uid"].GetUint()] = m_paramUids[i];
-
-			deserializeShaderParamRefl(params[i]["refl"], &m_paramRefl[i]);
-			deserializeShaderParamValue(params[i]["value"], m_paramRefl[i], &m_paramValues[i]);
-		}
-	}
-
-
-private:
-	vector<ShaderParamBindingRefl> m_paramRefl;
-	vector<ShaderParamValue> m_paramValues;
-	vector<u32> m_paramUids;
-};
-
-struct ComputePass : RenderPass
-{
-	ComputePass() {}
-	ComputePass(const std::string& shaderPath)
-	{
-		m_computeShader = ComputeShader(shaderPath);
-		updateParams();
-
-		FileWatcher::watchFile(shaderPath.c_str(), [this]()
-		{
-			if (m_computeShader.reload()) {
-				updateParams();
-			}
-		});
-	}
-
-	~ComputePass() {
-		FileWatcher::stopWatchingFile(m_computeShader.m_sourceFile.c_str());
-	}
-
-	ShaderParamIterProxy params() override {
-		return ShaderParamIterProxy(m_computeShader.m_params, m_paramValues, m_paramUids);
-	}
-
-	const ComputeShader& shader() const {
-		return m_computeShader;
-	}
- 
-	bool compile(const PassCompilerSettings& settings, CompiledPass *const compiled) override
-	{
-		compiled->shader = &m_computeShader;
-		compiled->params = params();
-		compiled->paramLocations.resize(m_paramRefl.size());
-
-		// Compile Loaded images first, so that we can have Created images relative to their dimensions
-		for (size_t i = 0; i < m_paramRefl.size(); ++i) {
-			const bool isTexture = m_paramRefl[i].type == ShaderParamType::Image2d || m_paramRefl[i].type == ShaderParamType::Sampler2d;
-			if (isTexture && m_paramValues[i].textureValue.source == TextureDesc::Source::Load) {
-				if (!compileImage(settings, *this, m_paramValues[i].textureValue, &compiled->compiledImages[i], nullptr)) {
-					return false;
-				}
-			}
-		}
-
-		for (size_t i = 0; i < m_paramRefl.size(); ++i) {
-			const GLint loc = glGetUniformLocation(m_computeShader.m_programHandle, m_paramRefl[i].name.c_str());
-			compiled->paramLocations[i] = loc;
-
-			if (m_paramRefl[i].type == ShaderParamType::Image2d && m_paramValues[i].textureValue.source != TextureDesc::Source::Load) {
-				if (!compileImage(settings, *this, m_paramValues[i].textureValue, &compiled->compiledImages[i], compiled)) {
-					return false;
-				}
-			}
-
-			if (m_paramRefl[i].type == ShaderParamType::Buffer) {
-				if (!compileBuffer(settings, *this, m_paramRefl[i].bufferSize, m_paramValues[i].bufferValue, &compiled->compiledBuffers[i], compiled)) {
-					return false;
-				}
-			}
-		}
-
-		return true;
-	}
-
-	int findParamByPortUid(nodegraph::port_uid uid) const override
-	{
-		for (int i = 0; i < int(m_paramUids.size()); ++i) {
-			if (m_paramUids[i] == uid) {
-				return i;
-			}
-		}
-
-		return -1;
-	}
-
-	std::string getDisplayName() const override
-	{
-		std::string filename = fs::path(m_computeShader.m_sourceFile).filename().string();
-		return filename.substr(0, filename.find_last_of("."));
-	}
-
-	bool canBeRemoved() const override {
-		return true;
-	}
-
-	void serialize(JsonWriter& writer) override
-	{
-		writer.String("type");
-		writer.String("Compute");
-
-		writer.String("shader");
-		writer.String(m_computeShader.m_sourceFile.c_str());
-
-		writer.String("params");
-		writer.StartArray();
-		serializeParams(writer);
-		writer.EndArray();
-
-		writer.String("dispatch");
-		writer.StartObject();
-		writeTextureSize(m_dispatchSize, writer);
-		writer.EndObject();
-	}
-
-	void deserialize(rapidjson::Value& json, DeserializationContext& ctx) override
-	{
-		assert(0 == strcmp(json["type"].GetString(), "Compute"));
-		deserializeParams(json["params"], ctx);
-
-		m_computeShader = ComputeShader(json["shader"].GetString());
-		updateParams();
-
-		FileWatcher::watchFile(m_computeShader.m_sourceFile.c_str(), [this]()
-		{
-			if (m_computeShader.reload()) {
-				updateParams();
-			}
-		});
-
-		if (json.HasMember("dispatch")) {
-			readTextureSize(json["dispatch"], &m_dispatchSize);
-		}
-	}
-
-	void findInvalidParamNameByUid(nodegraph::port_uid uid, std::string *const name) override
-	{
-		for (auto& param : m_prevParams) {
-			if (param.uid == uid) {
-				*name = param.refl.name;
-				return;
-			}
-		}
-	}
-
-
-	TextureSize m_dispatchSize;
-
-private:
-	void deserializeParams(rapidjson::Value& json, DeserializationContext& ctx)
-	{
-		auto& params = json.GetArray();
-		m_prevParams.resize(params.Size());
-
-		for (size_t i = 0; i < params.Size(); ++i) {
-			PrevShaderParam& param = m_prevParams[i];
-			param.uid = nextParamUid();
-			ctx.uidMap[params[i]["uid"].GetUint()] = param.uid;
-
-			deserializeShaderParamRefl(params[i]["refl"], &param.refl);
-			deserializeShaderParamValue(params[i]["value"], param.refl, &param.value);
-		}
-	}
-
-	void updateParams() {
-		vector<ShaderParamValue> newValues(m_computeShader.m_params.size());
-		vector<u32> newUids(m_computeShader.m_params.size());
-
-		for (size_t i = 0; i < newValues.size(); ++i) {
-			ShaderParamBindingRefl& newRefl = m_computeShader.m_params[i];
-			ShaderParamValue& newValue = newValues[i];
-			u32& newUid = newUids[i];
-
-			auto curMatch = std::find_if(m_paramRefl.begin(), m_paramRefl.end(), [&](auto& p) { return p.name == newRefl.name; });
-			if (curMatch != m_paramRefl.end()) {
-				if (curMatch->type == newRefl.type) {
-					// Found a value for the new field in the current array
-					const size_t src = std::distance(m_paramRefl.begin(), curMatch);
-					newValue = m_paramValues[src];
-					newUid = m_paramUids[src];
-				} else {
-					// Otherwise we found the param by name, but the type changed. Use the default.
-					newValue = m_computeShader.m_params[i].defaultValue();
-					newUid = nextParamUid();
-				}
-
-				// Drop the saved param since we have a new entry for it. We'll nuke params with empty names.
-				curMatch->name.clear();
-			} else {
-				// No match in current params, but maybe we have a match in the m_prevParams array.
-
-				auto prevMatch = std::find_if(m_prevParams.begin(), m_prevParams.end(), [&](auto& p) { return p.refl.name == newRefl.name; });
-				if (prevMatch != m_prevParams.end()) {
-					// Got a match in old params
-					if (prevMatch->refl.type == newRefl.type) {
-						// Type matches, let's go with it
-						newValue = prevMatch->value;
-						newUid = prevMatch->uid;
-					} else {
-						// Otherwise we have found an old param, but its type is now different. Use the default.
-						newValue = m_computeShader.m_params[i].defaultValue();
-						newUid = nextParamUid();
-					}
-
-					// Drop the old param
-					prevMatch->refl.name.clear();
-				} else {
-					// No match found anywhere. Just go with the default.
-					newValue = m_computeShader.m_params[i].defaultValue();
-					newUid = nextParamUid();
-				}
-			}
-		}
-
-		// Nuke old and current params that we've matched up to the new shader
-		m_prevParams.erase(
-			std::remove_if(m_prevParams.begin(), m_prevParams.end(), [](const auto& p) { return p.refl.name.empty(); }),
-			m_prevParams.end()
-		);
-
-		// All params from the previous shader version that we didn't find in the current one
-		// go to the m_prevParams array, so that we can restore old values upon further shader modifications.
-		for (size_t i = 0; i < m_paramRefl.size(); ++i) {
-			if (!m_paramRefl[i].name.empty()) {
-				m_prevParams.push_back({ m_paramRefl[i], m_paramValues[i], m_paramUids[i] });
-			}
-		}
-
-		newValues.swap(m_paramValues);
-		newUids.swap(m_paramUids);
-		m_paramRefl.resize(m_computeShader.m_params.size());
-
-		for (size_t i = 0; i < m_paramRefl.size(); ++i) {
-			m_paramRefl[i] = m_computeShader.m_params[i];
-		}
-	}
-
-	ComputeShader m_computeShader;
-	vector<ShaderParamValue> m_paramValues;
-	vector<u32> m_paramUids;
-
-	// Kept around for preserving previous values across shader reload and shader modifications
-	vector<ShaderParamRefl> m_paramRefl;
-	struct PrevShaderParam {
-		ShaderParamRefl refl;
-		ShaderParamValue value;
-		u32 uid;
-	};
-	vector<PrevShaderParam> m_prevParams;
-};
-
-bool needsOutputPort(const ShaderParamProxy& param)
-{
-	if (param.refl.type == ShaderParamType::Image2d) {
-		return param.value.textureValue.source == TextureDesc::Source::Create;
-	}
-	else if (param.refl.type == ShaderParamType::Buffer) {
-		return param.value.bufferValue.source == BufferDesc::Source::Create;
-	}
-	else {
-		return false;
-	}	
-}
-
-bool needsInputPort(const ShaderParamProxy& param)
-{
-	if (param.refl.type == ShaderParamType::Image2d || param.refl.type == ShaderParamType::Sampler2d) {
-		return param.value.textureValue.source == TextureDesc::Source::Input;
-	}
-	else if (param.refl.type == ShaderParamType::Buffer) {
-		return param.value.bufferValue.source == BufferDesc::Source::Input;
-	}
-	else {
-		return false;
-	}
-}
-
-void serializeGraph(nodegraph::Graph& graph, JsonWriter& writer)
-{
-	writer.String("nodes");
-	writer.StartArray();
-
-	graph.iterNodes([&](nodegraph::node_handle nodeHandle) {
-		writer.StartObject();
-
-		writer.String("idx");
-		writer.Int(nodeHandle.idx);
-
-		writer.String("inputs");
-		writer.StartArray();
-		graph.iterNodeInputPorts(nodeHandle, [&](nodegraph::port_handle portHandle) {
-			writer.StartObject();
-
-			writer.String("idx");
-			writer.Int(portHandle.idx);
-
-			const nodegraph::Port& port = graph.ports[portHandle.idx];
-			writer.String("uid");
-			writer.Int(port.uid);
-
-			if (port.link != nodegraph::invalid_link_idx) {
-				writer.String("src");
-				writer.Int(graph.links[port.link].srcPort);
-			}
-
-			writer.EndObject();
-		});
-		writer.EndArray();
-
-		writer.String("outputs");
-		writer.StartArray();
-		graph.iterNodeOutputPorts(nodeHandle, [&](nodegraph::port_handle portHandle) {
-			writer.StartObject();
-
-			writer.String("idx");
-			writer.Int(portHandle.idx);
-
-			const nodegraph::Port& port = graph.ports[portHandle.idx];
-			writer.String("uid");
-			writer.Int(port.uid);
-
-			writer.EndObject();
-		});
-		writer.EndArray();
-
-		writer.EndObject();
-	});
-
-	writer.EndArray();
-}
-
-void deserializeGraph(nodegraph::Graph *const graph, const rapidjson::Value& json, DeserializationContext& ctx)
-{
-	auto& nodes = json["nodes"].GetArray();
-	std::unordered_map<int, nodegraph::port_handle> portMap;
-
-	auto mapUid = [&](u32 uid, u32* mapped) {
-		auto found = ctx.uidMap.find(uid);
-		if (found != ctx.uidMap.end()) {
-			*mapped = found->second;
-			return true;
-		} else {
-			return false;
-		}
-	};
-
-	for (size_t i = 0; i < nodes.Size(); ++i) {
-		auto& node = nodes[i];
-		auto foundNode = ctx.nodeMap.find(node["idx"].GetInt());
-		if (foundNode == ctx.nodeMap.end()) {
-			continue;
-		}
-
-		const nodegraph::node_handle nodeHandle = foundNode->second;
-
-		auto& inputs = node["inputs"].GetArray();
-		for (size_t j = 0; j < inputs.Size(); ++j) {
-			auto& port = inputs[j];
-			u32 uid;
-			if (mapUid(port["uid"].GetInt(), &uid)) {
-				nodegraph::port_handle portHandle = graph->addPort(nodeHandle.idx, uid);
-				graph->addInputPortToNode(graph->nodes[nodeHandle.idx], portHandle.idx);
-				portMap[port["idx"].GetInt()] = portHandle;
-			}
-		}
-
-		auto& outputs = node["outputs"].GetArray();
-		for (size_t j = 0; j < outputs.Size(); ++j) {
-			auto& port = outputs[j];
-			u32 uid;
-			if (mapUid(port["uid"].GetInt(), &uid)) {
-				nodegraph::port_handle portHandle = graph->addPort(nodeHandle.idx, uid);
-				graph->addOutputPortToNode(graph->nodes[nodeHandle.idx], portHandle.idx);
-				portMap[port["idx"].GetInt()] = portHandle;
-			}
-		}
-	}
-
-	for (size_t i = 0; i < nodes.Size(); ++i) {
-		auto& node = nodes[i];
-		auto foundNode = ctx.nodeMap.find(node["idx"].GetInt());
-		if (foundNode == ctx.nodeMap.end()) {
-			continue;
-		}
-
-		const nodegraph::node_handle nodeHandle = foundNode->second;
-
-		auto& inputs = node["inputs"].GetArray();
-		for (size_t j = 0; j < inputs.Size(); ++j) {
-			auto& port = inputs[j];
-
-			if (!port.HasMember("src")) {
-				continue;
-			}
-
-			auto src = portMap.find(port["src"].GetInt());
-			if (src == portMap.end()) {
-				continue;
-			}
-
-			auto dst = portMap.find(port["idx"].GetInt());
-			if (dst == portMap.end()) {
-				continue;
-			}
-
-			graph->addLink(src->second.idx, dst->second.idx);
-		}
-	}
-}
-
-struct CompiledPackage
-{
-	vector<CompiledPass> orderedPasses;
-	shared_ptr<CreatedTexture> outputTexture;
-};
-
-struct Package
-{
-	vector<shared_ptr<RenderPass>> m_passes;
-	nodegraph::Graph graph;
-
-	nodegraph::node_handle addOutputPass() {
-		return addPass(make_shared<OutputPass>());
-	}
-
-	void deletePass(u32 passIndex) {
-		m_passes[passIndex] = nullptr;
-	}
-
-	void getNodeDesc(RenderPass& pass, nodegraph::NodeDesc *const desc)
-	{
-		desc->inputs.clear();
-		desc->outputs.clear();
-
-		for (auto& p : pass.params()) {
-			if (needsInputPort(p)) {
-				desc->inputs.push_back(p.uid);
-			} else if (needsOutputPort(p)) {
-				desc->outputs.push_back(p.uid);
-			}
-		}
-	}
+std::shared_ptr<RenderPass> g_editedPass = nullptr;
 
-	void updateGraph()
-	{
-		graph.iterNodes([&](nodegraph::node_handle nodeHandle)
-		{
-			RenderPass& pass = *m_passes[nodeHandle.idx];
-			nodegraph::NodeDesc desc;
-			getNodeDesc(pass, &desc);
-			graph.updateNode(nodeHandle, desc);
-		});
-	}
 
-	void handleFileDrop(const std::string& path)
-	{
-		if (ends_with(path, ".glsl")) {
-			addPass(make_shared<ComputePass>(path));
-		}
-	}
+struct Project
+{
+	vector<shared_ptr<Package>> m_packages;
 
-	nodegraph::node_handle getOutputPass()
-	{
-		nodegraph::node_handle result;
+	// Splits compute dispatches into tiles of this many pixels on each side; zero disables tiling.
+	// Used for huge outputs, where a single dispatch could trip the driver's watchdog.
+	int m_dispatchTileSize = 0;
 
-		graph.iterNodes([&](nodegraph::node_handle nodeHandle) {
-			if (graph.nodes[nodeHandle.idx].firstOutputPort == nodegraph::invalid_port_idx) {
-				result = nodeHandle;
-			}
-		});
+	// Renders the graph this many pixels of the output at a time, with intermediate images only as large as each tile
+	// needs; zero disables it. For outputs too big to keep whole intermediates of in memory.
+	int m_graphTileSize = 0;
 
-		return result;
-	}
+	// Caps the resolution of Loaded images to save memory and load time; zero disables the cap
+	int m_maxTextureSize = 0;
 
-	void findPassOrder(nodegraph::node_handle outputPass, vector<nodegraph::node_idx> *const order)
+	void handleFileDrop(const std::string& path)
 	{
-		vector<bool> enqueued(graph.nodes.size(), false);	// has it been added to the 'order' list yet?
-		vector<bool> visited(graph.nodes.size(), false);	// has it been visited yet?
-
-		std::vector<std::pair<nodegraph::node_idx, bool>> nodeStack;
-		nodeStack.push_back({outputPass.idx, false});
-
-		while (!nodeStack.empty()) {
-			auto top = nodeStack.back();
-			nodegraph::node_idx nodeIdx = top.first;
-			nodeStack.pop_back();
-
-			if (!top.second) {
-				if (!visited[nodeIdx]) {
-					// Push it into the stack again, so that we process it after
-					// its incident subgraph has been visited.
-					nodeStack.push_back({ nodeIdx, true });
-					visited[nodeIdx] = true;
-
-					// TODO: only follow valid links, return error if not all ports are connected
-					graph.iterNodeIncidentLinks(nodeIdx, [&](nodegraph::link_handle linkHandle) {
-						nodegraph::node_idx srcNode = graph.ports[graph.links[linkHandle.idx].srcPort].node;
-						nodeStack.push_back({ srcNode, false });
-					});
-				}
-			} else {
-				if (!enqueued[nodeIdx]) {
-					order->push_back(nodeIdx);
-					enqueued[nodeIdx] = true;
-				}
-			}
-		}
-	}
-
-	bool compile(const PassCompilerSettings& settings, CompiledPackage *const compiled) {
-		u32 alivePassCount = 0;
-		graph.iterNodes([&](nodegraph::node_handle) {
-			++alivePassCount;
-		});
-
-		compiled->orderedPasses.clear();
-
-		// Find the output pass
-		nodegraph::node_handle outputPass = getOutputPass();
-		if (!outputPass.valid()) {
-			return false;
-		}
-
-		// Perform a topological sort, and identify the order to run passes in
-		vector<nodegraph::node_idx> passOrder;
-		findPassOrder(outputPass, &passOrder);
-
-		compiled->orderedPasses.resize(passOrder.size());
-		vector<CompiledPass*> passToCompiledPass(m_passes.size(), nullptr);
-
-		// Compile passes, create and load textures
-		u32 compiledPassIdx = 0;
-		for (const nodegraph::node_idx nodeIdx : passOrder) {
-			RenderPass& dstPass = *m_passes[nodeIdx];
-			CompiledPass& dstCompiled = compiled->orderedPasses[compiledPassIdx++];
-			passToCompiledPass[nodeIdx] = &dstCompiled;
-
-			dstCompiled.compiledImages.clear();
-			dstCompiled.compiledBuffers.clear();
-
-			dstCompiled.compiledImages.resize(dstPass.params().size());
-			dstCompiled.compiledBuffers.resize(dstPass.params().size());
-
-			bool allInputsBound = true;
-
-			// Propagate texture inputs
-			graph.iterNodeInputPorts(nodeIdx, [&](nodegraph::port_handle portHandle) {
-				const nodegraph::Port& dstPort = graph.ports[portHandle.idx];
-				const int dstParamIdx = dstPass.findParamByPortUid(dstPort.uid);
-
-				// Only care if this is a valid port
-				if (dstParamIdx != -1)
-				{
-					if (dstPort.link != nodegraph::invalid_link_idx) {
-						const nodegraph::Link& link = graph.links[dstPort.link];
-						RenderPass& srcPass = *m_passes[graph.ports[link.srcPort].node];
-						CompiledPass& srcCompiled = *passToCompiledPass[graph.ports[link.srcPort].node];
-
-						const nodegraph::Port& srcPort = graph.ports[link.srcPort];
-						const int srcParamIdx = srcPass.findParamByPortUid(srcPort.uid);
-
-						if (srcParamIdx != -1) {
-							dstCompiled.compiledImages[dstParamIdx].tex = srcCompiled.compiledImages[srcParamIdx].tex;
-							dstCompiled.compiledBuffers[dstParamIdx].buf = srcCompiled.compiledBuffers[srcParamIdx].buf;
-						} else {
-							allInputsBound = false;
-						}
-					} else {
-						allInputsBound = false;
-					}
-				}
-			});
-
-			if (!allInputsBound || !dstPass.compile(settings, &dstCompiled)) {
-				return false;
-			}
-		}
-
-		compiled->outputTexture = nullptr;
-		for (auto& img : passToCompiledPass[outputPass.idx]->compiledImages) {
-			if (img.valid()) {
-				compiled->outputTexture = img.tex;
-				break;
-			}
-		}
-
-		// Find dispatch size for compute passes
-		for (const nodegraph::node_idx nodeIdx : passOrder) {
-			RenderPass& renderPass = *m_passes[nodeIdx];
-			ComputePass *const computePass = dynamic_cast<ComputePass*>(&renderPass);
-			if (!computePass) {
-				continue;
-			}
-
-			CompiledPass& compiled = *passToCompiledPass[nodeIdx];
-
-			if (computePass->shader().m_hasDefaultDispatchSize) {
-				computePass->m_dispatchSize = computePass->shader().m_defaultDispatchSize;
-			}
-
-			if (!compileTextureSize(settings, renderPass, compiled, computePass->m_dispatchSize, true, &compiled.dispatchSize)) {
-				return false;
-			}
-		}
-
-		return true;
+		m_packages.back()->handleFileDrop(path);
 	}
+};
 
-	void serialize(JsonWriter& writer)
-	{
-		writer.String("passes");
-		writer.StartArray();
-		graph.iterNodes([&](nodegraph::node_handle nodeHandle){
-			writer.StartObject();
-
-			writer.String("idx");
-			writer.Int(nodeHandle.idx);
-
-			m_passes[nodeHandle.idx]->serialize(writer);
-
-			writer.EndObject();
-		});
-		writer.EndArray();
-
-		writer.String("graph");
-		writer.StartObject();
-		serializeGraph(graph, writer);
-		writer.EndObject();
-	}
+Project g_project;
 
-	void reset()
-	{
-		resetNodeGraphGui(graph);
-		graph = nodegraph::Graph();
-		m_passes.clear();
+void doTextureLoadUi(ShaderParamValue& value, bool forcePickFile)
+{
+	if (ImGui::Button("Browse...") || forcePickFile) {
+		openFileDialog(
+			"Select an image",
+			"Image Files\0*.bmp;*.cut;*.dds;*.ktx;*.exr;*.g3;*.gif;*.hdr;*.ico;*.iff;*.lbm;*.j2k;*.j2c;*.jng;*.jp2;*.jpg;*.jif;*.jpeg;*.jpe;*.jxr;*.wdp;*.hdp;*.koa;*.mng;*.pcd;*.pcx;*.pfm;*.pct;*.pict;*.pic;*.png;*.pbm;*.pgm;*.ppm;*.psd;*.ras;*.sgi;*.rgb;*.rgba;*.bw;*.tga;*.targa;*.tif;*.tiff;*.wap;*.wbmp;*.wbm;*.webp;*.xbm;*.xpm;*.bmp\0",
+			&value.textureValue.path);
 	}
 
-	nodegraph::node_handle deserializeNode(rapidjson::Value& json, DeserializationContext& ctx)
-	{
-		shared_ptr<RenderPass> pass;
-		const char* const nodeType = json["type"].GetString();
-
-		if (0 == strcmp(nodeType, "Output")) {
-			pass = make_shared<OutputPass>();
-		} else if (0 == strcmp(nodeType, "Compute")) {
-			pass = make_shared<ComputePass>();
-		} else {
-			assert(false);
-		}
-
-		pass->deserialize(json, ctx);
-
-		return addPass(pass);
+	if (ends_with(to_lower(value.textureValue.path), ".exr")) {
+		ImGui::SameLine();
+		ImGui::PushID("exrPart");
+		ImGui::PushItemWidth(80);
+		int part = int(value.textureValue.exrPart);
+		ImGui::InputInt("part", &part);
+		value.textureValue.exrPart = u32(std::max(0, part));
+		ImGui::PopItemWidth();
+		ImGui::PopID();
 	}
 
-	void deserialize(rapidjson::Document& doc, DeserializationContext& ctx)
-	{
-		auto& passArray = doc["passes"];
-		const size_t passCount = passArray.Size();
-
-		for (size_t i = 0; i < passCount; ++i ) {
-			auto& node = passArray[i];
-			const int idx = node["idx"].GetInt();
-
-			nodegraph::node_handle nodeHandle = deserializeNode(node, ctx);
-			ctx.nodeMap[idx] = nodeHandle;
-		}
-	
-		deserializeGraph(&graph, doc["graph"], ctx);
-	}
+	ImGui::SameLine();
+	ImGui::Text(value.textureValue.path.c_str());
+}
 
-private:
+// Picking any frame of a sequence finds the rest of the range on disk
+void doTextureSequenceUi(ShaderParamValue& value, bool forcePickFile)
+{
+	TextureDesc& desc = value.textureValue;
 
-	nodegraph::node_handle addPass(shared_ptr<RenderPass> pass)
-	{
-		nodegraph::NodeDesc desc;
-		//getNodeDesc(*pass, &desc);
-		nodegraph::node_handle nodeHandle = graph.addNode(desc);
+	if (ImGui::Button("Browse...") || forcePickFile) {
+		std::string framePath;
+		const bool picked = openFileDialog(
+			"Select a frame",
+			"Image Files\0*.bmp;*.exr;*.gif;*.hdr;*.j2k;*.jp2;*.jpg;*.jpeg;*.jxr;*.pfm;*.png;*.psd;*.tga;*.tif;*.tiff;*.webp\0",
+			&framePath);
 
-		if (m_passes.size() == nodeHandle.idx) {
-			m_passes.emplace_back(pass);
-		}
-		else {
-			m_passes[nodeHandle.idx] = pass;
+		if (picked && !detectImageSequence(framePath, &desc.path, &desc.firstFrame, &desc.lastFrame)) {
+			fprintf(stderr, "No frame number in %s\n", framePath.c_str());
 		}
-
-		return nodeHandle;
 	}
-};
 
-struct Project
-{
-	vector<shared_ptr<Package>> m_packages;
+	ImGui::SameLine();
+	ImGui::PushID("frames");
+	ImGui::PushItemWidth(120);
+	int frames[2] = { int(desc.firstFrame), int(desc.lastFrame) };
+	ImGui::InputInt2("frames", frames);
+	desc.firstFrame = u32(std::max(0, frames[0]));
+	desc.lastFrame = u32(std::max(frames[0], frames[1]));
+	ImGui::PopItemWidth();
+	ImGui::PopID();
 
-	void handleFileDrop(const std::string& path)
-	{
-		m_packages.back()->handleFileDrop(path);
+	ImGui::SameLine();
+	ImGui::PushID("frameRate");
+	ImGui::PushItemWidth(60);
+	ImGui::InputFloat("fps", &desc.frameRate);
+	desc.frameRate = std::max(1.0f, desc.frameRate);
+	ImGui::PopItemWidth();
+	ImGui::PopID();
+
+	if (const ImageSequence* const seq = findOpenImageSequence(desc)) {
+		ImGui::SameLine();
+		ImGui::Text("%u underruns", seq->underrunCount());
 	}
-};
 
-Project g_project;
+	ImGui::SameLine();
+	ImGui::Text(desc.path.c_str());
+}
 
-void doTextureLoadUi(ShaderParamValue& value, bool forcePickFile)
+// Pick the Created image whose previous frame is read by a History param
+void doTextureHistoryUi(ShaderParamValue& value, RenderPass& pass)
 {
-	if (ImGui::Button("Browse...") || forcePickFile) {
-		openFileDialog(
-			"Select an image",
-			"Image Files\0*.bmp;*.cut;*.dds;*.ktx;*.exr;*.g3;*.gif;*.hdr;*.ico;*.iff;*.lbm;*.j2k;*.j2c;*.jng;*.jp2;*.jpg;*.jif;*.jpeg;*.jpe;*.jxr;*.wdp;*.hdp;*.koa;*.mng;*.pcd;*.pcx;*.pfm;*.pct;*.pict;*.pic;*.png;*.pbm;*.pgm;*.ppm;*.psd;*.ras;*.sgi;*.rgb;*.rgba;*.bw;*.tga;*.targa;*.tif;*.tiff;*.wap;*.wbmp;*.wbm;*.webp;*.xbm;*.xpm;*.bmp\0",
-			&value.textureValue.path);
+	static vector<const char*> createdNames;
+	createdNames.clear();
+
+	int createdIdx = -1;
+	for (auto& otherParam : pass.params()) {
+		if (otherParam.refl.type == ShaderParamType::Image2d && otherParam.value.textureValue.source == TextureDesc::Source::Create) {
+			if (otherParam.refl.name == value.textureValue.historyOf) {
+				createdIdx = int(createdNames.size());
+			}
+			createdNames.push_back(otherParam.refl.name.c_str());
+		}
 	}
 
-	ImGui::SameLine();
-	ImGui::Text(value.textureValue.path.c_str());
+	ImGui::PushID("historyOf");
+	ImGui::PushItemWidth(150);
+	if (ImGui::Combo("", &createdIdx, createdNames.data(), createdNames.size()) && createdIdx != -1) {
+		value.textureValue.historyOf = createdNames[createdIdx];
+	}
+	ImGui::PopID();
 }
 
 void doTextureSizeGui(TextureSize *const size, RenderPass& pass, bool allowRelativeToCreated)
@@ -1613,7 +174,8 @@ void doTextureSizeGui(TextureSize *const size, RenderPass& pass, bool allowRelat
 
 		for (auto& otherParam : pass.params()) {
 			const bool isTexture = otherParam.refl.type == ShaderParamType::Image2d || otherParam.refl.type == ShaderParamType::Sampler2d;
-			if (isTexture && (otherParam.value.textureValue.source != TextureDesc::Source::Create || allowRelativeToCreated)) {
+			const bool isCreated = otherParam.value.textureValue.source == TextureDesc::Source::Create || otherParam.value.textureValue.source == TextureDesc::Source::History;
+			if (isTexture && (!isCreated || allowRelativeToCreated)) {
 				if (otherParam.refl.name == size->scaleRelativeTo) {
 					targetIdx = int(targetNames.size());
 				}
@@ -1691,16 +253,26 @@ void doPassParamUi(ShaderParamProxy& param, ComputePass& pass)
 		ImGui::SliderInt4("", &value.int4Value.x, refl.annotation.get("min", 0), refl.annotation.get("max", 16));
 	}
 	else if (refl.type == ShaderParamType::Sampler2d) {
-		int sourceIdx = TextureDesc::Source::Load == value.textureValue.source ? 0 : 1;
+		const TextureDesc::Source sourceValues[] = {
+			TextureDesc::Source::Load,
+			TextureDesc::Source::Input,
+			TextureDesc::Source::History,
+			TextureDesc::Source::Tiled,
+			TextureDesc::Source::Sequence,
+		};
 		const char* const sources[] = {
 			"Load",
 			"Input",
+			"History",
+			"Tiled",
+			"Sequence",
 		};
+		int sourceIdx = int(std::find(std::begin(sourceValues), std::end(sourceValues), value.textureValue.source) - std::begin(sourceValues));
 		ImGui::PushID("source");
 		ImGui::PushItemWidth(100);
 		bool sourceJustSelected = ImGui::Combo("", &sourceIdx, sources, sizeof(sources) / sizeof(*sources));
 		ImGui::PopID();
-		value.textureValue.source = 0 == sourceIdx ? TextureDesc::Source::Load : TextureDesc::Source::Input;
+		value.textureValue.source = sourceValues[sourceIdx];
 
 		ImGui::SameLine();
 
@@ -1733,9 +305,26 @@ void doPassParamUi(ShaderParamProxy& param, ComputePass& pass)
 		}
 
 		if (TextureDesc::Source::Load == value.textureValue.source) {
+			ImGui::SameLine();
+			bool compress = value.textureValue.compress;
+			ImGui::Checkbox("Compress", &compress);
+			value.textureValue.compress = compress;
+
+			ImGui::SameLine();
+			doTextureLoadUi(value, sourceJustSelected);
+		}
+		else if (TextureDesc::Source::Tiled == value.textureValue.source) {
 			ImGui::SameLine();
 			doTextureLoadUi(value, sourceJustSelected);
 		}
+		else if (TextureDesc::Source::Sequence == value.textureValue.source) {
+			ImGui::SameLine();
+			doTextureSequenceUi(value, sourceJustSelected);
+		}
+		else if (TextureDesc::Source::History == value.textureValue.source) {
+			ImGui::SameLine();
+			doTextureHistoryUi(value, pass);
+		}
 	}
 	else if (refl.type == ShaderParamType::Image2d) {
 		ImGui::BeginGroup();
@@ -1744,6 +333,7 @@ void doPassParamUi(ShaderParamProxy& param, ComputePass& pass)
 			"Load",
 			"Create",
 			"Input",
+			"History",
 		};
 		ImGui::PushID("source");
 		ImGui::PushItemWidth(100);
@@ -1774,6 +364,10 @@ void doPassParamUi(ShaderParamProxy& param, ComputePass& pass)
 			ImGui::SameLine();
 			doTextureSizeGui(&value.textureValue.size, pass);
 		}
+		else if (TextureDesc::Source::History == value.textureValue.source) {
+			ImGui::SameLine();
+			doTextureHistoryUi(value, pass);
+		}
 
 		ImGui::EndGroup();
 	}
@@ -1817,7 +411,13 @@ void doPassUi(ComputePass& pass)
 		ImGui::SetColumnOffset(1, maxLabelWidth + 10);
 		ImGui::NextColumn();
 
-		doPassParamUi(param, pass);
+		// Baked values are compiled into the shader; unbake to edit them
+		std::string constant;
+		if (pass.m_baked && getShaderParamConstant(param.refl.type, param.value, &constant)) {
+			ImGui::TextDisabled("%s", constant.c_str());
+		} else {
+			doPassParamUi(param, pass);
+		}
 
 		ImGui::PopID();
 		ImGui::NextColumn();
@@ -1836,6 +436,9 @@ void doPassUi(ComputePass& pass)
 		shellExecute(pass.shader().m_sourceFile.c_str());
 	}
 
+	ImGui::SameLine();
+	ImGui::Checkbox("Bake params", &pass.m_baked);
+
 	if (!pass.shader().m_errorLog.empty()) {
 		ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1, 0.2, 0.1, 1));
 		ImGui::Text("Compile error:\n%s", pass.shader().m_errorLog.c_str());
@@ -2080,28 +683,47 @@ static void windowKeyCallback(GLFWwindow* window, int key, int scancode, int act
 
 void doNewProject()
 {
+	resetNodeGraphGui(g_project.m_packages[0]->graph);
 	g_project.m_packages[0]->reset();
 	g_project.m_packages[0]->addOutputPass();
+	g_project.m_dispatchTileSize = 0;
+	g_project.m_graphTileSize = 0;
+	g_project.m_maxTextureSize = 0;
 	g_currentProjectFile.clear();
 }
 
+bool loadProject(const std::string& filePath)
+{
+	if (!fs::exists(filePath)) {
+		fprintf(stderr, "Project file not found: %s\n", filePath.c_str());
+		return false;
+	}
+
+	vector<char> data = loadTextFileZ(filePath.c_str());
+
+	rapidjson::Document doc;
+	doc.Parse(data.data(), data.size());
+
+	DeserializationContext ctx;
+	guiGlue = NodeGraphGuiGlue();
+	resetNodeGraphGui(g_project.m_packages[0]->graph);
+	g_project.m_packages[0]->reset();
+	g_project.m_packages[0]->deserialize(doc, ctx);
+
+	guiGlue.deserialize(doc["gui"], ctx);
+	g_project.m_dispatchTileSize = doc.HasMember("dispatchTileSize") ? doc["dispatchTileSize"].GetInt() : 0;
+	g_project.m_graphTileSize = doc.HasMember("graphTileSize") ? doc["graphTileSize"].GetInt() : 0;
+	g_project.m_maxTextureSize = doc.HasMember("maxTextureSize") ? doc["maxTextureSize"].GetInt() : 0;
+	g_currentProjectFile = filePath;
+	return true;
+}
+
 void doOpenProject()
 {
 	std::string filePath;
 	if (openFileDialog("Select a project file to load", "RenderToy Project\0*.rtoy\0", &filePath))
 	{
-		vector<char> data = loadTextFileZ(filePath.c_str());
-
-		rapidjson::Document doc;
-		doc.Parse(data.data(), data.size());
-
-		DeserializationContext ctx;
-		guiGlue = NodeGraphGuiGlue();
-		g_project.m_packages[0]->reset();
-		g_project.m_packages[0]->deserialize(doc, ctx);
-
-		guiGlue.deserialize(doc["gui"], ctx);
-		g_currentProjectFile = filePath;
+		loadProject(filePath);
 	}
 }
 
@@ -2118,6 +740,15 @@ void doSaveProject(const std::string& filePath)
 	guiGlue.serialize(writer);
 	writer.EndObject();
 
+	writer.String("dispatchTileSize");
+	writer.Int(g_project.m_dispatchTileSize);
+
+	writer.String("graphTileSize");
+	writer.Int(g_project.m_graphTileSize);
+
+	writer.String("maxTextureSize");
+	writer.Int(g_project.m_maxTextureSize);
+
 	writer.EndObject();
 	std::ofstream(filePath).write(sb.GetString(), sb.GetLength());
 	puts(sb.GetString());
@@ -2134,6 +765,51 @@ void doSaveProject()
 	}
 }
 
+Benchmark g_benchmark;
+bool g_exitAfterBenchmark = false;
+bool g_showGlTrace = false;
+bool g_showReloadLatency = false;
+bool g_showHeapStats = false;
+bool g_fullResolutionTextures = false;	// ignores texture size limits, e.g. for final renders
+int g_exitCode = 0;
+
+void startBenchmark(const BenchmarkSettings& settings)
+{
+	g_benchmark.start(settings);
+	glfwSwapInterval(0);
+}
+
+void finishBenchmark()
+{
+	g_benchmark.printSummary();
+
+	const char* const renderer = (const char*)glGetString(GL_RENDERER);
+	if (g_benchmark.writeResults(renderer)) {
+		printf("Benchmark results written to %s\n", g_benchmark.settings().resultPath.c_str());
+	} else {
+		fprintf(stderr, "Could not write benchmark results to %s\n", g_benchmark.settings().resultPath.c_str());
+		g_exitCode = 1;
+	}
+
+	g_benchmark = Benchmark();
+	GpuProfiler::setEnabled(false);
+	glfwSwapInterval(1);
+
+	if (g_exitAfterBenchmark) {
+		glfwSetWindowShouldClose(g_mainWindow, 1);
+	}
+}
+
+void setAllPassesBaked(bool baked)
+{
+	for (shared_ptr<Package>& package : g_project.m_packages) {
+		for (auto& pass : package->m_passes) {
+			if (auto computePass = dynamic_cast<ComputePass*>(pass.get())) {
+				computePass->m_baked = baked;
+			}
+		}
+	}
+}
 
 void doMainMenu()
 {
@@ -2174,6 +850,67 @@ void doMainMenu()
 
 		ImGui::EndMenu();
 	}
+
+	if (ImGui::BeginMenu("Render")) {
+		if (ImGui::BeginMenu("Tiled dispatch")) {
+			const int tileSizes[] = { 0, 256, 512, 1024, 2048, 4096 };
+			for (int tileSize : tileSizes) {
+				const std::string label = tileSize > 0 ? std::to_string(tileSize) + "x" + std::to_string(tileSize) : "Off";
+				if (ImGui::MenuItem(label.c_str(), nullptr, g_project.m_dispatchTileSize == tileSize)) {
+					g_project.m_dispatchTileSize = tileSize;
+				}
+			}
+			ImGui::EndMenu();
+		}
+
+		if (ImGui::BeginMenu("Graph tiles")) {
+			const int tileSizes[] = { 0, 512, 1024, 2048, 4096 };
+			for (int tileSize : tileSizes) {
+				const std::string label = tileSize > 0 ? std::to_string(tileSize) + "x" + std::to_string(tileSize) : "Off";
+				if (ImGui::MenuItem(label.c_str(), nullptr, g_project.m_graphTileSize == tileSize)) {
+					g_project.m_graphTileSize = tileSize;
+				}
+			}
+			ImGui::EndMenu();
+		}
+
+		if (ImGui::BeginMenu("Texture size limit")) {
+			const int maxSizes[] = { 0, 1024, 2048, 4096, 8192 };
+			for (int maxSize : maxSizes) {
+				const std::string label = maxSize > 0 ? std::to_string(maxSize) : "Off";
+				if (ImGui::MenuItem(label.c_str(), nullptr, g_project.m_maxTextureSize == maxSize)) {
+					g_project.m_maxTextureSize = maxSize;
+				}
+			}
+
+			ImGui::Separator();
+			ImGui::MenuItem("Full resolution (final render)", nullptr, &g_fullResolutionTextures);
+			ImGui::EndMenu();
+		}
+
+		if (ImGui::MenuItem("Benchmark", nullptr, false, !g_benchmark.active())) {
+			BenchmarkSettings settings;
+			settings.projectPath = g_currentProjectFile;
+			if (!g_currentProjectFile.empty()) {
+				settings.resultPath = g_currentProjectFile + ".benchmark.json";
+			}
+			startBenchmark(settings);
+		}
+
+		if (ImGui::MenuItem("Bake all passes")) {
+			setAllPassesBaked(true);
+		}
+
+		if (ImGui::MenuItem("Unbake all passes")) {
+			setAllPassesBaked(false);
+		}
+
+		ImGui::MenuItem("GL call statistics", nullptr, &g_showGlTrace);
+		ImGui::MenuItem("Reload latency", nullptr, &g_showReloadLatency);
+		ImGui::MenuItem("Heap allocations", nullptr, &g_showHeapStats);
+
+		ImGui::EndMenu();
+	}
 }
 
 void drawFullscreenQuad(GLuint tex)
@@ -2213,22 +950,20 @@ void drawFullscreenQuad(GLuint tex)
 		glLinkProgram(g_ShaderHandle);
 	}
 
-	glUseProgram(g_ShaderHandle);
-
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, tex);
+	GlState::useProgram(g_ShaderHandle);
+	GlState::bindTexture(0, GL_TEXTURE_2D, tex);
 
 	const GLint loc = glGetUniformLocation(g_ShaderHandle, "Texture");
 	const GLint img_unit = 0;
 	glUniform1i(loc, img_unit);
 
 	glDrawArrays(GL_TRIANGLES, 0, 3);
-	glUseProgram(0);
 }
 
-void drawOutputView(const shared_ptr<CreatedTexture>& tex, int width, int height)
+// The part of the window the output is shown in: x, y, width, height
+ivec4 getOutputViewRect(const TextureKey& outputKey, int width, int height)
 {
-	vec2 texSize = vec2(tex->key.width, tex->key.height);
+	vec2 texSize = vec2(outputKey.width, outputKey.height);
 	vec2 viewSize = vec2(width, height);
 
 	// Move to a space where the window is 1x1 units
@@ -2240,8 +975,19 @@ void drawOutputView(const shared_ptr<CreatedTexture>& tex, int width, int height
 	// Move back to pixels and find out how much padding is needed on one of the axes
 	ivec2 padding = ivec2(viewSize * (1.f - texFrac));
 
-	glViewport(padding.x / 2, padding.y / 2, width - padding.x, height - padding.y);
-	glScissor(padding.x / 2, padding.y / 2, width - padding.x, height - padding.y);
+	return ivec4(padding.x / 2, padding.y / 2, width - padding.x, height - padding.y);
+}
+
+void drawOutputView(TextureHandle texHandle, int width, int height)
+{
+	const CreatedTexture* const tex = Resources::find(texHandle);
+	if (!tex) {
+		return;
+	}
+
+	const ivec4 rect = getOutputViewRect(tex->key, width, height);
+	GlState::viewport(rect.x, rect.y, rect.z, rect.w);
+	GlState::scissor(rect.x, rect.y, rect.z, rect.w);
 
 	drawFullscreenQuad(tex->texId);
 }
@@ -2251,38 +997,46 @@ void renderProject(int width, int height)
 	for (shared_ptr<Package>& package : g_project.m_packages) {
 		PassCompilerSettings settings;
 		settings.windowSize = ivec2(width, height);
+		settings.dispatchTileSize = ivec2(g_project.m_dispatchTileSize);
+		settings.graphTileSize = ivec2(g_project.m_graphTileSize);
+		settings.maxTextureSize = u32(g_project.m_maxTextureSize);
+		settings.fullResolutionTextures = g_fullResolutionTextures;
+		settings.playbackTime = glfwGetTime();
 
 		CompiledPackage compiled;
-		if (!package->compile(settings, &compiled) || !compiled.outputTexture) {
-			continue;
-		}
-
-		for (auto& pass : compiled.orderedPasses) {
-			/*int dispatchWidth = width;
-			int dispatchHeight = height;
-
-			// TODO: proper dispatch size setting
-			// For now, we get the dispatch size from the first output image of the shader
-			for (auto& img : pass.compiledImages) {
-				if (img.owned) {
-					dispatchWidth = img.tex->key.width;
-					dispatchHeight = img.tex->key.height;
-					break;
-				}
-			}*/
+		bool compiledOk;
+		{
+			GlTrace::Scope traceScope(GlTrace::Subsystem::Compile);
+			const auto compileStart = std::chrono::high_resolution_clock::now();
+			compiledOk = package->compile(settings, &compiled);
 
-			pass.render();
+			if (ReloadLatency::awaitingFrame()) {
+				const double compileMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - compileStart).count();
+				ReloadLatency::addStageTime(ReloadLatency::Stage::GraphCompile, compileMs);
+			}
 		}
 
-		drawOutputView(compiled.outputTexture, width, height);
+		if (!compiledOk || !compiled.hasOutput()) {
+			continue;
+		}
 
-		for (auto& pass : compiled.orderedPasses) {
-			for (auto& img : pass.compiledImages) {
-				if (img.owned) {
-					img.release();
-				}
+		if (compiled.graphTiled()) {
+			// Each tile goes straight to its part of the window, so the whole output isn't allocated for display either
+			static GLuint readFramebuffer = 0;
+			if (!readFramebuffer) {
+				glGenFramebuffers(1, &readFramebuffer);
 			}
+
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+			compiled.renderToFramebuffer(getOutputViewRect(compiled.outputKey, width, height), readFramebuffer);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		} else {
+			compiled.render();
+			drawOutputView(compiled.outputTexture, width, height);
 		}
+		GpuProfiler::endScope("output");
+
+		compiled.releaseImages();
 	}
 }
 
@@ -2304,17 +1058,59 @@ void APIENTRY openGLDebugCallback(
 	}
 }
 
-int main(int, char**)
+static void printUsage()
+{
+	puts("Usage: rendertoy [--hidden] [--benchmark project.rtoy [--warmup N] [--frames M] [--resolution WxH] [--out results.json]]");
+}
+
+int main(int argc, char** argv)
 /*int CALLBACK WinMain(
 	_In_ HINSTANCE hInstance,
 	_In_ HINSTANCE hPrevInstance,
 	_In_ LPSTR     lpCmdLine,
 	_In_ int       nCmdShow
 )*/ {
+	BenchmarkSettings benchmarkSettings;
+	bool runBenchmark = false;
+	bool hiddenWindow = false;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (arg == "--benchmark" && hasValue) {
+			runBenchmark = true;
+			benchmarkSettings.projectPath = argv[++i];
+		} else if (arg == "--warmup" && hasValue) {
+			benchmarkSettings.warmupFrames = std::max(0, atoi(argv[++i]));
+		} else if (arg == "--frames" && hasValue) {
+			benchmarkSettings.measuredFrames = std::max(1, atoi(argv[++i]));
+		} else if (arg == "--resolution" && hasValue) {
+			ivec2 res;
+			if (sscanf(argv[++i], "%dx%d", &res.x, &res.y) != 2 || res.x <= 0 || res.y <= 0) {
+				fprintf(stderr, "Invalid resolution: %s\n", argv[i]);
+				return 1;
+			}
+			benchmarkSettings.resolution = res;
+		} else if (arg == "--out" && hasValue) {
+			benchmarkSettings.resultPath = argv[++i];
+		} else if (arg == "--hidden") {
+			// For unattended runs, e.g. the benchmark suite
+			hiddenWindow = true;
+		} else {
+			fprintf(stderr, "Unknown argument: %s\n", arg.c_str());
+			printUsage();
+			return 1;
+		}
+	}
+
 	// Setup window
 	glfwSetErrorCallback(&windowErrorCallback);
 	FileWatcher::start();
 
+	// Editor plugins get shader build results from here. Not fatal; they fall back to .errors files.
+	EventServer::start();
+
 	if (!glfwInit()) {
 		return 1;
 	}
@@ -2323,13 +1119,14 @@ int main(int, char**)
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_COMPAT_PROFILE);
 	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, 1);
+	glfwWindowHint(GLFW_VISIBLE, hiddenWindow ? 0 : 1);
 
 	GLFWmonitor* monitor = glfwGetPrimaryMonitor();
 	const GLFWvidmode* vidMode = glfwGetVideoMode(monitor);
 	g_mainWindow = glfwCreateWindow(vidMode->width / 2, vidMode->height, "RenderToy", NULL, NULL);
 	GLFWwindow*& window = g_mainWindow;
 
-	{
+	if (!hiddenWindow) {
 		int x, y;
 		glfwGetWindowPos(window, &x, &y);
 		glfwRestoreWindow(window);
@@ -2343,11 +1140,12 @@ int main(int, char**)
 	glfwMakeContextCurrent(window);
 	glfwSwapInterval(1);
 	gladLoadGL();
+	GlState::invalidate();
 
 	glDebugMessageCallback(&openGLDebugCallback, nullptr);
 	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, 1);
 	glDebugMessageControl(GL_DEBUG_SOURCE_SHADER_COMPILER, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, 0);
-	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	GlState::setEnabled(GL_DEBUG_OUTPUT_SYNCHRONOUS, true);
 
 	// Setup ImGui binding
 	ImGui_ImplGlfwGL3_Init(window, true);
@@ -2358,6 +1156,15 @@ int main(int, char**)
 		guiGlue.setDesiredNodePosition(outputNode, vec2(vidMode->width / 2 * 0.7, vidMode->height / 2 * 0.5 - 30));
 	}
 
+	if (runBenchmark) {
+		if (!loadProject(benchmarkSettings.projectPath)) {
+			return 1;
+		}
+
+		g_exitAfterBenchmark = true;
+		startBenchmark(benchmarkSettings);
+	}
+
 	ImVec4 clearColor = ImColor(75, 75, 75);
 	bool fullscreen = false;
 	bool maximized = false;
@@ -2365,6 +1172,10 @@ int main(int, char**)
 
 	// Main loop
 	while (!glfwWindowShouldClose(window)) {
+		const auto frameStart = std::chrono::high_resolution_clock::now();
+		GlState::resetStats();
+		GlTrace::beginFrame();
+		HeapStats::beginFrame();
 		glfwPollEvents();
 		ImGui_ImplGlfwGL3_NewFrame();
 
@@ -2446,27 +1257,94 @@ int main(int, char**)
 			}
 		}
 
+		if (g_showGlTrace) {
+			GlTrace::doGui(&g_showGlTrace);
+		}
+
+		if (g_showReloadLatency) {
+			ReloadLatency::doGui(&g_showReloadLatency);
+		}
+
+		if (g_showHeapStats) {
+			HeapStats::doGui(&g_showHeapStats);
+		}
+
 		// Rendering
 		int display_w, display_h;
 		glfwGetFramebufferSize(window, &display_w, &display_h);
-		glViewport(0, 0, display_w, display_h);
+		GlState::viewport(0, 0, display_w, display_h);
 		glClearColor(clearColor.x, clearColor.y, clearColor.z, clearColor.w);
 		glClear(GL_COLOR_BUFFER_BIT);
 
+		GpuProfiler::beginFrame();
+
+		// The first frame after a shader reload gets timed on the GPU as a whole
+		static GLuint reloadTimerQuery = 0;
+		const bool timeReloadFrame = ReloadLatency::awaitingFrame();
+		if (timeReloadFrame) {
+			if (!reloadTimerQuery) {
+				glGenQueries(1, &reloadTimerQuery);
+			}
+			glBeginQuery(GL_TIME_ELAPSED, reloadTimerQuery);
+		}
+
 		const u32 renderHeight = (fullscreen || maximized) ? display_h : display_h / 2;
-		glEnable(GL_FRAMEBUFFER_SRGB);
-		renderProject(display_w, renderHeight);
-		glDisable(GL_FRAMEBUFFER_SRGB);
+		GlState::setEnabled(GL_FRAMEBUFFER_SRGB, true);
+		HeapStats::beginRender();
+		if (g_benchmark.active()) {
+			const ivec2 res = g_benchmark.settings().resolution;
+			renderProject(res.x, res.y);
+		} else {
+			renderProject(display_w, renderHeight);
+		}
+		HeapStats::endRender();
+		GlState::setEnabled(GL_FRAMEBUFFER_SRGB, false);
 
-		glViewport(0, 0, display_w, display_h);
-		glScissor(0, 0, display_w, display_h);
+		if (timeReloadFrame) {
+			glEndQuery(GL_TIME_ELAPSED);
+		}
+
+		GlState::viewport(0, 0, display_w, display_h);
+		GlState::scissor(0, 0, display_w, display_h);
+
+		GlState::setEnabled(GL_DEBUG_OUTPUT, false);
+		{
+			GlTrace::Scope traceScope(GlTrace::Subsystem::Gui);
+			ImGui::Render();
+		}
+		GlState::setEnabled(GL_DEBUG_OUTPUT, true);
 
-		glDisable(GL_DEBUG_OUTPUT);
-		ImGui::Render();
-		glEnable(GL_DEBUG_OUTPUT);
+		GpuProfiler::endScope("gui");
+		GpuProfiler::endFrame();
+		GlTrace::endFrame();
 
+		const double cpuFrameMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frameStart).count();
 		glfwSwapBuffers(window);
+
+		if (timeReloadFrame) {
+			// Blocks until the frame is done, but only once per reload
+			GLuint64 gpuNs = 0;
+			glGetQueryObjectui64v(reloadTimerQuery, GL_QUERY_RESULT, &gpuNs);
+			ReloadLatency::addStageTime(ReloadLatency::Stage::Gpu, gpuNs / 1e6);
+			ReloadLatency::framePresented();
+		}
+
+		if (g_benchmark.active()) {
+			g_benchmark.endFrame(cpuFrameMs);
+			if (g_benchmark.finished()) {
+				finishBenchmark();
+			}
+		}
+
 		FileWatcher::update();
+		EventServer::update();
+		ShaderDependencies::update();
+		ShaderLibrary::releaseUnused();
+		releaseReplacedTextureVariants();
+
+		// Compiled packages are gone by now
+		FrameArena::reset();
+		HeapStats::endFrame();
 
 		if (!fullscreen && toggleMaximized) {
 			static int prevX, prevY, prevW, prevH;
@@ -2492,10 +1370,10 @@ int main(int, char**)
 
 				const GLFWvidmode* mode = glfwGetVideoMode(monitor);
 				glfwSetWindowMonitor(window, monitor, 0, 0, mode->width, mode->height, mode->refreshRate);
-				glfwSwapInterval(1);
+				glfwSwapInterval(g_benchmark.active() ? 0 : 1);
 			} else {
 				glfwSetWindowMonitor(window, nullptr, lastX, lastY, lastWidth, lastHeight, GLFW_DONT_CARE);
-				glfwSwapInterval(1);
+				glfwSwapInterval(g_benchmark.active() ? 0 : 1);
 			}
 		}
 
@@ -2516,6 +1394,7 @@ int main(int, char**)
 	glfwTerminate();
 
 	FileWatcher::stop();
+	EventServer::stop();
 
-	return 0;
+	return g_exitCode;
 }
\ No newline at end of file
@@ -0,0 +1,25 @@
+#pragma once
+#include "Common.h"
+#include <cstring>
+
+#define	MD5_BLOCK_LENGTH		64
+#define	MD5_DIGEST_LENGTH		16
+#define	MD5_DIGEST_STRING_LENGTH	(MD5_DIGEST_LENGTH * 2 + 1)
+
+struct MD5_CTX {
+	u32	state[4];		/* state */
+	u64	count;			/* number of bits, mod 2^64 */
+	u8	buffer[MD5_BLOCK_LENGTH];	/* input buffer */
+};
+
+struct MD5Digest {
+	u8 data[MD5_DIGEST_LENGTH];
+
+	bool operator!=(const MD5Digest& rhs) const {
+		return memcmp(data, rhs.data, sizeof(data)) != 0;
+	}
+};
+
+void	 MD5Init(MD5_CTX*);
+void	 MD5Update(MD5_CTX *, const unsigned char *, size_t);
+void	 MD5Final(MD5Digest*, MD5_CTX*);
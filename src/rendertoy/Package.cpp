@@ -0,0 +1,1846 @@
+#include "Package.h"
+#include "GlTrace.h"
+#include "GpuProfiler.h"
+#include "Arena.h"
+#include "ImageSequence.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+
+TransientCache<TextureKey, TextureHandle> g_transientTextureCache;
+
+TransientCache<BufferKey, BufferHandle> g_transientBufferCache;
+
+void CompiledPass::clearImages()
+{
+	GlTrace::Scope traceScope(GlTrace::Subsystem::Clear);
+
+	for (const auto& param : params) {
+		const auto& refl = param.refl;
+		const auto& value = param.value;
+
+		if (-1 == refl.location) {
+			continue;
+		}
+
+		// Sampled images only need clearing when they're freshly allocated history textures
+		if (refl.type == ShaderParamType::Image2d || refl.type == ShaderParamType::Sampler2d) {
+			CompiledImage& img = compiledImages[param.idx];
+			if (img.valid() && img.clear) {
+				const CreatedTexture& tex = Resources::get(img.tex);
+
+				// Held for the lifetime of the app, so that the library keeps them
+				static const shared_ptr<ComputeShader> clearFloat = ShaderLibrary::get("data/std/clearFloat.glsl");
+				static const shared_ptr<ComputeShader> clearUint = ShaderLibrary::get("data/std/clearUint.glsl");
+
+				// HACK
+				ComputeShader& sh = (tex.key.format == GL_RGBA16F) ? *clearFloat : *clearUint;
+
+				GlState::useProgram(sh.m_programHandle);
+				const bool layered = false;
+				GlState::bindImageTexture(0, tex.texId, 0, layered, 0, GL_WRITE_ONLY, tex.key.format);
+				glUniform1i(glGetUniformLocation(sh.m_programHandle, "outputImage"), 0);
+
+				GLint workGroupSize[3];
+				glGetProgramiv(sh.m_programHandle, GL_COMPUTE_WORK_GROUP_SIZE, workGroupSize);
+				glDispatchCompute(
+					(tex.key.width + workGroupSize[0] - 1) / workGroupSize[0],
+					(tex.key.height + workGroupSize[1] - 1) / workGroupSize[1],
+					1);
+			}
+		}
+	}
+}
+
+// Tiled sources are assumed to be read at the uvs of the invocations, as is the norm for image filters
+static void makeVirtualTexturesResident(const FrameVector<std::pair<VirtualTexture*, u32>>& virtualTextures, ivec2 offset, ivec2 extent, ivec2 dispatchSize)
+{
+	const vec2 uvMin = vec2(offset) / vec2(dispatchSize);
+	const vec2 uvMax = vec2(offset + extent) / vec2(dispatchSize);
+
+	for (const auto& vt : virtualTextures) {
+		vt.first->makeResident(vt.second, uvMin, uvMax);
+	}
+}
+
+void CompiledPass::render()
+{
+	// TODO: clean up. this is only there for the Output node which doesn't have a shader
+	if (!shader) {
+		return;
+	}
+
+	clearImages();
+
+	// Not needed by the current graph tile
+	if (regionSize.x <= 0 || regionSize.y <= 0) {
+		return;
+	}
+
+	GlState::useProgram(program->program);
+	u32 imgUnit = 0;
+	u32 texUnit = 0;
+
+	// Tiled sources read by this pass, paged in for each dispatch
+	FrameVector<std::pair<VirtualTexture*, u32>> virtualTextures;
+
+	for (const auto& param : params) {
+		const auto& refl = param.refl;
+		const auto& value = param.value;
+
+		if (-1 == refl.location) {
+			continue;
+		}
+
+		// Locations in the program in use. Static params aren't uniforms in variants, so these are -1 there.
+		const GLint location = program->paramLocations[param.idx];
+		const ShaderProgramRefl::TextureUniforms& texUniforms = program->textureUniforms[param.idx];
+
+		if (refl.type == ShaderParamType::Float) {
+			glUniform1f(location, value.floatValue);
+		}
+		else if (refl.type == ShaderParamType::Float2) {
+			glUniform2f(location, value.float2Value.x, value.float2Value.y);
+		}
+		else if (refl.type == ShaderParamType::Float3) {
+			glUniform3f(location, value.float3Value.x, value.float3Value.y, value.float3Value.z);
+		}
+		else if (refl.type == ShaderParamType::Float4) {
+			glUniform4f(location, value.float4Value.x, value.float4Value.y, value.float4Value.z, value.float4Value.w);
+		}
+		else if (refl.type == ShaderParamType::Int) {
+			glUniform1i(location, value.intValue);
+		}
+		else if (refl.type == ShaderParamType::Int2) {
+			glUniform2i(location, value.int2Value.x, value.int2Value.y);
+		}
+		else if (refl.type == ShaderParamType::Int3) {
+			glUniform3i(location, value.int3Value.x, value.int3Value.y, value.int3Value.z);
+		}
+		else if (refl.type == ShaderParamType::Int4) {
+			glUniform4i(location, value.int4Value.x, value.int4Value.y, value.int4Value.z, value.int4Value.w);
+		}
+		else if (refl.type == ShaderParamType::Image2d) {
+			CompiledImage& img = compiledImages[param.idx];
+			if (img.valid()) {
+				const GLint level = 0;
+				const bool layered = false;
+				const CreatedTexture& tex = Resources::get(img.tex);
+				GlState::bindImageTexture(imgUnit, tex.texId, level, layered, 0, GL_READ_WRITE, tex.key.format);
+				glUniform1i(location, imgUnit);
+				++imgUnit;
+			}
+		}
+		else if (refl.type == ShaderParamType::Sampler2d) {
+			CompiledImage& img = compiledImages[param.idx];
+			if (img.valid() && img.virtualTexture) {
+				// Along with [texname]_indirection and [texname]_vtLevel; see sampleVirtual in data/tiled.glsl
+				img.virtualTexture->bind(texUnit, texUnit + 1, img.sampler);
+				glUniform1i(location, texUnit);
+				glUniform1i(texUniforms.indirection, texUnit + 1);
+
+				const u32 level = img.virtualTexture->getLevelForDispatch(dispatchSize);
+				glUniform1i(texUniforms.vtLevel, GLint(level));
+
+				texUnit += 2;
+				virtualTextures.emplace_back(img.virtualTexture, level);
+			}
+			else if (img.valid()) {
+				GlState::bindTexture(texUnit, GL_TEXTURE_2D, Resources::get(img.tex).texId);
+				GlState::bindSampler(texUnit, img.sampler);
+				glUniform1i(location, texUnit);
+				++texUnit;
+			}
+		}
+		else if (refl.type == ShaderParamType::Buffer) {
+			CompiledBuffer& buf = compiledBuffers[param.idx];
+			if (buf.valid()) {
+				GlState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, refl.location, Resources::get(buf.buf).id);
+			}
+		}
+
+		// Upload hardcoded [texname]_size uniform; xy: resolution, zw: 1/resolution
+		if (refl.type == ShaderParamType::Image2d || refl.type == ShaderParamType::Sampler2d) {
+			CompiledImage& img = compiledImages[param.idx];
+			if (texUniforms.size != -1) {
+				vec2 reso = vec2(img.size());
+				vec4 size = vec4(reso.x, reso.y, 1.f / reso.x, 1.f / reso.y);
+				glUniform4fv(texUniforms.size, 1, &size.x);
+			}
+
+			// And [texname]_flipY; non-zero if the texture's blocks are stored top-down, and v needs flipping.
+			// See sampleFlipped in data/std/sampleFlipped.glsl.
+			if (texUniforms.flipY != -1) {
+				const CreatedTexture* const tex = Resources::find(img.tex);
+				glUniform1i(texUniforms.flipY, (tex && tex->flipY) ? 1 : 0);
+			}
+
+			// And [texname]_origin; see data/std/graphTile.glsl
+			if (texUniforms.origin != -1) {
+				glUniform2i(texUniforms.origin, img.origin.x, img.origin.y);
+			}
+		}
+	}
+
+	const ivec2 groupSize = program->workGroupSize;
+
+	// Only shaders which index via gl_GlobalInvocationID or gl_WorkGroupID have an active
+	// offset uniform (see loadShaderSource); anything else must run in a single dispatch.
+	const GLint offsetLoc = program->dispatchOffset;
+
+	// Graph tiles only run passes which have the uniform, and align their regions to work groups
+	const ivec2 regionEnd = regionOrigin + regionSize;
+
+	if (offsetLoc != -1 && dispatchTileSize.x > 0 && dispatchTileSize.y > 0) {
+		// Tiles are whole work groups, so that the offset invocation IDs are exact
+		const ivec2 tileSize = ((dispatchTileSize + groupSize - 1) / groupSize) * groupSize;
+
+		for (int y = regionOrigin.y; y < regionEnd.y; y += tileSize.y) {
+			for (int x = regionOrigin.x; x < regionEnd.x; x += tileSize.x) {
+				const ivec2 extent = glm::min(tileSize, regionEnd - ivec2(x, y));
+				makeVirtualTexturesResident(virtualTextures, ivec2(x, y), extent, dispatchSize);
+				glUniform2i(offsetLoc, x, y);
+				glDispatchCompute(
+					(extent.x + groupSize.x - 1) / groupSize.x,
+					(extent.y + groupSize.y - 1) / groupSize.y,
+					1);
+
+				// Submit each tile separately, so that no single command buffer runs long enough to trip the driver watchdog
+				glFlush();
+			}
+		}
+	} else {
+		if (offsetLoc != -1) {
+			glUniform2i(offsetLoc, regionOrigin.x, regionOrigin.y);
+		}
+
+		makeVirtualTexturesResident(virtualTextures, regionOrigin, regionSize, dispatchSize);
+
+		glDispatchCompute(
+			(regionSize.x + groupSize.x - 1) / groupSize.x,
+			(regionSize.y + groupSize.y - 1) / groupSize.y,
+			1);
+	}
+}
+
+TextureHandle createTransientTexture(const TextureDesc& desc, const TextureKey& key)
+{
+	auto existing = g_transientTextureCache.find(key);
+	if (existing != g_transientTextureCache.end()) {
+		const TextureHandle res = existing->second;
+		g_transientTextureCache.erase(existing);
+		return res;
+	}
+	else {
+		return createTexture(desc, key);
+	}
+}
+
+BufferHandle createBuffer(const BufferDesc& desc, const BufferKey& key)
+{
+	GlTrace::Scope traceScope(GlTrace::Subsystem::Upload);
+
+	GLuint id;
+	glGenBuffers(1, &id);
+	GlState::bindBuffer(GL_SHADER_STORAGE_BUFFER, id);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, key.sizeBytes, nullptr, GL_STATIC_COPY);
+	CreatedBuffer buf;
+	buf.key = key;
+	buf.id = id;
+	return Resources::add(buf);
+}
+
+
+BufferHandle createTransientBuffer(const BufferDesc& desc, const BufferKey& key)
+{
+	auto existing = g_transientBufferCache.find(key);
+	if (existing != g_transientBufferCache.end()) {
+		const BufferHandle res = existing->second;
+		g_transientBufferCache.erase(existing);
+		return res;
+	}
+	else {
+		return createBuffer(desc, key);
+	}
+}
+
+
+const char* const getShaderParamTypeName(ShaderParamType type)
+{
+	switch (type) {
+	case ShaderParamType::Float: return "Float";
+	case ShaderParamType::Float2: return "Float2";
+	case ShaderParamType::Float3: return "Float3";
+	case ShaderParamType::Float4: return "Float4";
+	case ShaderParamType::Int: return "Int";
+	case ShaderParamType::Int2: return "Int2";
+	case ShaderParamType::Int3: return "Int3";
+	case ShaderParamType::Int4: return "Int4";
+	case ShaderParamType::Sampler2d: return "Sampler2d";
+	case ShaderParamType::Image2d: return "Image2d";
+	case ShaderParamType::Buffer: return "Buffer";
+	default: assert(false);
+	}
+
+	return "Unknown";
+}
+
+ShaderParamType parseShaderParamTypeName(const char* const str)
+{
+	if (0 == strcmp("Float", str)) return ShaderParamType::Float;
+	if (0 == strcmp("Float2", str)) return ShaderParamType::Float2;
+	if (0 == strcmp("Float3", str)) return ShaderParamType::Float3;
+	if (0 == strcmp("Float4", str)) return ShaderParamType::Float4;
+	if (0 == strcmp("Int", str)) return ShaderParamType::Int;
+	if (0 == strcmp("Int2", str)) return ShaderParamType::Int2;
+	if (0 == strcmp("Int3", str)) return ShaderParamType::Int3;
+	if (0 == strcmp("Int4", str)) return ShaderParamType::Int4;
+	if (0 == strcmp("Sampler2d", str)) return ShaderParamType::Sampler2d;
+	if (0 == strcmp("Image2d", str)) return ShaderParamType::Image2d;
+	if (0 == strcmp("Buffer", str)) return ShaderParamType::Buffer;
+	return ShaderParamType::Unknown;
+}
+
+void serializeShaderParamRefl(const ShaderParamRefl& refl, JsonWriter& writer)
+{
+	writer.String("name");
+	writer.String(refl.name.c_str());
+
+	writer.String("type");
+	writer.String(getShaderParamTypeName(refl.type));
+
+	if (!refl.annotation.empty()) {
+		writer.String("annotation");
+		writer.StartObject();
+		for (auto& annot : refl.annotation.items) {
+			writer.String(annot.first.c_str());
+			writer.String(annot.second.c_str());
+		}
+		writer.EndObject();
+	}
+}
+
+void writeVec(JsonWriter& writer, const vec2& v) {
+	writer.StartArray();
+	writer.Double(v.x);
+	writer.Double(v.y);
+	writer.EndArray();
+}
+
+void writeVec(JsonWriter& writer, const vec3& v) {
+	writer.StartArray();
+	writer.Double(v.x);
+	writer.Double(v.y);
+	writer.Double(v.z);
+	writer.EndArray();
+}
+
+void writeVec(JsonWriter& writer, const vec4& v) {
+	writer.StartArray();
+	writer.Double(v.x);
+	writer.Double(v.y);
+	writer.Double(v.z);
+	writer.Double(v.w);
+	writer.EndArray();
+}
+
+void writeVec(JsonWriter& writer, const ivec2& v) {
+	writer.StartArray();
+	writer.Int(v.x);
+	writer.Int(v.y);
+	writer.EndArray();
+}
+
+void writeVec(JsonWriter& writer, const ivec3& v) {
+	writer.StartArray();
+	writer.Int(v.x);
+	writer.Int(v.y);
+	writer.Int(v.z);
+	writer.EndArray();
+}
+
+void writeVec(JsonWriter& writer, const ivec4& v) {
+	writer.StartArray();
+	writer.Int(v.x);
+	writer.Int(v.y);
+	writer.Int(v.z);
+	writer.Int(v.w);
+	writer.EndArray();
+}
+
+void readVec(rapidjson::Value& json, vec2 *const result)
+{
+	auto& v = json.GetArray();
+	*result = vec2(v[0].GetFloat(), v[1].GetFloat());
+}
+
+void readVec(rapidjson::Value& json, vec3 *const result)
+{
+	auto& v = json.GetArray();
+	*result = vec3(v[0].GetFloat(), v[1].GetFloat(), v[2].GetFloat());
+}
+
+void readVec(rapidjson::Value& json, vec4 *const result)
+{
+	auto& v = json.GetArray();
+	*result = vec4(v[0].GetFloat(), v[1].GetFloat(), v[2].GetFloat(), v[3].GetFloat());
+}
+
+void readVec(rapidjson::Value& json, ivec2 *const result)
+{
+	auto& v = json.GetArray();
+	*result = ivec2(v[0].GetInt(), v[1].GetInt());
+}
+
+void readVec(rapidjson::Value& json, ivec3 *const result)
+{
+	auto& v = json.GetArray();
+	*result = ivec3(v[0].GetInt(), v[1].GetInt(), v[2].GetInt());
+}
+
+void readVec(rapidjson::Value& json, ivec4 *const result)
+{
+	auto& v = json.GetArray();
+	*result = ivec4(v[0].GetInt(), v[1].GetInt(), v[2].GetInt(), v[3].GetInt());
+}
+
+void writeTextureSize(const TextureSize& size, JsonWriter& writer)
+{
+	writer.String("useRelativeScale");
+	writer.Bool(size.useRelativeScale);
+
+	if (size.useRelativeScale) {
+		writer.String("scaleRelativeTo");
+		writer.String(size.scaleRelativeTo.c_str());
+
+		writer.String("relativeScale");
+		writeVec(writer, size.relativeScale);
+	}
+	else {
+		writer.String("resolution");
+		writeVec(writer, size.resolution);
+	}
+}
+
+void readTextureSize(rapidjson::Value& json, TextureSize *const result)
+{
+	if (true == (result->useRelativeScale = json["useRelativeScale"].GetBool())) {
+		result->scaleRelativeTo = json["scaleRelativeTo"].GetString();
+		readVec(json["relativeScale"], &result->relativeScale);
+	}
+	else {
+		readVec(json["resolution"], &result->resolution);
+	}
+}
+
+void serializeShaderParamValue(const ShaderParamValue& value, const ShaderParamRefl& refl, JsonWriter& writer)
+{
+	if (refl.type == ShaderParamType::Float) {
+		writer.Double(value.floatValue);
+	}
+	else if (refl.type == ShaderParamType::Float2) {
+		writeVec(writer, value.float2Value);
+	}
+	else if (refl.type == ShaderParamType::Float3) {
+		writeVec(writer, value.float3Value);
+	}
+	else if (refl.type == ShaderParamType::Float4) {
+		writeVec(writer, value.float4Value);
+	}
+	else if (refl.type == ShaderParamType::Int) {
+		writer.Int(value.intValue);
+	}
+	else if (refl.type == ShaderParamType::Int2) {
+		writeVec(writer, value.int2Value);
+	}
+	else if (refl.type == ShaderParamType::Int3) {
+		writeVec(writer, value.int3Value);
+	}
+	else if (refl.type == ShaderParamType::Int4) {
+		writeVec(writer, value.int4Value);
+	}
+	else if (refl.type == ShaderParamType::Image2d || refl.type == ShaderParamType::Sampler2d) {
+		writer.StartObject();
+		{
+			writer.String("source");
+
+			switch (value.textureValue.source) {
+			case TextureDesc::Source::Load: {
+				writer.String("Load");
+
+				writer.String("path");
+				writer.String(value.textureValue.path.c_str());
+
+				if (value.textureValue.compress) {
+					writer.String("compress");
+					writer.Bool(true);
+				}
+
+				if (value.textureValue.exrPart > 0) {
+					writer.String("exrPart");
+					writer.Uint(value.textureValue.exrPart);
+				}
+				break;
+			}
+
+			case TextureDesc::Source::Create: {
+				writer.String("Create");
+				writeTextureSize(value.textureValue.size, writer);
+
+				writer.String("createFormat");
+				writer.String(textureFormatToString(value.textureValue.createFormat));
+				break;
+			}
+
+			case TextureDesc::Source::Input: {
+				writer.String("Input");
+				break;
+			}
+
+			case TextureDesc::Source::History: {
+				writer.String("History");
+
+				writer.String("historyOf");
+				writer.String(value.textureValue.historyOf.c_str());
+				break;
+			}
+
+			case TextureDesc::Source::Tiled: {
+				writer.String("Tiled");
+
+				writer.String("path");
+				writer.String(value.textureValue.path.c_str());
+
+				if (value.textureValue.exrPart > 0) {
+					writer.String("exrPart");
+					writer.Uint(value.textureValue.exrPart);
+				}
+				break;
+			}
+
+			case TextureDesc::Source::Sequence: {
+				writer.String("Sequence");
+
+				writer.String("path");
+				writer.String(value.textureValue.path.c_str());
+
+				writer.String("firstFrame");
+				writer.Uint(value.textureValue.firstFrame);
+
+				writer.String("lastFrame");
+				writer.Uint(value.textureValue.lastFrame);
+
+				writer.String("frameRate");
+				writer.Double(value.textureValue.frameRate);
+
+				if (value.textureValue.exrPart > 0) {
+					writer.String("exrPart");
+					writer.Uint(value.textureValue.exrPart);
+				}
+				break;
+			}
+			}
+
+			if (refl.type == ShaderParamType::Sampler2d)
+			{
+				writer.String("wrapS");
+				writer.Bool(value.textureValue.wrapS);
+
+				writer.String("wrapT");
+				writer.Bool(value.textureValue.wrapT);
+			}
+		}
+		writer.EndObject();
+	}
+	else if (refl.type == ShaderParamType::Buffer) {
+		writer.StartObject();
+		{
+			writer.String("source");
+
+			switch (value.bufferValue.source) {
+				case BufferDesc::Source::Create: {
+					writer.String("Create");
+					writeTextureSize(value.bufferValue.size, writer);
+					break;
+				}
+
+				case BufferDesc::Source::Input: {
+					writer.String("Input");
+					break;
+				}
+			}
+		}
+		writer.EndObject();
+	}
+	else {
+		assert(false);
+		writer.StartObject();
+		writer.EndObject();
+	}
+}
+
+void deserializeShaderParamRefl(rapidjson::Value& json, ShaderParamRefl *const refl)
+{
+	refl->name = json["name"].GetString();
+	refl->type = parseShaderParamTypeName(json["type"].GetString());
+	assert(refl->type != ShaderParamType::Unknown);
+	// TODO(?): annotation
+}
+
+void deserializeShaderParamValue(rapidjson::Value& json, const ShaderParamRefl& refl, ShaderParamValue *const value)
+{
+	if (refl.type == ShaderParamType::Float) {
+		value->floatValue = json.GetFloat();
+	}
+	else if (refl.type == ShaderParamType::Float2) {
+		auto& v = json.GetArray();
+		value->float2Value = vec2(v[0].GetFloat(), v[1].GetFloat());
+	}
+	else if (refl.type == ShaderParamType::Float3) {
+		auto& v = json.GetArray();
+		value->float3Value = vec3(v[0].GetFloat(), v[1].GetFloat(), v[2].GetFloat());
+	}
+	else if (refl.type == ShaderParamType::Float4) {
+		auto& v = json.GetArray();
+		value->float4Value = vec4(v[0].GetFloat(), v[1].GetFloat(), v[2].GetFloat(), v[3].GetFloat());
+	}
+	else if (refl.type == ShaderParamType::Int) {
+		value->intValue = json.GetInt();
+	}
+	else if (refl.type == ShaderParamType::Int2) {
+		auto& v = json.GetArray();
+		value->int2Value = ivec2(v[0].GetInt(), v[1].GetInt());
+	}
+	else if (refl.type == ShaderParamType::Int3) {
+		auto& v = json.GetArray();
+		value->int3Value = ivec3(v[0].GetInt(), v[1].GetInt(), v[2].GetInt());
+	}
+	else if (refl.type == ShaderParamType::Int4) {
+		auto& v = json.GetArray();
+		value->int4Value = ivec4(v[0].GetInt(), v[1].GetInt(), v[2].GetInt(), v[3].GetInt());
+	}
+	else if (refl.type == ShaderParamType::Image2d || refl.type == ShaderParamType::Sampler2d) {
+		value->textureValue.source = TextureDesc::Source::Input;
+		if (0 == strcmp("Load", json["source"].GetString())) value->textureValue.source = TextureDesc::Source::Load;
+		else if (0 == strcmp("Create", json["source"].GetString())) value->textureValue.source = TextureDesc::Source::Create;
+		else if (0 == strcmp("History", json["source"].GetString())) value->textureValue.source = TextureDesc::Source::History;
+		else if (0 == strcmp("Tiled", json["source"].GetString())) value->textureValue.source = TextureDesc::Source::Tiled;
+		else if (0 == strcmp("Sequence", json["source"].GetString())) value->textureValue.source = TextureDesc::Source::Sequence;
+
+		switch (value->textureValue.source) {
+		case TextureDesc::Source::Load: {
+			value->textureValue.path = json["path"].GetString();
+			value->textureValue.compress = json.HasMember("compress") && json["compress"].GetBool();
+			value->textureValue.exrPart = json.HasMember("exrPart") ? json["exrPart"].GetUint() : 0;
+			break;
+		}
+
+		case TextureDesc::Source::Create: {
+			readTextureSize(json, &value->textureValue.size);
+			if (json.HasMember("createFormat")) {
+				parseTextureFormat(json["createFormat"].GetString(), &value->textureValue.createFormat);
+			}
+			break;
+		}
+
+		case TextureDesc::Source::Input: {
+			break;
+		}
+
+		case TextureDesc::Source::History: {
+			value->textureValue.historyOf = json["historyOf"].GetString();
+			break;
+		}
+
+		case TextureDesc::Source::Tiled: {
+			value->textureValue.path = json["path"].GetString();
+			value->textureValue.exrPart = json.HasMember("exrPart") ? json["exrPart"].GetUint() : 0;
+			break;
+		}
+
+		case TextureDesc::Source::Sequence: {
+			value->textureValue.path = json["path"].GetString();
+			value->textureValue.firstFrame = json["firstFrame"].GetUint();
+			value->textureValue.lastFrame = json["lastFrame"].GetUint();
+			value->textureValue.frameRate = json["frameRate"].GetFloat();
+			value->textureValue.exrPart = json.HasMember("exrPart") ? json["exrPart"].GetUint() : 0;
+			break;
+		}
+		}
+
+		// Tiled and Sequence sources can only be sampled
+		const bool sampledOnly = TextureDesc::Source::Tiled == value->textureValue.source || TextureDesc::Source::Sequence == value->textureValue.source;
+		if (refl.type == ShaderParamType::Image2d && sampledOnly) {
+			value->textureValue.source = TextureDesc::Source::Input;
+		}
+
+		if (refl.type == ShaderParamType::Sampler2d)
+		{
+			// Samplers can't be Created
+			if (TextureDesc::Source::Create == value->textureValue.source) {
+				value->textureValue.source = TextureDesc::Source::Input;
+			}
+
+			value->textureValue.wrapS = json["wrapS"].GetBool();
+			value->textureValue.wrapT = json["wrapT"].GetBool();
+		}
+	}
+	else if (refl.type == ShaderParamType::Buffer) {
+		value->bufferValue.source = BufferDesc::Source::Input;
+		if (0 == strcmp("Create", json["source"].GetString())) value->bufferValue.source = BufferDesc::Source::Create;
+
+		switch (value->bufferValue.source) {
+			case BufferDesc::Source::Create: {
+				readTextureSize(json, &value->bufferValue.size);
+				break;
+			}
+
+			case BufferDesc::Source::Input: {
+				break;
+			}
+		}
+	}
+}
+
+
+bool compileTextureSize(
+	const PassCompilerSettings& settings,
+	RenderPass& pass,	// TODO: should be const
+	const CompiledPass& compiledPass,
+	const TextureSize& size,
+	bool allowRelativeToCreated,
+	ivec2 *const res)
+{
+	*res = size.resolution;
+
+	if (size.useRelativeScale) {
+		if (size.scaleRelativeTo == "#window") {
+			res->x = s32(std::max(0.0f, size.relativeScale.x) * settings.windowSize.x);
+			res->y = s32(std::max(0.0f, size.relativeScale.y) * settings.windowSize.y);
+		}
+		else {
+			u32 otherParamIdx = 0;
+			for (const auto& param : pass.params()) {
+				if (param.refl.name == size.scaleRelativeTo) {
+					const bool isImage = param.refl.type == ShaderParamType::Sampler2d || param.refl.type == ShaderParamType::Image2d;
+					const bool isCreatedImage = param.value.textureValue.source == TextureDesc::Source::Create || param.value.textureValue.source == TextureDesc::Source::History;
+					const bool isAllowedImage = isImage && (allowRelativeToCreated || !isCreatedImage);
+
+					if (isAllowedImage) {
+						const CompiledImage& otherImg = compiledPass.compiledImages[otherParamIdx];
+						if (!otherImg.valid() && !otherImg.tiled()) {
+							// TODO: report an error; a required input isn't these, thus we can't compile this graph
+							return false;
+						}
+						res->x = s32(std::max(0.0f, size.relativeScale.x) * otherImg.size().x);
+						res->y = s32(std::max(0.0f, size.relativeScale.y) * otherImg.size().y);
+					}
+					else {
+						// TODO: report an error. can only have scale relative to non-created textures
+					}
+				}
+
+				++otherParamIdx;
+			}
+		}
+	}
+
+	return true;
+}
+
+inline unsigned int textureFormatToGl(TextureFormat fmt) {
+	switch (fmt) {
+	case TextureFormat::rgba16f: return GL_RGBA16F;
+	case TextureFormat::r32ui: return GL_R32UI;
+	default: assert(false); return GL_RGBA16F;
+	}
+}
+
+bool compileCreatedImageKey(const PassCompilerSettings& settings, RenderPass& pass, const TextureDesc& desc, const CompiledPass& compiledPass, TextureKey *const key)
+{
+	ivec2 imgSize;
+	if (!compileTextureSize(settings, pass, compiledPass, desc.size, false, &imgSize)) {
+		return false;
+	}
+
+	key->format = textureFormatToGl(desc.createFormat);
+	key->width = std::max(1, imgSize.x);
+	key->height = std::max(1, imgSize.y);
+	return true;
+}
+
+u32 getMaxLoadedTextureSize(const PassCompilerSettings& settings, const ShaderParamRefl& refl)
+{
+	if (settings.fullResolutionTextures) {
+		return 0;
+	}
+
+	const u32 annotated = u32(std::max(0, refl.annotation.get("maxSize", 0)));
+	if (0 == annotated || 0 == settings.maxTextureSize) {
+		return std::max(annotated, settings.maxTextureSize);
+	}
+
+	return std::min(annotated, settings.maxTextureSize);
+}
+
+bool compileImage(const PassCompilerSettings& settings, RenderPass& pass, const TextureDesc& desc, u32 maxLoadSize, CompiledImage *const compiled, const CompiledPass *const compiledPass)
+{
+	if (desc.source == TextureDesc::Source::Create) {
+		TextureKey key;
+		if (!compileCreatedImageKey(settings, pass, desc, *compiledPass, &key)) {
+			return false;
+		}
+
+		if (compiledPass->graphTiled) {
+			compiled->wholeKey = key;
+		} else {
+			compiled->tex = createTransientTexture(desc, key);
+		}
+		compiled->owned = true;
+		compiled->clear = true;	// TODO: initial state handling
+	}
+	else if (desc.source == TextureDesc::Source::Load) {
+		compiled->tex = loadTexture(desc, maxLoadSize);
+	}
+	else if (desc.source == TextureDesc::Source::Tiled) {
+		compiled->virtualTexture = loadVirtualTexture(desc);
+		compiled->tex = compiled->virtualTexture ? compiled->virtualTexture->pool() : TextureHandle();
+	}
+	else if (desc.source == TextureDesc::Source::Sequence) {
+		ImageSequence* const seq = loadImageSequence(desc);
+		compiled->tex = seq ? seq->update(settings.playbackTime) : TextureHandle();
+	}
+
+	return true;
+}
+
+bool compileBuffer(const PassCompilerSettings& settings, RenderPass& pass, const BufferSize& sizeDesc, const BufferDesc& desc, CompiledBuffer *const compiled, const CompiledPass *const compiledPass)
+{
+	if (desc.source != BufferDesc::Source::Create) {
+		return true;
+	}
+
+	ivec2 bufSize;
+	if (!compileTextureSize(settings, pass, *compiledPass, desc.size, false, &bufSize)) {
+		return false;
+	}
+
+	BufferKey key = { bufSize.x * bufSize.y * sizeDesc.tailArrayStrideBytes + sizeDesc.baseSizeBytes };
+	key.sizeBytes = std::max(4u, key.sizeBytes);
+
+	compiled->buf = createTransientBuffer(desc, key);
+	compiled->owned = true;
+
+	return true;
+}
+
+bool ComputePass::compile(const PassCompilerSettings& settings, CompiledPass *const compiled)
+{
+	compiled->shader = m_computeShader.get();
+	compiled->params = params();
+
+	size_t defineCount = 0;
+	for (size_t i = 0; i < m_paramRefl.size(); ++i) {
+		if (m_baked || isStaticParam(m_paramRefl[i])) {
+			if (defineCount == m_variantDefines.size()) {
+				m_variantDefines.emplace_back();
+			}
+
+			auto& define = m_variantDefines[defineCount];
+			if (getShaderParamConstant(m_paramRefl[i].type, m_paramValues[i], &define.second)) {
+				define.first = m_paramRefl[i].name;
+				++defineCount;
+			}
+		}
+	}
+	m_variantDefines.resize(defineCount);
+	compiled->program = &m_computeShader->getVariantProgram(m_variantDefines);
+
+	// Compile images from files first, so that we can have Created images relative to their dimensions
+	for (size_t i = 0; i < m_paramRefl.size(); ++i) {
+		const bool isTexture = m_paramRefl[i].type == ShaderParamType::Image2d || m_paramRefl[i].type == ShaderParamType::Sampler2d;
+		const TextureDesc::Source source = m_paramValues[i].textureValue.source;
+		if (isTexture && (source == TextureDesc::Source::Load || source == TextureDesc::Source::Tiled || source == TextureDesc::Source::Sequence)) {
+			const u32 maxLoadSize = getMaxLoadedTextureSize(settings, m_paramRefl[i]);
+			if (!compileImage(settings, *this, m_paramValues[i].textureValue, maxLoadSize, &compiled->compiledImages[i], nullptr)) {
+				return false;
+			}
+		}
+	}
+
+	pruneHistoryTextures();
+
+	// Left over from a compile whose package failed
+	for (auto& it : m_historyTextures) {
+		it.second.written = false;
+	}
+
+	for (size_t i = 0; i < m_paramRefl.size(); ++i) {
+		if (m_paramRefl[i].type == ShaderParamType::Image2d && m_paramValues[i].textureValue.source != TextureDesc::Source::Load) {
+			if (m_paramValues[i].textureValue.source == TextureDesc::Source::Create && m_historyTextures.count(m_paramRefl[i].name) > 0) {
+				if (!compileHistoryImage(settings, i, compiled)) {
+					return false;
+				}
+			}
+			else if (!compileImage(settings, *this, m_paramValues[i].textureValue, 0, &compiled->compiledImages[i], compiled)) {
+				return false;
+			}
+		}
+
+		if (m_paramRefl[i].type == ShaderParamType::Buffer) {
+			if (!compileBuffer(settings, *this, m_paramRefl[i].bufferSize, m_paramValues[i].bufferValue, &compiled->compiledBuffers[i], compiled)) {
+				return false;
+			}
+		}
+	}
+
+	// History params read the previous frame of a Created image in this pass
+	for (size_t i = 0; i < m_paramRefl.size(); ++i) {
+		const bool isTexture = m_paramRefl[i].type == ShaderParamType::Image2d || m_paramRefl[i].type == ShaderParamType::Sampler2d;
+		if (isTexture && m_paramValues[i].textureValue.source == TextureDesc::Source::History) {
+			// Added for every History param by pruneHistoryTextures
+			HistoryTextures& history = m_historyTextures[m_paramValues[i].textureValue.historyOf];
+			if (!history.tex[0].valid()) {
+				// The param is left unbound; the rest of the pass still runs
+				if (!history.reportedMissing) {
+					fprintf(stderr, "%s: %s reads the history of %s, which isn't a Created image of the same pass\n",
+						m_computeShader->m_sourceFile.c_str(), m_paramRefl[i].name.c_str(), m_paramValues[i].textureValue.historyOf.c_str());
+					history.reportedMissing = true;
+				}
+				continue;
+			}
+
+			history.reportedMissing = false;
+
+			CompiledImage& img = compiled->compiledImages[i];
+			img.tex = history.tex[history.current];
+			img.clear = history.needsClear[history.current];
+		}
+	}
+
+	// Each param gets its own sampler state, even if several read the same texture
+	for (size_t i = 0; i < m_paramRefl.size(); ++i) {
+		CompiledImage& img = compiled->compiledImages[i];
+		if (m_paramRefl[i].type == ShaderParamType::Sampler2d && img.valid()) {
+			img.sampler = getSampler(getSamplerDesc(Resources::get(img.tex), m_paramValues[i].textureValue));
+		}
+		else if (m_paramRefl[i].type == ShaderParamType::Sampler2d && img.tiled()) {
+			// The tiles aren't allocated yet; like all Created images, they have a single level
+			CreatedTexture whole;
+			whole.key = img.wholeKey;
+			img.sampler = getSampler(getSamplerDesc(whole, m_paramValues[i].textureValue));
+		}
+
+		if (img.producer) {
+			img.apron = getInputApron(i);
+		}
+
+		// Such textures are only upright through sampleFlipped; see data/std/sampleFlipped.glsl
+		const CreatedTexture* const tex = Resources::find(img.tex);
+		if (tex && tex->flipY && -1 == compiled->program->textureUniforms[i].flipY) {
+			static std::unordered_set<std::string> reported;
+			if (reported.insert(m_computeShader->m_sourceFile + ":" + m_paramRefl[i].name).second) {
+				fprintf(stderr, "%s: %s is stored top-down, but the shader doesn't declare %s_flipY, so it will be upside down\n",
+					m_computeShader->m_sourceFile.c_str(), m_paramRefl[i].name.c_str(), m_paramRefl[i].name.c_str());
+			}
+		}
+	}
+
+	return true;
+}
+
+void ComputePass::commitHistory()
+{
+	for (size_t i = 0; i < m_paramRefl.size(); ++i) {
+		const bool isTexture = m_paramRefl[i].type == ShaderParamType::Image2d || m_paramRefl[i].type == ShaderParamType::Sampler2d;
+		if (!isTexture) {
+			continue;
+		}
+
+		const TextureDesc& desc = m_paramValues[i].textureValue;
+		if (desc.source == TextureDesc::Source::History) {
+			HistoryTextures& history = m_historyTextures[desc.historyOf];
+			history.needsClear[history.current] = false;
+		}
+	}
+
+	for (auto& it : m_historyTextures) {
+		HistoryTextures& history = it.second;
+		if (history.written) {
+			history.written = false;
+			history.needsClear[history.current ^ 1] = false;
+			history.current ^= 1;
+		}
+	}
+}
+
+void ComputePass::serialize(JsonWriter& writer)
+{
+	writer.String("type");
+	writer.String("Compute");
+
+	writer.String("shader");
+	writer.String(m_computeShader->m_sourceFile.c_str());
+
+	writer.String("params");
+	writer.StartArray();
+	serializeParams(writer);
+	writer.EndArray();
+
+	writer.String("dispatch");
+	writer.StartObject();
+	writeTextureSize(m_dispatchSize, writer);
+	writer.EndObject();
+
+	if (m_baked) {
+		writer.String("baked");
+		writer.Bool(true);
+	}
+}
+
+void ComputePass::deserialize(rapidjson::Value& json, DeserializationContext& ctx)
+{
+	assert(0 == strcmp(json["type"].GetString(), "Compute"));
+	deserializeParams(json["params"], ctx);
+
+	if (ctx.compileShaders) {
+		setShader(ShaderLibrary::get(json["shader"].GetString()));
+	} else {
+		// Not shared, as it's never compiled
+		ShaderLibrary::unsubscribe(m_computeShader.get(), this);
+		m_computeShader = std::make_shared<ComputeShader>();
+		m_computeShader->m_sourceFile = json["shader"].GetString();
+		for (const PrevShaderParam& param : m_prevParams) {
+			ShaderParamBindingRefl refl;
+			static_cast<ShaderParamRefl&>(refl) = param.refl;
+			m_computeShader->m_params.push_back(refl);
+		}
+
+		updateParams();
+	}
+
+	if (json.HasMember("dispatch")) {
+		readTextureSize(json["dispatch"], &m_dispatchSize);
+	}
+
+	m_baked = json.HasMember("baked") && json["baked"].GetBool();
+}
+
+void ComputePass::deserializeParams(rapidjson::Value& json, DeserializationContext& ctx)
+{
+	auto& params = json.GetArray();
+	m_prevParams.resize(params.Size());
+
+	for (size_t i = 0; i < params.Size(); ++i) {
+		PrevShaderParam& param = m_prevParams[i];
+		param.uid = nextParamUid();
+		ctx.uidMap[params[i]["uid"].GetUint()] = param.uid;
+
+		deserializeShaderParamRefl(params[i]["refl"], &param.refl);
+		deserializeShaderParamValue(params[i]["value"], param.refl, &param.value);
+	}
+}
+
+void ComputePass::setShader(const shared_ptr<ComputeShader>& shader)
+{
+	if (m_computeShader) {
+		ShaderLibrary::unsubscribe(m_computeShader.get(), this);
+	}
+
+	m_computeShader = shader;
+	updateParams();
+
+	ShaderLibrary::subscribe(m_computeShader.get(), this, [this]()
+	{
+		updateParams();
+	});
+}
+
+void ComputePass::updateParams()
+{
+	vector<ShaderParamValue> newValues(m_computeShader->m_params.size());
+	vector<u32> newUids(m_computeShader->m_params.size());
+
+	for (size_t i = 0; i < newValues.size(); ++i) {
+		ShaderParamBindingRefl& newRefl = m_computeShader->m_params[i];
+		ShaderParamValue& newValue = newValues[i];
+		u32& newUid = newUids[i];
+
+		auto curMatch = std::find_if(m_paramRefl.begin(), m_paramRefl.end(), [&](auto& p) { return p.name == newRefl.name; });
+		if (curMatch != m_paramRefl.end()) {
+			if (curMatch->type == newRefl.type) {
+				// Found a value for the new field in the current array
+				const size_t src = std::distance(m_paramRefl.begin(), curMatch);
+				newValue = m_paramValues[src];
+				newUid = m_paramUids[src];
+			} else {
+				// Otherwise we found the param by name, but the type changed. Use the default.
+				newValue = m_computeShader->m_params[i].defaultValue();
+				newUid = nextParamUid();
+			}
+
+			// Drop the saved param since we have a new entry for it. We'll nuke params with empty names.
+			curMatch->name.clear();
+		} else {
+			// No match in current params, but maybe we have a match in the m_prevParams array.
+
+			auto prevMatch = std::find_if(m_prevParams.begin(), m_prevParams.end(), [&](auto& p) { return p.refl.name == newRefl.name; });
+			if (prevMatch != m_prevParams.end()) {
+				// Got a match in old params
+				if (prevMatch->refl.type == newRefl.type) {
+					// Type matches, let's go with it
+					newValue = prevMatch->value;
+					newUid = prevMatch->uid;
+				} else {
+					// Otherwise we have found an old param, but its type is now different. Use the default.
+					newValue = m_computeShader->m_params[i].defaultValue();
+					newUid = nextParamUid();
+				}
+
+				// Drop the old param
+				prevMatch->refl.name.clear();
+			} else {
+				// No match found anywhere. Just go with the default.
+				newValue = m_computeShader->m_params[i].defaultValue();
+				newUid = nextParamUid();
+			}
+		}
+	}
+
+	// Nuke old and current params that we've matched up to the new shader
+	m_prevParams.erase(
+		std::remove_if(m_prevParams.begin(), m_prevParams.end(), [](const auto& p) { return p.refl.name.empty(); }),
+		m_prevParams.end()
+	);
+
+	// All params from the previous shader version that we didn't find in the current one
+	// go to the m_prevParams array, so that we can restore old values upon further shader modifications.
+	for (size_t i = 0; i < m_paramRefl.size(); ++i) {
+		if (!m_paramRefl[i].name.empty()) {
+			m_prevParams.push_back({ m_paramRefl[i], m_paramValues[i], m_paramUids[i] });
+		}
+	}
+
+	newValues.swap(m_paramValues);
+	newUids.swap(m_paramUids);
+	m_paramRefl.resize(m_computeShader->m_params.size());
+
+	for (size_t i = 0; i < m_paramRefl.size(); ++i) {
+		m_paramRefl[i] = m_computeShader->m_params[i];
+	}
+}
+
+void ComputePass::pruneHistoryTextures()
+{
+	// Runs every frame, and passes only have a handful of params, so this searches instead of building a set
+	auto isHistoryParam = [this](size_t i) {
+		const bool isTexture = m_paramRefl[i].type == ShaderParamType::Image2d || m_paramRefl[i].type == ShaderParamType::Sampler2d;
+		return isTexture && m_paramValues[i].textureValue.source == TextureDesc::Source::History;
+	};
+
+	auto isReadViaHistory = [&](const std::string& name) {
+		for (size_t i = 0; i < m_paramRefl.size(); ++i) {
+			if (isHistoryParam(i) && m_paramValues[i].textureValue.historyOf == name) {
+				return true;
+			}
+		}
+		return false;
+	};
+
+	for (size_t i = 0; i < m_paramRefl.size(); ++i) {
+		if (isHistoryParam(i)) {
+			m_historyTextures[m_paramValues[i].textureValue.historyOf];
+		}
+	}
+
+	for (auto it = m_historyTextures.begin(); it != m_historyTextures.end(); ) {
+		if (!isReadViaHistory(it->first)) {
+			releaseHistoryTextures(it->second);
+			it = m_historyTextures.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+void ComputePass::releaseHistoryTextures(HistoryTextures& history)
+{
+	for (TextureHandle& tex : history.tex) {
+		Resources::release(tex);
+		tex = TextureHandle();
+	}
+}
+
+bool ComputePass::compileHistoryImage(const PassCompilerSettings& settings, size_t paramIdx, CompiledPass *const compiled)
+{
+	const TextureDesc& desc = m_paramValues[paramIdx].textureValue;
+
+	TextureKey key;
+	if (!compileCreatedImageKey(settings, *this, desc, *compiled, &key)) {
+		return false;
+	}
+
+	HistoryTextures& history = m_historyTextures[m_paramRefl[paramIdx].name];
+	const u32 next = history.current ^ 1;
+
+	for (u32 i = 0; i < 2; ++i) {
+		const CreatedTexture* const existing = Resources::find(history.tex[i]);
+		if (!existing || !(existing->key == key)) {
+			Resources::release(history.tex[i]);
+			history.tex[i] = createTexture(desc, key);
+			history.needsClear[i] = true;
+		}
+	}
+
+	CompiledImage& img = compiled->compiledImages[paramIdx];
+	img.tex = history.tex[next];
+	img.owned = false;
+	img.clear = true;	// TODO: initial state handling
+	history.written = true;
+
+	return true;
+}
+
+std::string ComputePass::getGraphTileBlocker() const
+{
+	const std::string& name = m_computeShader->m_sourceFile;
+
+	if (!m_computeShader->m_tileable) {
+		return name + " isn't annotated as tileable";
+	}
+
+	// Invocation IDs only follow the tile with the offset; see loadShaderSource
+	if (-1 == m_computeShader->m_programRefl.dispatchOffset) {
+		return name + " doesn't index by gl_GlobalInvocationID";
+	}
+
+	for (size_t i = 0; i < m_paramRefl.size(); ++i) {
+		const bool isTexture = m_paramRefl[i].type == ShaderParamType::Image2d || m_paramRefl[i].type == ShaderParamType::Sampler2d;
+		const TextureDesc& desc = m_paramValues[i].textureValue;
+
+		if (isTexture && desc.source == TextureDesc::Source::History) {
+			return name + " reads the history of " + desc.historyOf;
+		}
+
+		// A tile's texture wraps around on itself, not on the whole image
+		if (m_paramRefl[i].type == ShaderParamType::Sampler2d && desc.source == TextureDesc::Source::Input && (desc.wrapS || desc.wrapT)) {
+			return name + " samples " + m_paramRefl[i].name + " with wrapping";
+		}
+
+		if (m_paramRefl[i].type == ShaderParamType::Buffer && m_paramValues[i].bufferValue.source == BufferDesc::Source::Create) {
+			return name + " creates the buffer " + m_paramRefl[i].name;
+		}
+	}
+
+	return std::string();
+}
+
+s32 ComputePass::getInputApron(size_t paramIdx) const
+{
+	const char* const apron = m_paramRefl[paramIdx].annotation.get("apron", "");
+
+	for (size_t i = 0; i < m_paramRefl.size(); ++i) {
+		if (m_paramRefl[i].type == ShaderParamType::Int && m_paramRefl[i].name == apron) {
+			return std::abs(m_paramValues[i].intValue);
+		}
+	}
+
+	return std::max(0, atoi(apron));
+}
+
+bool needsOutputPort(const ShaderParamProxy& param)
+{
+	if (param.refl.type == ShaderParamType::Image2d) {
+		return param.value.textureValue.source == TextureDesc::Source::Create;
+	}
+	else if (param.refl.type == ShaderParamType::Buffer) {
+		return param.value.bufferValue.source == BufferDesc::Source::Create;
+	}
+	else {
+		return false;
+	}	
+}
+
+bool needsInputPort(const ShaderParamProxy& param)
+{
+	if (param.refl.type == ShaderParamType::Image2d || param.refl.type == ShaderParamType::Sampler2d) {
+		return param.value.textureValue.source == TextureDesc::Source::Input;
+	}
+	else if (param.refl.type == ShaderParamType::Buffer) {
+		return param.value.bufferValue.source == BufferDesc::Source::Input;
+	}
+	else {
+		return false;
+	}
+}
+
+void serializeGraph(nodegraph::Graph& graph, JsonWriter& writer)
+{
+	writer.String("nodes");
+	writer.StartArray();
+
+	graph.iterNodes([&](nodegraph::node_handle nodeHandle) {
+		writer.StartObject();
+
+		writer.String("idx");
+		writer.Int(nodeHandle.idx);
+
+		writer.String("inputs");
+		writer.StartArray();
+		graph.iterNodeInputPorts(nodeHandle, [&](nodegraph::port_handle portHandle) {
+			writer.StartObject();
+
+			writer.String("idx");
+			writer.Int(portHandle.idx);
+
+			const nodegraph::Port& port = graph.ports[portHandle.idx];
+			writer.String("uid");
+			writer.Int(port.uid);
+
+			if (port.link != nodegraph::invalid_link_idx) {
+				writer.String("src");
+				writer.Int(graph.links[port.link].srcPort);
+			}
+
+			writer.EndObject();
+		});
+		writer.EndArray();
+
+		writer.String("outputs");
+		writer.StartArray();
+		graph.iterNodeOutputPorts(nodeHandle, [&](nodegraph::port_handle portHandle) {
+			writer.StartObject();
+
+			writer.String("idx");
+			writer.Int(portHandle.idx);
+
+			const nodegraph::Port& port = graph.ports[portHandle.idx];
+			writer.String("uid");
+			writer.Int(port.uid);
+
+			writer.EndObject();
+		});
+		writer.EndArray();
+
+		writer.EndObject();
+	});
+
+	writer.EndArray();
+}
+
+void deserializeGraph(nodegraph::Graph *const graph, const rapidjson::Value& json, DeserializationContext& ctx)
+{
+	auto& nodes = json["nodes"].GetArray();
+	std::unordered_map<int, nodegraph::port_handle> portMap;
+
+	auto mapUid = [&](u32 uid, u32* mapped) {
+		auto found = ctx.uidMap.find(uid);
+		if (found != ctx.uidMap.end()) {
+			*mapped = found->second;
+			return true;
+		} else {
+			return false;
+		}
+	};
+
+	for (size_t i = 0; i < nodes.Size(); ++i) {
+		auto& node = nodes[i];
+		auto foundNode = ctx.nodeMap.find(node["idx"].GetInt());
+		if (foundNode == ctx.nodeMap.end()) {
+			continue;
+		}
+
+		const nodegraph::node_handle nodeHandle = foundNode->second;
+
+		auto& inputs = node["inputs"].GetArray();
+		for (size_t j = 0; j < inputs.Size(); ++j) {
+			auto& port = inputs[j];
+			u32 uid;
+			if (mapUid(port["uid"].GetInt(), &uid)) {
+				nodegraph::port_handle portHandle = graph->addPort(nodeHandle.idx, uid);
+				graph->addInputPortToNode(graph->nodes[nodeHandle.idx], portHandle.idx);
+				portMap[port["idx"].GetInt()] = portHandle;
+			}
+		}
+
+		auto& outputs = node["outputs"].GetArray();
+		for (size_t j = 0; j < outputs.Size(); ++j) {
+			auto& port = outputs[j];
+			u32 uid;
+			if (mapUid(port["uid"].GetInt(), &uid)) {
+				nodegraph::port_handle portHandle = graph->addPort(nodeHandle.idx, uid);
+				graph->addOutputPortToNode(graph->nodes[nodeHandle.idx], portHandle.idx);
+				portMap[port["idx"].GetInt()] = portHandle;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < nodes.Size(); ++i) {
+		auto& node = nodes[i];
+		auto foundNode = ctx.nodeMap.find(node["idx"].GetInt());
+		if (foundNode == ctx.nodeMap.end()) {
+			continue;
+		}
+
+		const nodegraph::node_handle nodeHandle = foundNode->second;
+
+		auto& inputs = node["inputs"].GetArray();
+		for (size_t j = 0; j < inputs.Size(); ++j) {
+			auto& port = inputs[j];
+
+			if (!port.HasMember("src")) {
+				continue;
+			}
+
+			auto src = portMap.find(port["src"].GetInt());
+			if (src == portMap.end()) {
+				continue;
+			}
+
+			auto dst = portMap.find(port["idx"].GetInt());
+			if (dst == portMap.end()) {
+				continue;
+			}
+
+			graph->addLink(src->second.idx, dst->second.idx);
+		}
+	}
+}
+
+void Package::findPassOrder(nodegraph::node_handle outputPass, FrameVector<nodegraph::node_idx> *const order)
+{
+	FrameVector<bool> enqueued(graph.nodes.size(), false);	// has it been added to the 'order' list yet?
+	FrameVector<bool> visited(graph.nodes.size(), false);	// has it been visited yet?
+
+	FrameVector<std::pair<nodegraph::node_idx, bool>> nodeStack;
+	nodeStack.reserve(graph.links.size() + 1);
+	nodeStack.push_back({outputPass.idx, false});
+
+	while (!nodeStack.empty()) {
+		auto top = nodeStack.back();
+		nodegraph::node_idx nodeIdx = top.first;
+		nodeStack.pop_back();
+
+		if (!top.second) {
+			if (!visited[nodeIdx]) {
+				// Push it into the stack again, so that we process it after
+				// its incident subgraph has been visited.
+				nodeStack.push_back({ nodeIdx, true });
+				visited[nodeIdx] = true;
+
+				// TODO: only follow valid links, return error if not all ports are connected
+				graph.iterNodeIncidentLinks(nodeIdx, [&](nodegraph::link_handle linkHandle) {
+					nodegraph::node_idx srcNode = graph.ports[graph.links[linkHandle.idx].srcPort].node;
+					nodeStack.push_back({ srcNode, false });
+				});
+			}
+		} else {
+			if (!enqueued[nodeIdx]) {
+				order->push_back(nodeIdx);
+				enqueued[nodeIdx] = true;
+			}
+		}
+	}
+}
+
+bool Package::compile(const PassCompilerSettings& settings, CompiledPackage *const compiled)
+{
+	u32 alivePassCount = 0;
+	graph.iterNodes([&](nodegraph::node_handle) {
+		++alivePassCount;
+	});
+
+	compiled->orderedPasses.clear();
+
+	// Find the output pass
+	nodegraph::node_handle outputPass = getOutputPass();
+	if (!outputPass.valid()) {
+		return false;
+	}
+
+	// Perform a topological sort, and identify the order to run passes in
+	FrameVector<nodegraph::node_idx> passOrder;
+	passOrder.reserve(alivePassCount);
+	findPassOrder(outputPass, &passOrder);
+
+	compiled->orderedPasses.resize(passOrder.size());
+	FrameVector<CompiledPass*> passToCompiledPass(m_passes.size(), nullptr);
+
+	// Graph tiles need every pass to be tileable; otherwise the graph renders whole, as it always could
+	bool graphTiled = settings.graphTileSize.x > 0 && settings.graphTileSize.y > 0;
+	if (graphTiled) {
+		std::string blocker;
+		for (const nodegraph::node_idx nodeIdx : passOrder) {
+			const ComputePass *const computePass = dynamic_cast<const ComputePass*>(m_passes[nodeIdx].get());
+			if (computePass) {
+				blocker = computePass->getGraphTileBlocker();
+				if (!blocker.empty()) {
+					break;
+				}
+			}
+		}
+
+		if (blocker != m_graphTileBlocker && !blocker.empty()) {
+			fprintf(stderr, "Rendering without graph tiles: %s\n", blocker.c_str());
+		}
+
+		m_graphTileBlocker = blocker;
+		graphTiled = blocker.empty();
+	}
+
+	// Compile passes, create and load textures
+	u32 compiledPassIdx = 0;
+	for (const nodegraph::node_idx nodeIdx : passOrder) {
+		RenderPass& dstPass = *m_passes[nodeIdx];
+		if (nodeIdx == outputPass.idx) {
+			compiled->outputPassIdx = compiledPassIdx;
+		}
+
+		CompiledPass& dstCompiled = compiled->orderedPasses[compiledPassIdx++];
+		passToCompiledPass[nodeIdx] = &dstCompiled;
+
+		dstCompiled.compiledImages.clear();
+		dstCompiled.compiledBuffers.clear();
+
+		dstCompiled.compiledImages.resize(dstPass.params().size());
+		dstCompiled.compiledBuffers.resize(dstPass.params().size());
+		dstCompiled.graphTiled = graphTiled;
+
+		bool allInputsBound = true;
+
+		// Propagate texture inputs
+		graph.iterNodeInputPorts(nodeIdx, [&](nodegraph::port_handle portHandle) {
+			const nodegraph::Port& dstPort = graph.ports[portHandle.idx];
+			const int dstParamIdx = dstPass.findParamByPortUid(dstPort.uid);
+
+			// Only care if this is a valid port
+			if (dstParamIdx != -1)
+			{
+				if (dstPort.link != nodegraph::invalid_link_idx) {
+					const nodegraph::Link& link = graph.links[dstPort.link];
+					RenderPass& srcPass = *m_passes[graph.ports[link.srcPort].node];
+					CompiledPass& srcCompiled = *passToCompiledPass[graph.ports[link.srcPort].node];
+
+					const nodegraph::Port& srcPort = graph.ports[link.srcPort];
+					const int srcParamIdx = srcPass.findParamByPortUid(srcPort.uid);
+
+					if (srcParamIdx != -1) {
+						const CompiledImage& srcImg = srcCompiled.compiledImages[srcParamIdx];
+						CompiledImage& dstImg = dstCompiled.compiledImages[dstParamIdx];
+						dstImg.tex = srcImg.tex;
+						dstImg.wholeKey = srcImg.wholeKey;
+						if (srcImg.tiled()) {
+							dstImg.producer = &srcCompiled;
+							dstImg.producerParam = u32(srcParamIdx);
+						}
+						dstCompiled.compiledBuffers[dstParamIdx].buf = srcCompiled.compiledBuffers[srcParamIdx].buf;
+					} else {
+						allInputsBound = false;
+					}
+				} else {
+					allInputsBound = false;
+				}
+			}
+		});
+
+		if (!allInputsBound || !dstPass.compile(settings, &dstCompiled)) {
+			return false;
+		}
+	}
+
+	compiled->outputTexture = TextureHandle();
+	compiled->outputKey = TextureKey { 0, 0, 0 };
+	compiled->graphTileSize = graphTiled ? settings.graphTileSize : ivec2(0, 0);
+	for (auto& img : passToCompiledPass[outputPass.idx]->compiledImages) {
+		if (img.valid()) {
+			compiled->outputTexture = img.tex;
+			compiled->outputKey = Resources::get(img.tex).key;
+			break;
+		}
+		else if (img.tiled()) {
+			compiled->outputKey = img.wholeKey;
+			break;
+		}
+	}
+
+	// Find dispatch size for compute passes
+	for (const nodegraph::node_idx nodeIdx : passOrder) {
+		RenderPass& renderPass = *m_passes[nodeIdx];
+		ComputePass *const computePass = dynamic_cast<ComputePass*>(&renderPass);
+		if (!computePass) {
+			continue;
+		}
+
+		CompiledPass& compiled = *passToCompiledPass[nodeIdx];
+
+		if (computePass->shader().m_hasDefaultDispatchSize) {
+			computePass->m_dispatchSize = computePass->shader().m_defaultDispatchSize;
+		}
+
+		if (!compileTextureSize(settings, renderPass, compiled, computePass->m_dispatchSize, true, &compiled.dispatchSize)) {
+			return false;
+		}
+
+		compiled.dispatchTileSize = settings.dispatchTileSize;
+		compiled.regionOrigin = ivec2(0, 0);
+		compiled.regionSize = compiled.dispatchSize;
+	}
+
+	for (const nodegraph::node_idx nodeIdx : passOrder) {
+		if (ComputePass *const computePass = dynamic_cast<ComputePass*>(m_passes[nodeIdx].get())) {
+			computePass->commitHistory();
+		}
+	}
+
+	return true;
+}
+
+void CompiledPackage::render()
+{
+	u32 passIdx = 0;
+	for (auto& pass : orderedPasses) {
+		const bool profiled = GpuProfiler::enabled() || GlTrace::enabled();
+		const std::string scopeName = profiled ? "#" + std::to_string(passIdx) + " " + (pass.shader ? pass.shader->m_sourceFile : "") : std::string();
+
+		{
+			GlTrace::Scope traceScope(GlTrace::Subsystem::Render, scopeName);
+			pass.render();
+		}
+
+		if (GpuProfiler::enabled()) {
+			GpuProfiler::endScope(scopeName.c_str());
+		}
+		++passIdx;
+	}
+}
+
+// Finds the part of each pass a graph tile needs, from the output back. The Created images of a pass are assumed
+// to be written at its invocation IDs, and its Inputs read around the uvs of its invocations; see data/std/graphTile.glsl.
+static void layoutGraphTile(FrameVector<CompiledPass>& passes, CompiledPass& outputPass, ivec2 tileOrigin, ivec2 tileSize)
+{
+	for (auto& pass : passes) {
+		pass.regionOrigin = ivec2(0, 0);
+		pass.regionSize = ivec2(0, 0);
+	}
+
+	// The Output pass has no domain of its own, and reads its image as is
+	outputPass.regionOrigin = tileOrigin;
+	outputPass.regionSize = tileSize;
+
+	// Consumers come after their producers, so a pass's region is complete by the time it's reached
+	for (auto it = passes.rbegin(); it != passes.rend(); ++it) {
+		CompiledPass& pass = *it;
+		if (pass.regionSize.x <= 0 || pass.regionSize.y <= 0) {
+			continue;
+		}
+
+		if (pass.shader) {
+			// Whole work groups, as with dispatch tiles
+			const ivec2 groupSize = pass.program->workGroupSize;
+
+			const ivec2 regionEnd = glm::min(pass.regionOrigin + pass.regionSize, pass.dispatchSize);
+			pass.regionOrigin = (pass.regionOrigin / groupSize) * groupSize;
+			pass.regionSize = regionEnd - pass.regionOrigin;
+			if (pass.regionSize.x <= 0 || pass.regionSize.y <= 0) {
+				continue;
+			}
+		}
+
+		for (const CompiledImage& img : pass.compiledImages) {
+			if (!img.producer) {
+				continue;
+			}
+
+			const ivec2 imgSize = img.size();
+			const vec2 scale = pass.shader ? vec2(imgSize) / vec2(pass.dispatchSize) : vec2(1.0f);
+
+			// A texel more for filtering, and the rounding of uvs
+			const ivec2 apron = ivec2(img.apron + 1);
+			const ivec2 readMin = glm::max(ivec2(glm::floor(vec2(pass.regionOrigin) * scale)) - apron, ivec2(0));
+			const ivec2 readMax = glm::min(ivec2(glm::ceil(vec2(pass.regionOrigin + pass.regionSize) * scale)) + apron, imgSize);
+			if (readMax.x <= readMin.x || readMax.y <= readMin.y) {
+				continue;
+			}
+
+			CompiledPass& producer = *img.producer;
+			if (producer.regionSize.x <= 0 || producer.regionSize.y <= 0) {
+				producer.regionOrigin = readMin;
+				producer.regionSize = readMax - readMin;
+			} else {
+				const ivec2 unionMax = glm::max(producer.regionOrigin + producer.regionSize, readMax);
+				producer.regionOrigin = glm::min(producer.regionOrigin, readMin);
+				producer.regionSize = unionMax - producer.regionOrigin;
+			}
+		}
+	}
+}
+
+void CompiledPackage::renderTiles(const std::function<void(const CreatedTexture& tex, ivec2 srcOffset, ivec2 dstOffset, ivec2 size)>& onTile)
+{
+	const ivec2 outputSize = ivec2(outputKey.width, outputKey.height);
+
+	if (!graphTiled()) {
+		render();
+
+		const CreatedTexture* const output = Resources::find(outputTexture);
+		if (output) {
+			onTile(*output, ivec2(0, 0), ivec2(0, 0), outputSize);
+		}
+		return;
+	}
+
+	for (int y = 0; y < outputSize.y; y += graphTileSize.y) {
+		for (int x = 0; x < outputSize.x; x += graphTileSize.x) {
+			const ivec2 tileOrigin = ivec2(x, y);
+			const ivec2 tileSize = glm::min(graphTileSize, outputSize - tileOrigin);
+			layoutGraphTile(orderedPasses, orderedPasses[outputPassIdx], tileOrigin, tileSize);
+
+			// Producers come first, so Inputs can pick up their textures on the way
+			for (auto& pass : orderedPasses) {
+				for (auto& img : pass.compiledImages) {
+					if (img.producer) {
+						const CompiledImage& src = img.producer->compiledImages[img.producerParam];
+						img.tex = src.tex;
+						img.origin = src.origin;
+					}
+					else if (img.tiled() && img.owned && pass.regionSize.x > 0 && pass.regionSize.y > 0) {
+						const ivec2 end = glm::min(pass.regionOrigin + pass.regionSize, img.size());
+						TextureKey key = img.wholeKey;
+						key.width = u32(std::max(1, end.x - pass.regionOrigin.x));
+						key.height = u32(std::max(1, end.y - pass.regionOrigin.y));
+
+						img.tex = createTransientTexture(TextureDesc(), key);
+						img.origin = pass.regionOrigin;
+					}
+				}
+			}
+
+			render();
+
+			for (const auto& img : orderedPasses[outputPassIdx].compiledImages) {
+				const CreatedTexture* const output = Resources::find(img.tex);
+				if (output) {
+					onTile(*output, tileOrigin - img.origin, tileOrigin, tileSize);
+					break;
+				}
+			}
+
+			// Back to the cache for the next tile, which mostly needs the same sizes
+			for (auto& pass : orderedPasses) {
+				for (auto& img : pass.compiledImages) {
+					if (img.tiled() && img.owned && img.tex.valid()) {
+						g_transientTextureCache.emplace(Resources::get(img.tex).key, img.tex);
+					}
+
+					if (img.tiled()) {
+						img.tex = TextureHandle();
+						img.origin = ivec2(0, 0);
+					}
+				}
+			}
+
+			// Like dispatch tiles, so that no single submission runs long enough to trip the driver watchdog
+			glFlush();
+		}
+	}
+}
+
+void CompiledPackage::renderToFramebuffer(ivec4 dstRect, unsigned int readFramebuffer)
+{
+	const ivec2 outputSize = ivec2(outputKey.width, outputKey.height);
+	const ivec2 dstOrigin = ivec2(dstRect.x, dstRect.y);
+	const ivec2 dstSize = ivec2(dstRect.z, dstRect.w);
+	GlState::setEnabled(GL_SCISSOR_TEST, false);
+
+	renderTiles([&](const CreatedTexture& tex, ivec2 srcOffset, ivec2 dstOffset, ivec2 size) {
+		// Written by image stores, and read by the blit
+		glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex.texId, 0);
+
+		// Computed from the tile edges, so that neighbouring tiles meet exactly
+		const ivec2 dstMin = dstOrigin + ivec2(s64(dstOffset.x) * dstSize.x / outputSize.x, s64(dstOffset.y) * dstSize.y / outputSize.y);
+		const ivec2 dstMax = dstOrigin + ivec2(s64(dstOffset.x + size.x) * dstSize.x / outputSize.x, s64(dstOffset.y + size.y) * dstSize.y / outputSize.y);
+
+		glBlitFramebuffer(
+			srcOffset.x, srcOffset.y, srcOffset.x + size.x, srcOffset.y + size.y,
+			dstMin.x, dstMin.y, dstMax.x, dstMax.y,
+			GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	});
+}
+
+void CompiledPackage::releaseImages()
+{
+	for (auto& pass : orderedPasses) {
+		for (auto& img : pass.compiledImages) {
+			// Graph tiles return theirs as they go
+			if (img.owned && img.tex.valid()) {
+				img.release();
+			}
+		}
+	}
+}
+
+void Package::serialize(JsonWriter& writer)
+{
+	writer.String("passes");
+	writer.StartArray();
+	graph.iterNodes([&](nodegraph::node_handle nodeHandle){
+		writer.StartObject();
+
+		writer.String("idx");
+		writer.Int(nodeHandle.idx);
+
+		m_passes[nodeHandle.idx]->serialize(writer);
+
+		writer.EndObject();
+	});
+	writer.EndArray();
+
+	writer.String("graph");
+	writer.StartObject();
+	serializeGraph(graph, writer);
+	writer.EndObject();
+}
+
+void Package::reset()
+{
+	graph = nodegraph::Graph();
+	m_passes.clear();
+}
+
+nodegraph::node_handle Package::deserializeNode(rapidjson::Value& json, DeserializationContext& ctx)
+{
+	shared_ptr<RenderPass> pass;
+	const char* const nodeType = json["type"].GetString();
+
+	if (0 == strcmp(nodeType, "Output")) {
+		pass = make_shared<OutputPass>();
+	} else if (0 == strcmp(nodeType, "Compute")) {
+		pass = make_shared<ComputePass>();
+	} else {
+		assert(false);
+	}
+
+	pass->deserialize(json, ctx);
+
+	return addPass(pass);
+}
+
+void Package::deserialize(rapidjson::Document& doc, DeserializationContext& ctx)
+{
+	auto& passArray = doc["passes"];
+	const size_t passCount = passArray.Size();
+
+	for (size_t i = 0; i < passCount; ++i ) {
+		auto& node = passArray[i];
+		const int idx = node["idx"].GetInt();
+
+		nodegraph::node_handle nodeHandle = deserializeNode(node, ctx);
+		ctx.nodeMap[idx] = nodeHandle;
+	}
+
+	deserializeGraph(&graph, doc["graph"], ctx);
+}
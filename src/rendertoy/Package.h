@@ -0,0 +1,632 @@
+#pragma once
+#include "Common.h"
+#include "Math.h"
+#include "NodeGraph.h"
+#include "Shader.h"
+#include "Texture.h"
+#include "FileUtil.h"
+#include "StringUtil.h"
+#include "GlState.h"
+#include "Arena.h"
+#include "FreeList.h"
+#include "ResourceRegistry.h"
+#include "VirtualTexture.h"
+
+#define NOMINMAX	// glad.h, I'm not glad.
+#include <glad/glad.h>
+#include <rapidjson/document.h>
+#include <rapidjson/prettywriter.h>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+
+using JsonWriter = rapidjson::PrettyWriter<rapidjson::StringBuffer>;
+
+struct BufferKey {
+	u32 sizeBytes;
+
+	bool operator==(const BufferKey& other) const {
+		return sizeBytes == other.sizeBytes;
+	}
+};
+
+
+namespace std {
+	template <>
+	struct hash<TextureKey>
+	{
+		size_t operator()(const TextureKey& k) const {
+			size_t res = 17;
+			res = res * 31u + hash<u32>()(k.width);
+			res = res * 31u + hash<u32>()(k.height);
+			res = res * 31u + hash<GLenum>()(k.format);
+			return res;
+		}
+	};
+
+	template <>
+	struct hash<BufferKey>
+	{
+		size_t operator()(const BufferKey& k) const {
+			size_t res = 17;
+			res = res * 31u + hash<u32>()(k.sizeBytes);
+			return res;
+		}
+	};
+}
+
+namespace std {
+	template <>
+	struct hash<nodegraph::node_handle>
+	{
+		size_t operator()(const nodegraph::node_handle& k) const {
+			return size_t(k.idx) | (size_t(k.fingerprint) << 16);
+		}
+	};
+}
+
+
+// Transient resources are taken out when compiled into a pass, and put back when released at the end of the frame.
+// Several may share a key. Nodes come from a pool, so this churn doesn't hit the heap.
+template <typename Key, typename Value>
+using TransientCache = std::unordered_multimap<Key, Value, std::hash<Key>, std::equal_to<Key>, PoolAllocator<std::pair<const Key, Value>>>;
+
+extern TransientCache<TextureKey, TextureHandle> g_transientTextureCache;
+
+struct CompiledPass;
+
+struct CompiledImage
+{
+	TextureHandle tex;
+	VirtualTexture* virtualTexture = nullptr;	// Tiled sources; 'tex' is its tile pool then
+	unsigned int sampler = 0;	// GLuint; resolved at compile time for Sampler2d params
+	bool owned = false;
+	bool clear = false;
+
+	// Created images rendered in graph tiles, and the Inputs reading them. 'tex' only holds the current tile
+	// and its apron then, and is allocated by CompiledPackage::renderTiles; shaders see 'origin' as [texname]_origin.
+	TextureKey wholeKey = TextureKey { 0, 0, 0 };
+	ivec2 origin = ivec2(0, 0);		// texel of the whole image at texel (0, 0) of 'tex'
+	CompiledPass* producer = nullptr;	// the pass creating the image read by an Input
+	u32 producerParam = 0;
+	s32 apron = 0;					// texels an Input is read at around the uvs of the invocations
+
+	bool valid() const {
+		const CreatedTexture* const created = Resources::find(tex);
+		return created && created->texId != 0;
+	}
+
+	bool tiled() const {
+		return wholeKey.width != 0;
+	}
+
+	// As shaders see it, which isn't the size of the pool for Tiled sources, or of the current graph tile
+	ivec2 size() const {
+		if (virtualTexture) {
+			return ivec2(virtualTexture->width(), virtualTexture->height());
+		}
+
+		if (tiled()) {
+			return ivec2(wholeKey.width, wholeKey.height);
+		}
+
+		const CreatedTexture& created = Resources::get(tex);
+		return ivec2(created.key.width, created.key.height);
+	}
+
+	void release() {
+		g_transientTextureCache.emplace(Resources::get(tex).key, tex);
+		tex = TextureHandle();
+		virtualTexture = nullptr;
+		sampler = 0;
+		owned = false;
+		clear = false;
+	}
+};
+
+
+// Owned by the resource registry, and deleted by Resources::release
+struct CreatedBuffer {
+	unsigned int id = 0;			// GLuint
+	BufferKey key = BufferKey { 0 };
+};
+
+extern TransientCache<BufferKey, BufferHandle> g_transientBufferCache;
+
+struct CompiledBuffer
+{
+	BufferHandle buf;
+	bool owned = false;
+
+	bool valid() const {
+		const CreatedBuffer* const created = Resources::find(buf);
+		return created && created->id != 0;
+	}
+
+	void release() {
+		g_transientBufferCache.emplace(Resources::get(buf).key, buf);
+		buf = BufferHandle();
+		owned = false;
+	}
+};
+
+
+// Compiled every frame; the arrays live in the frame arena
+struct CompiledPass
+{
+	FrameVector<CompiledImage> compiledImages;
+	FrameVector<CompiledBuffer> compiledBuffers;
+	ShaderParamIterProxy params;
+	ivec2 dispatchSize = ivec2(0, 0);
+	ivec2 dispatchTileSize = ivec2(0, 0);	// zero for a single dispatch over the whole domain
+	ComputeShader* shader = nullptr;
+	const ShaderProgramRefl* program = nullptr;	// the shader's variant for the current static params
+
+	// The part of the domain to run; all of it, unless rendering in graph tiles
+	ivec2 regionOrigin = ivec2(0, 0);
+	ivec2 regionSize = ivec2(0, 0);
+	bool graphTiled = false;	// Created images are allocated per graph tile
+
+	void clearImages();
+
+	void render();
+};
+
+TextureHandle createTransientTexture(const TextureDesc& desc, const TextureKey& key);
+
+BufferHandle createBuffer(const BufferDesc& desc, const BufferKey& key);
+
+BufferHandle createTransientBuffer(const BufferDesc& desc, const BufferKey& key);
+
+struct PassCompilerSettings
+{
+	ivec2 windowSize;
+	ivec2 dispatchTileSize = ivec2(0, 0);
+
+	// Renders the whole graph one tile of the output at a time, so that intermediate images only take the memory
+	// of a tile and its apron; zero to disable. Only graphs of tileable passes can; see data/std/graphTile.glsl.
+	ivec2 graphTileSize = ivec2(0, 0);
+
+	// Caps the resolution of Loaded images, along with the maxSize annotations of their params; zero for no cap
+	u32 maxTextureSize = 0;
+
+	// Ignores all caps, e.g. for final renders
+	bool fullResolutionTextures = false;
+
+	// Seconds on the playback clock, which picks the frames of Sequence sources
+	double playbackTime = 0.0;
+};
+
+struct DeserializationContext
+{
+	std::unordered_map<int, nodegraph::node_handle> nodeMap;
+	std::unordered_map<u32, u32> uidMap;
+
+	// Without a GL context shaders can't be compiled, so tools which only need the graph
+	// (e.g. the CPU benchmarks) turn this off, and the param reflection saved in the project is used instead.
+	bool compileShaders = true;
+};
+
+const char* const getShaderParamTypeName(ShaderParamType type);
+
+ShaderParamType parseShaderParamTypeName(const char* const str);
+
+void serializeShaderParamRefl(const ShaderParamRefl& refl, JsonWriter& writer);
+
+void writeVec(JsonWriter& writer, const vec2& v);
+void writeVec(JsonWriter& writer, const vec3& v);
+void writeVec(JsonWriter& writer, const vec4& v);
+void writeVec(JsonWriter& writer, const ivec2& v);
+void writeVec(JsonWriter& writer, const ivec3& v);
+void writeVec(JsonWriter& writer, const ivec4& v);
+void readVec(rapidjson::Value& json, vec2 *const result);
+void readVec(rapidjson::Value& json, vec3 *const result);
+void readVec(rapidjson::Value& json, vec4 *const result);
+void readVec(rapidjson::Value& json, ivec2 *const result);
+void readVec(rapidjson::Value& json, ivec3 *const result);
+void readVec(rapidjson::Value& json, ivec4 *const result);
+
+void writeTextureSize(const TextureSize& size, JsonWriter& writer);
+void readTextureSize(rapidjson::Value& json, TextureSize *const result);
+
+void serializeShaderParamValue(const ShaderParamValue& value, const ShaderParamRefl& refl, JsonWriter& writer);
+
+void deserializeShaderParamRefl(rapidjson::Value& json, ShaderParamRefl *const refl);
+
+void deserializeShaderParamValue(rapidjson::Value& json, const ShaderParamRefl& refl, ShaderParamValue *const value);
+
+struct RenderPass
+{
+	virtual ~RenderPass() {}
+	virtual ShaderParamIterProxy params() = 0;
+	virtual bool compile(const PassCompilerSettings& settings, CompiledPass *const compiled) = 0;
+	virtual int findParamByPortUid(nodegraph::port_uid uid) const = 0;
+	virtual std::string getDisplayName() const = 0;
+	virtual bool canBeRemoved() const = 0;
+	virtual void serialize(JsonWriter& writer) = 0;
+	virtual void deserialize(rapidjson::Value& json, DeserializationContext& ctx) = 0;
+	virtual void findInvalidParamNameByUid(nodegraph::port_uid uid, std::string *const name) {}
+
+	static u32 nextParamUid() {
+		static u32 i = 0;
+		return ++i;
+	}
+
+protected:
+	void serializeParams(JsonWriter& writer)
+	{
+		auto serializeParam = [&writer](const ShaderParamProxy& param) {
+			writer.StartObject();
+			{
+				writer.String("refl");
+				writer.StartObject();
+				serializeShaderParamRefl(param.refl, writer);
+				writer.EndObject();
+
+				writer.String("value");
+				serializeShaderParamValue(param.value, param.refl, writer);
+
+				writer.String("uid");
+				writer.Int(param.uid);
+			}
+			writer.EndObject();
+		};
+
+		for (const auto& param : params()) {
+			serializeParam(param);
+		}
+	}
+};
+
+bool compileTextureSize(
+	const PassCompilerSettings& settings,
+	RenderPass& pass,	// TODO: should be const
+	const CompiledPass& compiledPass,
+	const TextureSize& size,
+	bool allowRelativeToCreated,
+	ivec2 *const res);
+
+// Find the dimensions and format of a Created image
+bool compileCreatedImageKey(const PassCompilerSettings& settings, RenderPass& pass, const TextureDesc& desc, const CompiledPass& compiledPass, TextureKey *const key);
+
+// The resolution cap for a param's Loaded image; zero for none
+u32 getMaxLoadedTextureSize(const PassCompilerSettings& settings, const ShaderParamRefl& refl);
+
+// Create or load the image
+bool compileImage(const PassCompilerSettings& settings, RenderPass& pass, const TextureDesc& desc, u32 maxLoadSize, CompiledImage *const compiled, const CompiledPass *const compiledPass);
+
+bool compileBuffer(const PassCompilerSettings& settings, RenderPass& pass, const BufferSize& sizeDesc, const BufferDesc& desc, CompiledBuffer *const compiled, const CompiledPass *const compiledPass);
+
+struct OutputPass : RenderPass
+{
+	OutputPass()
+	{
+		ShaderParamBindingRefl param;
+		param.name = "image";
+		param.type = ShaderParamType::Sampler2d;
+		m_paramRefl.push_back(param);
+		ShaderParamValue value;
+		value.textureValue.source = TextureDesc::Source::Input;
+		m_paramValues.push_back(value);
+		m_paramUids.push_back(nextParamUid());
+	}
+
+	ShaderParamIterProxy params() override {
+		return ShaderParamIterProxy(m_paramRefl, m_paramValues, m_paramUids);
+	}
+
+	bool compile(const PassCompilerSettings& settings, CompiledPass *const compiled) override {
+		return compileImage(settings, *this, m_paramValues[0].textureValue, getMaxLoadedTextureSize(settings, m_paramRefl[0]), &compiled->compiledImages[0], compiled);
+	}
+
+	int findParamByPortUid(nodegraph::port_uid uid) const override {
+		assert(uid == m_paramUids[0]);
+		return 0;
+	}
+
+	std::string getDisplayName() const override {
+		return "Output";
+	}
+
+	bool canBeRemoved() const override {
+		return false;
+	}
+
+	void serialize(JsonWriter& writer) override
+	{
+		writer.String("type");
+		writer.String("Output");
+
+		writer.String("params");
+		writer.StartArray();
+		serializeParams(writer);
+		writer.EndArray();
+	}
+
+	void deserialize(rapidjson::Value& json, DeserializationContext& ctx) override
+	{
+		assert(0 == strcmp(json["type"].GetString(), "Output"));
+
+		m_paramRefl.clear();
+		m_paramValues.clear();
+		m_paramUids.clear();
+
+		auto& params = json["params"].GetArray();
+		m_paramRefl.resize(params.Size());
+		m_paramValues.resize(params.Size());
+		m_paramUids.resize(params.Size());
+
+		for (size_t i = 0; i < params.Size(); ++i) {
+			m_paramUids[i] = nextParamUid();
+			ctx.uidMap[params[i]["uid"].GetUint()] = m_paramUids[i];
+
+			deserializeShaderParamRefl(params[i]["refl"], &m_paramRefl[i]);
+			deserializeShaderParamValue(params[i]["value"], m_paramRefl[i], &m_paramValues[i]);
+		}
+	}
+
+
+private:
+	vector<ShaderParamBindingRefl> m_paramRefl;
+	vector<ShaderParamValue> m_paramValues;
+	vector<u32> m_paramUids;
+};
+
+struct ComputePass : RenderPass
+{
+	ComputePass()
+		: m_computeShader(std::make_shared<ComputeShader>())
+	{}
+
+	ComputePass(const std::string& shaderPath)
+	{
+		setShader(ShaderLibrary::get(shaderPath));
+	}
+
+	~ComputePass() {
+		ShaderLibrary::unsubscribe(m_computeShader.get(), this);
+
+		for (auto& history : m_historyTextures) {
+			releaseHistoryTextures(history.second);
+		}
+	}
+
+	ShaderParamIterProxy params() override {
+		return ShaderParamIterProxy(m_computeShader->m_params, m_paramValues, m_paramUids);
+	}
+
+	const ComputeShader& shader() const {
+		return *m_computeShader;
+	}
+ 
+	bool compile(const PassCompilerSettings& settings, CompiledPass *const compiled) override;
+
+	// Flips the history pairs output to by the last compile. Called once the whole package has compiled,
+	// so that a failure anywhere doesn't advance the history, or lose a pending clear.
+	void commitHistory();
+
+	int findParamByPortUid(nodegraph::port_uid uid) const override
+	{
+		for (int i = 0; i < int(m_paramUids.size()); ++i) {
+			if (m_paramUids[i] == uid) {
+				return i;
+			}
+		}
+
+		return -1;
+	}
+
+	std::string getDisplayName() const override
+	{
+		std::string filename = fs::path(m_computeShader->m_sourceFile).filename().string();
+		return filename.substr(0, filename.find_last_of("."));
+	}
+
+	bool canBeRemoved() const override {
+		return true;
+	}
+
+	void serialize(JsonWriter& writer) override;
+
+	void deserialize(rapidjson::Value& json, DeserializationContext& ctx) override;
+
+	void findInvalidParamNameByUid(nodegraph::port_uid uid, std::string *const name) override
+	{
+		for (auto& param : m_prevParams) {
+			if (param.uid == uid) {
+				*name = param.refl.name;
+				return;
+			}
+		}
+	}
+
+
+	TextureSize m_dispatchSize;
+
+	// Baked passes compile all their scalar and vector params in as constants
+	bool m_baked = false;
+
+	// Why the pass can't render in graph tiles; empty if it can
+	std::string getGraphTileBlocker() const;
+
+private:
+	void deserializeParams(rapidjson::Value& json, DeserializationContext& ctx);
+
+	void updateParams();
+
+	// Switches to a shader from the library, and follows its reloads
+	void setShader(const shared_ptr<ComputeShader>& shader);
+
+	// Keep history entries only for Created images which are currently read via History params
+	void pruneHistoryTextures();
+
+	// From the apron annotation of an Input: a texel count, or the name of an Int param holding one
+	s32 getInputApron(size_t paramIdx) const;
+
+	// Output a Created image to the texture of its history pair which isn't current. The pair flips
+	// in commitHistory. The textures are only reallocated when the image dimensions or format change.
+	bool compileHistoryImage(const PassCompilerSettings& settings, size_t paramIdx, CompiledPass *const compiled);
+
+	shared_ptr<ComputeShader> m_computeShader;
+	vector<ShaderParamValue> m_paramValues;
+
+	// Rebuilt on every compile, but kept so that the strings reuse their storage
+	ShaderDefines m_variantDefines;
+	vector<u32> m_paramUids;
+
+	// Created images which are read back via History params live in a persistent pair of textures
+	// instead of coming from the transient pool. The pair swaps roles every time the pass is compiled,
+	// so the previous frame's output is available without any copies.
+	// The pass owns these, and releases them when they're pruned, resized or the pass is destroyed.
+	struct HistoryTextures {
+		TextureHandle tex[2];
+		bool needsClear[2] = { false, false };
+		u32 current = 0;			// the previous frame's output, read by History params
+		bool written = false;		// output to by the last compile, and due to flip
+		bool reportedMissing = false;
+	};
+	std::unordered_map<std::string, HistoryTextures> m_historyTextures;
+
+	static void releaseHistoryTextures(HistoryTextures& history);
+
+	// Kept around for preserving previous values across shader reload and shader modifications
+	vector<ShaderParamRefl> m_paramRefl;
+	struct PrevShaderParam {
+		ShaderParamRefl refl;
+		ShaderParamValue value;
+		u32 uid;
+	};
+	vector<PrevShaderParam> m_prevParams;
+};
+
+bool needsOutputPort(const ShaderParamProxy& param);
+
+bool needsInputPort(const ShaderParamProxy& param);
+
+void serializeGraph(nodegraph::Graph& graph, JsonWriter& writer);
+
+void deserializeGraph(nodegraph::Graph *const graph, const rapidjson::Value& json, DeserializationContext& ctx);
+
+struct CompiledPackage
+{
+	FrameVector<CompiledPass> orderedPasses;
+	u32 outputPassIdx = 0;			// in orderedPasses
+	TextureHandle outputTexture;	// invalid when rendering in graph tiles
+	TextureKey outputKey = TextureKey { 0, 0, 0 };	// of the whole output image
+	ivec2 graphTileSize = ivec2(0, 0);	// zero unless the graph renders in graph tiles
+
+	bool hasOutput() const {
+		return outputKey.width != 0;
+	}
+
+	bool graphTiled() const {
+		return graphTileSize.x > 0 && graphTileSize.y > 0;
+	}
+
+	// Runs the passes in order, each in its own GL trace and GPU profiler scope
+	void render();
+
+	// Renders the output a graph tile at a time. 'onTile' gets each one while its texture is alive: the texture,
+	// the texel of the tile in it, and the tile's texel in the whole output and its size. It may copy the tile out,
+	// but must not hold on to the texture. Without graph tiles, this renders once, and passes the whole output.
+	void renderTiles(const std::function<void(const CreatedTexture& tex, ivec2 srcOffset, ivec2 dstOffset, ivec2 size)>& onTile);
+
+	// Renders the output stretched over 'dstRect' (x, y, width, height) of the bound draw framebuffer, blitting
+	// each graph tile as it's done. 'readFramebuffer' is a framebuffer object to blit through. Disables scissoring.
+	void renderToFramebuffer(ivec4 dstRect, unsigned int readFramebuffer);
+
+	// Returns the images owned by the passes to the transient cache, once the output has been read
+	void releaseImages();
+};
+
+struct Package
+{
+	vector<shared_ptr<RenderPass>> m_passes;
+	nodegraph::Graph graph;
+
+	nodegraph::node_handle addOutputPass() {
+		return addPass(make_shared<OutputPass>());
+	}
+
+	void deletePass(u32 passIndex) {
+		m_passes[passIndex] = nullptr;
+	}
+
+	void getNodeDesc(RenderPass& pass, nodegraph::NodeDesc *const desc)
+	{
+		desc->inputs.clear();
+		desc->outputs.clear();
+
+		for (auto& p : pass.params()) {
+			if (needsInputPort(p)) {
+				desc->inputs.push_back(p.uid);
+			} else if (needsOutputPort(p)) {
+				desc->outputs.push_back(p.uid);
+			}
+		}
+	}
+
+	void updateGraph()
+	{
+		graph.iterNodes([&](nodegraph::node_handle nodeHandle)
+		{
+			RenderPass& pass = *m_passes[nodeHandle.idx];
+			nodegraph::NodeDesc desc;
+			getNodeDesc(pass, &desc);
+			graph.updateNode(nodeHandle, desc);
+		});
+	}
+
+	void handleFileDrop(const std::string& path)
+	{
+		if (ends_with(path, ".glsl")) {
+			addPass(make_shared<ComputePass>(path));
+		}
+	}
+
+	nodegraph::node_handle getOutputPass()
+	{
+		nodegraph::node_handle result;
+
+		graph.iterNodes([&](nodegraph::node_handle nodeHandle) {
+			if (graph.nodes[nodeHandle.idx].firstOutputPort == nodegraph::invalid_port_idx) {
+				result = nodeHandle;
+			}
+		});
+
+		return result;
+	}
+
+	void findPassOrder(nodegraph::node_handle outputPass, FrameVector<nodegraph::node_idx> *const order);
+
+	bool compile(const PassCompilerSettings& settings, CompiledPackage *const compiled);
+
+	void serialize(JsonWriter& writer);
+
+	void reset();
+
+	nodegraph::node_handle deserializeNode(rapidjson::Value& json, DeserializationContext& ctx);
+
+	void deserialize(rapidjson::Document& doc, DeserializationContext& ctx);
+
+private:
+	// Why the last compile with graph tiles rendered without them; reported when it changes
+	std::string m_graphTileBlocker;
+
+	nodegraph::node_handle addPass(shared_ptr<RenderPass> pass)
+	{
+		nodegraph::NodeDesc desc;
+		//getNodeDesc(*pass, &desc);
+		nodegraph::node_handle nodeHandle = graph.addNode(desc);
+
+		if (m_passes.size() == nodeHandle.idx) {
+			m_passes.emplace_back(pass);
+		}
+		else {
+			m_passes[nodeHandle.idx] = pass;
+		}
+
+		return nodeHandle;
+	}
+};
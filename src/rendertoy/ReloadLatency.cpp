@@ -0,0 +1,157 @@
+#include "ReloadLatency.h"
+
+#ifndef RENDERTOY_RUNTIME
+#include <imgui.h>
+#endif
+#include <algorithm>
+#include <cstdio>
+
+namespace ReloadLatency {
+	enum { MaxSamples = 64 };
+
+	struct Sample {
+		double stageMs[int(Stage::Count)];
+		double totalMs;
+	};
+
+	enum class State {
+		Idle,
+		Building,
+		AwaitingFrame,
+	};
+
+	State state = State::Idle;
+	Sample current;
+	std::chrono::steady_clock::time_point detectedTime;
+
+	// Ring buffer of finished measurements
+	vector<Sample> samples;
+	size_t nextSample = 0;
+
+	const char* getStageName(Stage stage) {
+		switch (stage) {
+		case Stage::Detection: return "detection";
+		case Stage::Dispatch: return "dispatch";
+		case Stage::Build: return "build";
+		case Stage::Reflection: return "reflection";
+		case Stage::UpdateParams: return "updateParams";
+		case Stage::GraphCompile: return "graph compile";
+		case Stage::Gpu: return "gpu";
+		case Stage::Other: return "other";
+		default: return "?";
+		}
+	}
+
+	void fileChanged(const FileWatcher::ChangeInfo& change) {
+		if (state != State::Idle) {
+			return;
+		}
+
+		state = State::Building;
+		current = Sample();
+		detectedTime = change.detectedTime;
+		current.stageMs[int(Stage::Detection)] = change.detectionDelayMs;
+		current.stageMs[int(Stage::Dispatch)] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - change.detectedTime).count();
+	}
+
+	void addStageTime(Stage stage, double ms) {
+		if (state != State::Idle) {
+			current.stageMs[int(stage)] += ms;
+		}
+	}
+
+	void buildFinished(bool succeeded) {
+		if (State::Building == state) {
+			state = succeeded ? State::AwaitingFrame : State::Idle;
+		}
+	}
+
+	bool awaitingFrame() {
+		return State::AwaitingFrame == state;
+	}
+
+	void framePresented() {
+		if (state != State::AwaitingFrame) {
+			return;
+		}
+
+		state = State::Idle;
+
+		Sample& s = current;
+		s.totalMs = s.stageMs[int(Stage::Detection)] + std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - detectedTime).count();
+
+		double accounted = 0.0;
+		for (int i = 0; i < int(Stage::Other); ++i) {
+			accounted += s.stageMs[i];
+		}
+		s.stageMs[int(Stage::Other)] = std::max(0.0, s.totalMs - accounted);
+
+		printf("Reload latency: %.1f ms (", s.totalMs);
+		for (int i = 0; i < int(Stage::Count); ++i) {
+			printf("%s%s %.1f", i > 0 ? ", " : "", getStageName(Stage(i)), s.stageMs[i]);
+		}
+		printf(")\n");
+
+		if (samples.size() < MaxSamples) {
+			samples.push_back(s);
+		} else {
+			samples[nextSample] = s;
+		}
+		nextSample = (nextSample + 1) % MaxSamples;
+	}
+
+#ifndef RENDERTOY_RUNTIME
+	void doGui(bool *const open) {
+		ImGui::SetNextWindowSize(ImVec2(420, 360), ImGuiSetCond_FirstUseEver);
+		if (!ImGui::Begin("Reload latency", open)) {
+			ImGui::End();
+			return;
+		}
+
+		if (samples.empty()) {
+			ImGui::TextWrapped("Save a shader to measure the time until the first frame using it is presented.");
+			ImGui::End();
+			return;
+		}
+
+		// Oldest first
+		vector<float> totals;
+		float maxTotal = 0.0f;
+		for (size_t i = 0; i < samples.size(); ++i) {
+			const Sample& s = samples[(nextSample + MaxSamples - samples.size() + i) % MaxSamples];
+			totals.push_back(float(s.totalMs));
+			maxTotal = std::max(maxTotal, totals.back());
+		}
+
+		const Sample& last = samples[(nextSample + MaxSamples - 1) % MaxSamples];
+		char overlay[64];
+		snprintf(overlay, sizeof(overlay), "last %.1f ms", last.totalMs);
+		ImGui::PlotHistogram("##totals", totals.data(), int(totals.size()), 0, overlay, 0.0f, maxTotal * 1.1f, ImVec2(-1, 80));
+
+		ImGui::Columns(4, "stages");
+		ImGui::Text("Stage"); ImGui::NextColumn();
+		ImGui::Text("Last"); ImGui::NextColumn();
+		ImGui::Text("Avg"); ImGui::NextColumn();
+		ImGui::Text("Max"); ImGui::NextColumn();
+		ImGui::Separator();
+
+		for (int stage = 0; stage <= int(Stage::Count); ++stage) {
+			double sum = 0.0, maxMs = 0.0;
+			for (const Sample& s : samples) {
+				const double ms = stage < int(Stage::Count) ? s.stageMs[stage] : s.totalMs;
+				sum += ms;
+				maxMs = std::max(maxMs, ms);
+			}
+
+			const double lastMs = stage < int(Stage::Count) ? last.stageMs[stage] : last.totalMs;
+			ImGui::Text("%s", stage < int(Stage::Count) ? getStageName(Stage(stage)) : "total"); ImGui::NextColumn();
+			ImGui::Text("%.1f ms", lastMs); ImGui::NextColumn();
+			ImGui::Text("%.1f ms", sum / samples.size()); ImGui::NextColumn();
+			ImGui::Text("%.1f ms", maxMs); ImGui::NextColumn();
+		}
+		ImGui::Columns(1);
+
+		ImGui::End();
+	}
+#endif
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "Common.h"
+#include "FileWatcher.h"
+
+// Measures the time from a shader file being saved to the first presented frame using the rebuilt
+// program, split into stages. Finished measurements are logged, and the recent ones kept for the UI.
+namespace ReloadLatency {
+	enum class Stage {
+		Detection,		// file saved -> FileWatcher notices the change
+		Dispatch,		// waiting for the main thread's FileWatcher::update
+		Build,			// preprocessing, compiling and linking
+		Reflection,
+		UpdateParams,
+		GraphCompile,	// compiling the packages for the first frame with the new program
+		Gpu,			// executing that frame
+		Other,			// the rest, e.g. waiting for the frame loop and presenting
+		Count
+	};
+
+	const char* getStageName(Stage stage);
+
+	// Starts a measurement, unless one is already in progress. Call from FileWatcher callbacks.
+	void fileChanged(const FileWatcher::ChangeInfo& change);
+
+	// Only accumulated while a measurement is in progress
+	void addStageTime(Stage stage, double ms);
+
+	// A measurement whose builds all failed is dropped; otherwise it waits for the next frame
+	void buildFinished(bool succeeded);
+	bool awaitingFrame();
+	void framePresented();
+
+#ifndef RENDERTOY_RUNTIME
+	void doGui(bool *const open);
+#endif
+}
@@ -0,0 +1,56 @@
+#include "ResourceRegistry.h"
+#include "Package.h"
+
+
+namespace Resources {
+	ResourceRegistry<CreatedTexture> textures;
+	ResourceRegistry<CreatedBuffer> buffers;
+
+	TextureHandle add(const CreatedTexture& tex) {
+		return textures.add(tex);
+	}
+
+	BufferHandle add(const CreatedBuffer& buf) {
+		return buffers.add(buf);
+	}
+
+	void release(TextureHandle tex) {
+		if (const CreatedTexture* const record = textures.find(tex)) {
+			if (record->texId != 0) {
+				GlState::textureDeleted(record->texId);
+				glDeleteTextures(1, &record->texId);
+			}
+			textures.remove(tex);
+		}
+	}
+
+	void release(BufferHandle buf) {
+		if (const CreatedBuffer* const record = buffers.find(buf)) {
+			if (record->id != 0) {
+				GlState::bufferDeleted(record->id);
+				glDeleteBuffers(1, &record->id);
+			}
+			buffers.remove(buf);
+		}
+	}
+
+	const CreatedTexture* find(TextureHandle tex) {
+		return textures.find(tex);
+	}
+
+	const CreatedBuffer* find(BufferHandle buf) {
+		return buffers.find(buf);
+	}
+
+	const CreatedTexture& get(TextureHandle tex) {
+		const CreatedTexture* const record = textures.find(tex);
+		assert(record);
+		return *record;
+	}
+
+	const CreatedBuffer& get(BufferHandle buf) {
+		const CreatedBuffer* const record = buffers.find(buf);
+		assert(record);
+		return *record;
+	}
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "Common.h"
+#include <cassert>
+
+// Generational handle to a record in a ResourceRegistry. Handles are plain 32-bit values, so they're free
+// to copy between passes; once the record is released, all copies go stale instead of dangling.
+template <typename Record>
+struct ResourceHandle {
+	u16 idx = u16(-1);
+	u16 fingerprint = u16(-1);
+
+	ResourceHandle() {}
+	ResourceHandle(u16 idx, u16 fingerprint)
+		: idx(idx)
+		, fingerprint(fingerprint)
+	{}
+
+	bool valid() const {
+		return idx != u16(-1);
+	}
+
+	bool operator==(const ResourceHandle& other) const {
+		return idx == other.idx && fingerprint == other.fingerprint;
+	}
+	bool operator!=(const ResourceHandle& other) const {
+		return !(*this == other);
+	}
+};
+
+// Records in a dense array; released slots are reused, and their fingerprint bumped so that old handles miss
+template <typename Record>
+class ResourceRegistry
+{
+public:
+	typedef ResourceHandle<Record> Handle;
+
+	Handle add(const Record& record) {
+		u16 idx;
+		if (!m_freeSlots.empty()) {
+			idx = m_freeSlots.back();
+			m_freeSlots.pop_back();
+			m_records[idx] = record;
+		} else {
+			assert(m_records.size() < u16(-1));
+			idx = u16(m_records.size());
+			m_records.push_back(record);
+			m_fingerprints.push_back(0);
+		}
+
+		return Handle(idx, m_fingerprints[idx]);
+	}
+
+	void remove(Handle h) {
+		if (find(h)) {
+			m_records[h.idx] = Record();
+			++m_fingerprints[h.idx];
+			m_freeSlots.push_back(h.idx);
+		}
+	}
+
+	Record* find(Handle h) {
+		if (h.idx < m_records.size() && m_fingerprints[h.idx] == h.fingerprint) {
+			return &m_records[h.idx];
+		}
+		return nullptr;
+	}
+
+private:
+	vector<Record> m_records;
+	vector<u16> m_fingerprints;
+	vector<u16> m_freeSlots;
+};
+
+struct CreatedTexture;
+struct CreatedBuffer;
+
+typedef ResourceHandle<CreatedTexture> TextureHandle;
+typedef ResourceHandle<CreatedBuffer> BufferHandle;
+
+// All GPU textures and buffers made by the frame compiler and the texture loaders. The registry owns
+// the GL objects; whoever holds a handle decides when to release it, as nothing is reference counted.
+namespace Resources {
+	TextureHandle add(const CreatedTexture& tex);
+	BufferHandle add(const CreatedBuffer& buf);
+
+	// Deletes the GL object; does nothing for stale or invalid handles
+	void release(TextureHandle tex);
+	void release(BufferHandle buf);
+
+	// nullptr for stale or invalid handles
+	const CreatedTexture* find(TextureHandle tex);
+	const CreatedBuffer* find(BufferHandle buf);
+
+	// For handles known to be live
+	const CreatedTexture& get(TextureHandle tex);
+	const CreatedBuffer& get(BufferHandle buf);
+}
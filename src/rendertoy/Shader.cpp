@@ -2,27 +2,244 @@
 #include "Shader.h"
 #include "StringUtil.h"
 #include "FileUtil.h"
+#include "FileWatcher.h"
+#include "Md5.h"
+#ifndef RENDERTOY_RUNTIME
+#include "EventServer.h"
+#endif
+#include "ReloadLatency.h"
 #include <glad/glad.h>
 #include <unordered_set>
+#include <list>
+#include <chrono>
+#include <cmath>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
 #include <fstream>
 
-vector<char> loadShaderSource(const std::string& path, const char* preprocessorOptions)
+// Source files split into lines, with #include directives picked out
+struct ParsedSourceFile {
+	vector<std::string> lines;
+	vector<std::string> includes;	// per line; empty if the line isn't an #include
+};
+
+std::unordered_map<std::string, ParsedSourceFile> g_includeCache;
+
+static std::string normalizePath(const std::string& path)
 {
-	/*std::string preprocessedFile = path + ".preprocessed";
+	vector<std::string> parts;
+	size_t begin = 0;
+	while (begin <= path.size()) {
+		size_t end = path.find_first_of("/\\", begin);
+		if (std::string::npos == end) {
+			end = path.size();
+		}
 
-	//if (getFileModifiedTime(preprocessedFile) < getFileModifiedTime(path))
-	{
-	std::string cmd = "cpp -P " + path + " -o " + preprocessedFile + " " + preprocessorOptions;
-	system(cmd.c_str());
+		const std::string part = path.substr(begin, end - begin);
+		if (".." == part && !parts.empty() && parts.back() != "..") {
+			parts.pop_back();
+		} else if (part != "." && (!part.empty() || parts.empty())) {
+			parts.push_back(part);
+		}
+
+		begin = end + 1;
 	}
 
-	std::vector<char> result = loadTextFileZ(preprocessedFile.c_str());*/
+	std::string result;
+	for (size_t i = 0; i < parts.size(); ++i) {
+		if (i > 0) result += '/';
+		result += parts[i];
+	}
+	return result;
+}
 
-	std::vector<char> result = loadTextFileZ(path.c_str());
-	std::string prefix = "#version 440\n#line 0\n";
+// Returns the file name of an #include "file" or #include <file> directive, or an empty string
+static std::string parseIncludeDirective(const std::string& line)
+{
+	const char* c = line.c_str();
+	while (*c == ' ' || *c == '\t') ++c;
+	if (*c++ != '#') return std::string();
+	while (*c == ' ' || *c == '\t') ++c;
+	if (strncmp(c, "include", 7) != 0) return std::string();
+	c += 7;
+	while (*c == ' ' || *c == '\t') ++c;
+
+	const char close = (*c == '"') ? '"' : (*c == '<') ? '>' : '\0';
+	if (!close) return std::string();
+
+	const char* const nameBegin = ++c;
+	while (*c && *c != close) ++c;
+	if (*c != close) return std::string();
+
+	return std::string(nameBegin, c);
+}
 
-	result.insert(result.begin(), prefix.begin(), prefix.end());
-	return result;
+static bool parseSourceFile(const std::string& path, ParsedSourceFile *const res)
+{
+	if (!fs::exists(path)) {
+		return false;
+	}
+
+	const vector<char> text = loadTextFileZ(path.c_str());
+	res->lines.clear();
+	res->includes.clear();
+
+	const char* lineBegin = text.data();
+	const char* const textEnd = text.data() + text.size() - 1;
+	while (lineBegin <= textEnd) {
+		const char* lineEnd = std::find(lineBegin, textEnd, '\n');
+		const char* trimmedEnd = lineEnd;
+		if (trimmedEnd > lineBegin && trimmedEnd[-1] == '\r') --trimmedEnd;
+
+		res->lines.emplace_back(lineBegin, trimmedEnd);
+		res->includes.push_back(parseIncludeDirective(res->lines.back()));
+		lineBegin = lineEnd + 1;
+	}
+
+	return true;
+}
+
+static const ParsedSourceFile* getIncludeFile(const std::string& path)
+{
+	auto found = g_includeCache.find(path);
+	if (found != g_includeCache.end()) {
+		return &found->second;
+	}
+
+	ParsedSourceFile file;
+	if (!parseSourceFile(path, &file)) {
+		return nullptr;
+	}
+
+	return &(g_includeCache[path] = std::move(file));
+}
+
+// Tiled dispatch runs the shader over sub-rectangles of the domain, offsetting the invocation and work group IDs by
+// rtoy_dispatchOffset, which is always a multiple of the work group size. Names starting with gl_ are reserved, so
+// the built-ins aren't redefined; references to them are renamed to the offset versions in the prefix instead.
+static const char* const g_offsetBuiltins[] = { "GlobalInvocationID", "WorkGroupID" };
+
+static bool isIdentifierChar(char c)
+{
+	return isalnum(u8(c)) || '_' == c;
+}
+
+static void appendWithOffsetBuiltins(const char* const begin, const char* const end, std::string *const text)
+{
+	const char* copied = begin;
+	for (const char* c = begin; c < end; ) {
+		const char* identEnd = c;
+		while (identEnd < end && isIdentifierChar(*identEnd)) ++identEnd;
+		if (identEnd == c) {
+			++c;
+			continue;
+		}
+
+		if (identEnd - c > 3 && 0 == strncmp(c, "gl_", 3)) {
+			for (const char* const builtin : g_offsetBuiltins) {
+				if (size_t(identEnd - c - 3) == strlen(builtin) && 0 == strncmp(c + 3, builtin, strlen(builtin))) {
+					text->append(copied, c);
+					*text += "rtoy_";
+					copied = c + 3;
+				}
+			}
+		}
+		c = identEnd;
+	}
+	text->append(copied, end);
+}
+
+struct ShaderPreprocessor {
+	ShaderSource* res;
+	std::string text;
+	vector<std::string> includeStack;
+
+	u32 getFileIndex(const std::string& path) {
+		auto found = std::find(res->files.begin(), res->files.end(), path);
+		if (found != res->files.end()) {
+			return u32(found - res->files.begin());
+		}
+
+		res->files.push_back(path);
+		return u32(res->files.size() - 1);
+	}
+
+	void error(u32 fileIdx, size_t line, const std::string& message) {
+		res->errorLog += std::to_string(fileIdx) + "(" + std::to_string(line) + ") : error : " + message + "\n";
+	}
+
+	// Line numbers follow the "#line 0" convention of the prefix, so the first line of each file is line 0
+	bool expand(const ParsedSourceFile& file, const std::string& path) {
+		const u32 fileIdx = getFileIndex(path);
+		const std::string dir = fs::path(path).parent_path().string();
+		bool ok = true;
+
+		includeStack.push_back(path);
+		text += "#line 0 " + std::to_string(fileIdx) + "\n";
+
+		for (size_t i = 0; i < file.lines.size(); ++i) {
+			const std::string& includeName = file.includes[i];
+			if (includeName.empty()) {
+				const std::string& line = file.lines[i];
+				appendWithOffsetBuiltins(line.data(), line.data() + line.size(), &text);
+				text += '\n';
+				continue;
+			}
+
+			std::string includePath = normalizePath(dir.empty() ? includeName : dir + "/" + includeName);
+			if (!fs::exists(includePath) && fs::exists(includeName)) {
+				includePath = normalizePath(includeName);
+			}
+
+			if (std::find(includeStack.begin(), includeStack.end(), includePath) != includeStack.end()) {
+				error(fileIdx, i, "recursive #include of \"" + includeName + "\"");
+				ok = false;
+			} else if (const ParsedSourceFile* const included = getIncludeFile(includePath)) {
+				ok = expand(*included, includePath) && ok;
+			} else {
+				// Still a dependency, so creating the file triggers a rebuild
+				getFileIndex(includePath);
+				error(fileIdx, i, "cannot open include file \"" + includeName + "\"");
+				ok = false;
+			}
+
+			text += "#line " + std::to_string(i + 1) + " " + std::to_string(fileIdx) + "\n";
+		}
+
+		includeStack.pop_back();
+		return ok;
+	}
+};
+
+bool loadShaderSource(const std::string& path, ShaderSource *const res)
+{
+	res->text.clear();
+	res->files.clear();
+	res->errorLog.clear();
+
+	ShaderPreprocessor preprocessor;
+	preprocessor.res = res;
+
+	// See g_offsetBuiltins
+	preprocessor.text =
+		"#version 440\n"
+		"uniform ivec2 rtoy_dispatchOffset;\n"
+		"#define rtoy_GlobalInvocationID (gl_GlobalInvocationID + uvec3(rtoy_dispatchOffset, 0))\n"
+		"#define rtoy_WorkGroupID (gl_WorkGroupID + uvec3(uvec2(rtoy_dispatchOffset) / gl_WorkGroupSize.xy, 0))\n";
+
+	// The main file is always read afresh; only includes are cached
+	const std::string mainPath = normalizePath(path);
+	ParsedSourceFile mainFile;
+	if (!parseSourceFile(mainPath, &mainFile)) {
+		res->files.push_back(mainPath);
+		res->errorLog = "0(0) : error : cannot open \"" + path + "\"\n";
+		return false;
+	}
+
+	const bool ok = preprocessor.expand(mainFile, mainPath);
+	res->text.assign(preprocessor.text.begin(), preprocessor.text.end());
+	res->text.push_back('\0');
+	return ok;
 }
 
 bool parseTextureSizeAnnotations(const ParamAnnotation& annotation, TextureSize *const res)
@@ -75,7 +292,11 @@ ShaderParamValue ShaderParamRefl::defaultValue() const
 		res.int4Value = ivec4(annotation.get("default", 0));
 	}
 	else if (ShaderParamType::Sampler2d == type) {
-		if (annotation.has("input")) {
+		if (annotation.has("history")) {
+			res.textureValue.source = TextureDesc::Source::History;
+			res.textureValue.historyOf = annotation.get("history", "");
+		}
+		else if (annotation.has("input")) {
 			res.textureValue.source = TextureDesc::Source::Input;
 		}
 		else 
@@ -87,7 +308,11 @@ ShaderParamValue ShaderParamRefl::defaultValue() const
 		}
 	}
 	else if (ShaderParamType::Image2d == type) {
-		if (annotation.has("input")) {
+		if (annotation.has("history")) {
+			res.textureValue.source = TextureDesc::Source::History;
+			res.textureValue.historyOf = annotation.get("history", "");
+		}
+		else if (annotation.has("input")) {
 			res.textureValue.source = TextureDesc::Source::Input;
 		}
 		else if (annotation.has("default")) {
@@ -115,6 +340,7 @@ static ShaderParamType parseShaderType(GLenum type, GLint size)
 		{ GL_FLOAT_VEC3, ShaderParamType::Float3 },
 		{ GL_FLOAT_VEC4, ShaderParamType::Float4 },
 		{ GL_INT, ShaderParamType::Int },
+		{ GL_BOOL, ShaderParamType::Int },
 		{ GL_INT_VEC2, ShaderParamType::Int2 },
 		{ GL_INT_VEC3, ShaderParamType::Int3 },
 		{ GL_INT_VEC4, ShaderParamType::Int4 },
@@ -149,7 +375,7 @@ static bool parseParenthesizedExpression(const char*& c, const char* aend)
 	return false;
 }
 
-static bool parseAnnotation(const char* abegin, const char* aend, ParamAnnotation *const annot)
+bool parseAnnotation(const char* abegin, const char* aend, ParamAnnotation *const annot)
 {
 	const char* c = abegin;
 	auto skipWhite = [&]() {
@@ -211,8 +437,8 @@ static std::string getInfoLog(
 	return result;
 }
 
-// Returns 0 on failure
-static GLuint makeShader(GLenum shaderType, const vector<char>& source, std::string *const errorLog)
+// Returns 0 on failure. The compile status is checked by finishShader.
+static GLuint beginShader(GLenum shaderType, const vector<char>& source, std::string *const errorLog)
 {
 	GLuint handle = glCreateShader(shaderType);
 	if (!handle) {
@@ -225,36 +451,45 @@ static GLuint makeShader(GLenum shaderType, const vector<char>& source, std::str
 	glShaderSource(handle, 1, sources, &sourceLength);
 
 	glCompileShader(handle);
-	{
-		GLint shader_ok;
-		glGetShaderiv(handle, GL_COMPILE_STATUS, &shader_ok);
+	return handle;
+}
 
-		if (!shader_ok) {
-			*errorLog = getInfoLog(handle, glGetShaderiv, glGetShaderInfoLog);
-			glDeleteShader(handle);
-			return 0;
-		}
+// Deletes the shader and returns false if it failed to compile
+static bool finishShader(GLuint handle, std::string *const errorLog)
+{
+	GLint shader_ok;
+	glGetShaderiv(handle, GL_COMPILE_STATUS, &shader_ok);
+
+	if (!shader_ok) {
+		*errorLog = getInfoLog(handle, glGetShaderiv, glGetShaderInfoLog);
+		glDeleteShader(handle);
+		return false;
 	}
 
-	return handle;
+	return true;
 }
 
-static GLuint makeProgram(GLuint computeShader, std::string *const errorLog)
+static GLuint beginProgram(GLuint computeShader)
 {
-	GLint program_ok;
-
 	GLuint program = glCreateProgram();
 	glAttachShader(program, computeShader);
 	glLinkProgram(program);
+	return program;
+}
+
+// Deletes the program and returns false if it failed to link
+static bool finishProgram(GLuint program, std::string *const errorLog)
+{
+	GLint program_ok;
 	glGetProgramiv(program, GL_LINK_STATUS, &program_ok);
 
 	if (!program_ok) {
 		*errorLog = getInfoLog(program, glGetProgramiv, glGetProgramInfoLog);
 		glDeleteProgram(program);
-		return 0;
+		return false;
 	}
 
-	return program;
+	return true;
 }
 
 
@@ -371,6 +606,11 @@ void ComputeShader::reflectParams(const ComputeShader::AnnotationMap& annotation
 
 	m_params.erase(
 		std::remove_if(m_params.begin(), m_params.end(), [&](const ShaderParamBindingRefl& p) {
+			// Uniforms injected by RenderToy itself
+			if (0 == p.name.compare(0, 5, "rtoy_")) {
+				return true;
+			}
+
 			if (p.type == ShaderParamType::Float2 || p.type == ShaderParamType::Float4 || p.type == ShaderParamType::Int2) {
 				if (ends_with(p.name, "_size")) {
 					std::string texName = p.name.substr(0, p.name.length() - 5);
@@ -378,25 +618,85 @@ void ComputeShader::reflectParams(const ComputeShader::AnnotationMap& annotation
 				}
 			}
 
+			if (p.type == ShaderParamType::Int && ends_with(p.name, "_flipY")) {
+				std::string texName = p.name.substr(0, p.name.length() - 6);
+				return textureParamNames.find(texName) != textureParamNames.end();
+			}
+
+			// Graph tiles; see data/std/graphTile.glsl
+			if (p.type == ShaderParamType::Int2 && ends_with(p.name, "_origin")) {
+				std::string texName = p.name.substr(0, p.name.length() - 7);
+				return textureParamNames.find(texName) != textureParamNames.end();
+			}
+
+			// Tiled sources; see sampleVirtual in data/tiled.glsl
+			if (p.type == ShaderParamType::Unknown && ends_with(p.name, "_indirection")) {
+				std::string texName = p.name.substr(0, p.name.length() - 12);
+				return textureParamNames.find(texName) != textureParamNames.end();
+			}
+
+			if (p.type == ShaderParamType::Int && ends_with(p.name, "_vtLevel")) {
+				std::string texName = p.name.substr(0, p.name.length() - 8);
+				return textureParamNames.find(texName) != textureParamNames.end();
+			}
+
 			return false;
 		}),
 		m_params.end()
 	);
 }
 
+void ShaderProgramRefl::reflect(unsigned int program, const std::vector<ShaderParamBindingRefl>& params)
+{
+	this->program = program;
+
+	GLint groupSize[3];
+	glGetProgramiv(program, GL_COMPUTE_WORK_GROUP_SIZE, groupSize);
+	workGroupSize = ivec2(groupSize[0], groupSize[1]);
+	dispatchOffset = glGetUniformLocation(program, "rtoy_dispatchOffset");
+
+	paramLocations.resize(params.size());
+	textureUniforms.resize(params.size());
+
+	std::string uniformName;
+	auto findTextureUniform = [&](const std::string& texName, const char* suffix) {
+		uniformName = texName;
+		uniformName += suffix;
+		return glGetUniformLocation(program, uniformName.c_str());
+	};
+
+	for (size_t i = 0; i < params.size(); ++i) {
+		const ShaderParamBindingRefl& param = params[i];
+		paramLocations[i] = glGetUniformLocation(program, param.name.c_str());
+
+		TextureUniforms& tex = textureUniforms[i];
+		tex = TextureUniforms();
+		if (param.type == ShaderParamType::Sampler2d || param.type == ShaderParamType::Image2d) {
+			tex.size = findTextureUniform(param.name, "_size");
+			tex.flipY = findTextureUniform(param.name, "_flipY");
+			tex.origin = findTextureUniform(param.name, "_origin");
+			tex.indirection = findTextureUniform(param.name, "_indirection");
+			tex.vtLevel = findTextureUniform(param.name, "_vtLevel");
+		}
+	}
+}
+
 void ComputeShader::initializeDefaultDispatchSize(const ComputeShader::AnnotationMap& annotations)
 {
 	m_hasDefaultDispatchSize = false;
+	m_tileable = false;
 
 	auto it = annotations.find("in");
 	if (it != annotations.end()) {
 		if (parseTextureSizeAnnotations(it->second, &m_defaultDispatchSize)) {
 			m_hasDefaultDispatchSize = true;
 		}
+
+		m_tileable = it->second.has("tileable");
 	}
 }
 
-std::unordered_map<std::string, ParamAnnotation> ComputeShader::parseAnnotations(const vector<char>& source)
+ComputeShader::AnnotationMap ComputeShader::parseAnnotations(const vector<char>& source)
 {
 	std::unordered_map<std::string, ParamAnnotation> result;
 
@@ -457,42 +757,695 @@ std::unordered_map<std::string, ParamAnnotation> ComputeShader::parseAnnotations
 	return result;
 }
 
-void ComputeShader::updateErrorLogFile()
+bool isStaticParam(const ShaderParamRefl& refl)
+{
+	return refl.type == ShaderParamType::Int && refl.annotation.has("static");
+}
+
+// Enough digits for the float to survive the round trip. GLSL has no literals for infinities and NaNs,
+// so those keep their bits instead.
+static void formatFloatConstants(char *const buf, size_t size, const char* const type, const float* const values, u32 count)
 {
-	if (m_errorLog.length() > 0) {
-		std::ofstream(m_sourceFile + ".errors").write(m_errorLog.data(), m_errorLog.size());
+	size_t used = snprintf(buf, size, "%s(", type);
+	for (u32 i = 0; i < count; ++i) {
+		const char* const separator = i > 0 ? ", " : "";
+		if (std::isfinite(values[i])) {
+			used += snprintf(buf + used, size - used, "%s%.9g", separator, values[i]);
+		} else {
+			u32 bits;
+			memcpy(&bits, &values[i], sizeof(bits));
+			used += snprintf(buf + used, size - used, "%suintBitsToFloat(0x%08xu)", separator, bits);
+		}
 	}
-	else {
-		remove(fs::path(m_sourceFile + ".errors"));
+	snprintf(buf + used, size - used, ")");
+}
+
+bool getShaderParamConstant(ShaderParamType type, const ShaderParamValue& value, std::string *const res)
+{
+	// Formatted on the stack, as this runs on every compile of static and baked params,
+	// and assigning reuses the result's storage
+	char buf[192];
+
+	switch (type) {
+	case ShaderParamType::Float: formatFloatConstants(buf, sizeof(buf), "float", &value.floatValue, 1); break;
+	case ShaderParamType::Float2: formatFloatConstants(buf, sizeof(buf), "vec2", &value.float2Value.x, 2); break;
+	case ShaderParamType::Float3: formatFloatConstants(buf, sizeof(buf), "vec3", &value.float3Value.x, 3); break;
+	case ShaderParamType::Float4: formatFloatConstants(buf, sizeof(buf), "vec4", &value.float4Value.x, 4); break;
+	case ShaderParamType::Int: snprintf(buf, sizeof(buf), "%d", value.intValue); break;
+	case ShaderParamType::Int2: snprintf(buf, sizeof(buf), "ivec2(%d, %d)", value.int2Value.x, value.int2Value.y); break;
+	case ShaderParamType::Int3: snprintf(buf, sizeof(buf), "ivec3(%d, %d, %d)", value.int3Value.x, value.int3Value.y, value.int3Value.z); break;
+	case ShaderParamType::Int4: snprintf(buf, sizeof(buf), "ivec4(%d, %d, %d, %d)", value.int4Value.x, value.int4Value.y, value.int4Value.z, value.int4Value.w); break;
+	default: return false;
 	}
+
+	*res = buf;
+	return true;
 }
 
-bool ComputeShader::reload()
+// Only variants which weren't used in the current frame are evicted, so the cache grows past this
+// to hold the frame's working set, e.g. when every pass of a big graph is baked
+enum { MaxShaderVariants = 64 };
+
+struct ShaderVariant {
+	GLuint shader = 0;
+	ShaderProgramRefl program;
+	bool pending = true;	// compile and link issued, but not checked yet
+	u64 lastUsedFrame = 0;
+	std::list<std::string>::iterator lruPos;
+};
+
+// Keyed by the source digest and define set
+std::unordered_map<std::string, ShaderVariant> g_shaderVariants;
+
+// Most recently used first
+std::list<std::string> g_shaderVariantLru;
+
+// Passes compiled earlier in the frame may still use these; deleted by ShaderLibrary::releaseUnused
+vector<ShaderVariant> g_evictedShaderVariants;
+
+u64 g_shaderVariantFrame = 1;
+
+static const char* skipSpace(const char* c, const char* const end)
 {
-	m_errorLog.clear();
+	while (c < end && isspace(u8(*c))) ++c;
+	return c;
+}
 
-	vector<char> source = loadShaderSource(m_sourceFile, "");
-	GLuint sHandle = makeShader(GL_COMPUTE_SHADER, source, &m_errorLog);
-	if (!sHandle) {
-		updateErrorLogFile();
+static const char* skipIdentifier(const char* c, const char* const end)
+{
+	while (c < end && (isalnum(u8(*c)) || '_' == *c)) ++c;
+	return c;
+}
+
+// Finds a declaration of a single uniform taking up the start of the line: [layout(...)] uniform [qualifiers] <type> <name>;
+// Only comments may follow it. Lines declaring several uniforms, arrays or initializers don't match.
+static bool parseUniformDeclaration(const char* c, const char* const lineEnd, const char** nameBegin, const char** nameEnd, bool *const isBool, const char** declEnd)
+{
+	c = skipSpace(c, lineEnd);
+	if (lineEnd - c > 6 && 0 == strncmp(c, "layout", 6)) {
+		c = skipSpace(c + 6, lineEnd);
+		if (c == lineEnd || *c != '(') {
+			return false;
+		}
+		c = std::find(c, lineEnd, ')');
+		if (c == lineEnd) {
+			return false;
+		}
+		c = skipSpace(c + 1, lineEnd);
+	}
+
+	if (lineEnd - c <= 7 || strncmp(c, "uniform", 7) != 0 || !isspace(u8(c[7]))) {
 		return false;
 	}
+	c += 7;
+
+	// The name is the last of the identifiers, and the type the one before it
+	const char* typeBegin = nullptr;
+	const char* typeEnd = nullptr;
+	*nameBegin = *nameEnd = nullptr;
+	for (;;) {
+		c = skipSpace(c, lineEnd);
+		const char* const identEnd = skipIdentifier(c, lineEnd);
+		if (identEnd == c) {
+			break;
+		}
+		typeBegin = *nameBegin;
+		typeEnd = *nameEnd;
+		*nameBegin = c;
+		*nameEnd = identEnd;
+		c = identEnd;
+	}
 
-	GLuint pHandle = makeProgram(sHandle, &m_errorLog);
-	if (!pHandle) {
-		updateErrorLogFile();
+	if (!typeBegin || c == lineEnd || *c != ';') {
 		return false;
 	}
+	*declEnd = c + 1;
+
+	c = skipSpace(c + 1, lineEnd);
+	if (c != lineEnd && !(lineEnd - c >= 2 && '/' == c[0] && '/' == c[1])) {
+		return false;
+	}
+
+	*isBool = (typeEnd - typeBegin == 4) && 0 == strncmp(typeBegin, "bool", 4);
+	return true;
+}
+
+// Replaces the declarations of uniforms named in 'defines' with #defines of their values; comments after them stay.
+// The line count is unchanged, so the #line mapping still holds. Uniforms whose declarations don't parse
+// stay uniforms, and are set as usual.
+static vector<char> makeVariantSource(const vector<char>& source, const ShaderDefines& defines)
+{
+	vector<char> result;
+	result.reserve(source.size() + 64 * defines.size());
+
+	const char* lineBegin = source.data();
+	const char* const sourceEnd = source.data() + source.size();
+	while (lineBegin < sourceEnd) {
+		const char* const lineEnd = std::find(lineBegin, sourceEnd, '\n');
+
+		const ShaderDefines::value_type* define = nullptr;
+		const char* nameBegin;
+		const char* nameEnd;
+		const char* declEnd = lineEnd;
+		bool isBool = false;
+		if (parseUniformDeclaration(lineBegin, lineEnd, &nameBegin, &nameEnd, &isBool, &declEnd)) {
+			for (const auto& d : defines) {
+				if (d.first.size() == size_t(nameEnd - nameBegin) && 0 == strncmp(d.first.c_str(), nameBegin, d.first.size())) {
+					define = &d;
+				}
+			}
+		}
+
+		if (define) {
+			// Bools are reflected as ints
+			const std::string value = isBool ? (define->second != "0" ? "true" : "false") : define->second;
+			const std::string line = "#define " + define->first + " " + value;
+			result.insert(result.end(), line.begin(), line.end());
+			result.insert(result.end(), declEnd, lineEnd);
+		} else {
+			result.insert(result.end(), lineBegin, lineEnd);
+		}
+
+		if (lineEnd < sourceEnd) {
+			result.push_back('\n');
+		}
+		lineBegin = lineEnd + 1;
+	}
+
+	return result;
+}
+
+const ShaderProgramRefl& ComputeShader::getVariantProgram(const ShaderDefines& defines)
+{
+	if (defines.empty() || m_source.empty()) {
+		return m_programRefl;
+	}
+
+	// Looked up on every compile; appended piecewise into a kept buffer, so that no temporaries are allocated
+	static std::string key;
+	key = m_sourceDigest;
+	for (const auto& d : defines) {
+		key += '\n';
+		key += d.first;
+		key += '=';
+		key += d.second;
+	}
+
+	auto found = g_shaderVariants.find(key);
+	if (found == g_shaderVariants.end()) {
+		while (g_shaderVariants.size() >= MaxShaderVariants) {
+			auto evicted = g_shaderVariants.find(g_shaderVariantLru.back());
+			if (evicted->second.lastUsedFrame == g_shaderVariantFrame) {
+				break;
+			}
+
+			g_evictedShaderVariants.push_back(evicted->second);
+			g_shaderVariants.erase(evicted);
+			g_shaderVariantLru.pop_back();
+		}
+
+		// Only issued here. The status is checked on a later request, by when a driver which
+		// builds in the background may well be done; the generic program is used meanwhile.
+		ShaderVariant variant;
+		std::string errorLog;
+		variant.shader = beginShader(GL_COMPUTE_SHADER, makeVariantSource(m_source, defines), &errorLog);
+		if (variant.shader) {
+			variant.program.program = beginProgram(variant.shader);
+		}
+
+		variant.lastUsedFrame = g_shaderVariantFrame;
+		g_shaderVariantLru.push_front(key);
+		variant.lruPos = g_shaderVariantLru.begin();
+		g_shaderVariants[key] = variant;
+		return m_programRefl;
+	}
 
-	m_programHandle = pHandle;
-	m_csHandle = sHandle;
-	++versionId;
+	ShaderVariant& variant = found->second;
+	variant.lastUsedFrame = g_shaderVariantFrame;
+	g_shaderVariantLru.splice(g_shaderVariantLru.begin(), g_shaderVariantLru, variant.lruPos);
+
+	if (variant.pending) {
+		variant.pending = false;
+
+		std::string errorLog;
+		GLuint& program = variant.program.program;
+		if (!variant.shader) {
+			errorLog = "glCreateShader failed";
+		} else if (!finishShader(variant.shader, &errorLog)) {
+			glDeleteProgram(program);
+			variant.shader = 0;
+			program = GLuint(-1);
+		} else if (!finishProgram(program, &errorLog)) {
+			glDeleteShader(variant.shader);
+			variant.shader = 0;
+			program = GLuint(-1);
+		}
 
-	updateErrorLogFile();
+		if (program != GLuint(-1)) {
+			variant.program.reflect(program, m_params);
+		} else {
+			fprintf(stderr, "Failed to build a variant of %s:\n%s\n", m_sourceFile.c_str(), errorLog.c_str());
+		}
+	}
 
-	auto annotations = parseAnnotations(source);
-	reflectParams(annotations);
-	initializeDefaultDispatchSize(annotations);
+	return variant.program.program != GLuint(-1) ? variant.program : m_programRefl;
+}
 
+// Finds the source string number in a log line such as "0(12) : error ..." or "ERROR: 0:12: ..."
+static bool findLogSourceIndex(const std::string& line, size_t *const begin, size_t *const end)
+{
+	size_t pos = 0;
+	for (const char* prefix : { "ERROR: ", "WARNING: " }) {
+		if (0 == line.compare(0, strlen(prefix), prefix)) {
+			pos = strlen(prefix);
+		}
+	}
+
+	size_t digitsEnd = pos;
+	while (digitsEnd < line.size() && isdigit(line[digitsEnd])) ++digitsEnd;
+	if (digitsEnd == pos || digitsEnd == line.size()) {
+		return false;
+	}
+
+	if (line[digitsEnd] != (pos > 0 ? ':' : '(')) {
+		return false;
+	}
+
+	*begin = pos;
+	*end = digitsEnd;
 	return true;
 }
+
+static std::string getAbsolutePath(const std::string& path)
+{
+	return fs::absolute(fs::path(path)).string();
+}
+
+// The log shown in the UI names the files. Each file also gets a log of its own lines, with the
+// source string number reset to 0, as if it had been compiled alone. Those are pushed to connected
+// tools, or written to .errors files next to the sources if there are none.
+void ComputeShader::reportBuild(const std::string& compilerLog, bool succeeded, double buildMs)
+{
+	if (m_sourceFiles.empty()) {
+		m_sourceFiles.push_back(m_sourceFile);
+	}
+
+	vector<std::string> fileLogs(m_sourceFiles.size());
+	m_errorLog.clear();
+
+	size_t lineBegin = 0;
+	while (lineBegin < compilerLog.size()) {
+		size_t lineEnd = compilerLog.find('\n', lineBegin);
+		if (std::string::npos == lineEnd) {
+			lineEnd = compilerLog.size();
+		}
+
+		std::string line = compilerLog.substr(lineBegin, lineEnd - lineBegin);
+		lineBegin = lineEnd + 1;
+
+		size_t idxBegin, idxEnd;
+		size_t fileIdx = 0;
+		if (findLogSourceIndex(line, &idxBegin, &idxEnd)) {
+			fileIdx = atoi(line.c_str() + idxBegin);
+			if (fileIdx < m_sourceFiles.size()) {
+				fileLogs[fileIdx] += line.substr(0, idxBegin) + "0" + line.substr(idxEnd) + "\n";
+				m_errorLog += line.substr(0, idxBegin) + m_sourceFiles[fileIdx] + line.substr(idxEnd) + "\n";
+				continue;
+			}
+		}
+
+		// Anything without a recognizable location goes with the main file
+		fileLogs[0] += line + "\n";
+		m_errorLog += line + "\n";
+	}
+
+	// Logs are pushed to connected editor tools, or else written to .errors files next to the sources.
+	// The runtime library has no event server.
+	bool pushed = false;
+#ifndef RENDERTOY_RUNTIME
+	// Picks up tools which connected since the last frame
+	EventServer::update();
+	if (EventServer::hasClients()) {
+		rapidjson::StringBuffer buffer;
+		rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+		writer.StartObject();
+		writer.String("type");
+		writer.String("build");
+		writer.String("shader");
+		writer.String(getAbsolutePath(m_sourceFile).c_str());
+		writer.String("succeeded");
+		writer.Bool(succeeded);
+		writer.String("timeMs");
+		writer.Double(buildMs);
+
+		// Every file is listed, so that tools can clear errors which have been fixed
+		writer.String("files");
+		writer.StartArray();
+		for (size_t i = 0; i < m_sourceFiles.size(); ++i) {
+			writer.StartObject();
+			writer.String("path");
+			writer.String(getAbsolutePath(m_sourceFiles[i]).c_str());
+			writer.String("log");
+			writer.StartArray();
+			for (size_t begin = 0, end; begin < fileLogs[i].size(); begin = end + 1) {
+				end = fileLogs[i].find('\n', begin);
+				writer.String(fileLogs[i].c_str() + begin, rapidjson::SizeType(end - begin));
+			}
+			writer.EndArray();
+			writer.EndObject();
+		}
+		writer.EndArray();
+
+		writer.EndObject();
+		pushed = EventServer::send(buffer.GetString());
+	}
+#endif
+
+	for (size_t i = 0; i < m_sourceFiles.size(); ++i) {
+		const std::string errorsPath = m_sourceFiles[i] + ".errors";
+		if (!pushed && fileLogs[i].length() > 0) {
+			std::ofstream(errorsPath).write(fileLogs[i].data(), fileLogs[i].size());
+		}
+		else if (fs::exists(errorsPath)) {
+			remove(fs::path(errorsPath));
+		}
+	}
+}
+
+bool ComputeShader::reload()
+{
+	return reloadBatch({ this })[0];
+}
+
+vector<bool> ComputeShader::reloadBatch(const vector<ComputeShader*>& shaders)
+{
+	struct PendingShader {
+		ShaderSource source;
+		std::string errorLog;
+		GLuint shader = 0;
+		GLuint program = 0;
+	};
+
+	vector<PendingShader> pending(shaders.size());
+	vector<bool> result(shaders.size(), false);
+	const auto batchStart = std::chrono::high_resolution_clock::now();
+	double reflectionMs = 0.0;
+
+	for (size_t i = 0; i < shaders.size(); ++i) {
+		PendingShader& p = pending[i];
+		if (loadShaderSource(shaders[i]->m_sourceFile, &p.source)) {
+			p.shader = beginShader(GL_COMPUTE_SHADER, p.source.text, &p.errorLog);
+		}
+	}
+
+	for (PendingShader& p : pending) {
+		if (p.shader) {
+			if (finishShader(p.shader, &p.errorLog)) {
+				p.program = beginProgram(p.shader);
+			} else {
+				p.shader = 0;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < shaders.size(); ++i) {
+		ComputeShader& sh = *shaders[i];
+		PendingShader& p = pending[i];
+
+		// Kept even on failure, so that fixing any of the files triggers a rebuild
+		sh.m_sourceFiles = p.source.files;
+
+		if (p.program && !finishProgram(p.program, &p.errorLog)) {
+			glDeleteShader(p.shader);
+			p.program = 0;
+		}
+
+		// Measured from the start of the batch, as the builds overlap
+		const double buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - batchStart).count();
+		sh.reportBuild(p.source.errorLog + p.errorLog, p.program != 0, buildMs);
+		if (!p.program) {
+			continue;
+		}
+
+		// Passes don't hold on to programs across frames, so the previous version can go right away
+		if (sh.m_programHandle != GLuint(-1)) {
+			glDeleteProgram(sh.m_programHandle);
+			glDeleteShader(sh.m_csHandle);
+		}
+
+		sh.m_programHandle = p.program;
+		sh.m_csHandle = p.shader;
+		++sh.versionId;
+
+		MD5_CTX md5;
+		MD5Digest digest;
+		MD5Init(&md5);
+		MD5Update(&md5, (const unsigned char*)p.source.text.data(), p.source.text.size());
+		MD5Final(&digest, &md5);
+		sh.m_sourceDigest.assign((const char*)digest.data, sizeof(digest.data));
+		sh.m_source = std::move(p.source.text);
+
+		const auto reflectionStart = std::chrono::high_resolution_clock::now();
+		auto annotations = parseAnnotations(sh.m_source);
+		sh.reflectParams(annotations);
+		sh.m_programRefl.reflect(sh.m_programHandle, sh.m_params);
+		sh.initializeDefaultDispatchSize(annotations);
+		reflectionMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - reflectionStart).count();
+
+		result[i] = true;
+	}
+
+	const double batchMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - batchStart).count();
+	ReloadLatency::addStageTime(ReloadLatency::Stage::Build, batchMs - reflectionMs);
+	ReloadLatency::addStageTime(ReloadLatency::Stage::Reflection, reflectionMs);
+
+	return result;
+}
+
+namespace ShaderDependencies {
+	struct TrackedShader {
+		Callback onReloaded;
+		vector<std::string> files;
+	};
+
+	std::unordered_map<ComputeShader*, TrackedShader> trackedShaders;
+
+	// Reverse of TrackedShader::files
+	std::unordered_map<std::string, std::unordered_set<ComputeShader*>> dependents;
+
+	// Filled in by FileWatcher callbacks. The rebuild is deferred to update(), as FileWatcher
+	// can't be called into from its own callbacks.
+	std::unordered_set<std::string> changedFiles;
+
+	static void addDependency(const std::string& file, ComputeShader *const shader)
+	{
+		auto& fileDependents = dependents[file];
+		if (fileDependents.empty()) {
+			FileWatcher::watchFile(file.c_str(), [file]()
+			{
+				changedFiles.insert(file);
+				ReloadLatency::fileChanged(FileWatcher::currentChange());
+			});
+		}
+
+		fileDependents.insert(shader);
+	}
+
+	static void removeDependency(const std::string& file, ComputeShader *const shader)
+	{
+		auto found = dependents.find(file);
+		if (found != dependents.end()) {
+			found->second.erase(shader);
+			if (found->second.empty()) {
+				FileWatcher::stopWatchingFile(file.c_str());
+				dependents.erase(found);
+			}
+		}
+	}
+
+	static void updateDependencies(ComputeShader *const shader, TrackedShader& tracked)
+	{
+		vector<std::string> files = shader->m_sourceFiles;
+		if (files.empty()) {
+			files.push_back(shader->m_sourceFile);
+		}
+
+		for (const std::string& file : tracked.files) {
+			if (std::find(files.begin(), files.end(), file) == files.end()) {
+				removeDependency(file, shader);
+			}
+		}
+
+		for (const std::string& file : files) {
+			if (std::find(tracked.files.begin(), tracked.files.end(), file) == tracked.files.end()) {
+				addDependency(file, shader);
+			}
+		}
+
+		tracked.files = std::move(files);
+	}
+
+	void track(ComputeShader *const shader, const Callback& onReloaded)
+	{
+		TrackedShader& tracked = trackedShaders[shader];
+		tracked.onReloaded = onReloaded;
+		updateDependencies(shader, tracked);
+	}
+
+	void untrack(ComputeShader *const shader)
+	{
+		auto found = trackedShaders.find(shader);
+		if (found != trackedShaders.end()) {
+			for (const std::string& file : found->second.files) {
+				removeDependency(file, shader);
+			}
+			trackedShaders.erase(found);
+		}
+	}
+
+	void update()
+	{
+		if (changedFiles.empty()) {
+			return;
+		}
+
+		std::unordered_set<ComputeShader*> affected;
+		for (const std::string& file : changedFiles) {
+			g_includeCache.erase(file);
+
+			auto found = dependents.find(file);
+			if (found != dependents.end()) {
+				affected.insert(found->second.begin(), found->second.end());
+			}
+		}
+
+#ifndef RENDERTOY_RUNTIME
+		if (EventServer::hasClients()) {
+			rapidjson::StringBuffer buffer;
+			rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+			writer.StartObject();
+			writer.String("type");
+			writer.String("reload");
+			writer.String("files");
+			writer.StartArray();
+			for (const std::string& file : changedFiles) {
+				writer.String(getAbsolutePath(file).c_str());
+			}
+			writer.EndArray();
+			writer.EndObject();
+			EventServer::send(buffer.GetString());
+		}
+#endif
+
+		changedFiles.clear();
+
+		const vector<ComputeShader*> shaders(affected.begin(), affected.end());
+		const vector<bool> reloaded = ComputeShader::reloadBatch(shaders);
+
+		const auto paramsStart = std::chrono::high_resolution_clock::now();
+		bool anyReloaded = false;
+
+		for (size_t i = 0; i < shaders.size(); ++i) {
+			auto tracked = trackedShaders.find(shaders[i]);
+			if (tracked == trackedShaders.end()) {
+				continue;
+			}
+
+			updateDependencies(shaders[i], tracked->second);
+			if (reloaded[i]) {
+				tracked->second.onReloaded();
+				anyReloaded = true;
+			}
+		}
+
+		ReloadLatency::addStageTime(ReloadLatency::Stage::UpdateParams, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - paramsStart).count());
+		ReloadLatency::buildFinished(anyReloaded);
+	}
+}
+
+namespace ShaderLibrary {
+	struct LibraryEntry {
+		shared_ptr<ComputeShader> shader;
+		std::unordered_map<const void*, Callback> subscribers;
+	};
+
+	// By normalized path
+	std::unordered_map<std::string, LibraryEntry> entries;
+
+	shared_ptr<ComputeShader> get(const std::string& path)
+	{
+		const std::string key = normalizePath(path);
+		auto found = entries.find(key);
+		if (found != entries.end()) {
+			return found->second.shader;
+		}
+
+		auto shader = std::make_shared<ComputeShader>(path);
+		entries[key].shader = shader;
+
+		ShaderDependencies::track(shader.get(), [key]()
+		{
+			auto entry = entries.find(key);
+			if (entry != entries.end()) {
+				// Subscribers may unsubscribe from within their callbacks
+				const auto subscribers = entry->second.subscribers;
+				for (const auto& subscriber : subscribers) {
+					subscriber.second();
+				}
+			}
+		});
+
+		return shader;
+	}
+
+	static LibraryEntry* findEntry(ComputeShader *const shader)
+	{
+		auto found = entries.find(normalizePath(shader->m_sourceFile));
+		if (found != entries.end() && found->second.shader.get() == shader) {
+			return &found->second;
+		}
+
+		return nullptr;
+	}
+
+	void subscribe(ComputeShader *const shader, const void* const subscriber, const Callback& onReloaded)
+	{
+		if (LibraryEntry* const entry = findEntry(shader)) {
+			entry->subscribers[subscriber] = onReloaded;
+		}
+	}
+
+	void unsubscribe(ComputeShader *const shader, const void* const subscriber)
+	{
+		if (LibraryEntry* const entry = findEntry(shader)) {
+			entry->subscribers.erase(subscriber);
+		}
+	}
+
+	void releaseUnused()
+	{
+		for (auto it = entries.begin(); it != entries.end();) {
+			ComputeShader& shader = *it->second.shader;
+			if (it->second.shader.use_count() > 1) {
+				++it;
+				continue;
+			}
+
+			ShaderDependencies::untrack(&shader);
+			if (shader.m_programHandle != GLuint(-1)) {
+				glDeleteProgram(shader.m_programHandle);
+				glDeleteShader(shader.m_csHandle);
+			}
+
+			it = entries.erase(it);
+		}
+
+		// The frame's passes are gone, so variants evicted during it can go too
+		for (const ShaderVariant& variant : g_evictedShaderVariants) {
+			if (variant.program.program != GLuint(-1)) glDeleteProgram(variant.program.program);
+			if (variant.shader) glDeleteShader(variant.shader);
+		}
+		g_evictedShaderVariants.clear();
+		++g_shaderVariantFrame;
+	}
+}
@@ -8,9 +8,23 @@
 #include <unordered_map>
 //#include <fstream>
 #include <string>
+#include <functional>
 
 
-std::vector<char> loadShaderSource(const std::string& path, const char* preprocessorOptions);
+struct ShaderSource {
+	std::vector<char> text;
+
+	// The main file followed by everything it includes. The GLSL source string number
+	// of each file is its index here.
+	std::vector<std::string> files;
+
+	// Preprocessor errors, in the same format as the compiler's
+	std::string errorLog;
+};
+
+// Expands #include "file" directives (relative to the including file, then to the working directory),
+// and prefixes the shader with RenderToy's declarations. Included files are cached until they change.
+bool loadShaderSource(const std::string& path, ShaderSource *const res);
 
 struct ParamAnnotation
 {
@@ -55,6 +69,9 @@ struct ParamAnnotation
 	}
 };
 
+// Parse the text following a "//@" tag, e.g. "min(0) max(10) color"
+bool parseAnnotation(const char* abegin, const char* aend, ParamAnnotation *const annot);
+
 enum class ShaderParamType {
 	Float,
 	Float2,
@@ -124,23 +141,73 @@ struct ShaderParamBindingRefl : ShaderParamRefl {
 	unsigned int location = -1;
 };
 
+// Param values by name, as GLSL constants. They're compiled into shader variants as #defines in place
+// of the uniforms, so that the compiler can fold them. Int and bool params annotated with "static" are
+// always compiled in; other scalar and vector params when their pass is baked.
+typedef std::vector<std::pair<std::string, std::string>> ShaderDefines;
+
+bool isStaticParam(const ShaderParamRefl& refl);
+
+// Formats a Float* or Int* value as a GLSL constant; returns false for other types
+bool getShaderParamConstant(ShaderParamType type, const ShaderParamValue& value, std::string *const res);
+
+// What rendering needs to know about a linked program. Queried once when the program is linked,
+// rather than every frame.
+struct ShaderProgramRefl {
+	// Uniforms RenderToy sets for a texture param, named after it; -1 where the program doesn't have them
+	struct TextureUniforms {
+		int size = -1;			// [texname]_size
+		int flipY = -1;			// [texname]_flipY
+		int origin = -1;		// [texname]_origin
+		int indirection = -1;	// [texname]_indirection
+		int vtLevel = -1;		// [texname]_vtLevel
+	};
+
+	unsigned int program = -1;	// GLuint
+	ivec2 workGroupSize = ivec2(1, 1);
+	int dispatchOffset = -1;	// rtoy_dispatchOffset; see loadShaderSource
+
+	// By param index. Static params aren't uniforms in variants, so their locations are -1 there.
+	std::vector<int> paramLocations;
+	std::vector<TextureUniforms> textureUniforms;
+
+	void reflect(unsigned int program, const std::vector<ShaderParamBindingRefl>& params);
+};
+
 struct ComputeShader
 {
 	std::vector<ShaderParamBindingRefl> m_params;
 	std::string m_sourceFile;
+	std::vector<std::string> m_sourceFiles;	// m_sourceFile and its includes, as of the last reload
+	std::vector<char> m_source;				// preprocessed source of m_programHandle
+	std::string m_sourceDigest;				// MD5 of m_source, identifying its variants
 	std::string m_errorLog;
 
 	TextureSize m_defaultDispatchSize;
 	bool m_hasDefaultDispatchSize = false;
 
+	// From "//@ tileable" on the layout line: the shader follows the contract in data/std/graphTile.glsl,
+	// so graphs of such passes can render their Created images a tile at a time
+	bool m_tileable = false;
+
 	unsigned int m_csHandle = -1;
 	unsigned int m_programHandle = -1;
+	ShaderProgramRefl m_programRefl;	// of m_programHandle
 
 	// incremented every time the shader is dynamically reloaded
 	u32 versionId = 0;
 
 	bool reload();
 
+	// Reloads several shaders at once. All the compiles and links are issued before waiting
+	// on any of them, so that drivers which build shaders in the background can overlap them.
+	static vector<bool> reloadBatch(const vector<ComputeShader*>& shaders);
+
+	// Returns the program with 'defines' compiled in. Variants are cached, and built on first use; until
+	// a variant is ready, the generic program is returned, which takes the static params as uniforms.
+	// The result stays valid until the end of the frame; see ShaderLibrary::releaseUnused.
+	const ShaderProgramRefl& getVariantProgram(const ShaderDefines& defines);
+
 	ComputeShader() {}
 	ComputeShader(const std::string sourceFile)
 		: m_sourceFile(sourceFile)
@@ -148,15 +215,47 @@ struct ComputeShader
 		reload();
 	}
 
-private:
 	typedef std::unordered_map<std::string, ParamAnnotation> AnnotationMap;
 
-	std::unordered_map<std::string, ParamAnnotation> parseAnnotations(const std::vector<char>& source);
+	// Maps param names to their annotations in the shader source. Doesn't need a GL context.
+	static AnnotationMap parseAnnotations(const std::vector<char>& source);
+
+private:
 	void reflectParams(const AnnotationMap& annotations);
 	void initializeDefaultDispatchSize(const AnnotationMap& annotations);
-	void updateErrorLogFile();
+	void reportBuild(const std::string& compilerLog, bool succeeded, double buildMs);
 };
 
+// Rebuilds shaders when their source, or any file they include, changes on disk
+namespace ShaderDependencies {
+	typedef std::function<void()> Callback;
+
+	// 'onReloaded' is called after every successful rebuild of 'shader'
+	void track(ComputeShader *const shader, const Callback& onReloaded);
+	void untrack(ComputeShader *const shader);
+
+	// Rebuilds the shaders affected by files changed since the last update, each one once
+	void update();
+}
+
+// Shaders shared by everything using the same source file. Each is compiled once, reloaded once
+// when its files change, and all its subscribers are notified. Variants are shared through the
+// variant cache, which is keyed by the preprocessed source.
+namespace ShaderLibrary {
+	typedef std::function<void()> Callback;
+
+	// Returns the shader for 'path', loading it if it isn't in the library yet
+	shared_ptr<ComputeShader> get(const std::string& path);
+
+	// 'onReloaded' is called after every successful rebuild of 'shader', until unsubscribed
+	void subscribe(ComputeShader *const shader, const void* const subscriber, const Callback& onReloaded);
+	void unsubscribe(ComputeShader *const shader, const void* const subscriber);
+
+	// Frees the shaders nobody else holds a reference to, and the variants evicted from the cache
+	// during the frame. Called once a frame, after rendering.
+	void releaseUnused();
+}
+
 struct ShaderParamProxy {
 	const ShaderParamBindingRefl& refl;
 	ShaderParamValue& value;
@@ -1,14 +1,25 @@
 #include "Texture.h"
 #include "StringUtil.h"
+#include "GlState.h"
+#include "GlTrace.h"
+#include "FileUtil.h"
+#include "UploadRing.h"
+#include "TextureCache.h"
+#include "BcEncoder.h"
+#include "ExrLoader.h"
 
 #define NOMINMAX
 #include <glad/glad.h>
-#include <GLFW/glfw3.h>
-#include <tinyexr.h>
 #include <FreeImage.h>
 #include <gli/gli.hpp>
+#include <glm/gtc/packing.hpp>
+#include <limits>
+#include <unordered_set>
 
-std::unordered_map<std::string, shared_ptr<CreatedTexture>> g_loadedTextures;
+std::unordered_map<std::string, LoadedTexture> g_loadedTextures;
+
+// Set when a variant is loaded, so that the sweep only looks for replaced ones then
+static bool g_loadedTextureVariantAdded = false;
 
 
 bool parseTextureFormat(const char* const str, TextureFormat *const res)
@@ -35,124 +46,334 @@ TextureFormat parseTextureFormat(const char* const str)
 	return TextureFormat::rgba16f;
 }
 
-CreatedTexture::~CreatedTexture()
+namespace std {
+	template <>
+	struct hash<SamplerDesc>
+	{
+		size_t operator()(const SamplerDesc& s) const {
+			size_t res = 17;
+			res = res * 31u + hash<u32>()(s.minFilter);
+			res = res * 31u + hash<u32>()(s.magFilter);
+			res = res * 31u + hash<u32>()(s.wrapS);
+			res = res * 31u + hash<u32>()(s.wrapT);
+			res = res * 31u + hash<float>()(s.maxLod);
+			res = res * 31u + hash<float>()(s.maxAnisotropy);
+			return res;
+		}
+	};
+}
+
+std::unordered_map<SamplerDesc, GLuint> g_samplerCache;
+
+// From EXT_texture_filter_anisotropic, core in GL 4.6
+#ifndef GL_TEXTURE_MAX_ANISOTROPY_EXT
+	#define GL_TEXTURE_MAX_ANISOTROPY_EXT 0x84FE
+#endif
+
+SamplerDesc getSamplerDesc(const CreatedTexture& tex, const TextureDesc& desc)
 {
-	if (texId != 0) glDeleteTextures(1, &texId);
-	if (samplerId != 0) glDeleteSamplers(1, &samplerId);
+	SamplerDesc res;
+	res.minFilter = GL_LINEAR;
+	res.magFilter = GL_LINEAR;
+	res.wrapS = desc.wrapS ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+	res.wrapT = desc.wrapT ? GL_REPEAT : GL_CLAMP_TO_EDGE;
+	res.maxLod = float(tex.levels - 1);
+	return res;
 }
 
-shared_ptr<CreatedTexture> loadTextureExr(const TextureDesc& desc)
+unsigned int getSampler(const SamplerDesc& desc)
 {
-	int ret;
-	const char* err;
+	auto found = g_samplerCache.find(desc);
+	if (found != g_samplerCache.end()) {
+		return found->second;
+	}
 
-	// 1. Read EXR version.
-	EXRVersion exr_version;
+	GLuint samplerId;
+	glGenSamplers(1, &samplerId);
+	glSamplerParameteri(samplerId, GL_TEXTURE_MIN_FILTER, desc.minFilter);
+	glSamplerParameteri(samplerId, GL_TEXTURE_MAG_FILTER, desc.magFilter);
+	glSamplerParameteri(samplerId, GL_TEXTURE_WRAP_S, desc.wrapS);
+	glSamplerParameteri(samplerId, GL_TEXTURE_WRAP_T, desc.wrapT);
+	glSamplerParameterf(samplerId, GL_TEXTURE_MAX_LOD, desc.maxLod);
+	if (desc.maxAnisotropy > 1.0f) {
+		glSamplerParameterf(samplerId, GL_TEXTURE_MAX_ANISOTROPY_EXT, desc.maxAnisotropy);
+	}
 
-	ret = ParseEXRVersionFromFile(&exr_version, desc.path.c_str());
-	if (ret != 0) {
-		fprintf(stderr, "Invalid EXR file: %s\n", desc.path.c_str());
-		return nullptr;
+	g_samplerCache[desc] = samplerId;
+	return samplerId;
+}
+
+static u32 getMipLevelCount(u32 width, u32 height)
+{
+	u32 levels = 1;
+	while ((width | height) >> levels) {
+		++levels;
 	}
 
-	if (exr_version.multipart) {
-		// must be multipart flag is false.
-		printf("Multipart EXR not supported");
-		return nullptr;
+	return levels;
+}
+
+// In the notation of KTXswizzle, e.g. "rrr1"
+static std::string swizzleToString(const GLint *const swizzle)
+{
+	std::string res;
+	for (int i = 0; i < 4; ++i) {
+		switch (swizzle[i]) {
+			case GL_RED: res += 'r'; break;
+			case GL_GREEN: res += 'g'; break;
+			case GL_BLUE: res += 'b'; break;
+			case GL_ALPHA: res += 'a'; break;
+			case GL_ZERO: res += '0'; break;
+			default: res += '1'; break;
+		}
 	}
 
-	// 2. Read EXR header
-	EXRHeader exr_header;
-	InitEXRHeader(&exr_header);
+	return res;
+}
 
-	ret = ParseEXRHeaderFromFile(&exr_header, &exr_version, desc.path.c_str(), &err);
-	if (ret != 0) {
-		fprintf(stderr, "Parse EXR err: %s\n", err);
-		return nullptr;
+static gli::swizzles parseKtxSwizzle(const char* const str)
+{
+	gli::swizzles res(gli::SWIZZLE_RED, gli::SWIZZLE_GREEN, gli::SWIZZLE_BLUE, gli::SWIZZLE_ALPHA);
+	for (int i = 0; i < 4 && str[i]; ++i) {
+		switch (str[i]) {
+			case 'r': res[i] = gli::SWIZZLE_RED; break;
+			case 'g': res[i] = gli::SWIZZLE_GREEN; break;
+			case 'b': res[i] = gli::SWIZZLE_BLUE; break;
+			case 'a': res[i] = gli::SWIZZLE_ALPHA; break;
+			case '0': res[i] = gli::SWIZZLE_ZERO; break;
+			case '1': res[i] = gli::SWIZZLE_ONE; break;
+			default: break;
+		}
 	}
 
-	EXRImage exr_image;
-	InitEXRImage(&exr_image);
+	return res;
+}
 
-	for (int i = 0; i < exr_header.num_channels; ++i) {
-		exr_header.requested_pixel_types[i] = TINYEXR_PIXELTYPE_HALF;
+static u32 getTexelBytes(GLenum externalFormat, GLenum type, u32 *const typeBytes)
+{
+	u32 components = 4;
+	switch (externalFormat) {
+		case GL_RED: components = 1; break;
+		case GL_RG: components = 2; break;
+		case GL_RGB:
+		case GL_BGR: components = 3; break;
+		default: break;
 	}
 
-	ret = LoadEXRImageFromFile(&exr_image, &exr_header, desc.path.c_str(), &err);
-	if (ret != 0) {
-		fprintf(stderr, "Load EXR err: %s\n", err);
-		return nullptr;
+	switch (type) {
+		case GL_UNSIGNED_SHORT:
+		case GL_SHORT:
+		case GL_HALF_FLOAT: *typeBytes = 2; break;
+		case GL_FLOAT: *typeBytes = 4; break;
+		default: *typeBytes = 1; break;
 	}
 
-	short* out_rgba = nullptr;
+	return components * *typeBytes;
+}
 
-	{
-		// RGBA
-		int idxR = -1;
-		int idxG = -1;
-		int idxB = -1;
-		int idxA = -1;
-		for (int c = 0; c < exr_header.num_channels; c++) {
-			if (strcmp(exr_header.channels[c].name, "R") == 0) {
-				idxR = c;
-			}
-			else if (strcmp(exr_header.channels[c].name, "G") == 0) {
-				idxG = c;
-			}
-			else if (strcmp(exr_header.channels[c].name, "B") == 0) {
-				idxB = c;
-			}
-			else if (strcmp(exr_header.channels[c].name, "A") == 0) {
-				idxA = c;
-			}
-		}
+// Reads back the whole mip chain, with rows padded to 4 bytes
+static void readTextureLevels(const CreatedTexture& tex, GLenum externalFormat, GLenum type, TextureCache::Image *const image)
+{
+	const u32 texelBytes = getTexelBytes(externalFormat, type, &image->typeBytes);
+	image->internalFormat = tex.key.format;
+	image->baseFormat = externalFormat;
+	image->externalFormat = externalFormat;
+	image->type = type;
+	image->width = tex.key.width;
+	image->height = tex.key.height;
+	image->levels.resize(tex.levels);
+
+	GlState::bindTexture(GL_TEXTURE_2D, tex.texId);
+
+	GLint swizzle[4];
+	glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	image->swizzle = swizzleToString(swizzle);
+	for (u32 level = 0; level < tex.levels; ++level) {
+		const u32 width = std::max(1u, tex.key.width >> level);
+		const u32 height = std::max(1u, tex.key.height >> level);
+
+		image->levels[level].resize(((width * texelBytes + 3) & ~3u) * height);
+		glGetTexImage(GL_TEXTURE_2D, GLint(level), externalFormat, type, image->levels[level].data());
+	}
+}
+
+// Only EXR files have parts; the setting is kept, but ignored for other files
+static u32 getSourcePart(const TextureDesc& desc)
+{
+	return ends_with(to_lower(desc.path), ".exr") ? desc.exrPart : 0;
+}
+
+// Decoded images get a full mip chain, and go into the texture cache as such
+static float srgbToLinear(float v)
+{
+	return v <= 0.04045f ? v / 12.92f : powf((v + 0.055f) / 1.055f, 2.4f);
+}
 
-		size_t imgSizeBytes = 4 * sizeof(short) * static_cast<size_t>(exr_image.width) * static_cast<size_t>(exr_image.height);
+static float linearToSrgb(float v)
+{
+	return v <= 0.0031308f ? v * 12.92f : 1.055f * powf(v, 1.0f / 2.4f) - 0.055f;
+}
+
+static float decodeComponent(const u8* const src, GLenum type)
+{
+	switch (type) {
+	case GL_UNSIGNED_BYTE: return float(*src);
+	case GL_UNSIGNED_SHORT: return float(*reinterpret_cast<const u16*>(src));
+	case GL_SHORT: return float(*reinterpret_cast<const s16*>(src));
+	case GL_HALF_FLOAT: return glm::unpackHalf1x16(*reinterpret_cast<const u16*>(src));
+	default: return *reinterpret_cast<const float*>(src);
+	}
+}
+
+static void encodeComponent(float v, GLenum type, u8 *const dst)
+{
+	switch (type) {
+	case GL_UNSIGNED_BYTE: *dst = u8(glm::clamp(v + 0.5f, 0.0f, 255.0f)); break;
+	case GL_UNSIGNED_SHORT: *reinterpret_cast<u16*>(dst) = u16(glm::clamp(v + 0.5f, 0.0f, 65535.0f)); break;
+	case GL_SHORT: *reinterpret_cast<s16*>(dst) = s16(glm::clamp(roundf(v), -32768.0f, 32767.0f)); break;
+	case GL_HALF_FLOAT: *reinterpret_cast<u16*>(dst) = glm::packHalf1x16(v); break;
+	default: *reinterpret_cast<float*>(dst) = v; break;
+	}
+}
+
+// For formats the GPU can't generate mips of, e.g. ones which aren't color-renderable. Levels are box
+// filtered from level 0 as read back in 'externalFormat' and 'type'; sRGB color is filtered in linear space.
+static void generateMipmapsCpu(const CreatedTexture& tex, GLenum externalFormat, GLenum type)
+{
+	u32 typeBytes;
+	const u32 texelBytes = getTexelBytes(externalFormat, type, &typeBytes);
+	const u32 components = texelBytes / typeBytes;
+	const bool srgb = GL_SRGB8_ALPHA8 == tex.key.format || GL_SRGB8 == tex.key.format;
+	const u32 colorComponents = (srgb && 4 == components) ? 3 : components;
 
-		out_rgba = reinterpret_cast<short *>(malloc(imgSizeBytes));
-		memset(out_rgba, 0, imgSizeBytes);
+	u32 width = tex.key.width;
+	u32 height = tex.key.height;
+	vector<u8> texels(((width * texelBytes + 3) & ~3u) * height);
+	glGetTexImage(GL_TEXTURE_2D, 0, externalFormat, type, texels.data());
 
-		auto loadChannel = [&](int chIdx, int compIdx) {
-			for (int y = 0; y < exr_image.height; ++y) {
-				for (int x = 0; x < exr_image.width; ++x) {
-					out_rgba[4 * (y * exr_image.width + x) + compIdx] =
-						reinterpret_cast<short**>(exr_image.images)[chIdx][((exr_image.height - y - 1) * exr_image.width + x)];
+	vector<float> level(size_t(width) * height * components);
+	for (u32 y = 0; y < height; ++y) {
+		const u8* const row = texels.data() + ((width * texelBytes + 3) & ~3u) * y;
+		for (u32 i = 0; i < width * components; ++i) {
+			const float v = decodeComponent(row + i * typeBytes, type);
+			level[size_t(y) * width * components + i] = (srgb && i % components < colorComponents) ? srgbToLinear(v / 255.0f) : v;
+		}
+	}
+
+	vector<float> next;
+	for (u32 levelIdx = 1; levelIdx < tex.levels; ++levelIdx) {
+		const u32 nextWidth = std::max(1u, width / 2);
+		const u32 nextHeight = std::max(1u, height / 2);
+		next.resize(size_t(nextWidth) * nextHeight * components);
+
+		// Odd sizes drop their last row or column, as GL's own filtering does
+		for (u32 y = 0; y < nextHeight; ++y) {
+			const u32 y0 = std::min(y * 2, height - 1);
+			const u32 y1 = std::min(y * 2 + 1, height - 1);
+			for (u32 x = 0; x < nextWidth; ++x) {
+				const u32 x0 = std::min(x * 2, width - 1);
+				const u32 x1 = std::min(x * 2 + 1, width - 1);
+				for (u32 c = 0; c < components; ++c) {
+					const float sum =
+						level[(size_t(y0) * width + x0) * components + c] + level[(size_t(y0) * width + x1) * components + c] +
+						level[(size_t(y1) * width + x0) * components + c] + level[(size_t(y1) * width + x1) * components + c];
+					next[(size_t(y) * nextWidth + x) * components + c] = sum * 0.25f;
 				}
 			}
-		};
+		}
 
-		if (idxR != -1) loadChannel(idxR, 0);
-		if (idxG != -1) loadChannel(idxG, 1);
-		if (idxB != -1) loadChannel(idxB, 2);
+		level.swap(next);
+		width = nextWidth;
+		height = nextHeight;
 
-		if (idxA != -1) loadChannel(idxA, 3);
-		else {
-			const short one = 15 << 10;
-			for (int i = 0; i < exr_image.width * exr_image.height; i++) {
-				out_rgba[4 * i + 3] = one;
+		const size_t rowBytes = (width * texelBytes + 3) & ~size_t(3);
+		for (u32 y = 0; y < height; ++y) {
+			u8* const row = texels.data() + rowBytes * y;
+			for (u32 i = 0; i < width * components; ++i) {
+				const float v = level[size_t(y) * width * components + i];
+				encodeComponent((srgb && i % components < colorComponents) ? linearToSrgb(v) * 255.0f : v, type, row + i * typeBytes);
 			}
 		}
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexSubImage2D(GL_TEXTURE_2D, GLint(levelIdx), 0, 0, width, height, externalFormat, type, texels.data());
 	}
+}
+
+// Fills levels 1 and up of the texture from level 0. False if that failed, and the levels are undefined.
+static bool generateMipmaps(const CreatedTexture& tex, GLenum externalFormat, GLenum type)
+{
+	GlState::bindTexture(GL_TEXTURE_2D, tex.texId);
+	if (tex.levels <= 1) {
+		return true;
+	}
+
+	// Only color-renderable formats are required to support glGenerateMipmap; strict drivers fail the rest
+	GLint mipmap = GL_FALSE;
+	GLint renderable = GL_FALSE;
+	glGetInternalformativ(GL_TEXTURE_2D, tex.key.format, GL_MIPMAP, 1, &mipmap);
+	glGetInternalformativ(GL_TEXTURE_2D, tex.key.format, GL_COLOR_RENDERABLE, 1, &renderable);
 
-	shared_ptr<CreatedTexture> res = createTexture(
+	if (mipmap != GL_FALSE && renderable != GL_FALSE) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+		if (GL_NO_ERROR == glGetError()) {
+			return true;
+		}
+	}
+
+	// Without the external format, there's nothing to filter on the CPU
+	if (0 == externalFormat) {
+		return false;
+	}
+
+	generateMipmapsCpu(tex, externalFormat, type);
+	return GL_NO_ERROR == glGetError();
+}
+
+static void finishDecodedTexture(const TextureDesc& desc, TextureHandle tex, GLenum externalFormat, GLenum type)
+{
+	if (!generateMipmaps(Resources::get(tex), externalFormat, type)) {
+		fprintf(stderr, "Could not generate mip levels of %s; it stays out of the texture cache\n", desc.path.c_str());
+		return;
+	}
+
+	TextureCache::Image image;
+	readTextureLevels(Resources::get(tex), externalFormat, type, &image);
+	TextureCache::store(desc.path, getSourcePart(desc), TextureCache::Variant::Decoded, image);
+}
+
+// Tiled files with mip levels only have the level which fits 'maxSize' decoded. Such textures
+// stay out of the texture cache, which holds whole chains.
+TextureHandle loadTextureExr(const TextureDesc& desc, u32 maxSize)
+{
+	ExrLoader::Image image;
+	if (!ExrLoader::load(desc.path.c_str(), desc.exrPart, maxSize, &image)) {
+		return TextureHandle();
+	}
+
+	TextureHandle res = createTexture(
 		desc,
-		TextureKey{ u32(exr_image.width), u32(exr_image.height), GL_RGBA16F }
+		TextureKey{ image.width, image.height, GL_RGBA16F },
+		getMipLevelCount(image.width, image.height)
 	);
 
-	glBindTexture(GL_TEXTURE_2D, res->texId);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, exr_image.width, exr_image.height, GL_RGBA, GL_HALF_FLOAT, out_rgba);
+	GlState::bindTexture(GL_TEXTURE_2D, Resources::get(res).texId);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, GL_RGBA, GL_HALF_FLOAT, image.texels.data());
 
-	FreeEXRHeader(&exr_header);
-	FreeEXRImage(&exr_image);
+	if (0 == image.level) {
+		finishDecodedTexture(desc, res, GL_RGBA, GL_HALF_FLOAT);
+	} else {
+		generateMipmaps(Resources::get(res), GL_RGBA, GL_HALF_FLOAT);
+	}
 
 	return res;
 }
 
-shared_ptr<CreatedTexture> loadTextureGli(const TextureDesc& desc)
+TextureHandle loadTextureGli(const TextureDesc& desc)
 {
 	gli::texture image = gli::load(desc.path.c_str());
 	if (image.empty() || image.target() != gli::TARGET_2D) {
-		return nullptr;
+		return TextureHandle();
 	}
 
 	// TODO: is this needed?
@@ -166,7 +387,7 @@ shared_ptr<CreatedTexture> loadTextureGli(const TextureDesc& desc)
 
 	GLuint TextureName = 0;
 	glGenTextures(1, &TextureName);
-	glBindTexture(target, TextureName);
+	GlState::bindTexture(target, TextureName);
 	glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
 	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.levels() - 1));
 	glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, &format.Swizzles[0]);
@@ -188,18 +409,380 @@ shared_ptr<CreatedTexture> loadTextureGli(const TextureDesc& desc)
 		}
 	}
 
-	GLuint samplerId;
-	glGenSamplers(1, &samplerId);
-	glSamplerParameteri(samplerId, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glSamplerParameteri(samplerId, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glSamplerParameteri(samplerId, GL_TEXTURE_MAX_LOD, static_cast<GLint>(image.levels() - 1));
+	CreatedTexture tex;
+	tex.key = TextureKey{ u32(extent.x), u32(extent.y), (unsigned int)(format.Internal) };
+	tex.texId = TextureName;
+	tex.levels = u32(image.levels());
+
+	return Resources::add(tex);
+}
 
-	auto tex = std::make_shared<CreatedTexture>();
-	tex->key = TextureKey{ u32(extent.x), u32(extent.y), (unsigned int)(format.Internal) };
-	tex->texId = TextureName;
-	tex->samplerId = samplerId;
+// Where the mip chain of a single 2D image sits in a KTX or DDS file
+struct MappedImageLayout {
+	enum { MaxLevels = 32 };
 
-	return tex;
+	gli::format format = gli::FORMAT_UNDEFINED;
+	u32 width = 0;
+	u32 height = 0;
+	u32 levels = 0;
+	size_t levelOffsets[MaxLevels];
+	size_t levelSizes[MaxLevels];
+	u32 rowAlignment = 1;	// KTX pads rows to 4 bytes, DDS packs them tightly
+	u32 externalFormat = 0;	// GLenum; only known for KTX
+	bool topDown = true;
+	gli::swizzles swizzles = gli::swizzles(gli::SWIZZLE_RED, gli::SWIZZLE_GREEN, gli::SWIZZLE_BLUE, gli::SWIZZLE_ALPHA);
+};
+
+static bool isValidGliFormat(gli::format format)
+{
+	return format != gli::FORMAT_UNDEFINED && format != static_cast<gli::format>(gli::FORMAT_INVALID);
+}
+
+static size_t getLevelRowBytes(gli::format format, u32 width, u32 rowAlignment)
+{
+	const u32 blockWidth = u32(gli::block_extent(format).x);
+	const size_t rowBytes = ((width + blockWidth - 1) / blockWidth) * gli::block_size(format);
+	return (rowBytes + rowAlignment - 1) / rowAlignment * rowAlignment;
+}
+
+static u32 getLevelBlockRows(gli::format format, u32 height)
+{
+	const u32 blockHeight = u32(gli::block_extent(format).y);
+	return (height + blockHeight - 1) / blockHeight;
+}
+
+// Only plain 2D images in little-endian files; anything else is left to gli
+static bool parseKtxLayout(const u8* const data, const size_t size, MappedImageLayout *const layout)
+{
+	gli::detail::ktx_header10 header;
+	const size_t headerOffset = sizeof(gli::detail::FOURCC_KTX10);
+	if (size < headerOffset + sizeof(header) || memcmp(data, gli::detail::FOURCC_KTX10, headerOffset) != 0) {
+		return false;
+	}
+
+	memcpy(&header, data + headerOffset, sizeof(header));
+	const size_t kvOffset = headerOffset + sizeof(header);
+	if (kvOffset + header.BytesOfKeyValueData > size || header.Endianness != 0x04030201 || header.NumberOfFaces > 1 || header.NumberOfArrayElements > 0
+		|| header.PixelDepth > 0 || 0 == header.PixelHeight || header.NumberOfMipmapLevels > MappedImageLayout::MaxLevels)
+	{
+		return false;
+	}
+
+	gli::gl GL(gli::gl::PROFILE_KTX);
+	layout->format = GL.find(
+		static_cast<gli::gl::internal_format>(header.GLInternalFormat),
+		static_cast<gli::gl::external_format>(header.GLFormat),
+		static_cast<gli::gl::type_format>(header.GLType));
+	if (!isValidGliFormat(layout->format)) {
+		return false;
+	}
+
+	layout->width = header.PixelWidth;
+	layout->height = header.PixelHeight;
+	layout->levels = std::max(1u, header.NumberOfMipmapLevels);
+	layout->rowAlignment = 4;
+	layout->externalFormat = header.GLFormat;
+
+	const char* const orientation = findKtxValue(data + kvOffset, header.BytesOfKeyValueData, "KTXorientation");
+	layout->topDown = !(orientation && strstr(orientation, "T=u"));
+
+	if (const char* const swizzle = findKtxValue(data + kvOffset, header.BytesOfKeyValueData, "KTXswizzle")) {
+		layout->swizzles = parseKtxSwizzle(swizzle);
+	}
+
+	// Each level is preceded by its size, and padded to 4 bytes
+	size_t offset = kvOffset + header.BytesOfKeyValueData;
+	for (u32 level = 0; level < layout->levels; ++level) {
+		u32 imageSize;
+		if (offset + sizeof(imageSize) > size) {
+			return false;
+		}
+
+		memcpy(&imageSize, data + offset, sizeof(imageSize));
+		offset += sizeof(imageSize);
+
+		layout->levelOffsets[level] = offset;
+		layout->levelSizes[level] = imageSize;
+		offset += std::max(gli::block_size(layout->format), (size_t(imageSize) + 3) & ~size_t(3));
+	}
+
+	return true;
+}
+
+// Only 2D images with a FourCC or DX10 format; masked formats are left to gli
+static bool parseDdsLayout(const u8* const data, const size_t size, MappedImageLayout *const layout)
+{
+	gli::detail::dds_header header;
+	size_t offset = sizeof(gli::detail::FOURCC_DDS);
+	if (size < offset + sizeof(header) || memcmp(data, gli::detail::FOURCC_DDS, offset) != 0) {
+		return false;
+	}
+
+	memcpy(&header, data + offset, sizeof(header));
+	offset += sizeof(header);
+
+	if ((header.CubemapFlags & (gli::detail::DDSCAPS2_CUBEMAP | gli::detail::DDSCAPS2_VOLUME)) || !(header.Format.flags & gli::dx::DDPF_FOURCC)) {
+		return false;
+	}
+
+	gli::dx DX;
+	if (header.Format.fourCC == gli::dx::D3DFMT_DX10 || header.Format.fourCC == gli::dx::D3DFMT_GLI1) {
+		gli::detail::dds_header10 header10;
+		if (offset + sizeof(header10) > size) {
+			return false;
+		}
+
+		memcpy(&header10, data + offset, sizeof(header10));
+		offset += sizeof(header10);
+
+		if (header10.ArraySize > 1 || header10.ResourceDimension != gli::detail::D3D10_RESOURCE_DIMENSION_TEXTURE2D) {
+			return false;
+		}
+
+		layout->format = DX.find(header.Format.fourCC, header10.Format);
+	} else {
+		layout->format = DX.find(gli::detail::remap_four_cc(header.Format.fourCC));
+	}
+
+	if (!isValidGliFormat(layout->format)) {
+		return false;
+	}
+
+	layout->width = header.Width;
+	layout->height = header.Height;
+	layout->levels = (header.Flags & gli::detail::DDSD_MIPMAPCOUNT) ? std::max(1u, header.MipMapLevels) : 1u;
+	layout->rowAlignment = 1;
+
+	if (layout->levels > MappedImageLayout::MaxLevels) {
+		return false;
+	}
+
+	// Levels follow each other without padding
+	for (u32 level = 0; level < layout->levels; ++level) {
+		const u32 width = std::max(1u, layout->width >> level);
+		const u32 height = std::max(1u, layout->height >> level);
+
+		layout->levelOffsets[level] = offset;
+		layout->levelSizes[level] = getLevelRowBytes(layout->format, width, 1) * getLevelBlockRows(layout->format, height);
+		offset += layout->levelSizes[level];
+	}
+
+	return true;
+}
+
+// The first mip level no larger than 'maxSize' on either side, or the last one
+static u32 getFirstLevelWithin(u32 width, u32 height, u32 levels, u32 maxSize)
+{
+	u32 level = 0;
+	while (maxSize > 0 && level + 1 < levels && std::max(width >> level, height >> level) > maxSize) {
+		++level;
+	}
+
+	return level;
+}
+
+// Reverses the first 'rows' texel rows of each 4x4 block in a row of BC1-BC5 blocks, by reordering their indices
+static void flipBlockRow(gli::format format, u8* const data, const size_t rowBytes, const u32 rows)
+{
+	// Endpoints, then a byte of 2-bit indices per texel row
+	auto flipColor = [rows](u8* const block) {
+		std::reverse(block + 4, block + 4 + rows);
+	};
+
+	// Two endpoints, then 12 bits of 3-bit indices per texel row; little-endian
+	auto flipAlpha = [rows](u8* const block) {
+		u64 bits = 0;
+		memcpy(&bits, block + 2, 6);
+		u64 flipped = bits & ~((u64(1) << (12 * rows)) - 1);
+		for (u32 r = 0; r < rows; ++r) {
+			flipped |= ((bits >> (12 * r)) & 0xfff) << (12 * (rows - 1 - r));
+		}
+		memcpy(block + 2, &flipped, 6);
+	};
+
+	// 16 bits of 4-bit alphas per texel row
+	auto flipExplicitAlpha = [rows](u8* const block) {
+		u16 alphaRows[4];
+		memcpy(alphaRows, block, sizeof(alphaRows));
+		std::reverse(alphaRows, alphaRows + rows);
+		memcpy(block, alphaRows, sizeof(alphaRows));
+	};
+
+	const size_t blockSize = gli::block_size(format);
+	for (u8* block = data; block < data + rowBytes; block += blockSize) {
+		switch (format) {
+		case gli::FORMAT_RGB_DXT1_UNORM_BLOCK8: case gli::FORMAT_RGB_DXT1_SRGB_BLOCK8:
+		case gli::FORMAT_RGBA_DXT1_UNORM_BLOCK8: case gli::FORMAT_RGBA_DXT1_SRGB_BLOCK8:
+			flipColor(block);
+			break;
+		case gli::FORMAT_RGBA_DXT3_UNORM_BLOCK16: case gli::FORMAT_RGBA_DXT3_SRGB_BLOCK16:
+			flipExplicitAlpha(block);
+			flipColor(block + 8);
+			break;
+		case gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16: case gli::FORMAT_RGBA_DXT5_SRGB_BLOCK16:
+			flipAlpha(block);
+			flipColor(block + 8);
+			break;
+		case gli::FORMAT_R_ATI1N_UNORM_BLOCK8: case gli::FORMAT_R_ATI1N_SNORM_BLOCK8:
+			flipAlpha(block);
+			break;
+		case gli::FORMAT_RG_ATI2N_UNORM_BLOCK16: case gli::FORMAT_RG_ATI2N_SNORM_BLOCK16:
+			flipAlpha(block);
+			flipAlpha(block + 8);
+			break;
+		default:
+			assert(false);
+		}
+	}
+}
+
+// BC1-BC5 blocks can be flipped in place, as long as the texel rows don't need to move between blocks,
+// i.e. every level is a whole number of blocks high, or fits in one. Their modes don't depend on the
+// texel order, unlike those of BC6H and BC7.
+static bool canFlipBlocks(const MappedImageLayout& layout, u32 firstLevel)
+{
+	if (layout.format < gli::FORMAT_RGB_DXT1_UNORM_BLOCK8 || layout.format > gli::FORMAT_RG_ATI2N_SNORM_BLOCK16) {
+		return false;
+	}
+
+	for (u32 level = firstLevel; level < layout.levels; ++level) {
+		const u32 height = std::max(1u, layout.height >> level);
+		if (height > 4 && height % 4 != 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Fast path for KTX and DDS: the file is mapped instead of read, and level data is copied straight from
+// the mapping into the upload ring, in bands of block rows. Top-down levels have their rows reversed in
+// the copy, along with the texel rows inside each block for BC1-BC5. Other top-down compressed formats
+// are flagged for shaders to flip, as sampleFlipped does. Levels larger than 'maxSize' (if non-zero)
+// are skipped. Returns false for files this doesn't handle.
+static bool loadTextureMapped(const char* const path, u32 maxSize, TextureHandle *const result)
+{
+	MappedFile file;
+	if (!file.open(path)) {
+		return false;
+	}
+
+	MappedImageLayout layout;
+	if (!parseKtxLayout(file.data(), file.size(), &layout) && !parseDdsLayout(file.data(), file.size(), &layout)) {
+		return false;
+	}
+
+	for (u32 level = 0; level < layout.levels; ++level) {
+		const u32 width = std::max(1u, layout.width >> level);
+		const u32 height = std::max(1u, layout.height >> level);
+		const size_t expectedSize = getLevelRowBytes(layout.format, width, layout.rowAlignment) * getLevelBlockRows(layout.format, height);
+
+		if (layout.levelSizes[level] < expectedSize || layout.levelOffsets[level] + expectedSize > file.size()) {
+			fprintf(stderr, "Truncated texture file: %s\n", path);
+			return false;
+		}
+	}
+
+	gli::gl GL(gli::gl::PROFILE_GL33);
+	gli::gl::format format = GL.translate(layout.format, layout.swizzles);
+
+	// gli turns BGR formats into RGB ones without swizzling them back
+	if (GL_BGR == layout.externalFormat || GL_BGRA == layout.externalFormat) {
+		format.External = static_cast<gli::gl::external_format>(layout.externalFormat);
+	}
+
+	const bool compressed = gli::is_compressed(layout.format);
+	const u32 blockHeight = u32(gli::block_extent(layout.format).y);
+	const u32 firstLevel = getFirstLevelWithin(layout.width, layout.height, layout.levels, maxSize);
+	const bool flipBlocks = layout.topDown && compressed && canFlipBlocks(layout, firstLevel);
+	const bool flipRows = layout.topDown && (!compressed || flipBlocks);
+	const u32 baseWidth = std::max(1u, layout.width >> firstLevel);
+	const u32 baseHeight = std::max(1u, layout.height >> firstLevel);
+
+	GLuint texId = 0;
+	glGenTextures(1, &texId);
+	GlState::bindTexture(GL_TEXTURE_2D, texId);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(layout.levels - firstLevel - 1));
+	glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, &format.Swizzles[0]);
+	glTexStorage2D(GL_TEXTURE_2D, GLsizei(layout.levels - firstLevel), format.Internal, baseWidth, baseHeight);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, layout.rowAlignment);
+
+	// Small levels share a segment; offsets stay aligned for any pixel type
+	UploadRing::Segment segment;
+	size_t segmentUsed = 0;
+	bool inSegment = false;
+	bool succeeded = true;
+
+	for (u32 level = firstLevel; level < layout.levels && succeeded; ++level) {
+		const u32 width = std::max(1u, layout.width >> level);
+		const u32 height = std::max(1u, layout.height >> level);
+		const size_t rowBytes = getLevelRowBytes(layout.format, width, layout.rowAlignment);
+		const u32 blockRows = getLevelBlockRows(layout.format, height);
+		const u8* const levelData = file.data() + layout.levelOffsets[level];
+
+		for (u32 row = 0; row < blockRows; ) {
+			if (!inSegment || segmentUsed + rowBytes > segment.size) {
+				UploadRing::end();
+				if (rowBytes > UploadRing::segmentSize() || !UploadRing::begin(&segment)) {
+					succeeded = false;
+					break;
+				}
+
+				inSegment = true;
+				segmentUsed = 0;
+			}
+
+			const u32 rows = std::min(blockRows - row, u32((segment.size - segmentUsed) / rowBytes));
+			const size_t bandBytes = rows * rowBytes;
+
+			// Top-down rows are reversed on the way into the ring, so that the texture is bottom-up like all others
+			GLint y;
+			if (flipRows) {
+				for (u32 i = 0; i < rows; ++i) {
+					u8* const dst = segment.data + segmentUsed + i * rowBytes;
+					memcpy(dst, levelData + (row + rows - 1 - i) * rowBytes, rowBytes);
+					if (flipBlocks) {
+						flipBlockRow(layout.format, dst, rowBytes, std::min(height, blockHeight));
+					}
+				}
+				y = GLint((blockRows - row - rows) * blockHeight);
+			} else {
+				memcpy(segment.data + segmentUsed, levelData + row * rowBytes, bandBytes);
+				y = GLint(row * blockHeight);
+			}
+
+			const GLsizei bandHeight = GLsizei(std::min(rows * blockHeight, height - y));
+			const void* const pixels = reinterpret_cast<const void*>(segment.offset + segmentUsed);
+
+			if (compressed) {
+				glCompressedTexSubImage2D(GL_TEXTURE_2D, GLint(level - firstLevel), 0, y, width, bandHeight, format.Internal, GLsizei(bandBytes), pixels);
+			} else {
+				glTexSubImage2D(GL_TEXTURE_2D, GLint(level - firstLevel), 0, y, width, bandHeight, format.External, format.Type, pixels);
+			}
+
+			segmentUsed = (segmentUsed + bandBytes + 15) & ~size_t(15);
+			row += rows;
+		}
+	}
+
+	UploadRing::end();
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	if (!succeeded) {
+		GlState::textureDeleted(texId);
+		glDeleteTextures(1, &texId);
+		return false;
+	}
+
+	CreatedTexture tex;
+	tex.key = TextureKey{ baseWidth, baseHeight, (unsigned int)(format.Internal) };
+	tex.texId = texId;
+	tex.levels = layout.levels - firstLevel;
+	tex.flipY = layout.topDown && compressed && !flipBlocks;
+
+	*result = Resources::add(tex);
+	return true;
 }
 
 static FIBITMAP* LoadFIBITMAP(const std::string& path) {
@@ -220,102 +803,549 @@ static FIBITMAP* LoadFIBITMAP(const std::string& path) {
 	return nullptr;
 }
 
-shared_ptr<CreatedTexture> loadTextureFreeimage(const TextureDesc& desc)
+typedef void (*ConvertRowFn)(const u8* src, u8* dst, u32 width);
+
+template <u32 TexelBytes>
+static void copyRow(const u8* src, u8* dst, u32 width)
+{
+	memcpy(dst, src, size_t(width) * TexelBytes);
+}
+
+static void expandGrey8ToBgra8(const u8* src, u8* dst, u32 width)
+{
+	for (u32 x = 0; x < width; ++x, dst += 4) {
+		dst[0] = dst[1] = dst[2] = src[x];
+		dst[3] = 255;
+	}
+}
+
+static void expandBgr8ToBgra8(const u8* src, u8* dst, u32 width)
+{
+	for (u32 x = 0; x < width; ++x, src += 3, dst += 4) {
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[2] = src[2];
+		dst[3] = 255;
+	}
+}
+
+static void expandRgb16ToRgba16(const u8* src, u8* dst, u32 width)
+{
+	const u16* const s = reinterpret_cast<const u16*>(src);
+	u16* const d = reinterpret_cast<u16*>(dst);
+	for (u32 x = 0; x < width; ++x) {
+		d[x * 4 + 0] = s[x * 3 + 0];
+		d[x * 4 + 1] = s[x * 3 + 1];
+		d[x * 4 + 2] = s[x * 3 + 2];
+		d[x * 4 + 3] = 0xffff;
+	}
+}
+
+static void expandRgbfToRgbaf(const u8* src, u8* dst, u32 width)
+{
+	const float* const s = reinterpret_cast<const float*>(src);
+	float* const d = reinterpret_cast<float*>(dst);
+	for (u32 x = 0; x < width; ++x) {
+		d[x * 4 + 0] = s[x * 3 + 0];
+		d[x * 4 + 1] = s[x * 3 + 1];
+		d[x * 4 + 2] = s[x * 3 + 2];
+		d[x * 4 + 3] = 1.0f;
+	}
+}
+
+// Integers are normalized, as 16-bit ones are by the GL
+template <typename T>
+static void normalizeToFloat(const u8* src, u8* dst, u32 width)
+{
+	const T* const s = reinterpret_cast<const T*>(src);
+	float* const d = reinterpret_cast<float*>(dst);
+	const double scale = 1.0 / double(std::numeric_limits<T>::max());
+	for (u32 x = 0; x < width; ++x) {
+		d[x] = float(std::max(-1.0, s[x] * scale));
+	}
+}
+
+// Doubles, and pairs of them for complex images
+template <u32 Components>
+static void narrowToFloat(const u8* src, u8* dst, u32 width)
+{
+	const double* const s = reinterpret_cast<const double*>(src);
+	float* const d = reinterpret_cast<float*>(dst);
+	for (u32 x = 0; x < width * Components; ++x) {
+		d[x] = float(s[x]);
+	}
+}
+
+// How a FreeImage type is uploaded. Texels are widened to 4 channels where needed, as the drivers
+// repack 3-channel data on the CPU, and 16-bit and float types keep their precision.
+struct FreeImageUpload {
+	GLenum internalFormat;
+	GLenum externalFormat;
+	GLenum type;
+	u32 texelBytes;			// as uploaded
+	ConvertRowFn convert;
+	bool grey;				// a single channel, sampled as grey
+};
+
+static bool getFreeImageUpload(FIBITMAP* const dib, FreeImageUpload *const res)
+{
+	switch (FreeImage_GetImageType(dib)) {
+	case FIT_BITMAP:
+		switch (FreeImage_GetBPP(dib)) {
+		case 8: *res = { GL_SRGB8_ALPHA8, GL_BGRA, GL_UNSIGNED_BYTE, 4, &expandGrey8ToBgra8, false }; return true;
+		case 24: *res = { GL_SRGB8_ALPHA8, GL_BGRA, GL_UNSIGNED_BYTE, 4, &expandBgr8ToBgra8, false }; return true;
+		case 32: *res = { GL_SRGB8_ALPHA8, GL_BGRA, GL_UNSIGNED_BYTE, 4, &copyRow<4>, false }; return true;
+		default: return false;
+		}
+
+	case FIT_UINT16: *res = { GL_R16, GL_RED, GL_UNSIGNED_SHORT, 2, &copyRow<2>, true }; return true;
+	case FIT_INT16: *res = { GL_R16_SNORM, GL_RED, GL_SHORT, 2, &copyRow<2>, true }; return true;
+	case FIT_UINT32: *res = { GL_R32F, GL_RED, GL_FLOAT, 4, &normalizeToFloat<u32>, true }; return true;
+	case FIT_INT32: *res = { GL_R32F, GL_RED, GL_FLOAT, 4, &normalizeToFloat<s32>, true }; return true;
+	case FIT_FLOAT: *res = { GL_R32F, GL_RED, GL_FLOAT, 4, &copyRow<4>, true }; return true;
+	case FIT_DOUBLE: *res = { GL_R32F, GL_RED, GL_FLOAT, 4, &narrowToFloat<1>, true }; return true;
+	case FIT_COMPLEX: *res = { GL_RG32F, GL_RG, GL_FLOAT, 8, &narrowToFloat<2>, false }; return true;
+	case FIT_RGB16: *res = { GL_RGBA16, GL_RGBA, GL_UNSIGNED_SHORT, 8, &expandRgb16ToRgba16, false }; return true;
+	case FIT_RGBA16: *res = { GL_RGBA16, GL_RGBA, GL_UNSIGNED_SHORT, 8, &copyRow<8>, false }; return true;
+	case FIT_RGBF: *res = { GL_RGBA32F, GL_RGBA, GL_FLOAT, 16, &expandRgbfToRgbaf, false }; return true;
+	case FIT_RGBAF: *res = { GL_RGBA32F, GL_RGBA, GL_FLOAT, 16, &copyRow<16>, false }; return true;
+	default: return false;
+	}
+}
+
+// Converts rows straight into the upload ring, in bands, and uploads them to level 0 of the bound texture.
+// Without the ring, bands are staged on the heap instead.
+static void uploadConvertedRows(const FreeImageUpload& upload, const u8* const rows, size_t rowPitch, u32 width, u32 height)
+{
+	const size_t dstRowBytes = (size_t(width) * upload.texelBytes + 3) & ~size_t(3);
+	vector<u8> heapStaging;
+
+	for (u32 row = 0; row < height; ) {
+		UploadRing::Segment segment;
+		const bool staged = dstRowBytes <= UploadRing::segmentSize() && UploadRing::begin(&segment);
+		if (!staged) {
+			heapStaging.resize(dstRowBytes * (height - row));
+			segment.data = heapStaging.data();
+			segment.offset = reinterpret_cast<size_t>(heapStaging.data());
+			segment.size = heapStaging.size();
+		}
+
+		const u32 rowCount = std::min(height - row, u32(segment.size / dstRowBytes));
+		for (u32 i = 0; i < rowCount; ++i) {
+			upload.convert(rows + (row + i) * rowPitch, segment.data + i * dstRowBytes, width);
+		}
+
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, GLint(row), width, rowCount, upload.externalFormat, upload.type, reinterpret_cast<const void*>(segment.offset));
+		if (staged) {
+			UploadRing::end();
+		}
+
+		row += rowCount;
+	}
+}
+
+TextureHandle loadTextureFreeimage(const TextureDesc& desc)
 {
 	static bool freeimageInitialized = (FreeImage_Initialise(), true);
 	auto dib = shared_ptr<FIBITMAP>(LoadFIBITMAP(desc.path), FreeImage_Unload);
 
 	if (dib == nullptr) {
 		// error("FreeImage returned a null bitmap");
-		return nullptr;
+		return TextureHandle();
 	}
 
-	if (FreeImage_GetPalette(dib.get())) {
-		// Convert to a bitmap
-		const bool transparent = FreeImage_GetTransparencyCount(dib.get()) > 0;
-		auto convFn = transparent ? &FreeImage_ConvertTo32Bits : &FreeImage_ConvertTo24Bits;
-		dib = shared_ptr<FIBITMAP>(convFn(dib.get()), FreeImage_Unload);
+	// Greyscale bitmaps keep their 8 bits; the rest are expanded, without loss, to 32 bits
+	if (FIT_BITMAP == FreeImage_GetImageType(dib.get())) {
+		const uint bits = FreeImage_GetBPP(dib.get());
+		const bool grey = 8 == bits && FIC_MINISBLACK == FreeImage_GetColorType(dib.get());
+		if (!grey && bits != 24 && bits != 32) {
+			dib = shared_ptr<FIBITMAP>(FreeImage_ConvertTo32Bits(dib.get()), FreeImage_Unload);
+		}
 	}
 
-	const FREE_IMAGE_TYPE itype = FreeImage_GetImageType(dib.get());
+	FreeImageUpload upload;
+	if (dib == nullptr || !getFreeImageUpload(dib.get(), &upload)) {
+		fprintf(stderr, "Unsupported image type: %s\n", desc.path.c_str());
+		return TextureHandle();
+	}
 
-	shared_ptr<CreatedTexture> result = nullptr;
+	const u32 width = FreeImage_GetWidth(dib.get());
+	const u32 height = FreeImage_GetHeight(dib.get());
 
-	u32 width = FreeImage_GetWidth(dib.get());
-	u32 height = FreeImage_GetHeight(dib.get());
+	TextureHandle result = createTexture(
+		desc,
+		TextureKey{ width, height, upload.internalFormat },
+		getMipLevelCount(width, height)
+	);
+
+	GlState::bindTexture(GL_TEXTURE_2D, Resources::get(result).texId);
+	if (upload.grey) {
+		const GLint swizzle[] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+		glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	}
+
+	uploadConvertedRows(upload, FreeImage_GetBits(dib.get()), FreeImage_GetPitch(dib.get()), width, height);
+	finishDecodedTexture(desc, result, upload.externalFormat, upload.type);
+
+	return result;
+}
+
+bool decodeTextureRgba16f(const std::string& path, u32 exrPart, ExrLoader::Image *const res, u32 maxThreads)
+{
+	if (ends_with(to_lower(path), ".exr")) {
+		return ExrLoader::load(path.c_str(), exrPart, 0, res, maxThreads);
+	}
 
-	if (FIT_BITMAP == itype) {
-		uint bits = FreeImage_GetBPP(dib.get());
-		if (bits != 24 && bits != 32) {
-			dib = shared_ptr<FIBITMAP>(FreeImage_ConvertTo24Bits(dib.get()), FreeImage_Unload);
-			bits = 24;
+	TextureRowReader reader;
+	if (!reader.open(path, exrPart)) {
+		return false;
+	}
+
+	res->width = reader.width();
+	res->height = reader.height();
+	res->level = 0;
+	return reader.readRows(0, res->height, &res->texels);
+}
+
+TextureRowReader::TextureRowReader()
+{
+}
+
+TextureRowReader::~TextureRowReader()
+{
+}
+
+bool TextureRowReader::open(const std::string& path, u32 exrPart)
+{
+	if (ends_with(to_lower(path), ".exr")) {
+		m_exr.reset(new ExrLoader::Reader());
+		if (!m_exr->open(path.c_str(), exrPart)) {
+			m_exr.reset();
+			return false;
 		}
 
-		const u32 scanLineBytes = FreeImage_GetPitch(dib.get());
-		result = createTexture(
-			desc,
-			TextureKey{ u32(width), u32(height), uint(24 == bits ? GL_SRGB8 : GL_SRGB8_ALPHA8) }
-		);
+		m_width = m_exr->width();
+		m_height = m_exr->height();
+		return true;
+	}
+
+	static bool freeimageInitialized = (FreeImage_Initialise(), true);
+	m_bitmap = shared_ptr<FIBITMAP>(LoadFIBITMAP(path), FreeImage_Unload);
+	if (!m_bitmap) {
+		return false;
+	}
 
-		glBindTexture(GL_TEXTURE_2D, result->texId);
-		const u8* const imgData = FreeImage_GetBits(dib.get());
-		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, uint(24 == bits ? GL_BGR : GL_BGRA), GL_UNSIGNED_BYTE, (const void*)imgData);
-	} else if (FIT_RGBF == itype) {
-		const u32 scanLineBytes = FreeImage_GetPitch(dib.get());
-		result = createTexture(
-			desc,
-			TextureKey{ u32(width), u32(height), GL_RGB32F }
-		);
+	// Regular bitmaps are sRGB, and would be uploaded as such
+	m_srgb = FIT_BITMAP == FreeImage_GetImageType(m_bitmap.get());
+	m_width = FreeImage_GetWidth(m_bitmap.get());
+	m_height = FreeImage_GetHeight(m_bitmap.get());
+	return true;
+}
 
-		glBindTexture(GL_TEXTURE_2D, result->texId);
-		const u8* const imgData = FreeImage_GetBits(dib.get());
-		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_FLOAT, (const void*)imgData);
-	} else {
-		// TODO
+bool TextureRowReader::readRows(u32 firstRow, u32 rowCount, vector<u16> *const texels)
+{
+	if (m_exr) {
+		return m_exr->readRows(firstRow, rowCount, texels);
 	}
 
-	return result;
+	if (!m_bitmap || 0 == rowCount || firstRow + rowCount > m_height) {
+		return false;
+	}
+
+	// Views are addressed top-down, while scanlines count from the bottom
+	auto band = shared_ptr<FIBITMAP>(FreeImage_CreateView(m_bitmap.get(), 0, m_height - firstRow - rowCount, m_width, m_height - firstRow), FreeImage_Unload);
+	auto rgba = band ? shared_ptr<FIBITMAP>(FreeImage_ConvertToRGBAF(band.get()), FreeImage_Unload) : nullptr;
+	if (!rgba) {
+		return false;
+	}
+
+	texels->resize(size_t(m_width) * rowCount * 4);
+	for (u32 y = 0; y < rowCount; ++y) {
+		const FIRGBAF* const src = reinterpret_cast<const FIRGBAF*>(FreeImage_GetScanLine(rgba.get(), int(y)));
+		u16* const dst = texels->data() + size_t(y) * m_width * 4;
+		for (u32 x = 0; x < m_width; ++x) {
+			const float rgb[3] = { src[x].red, src[x].green, src[x].blue };
+			for (int c = 0; c < 3; ++c) {
+				dst[x * 4 + c] = glm::packHalf1x16(m_srgb ? srgbToLinear(rgb[c]) : rgb[c]);
+			}
+			dst[x * 4 + 3] = glm::packHalf1x16(src[x].alpha);
+		}
+	}
+
+	return true;
+}
+
+struct CompressionTarget {
+	GLenum sourceFormat;
+	BcEncoder::Format encoding;
+	GLenum compressedFormat;
+	GLenum baseFormat;
+	GLenum readFormat;		// the texels BcEncoder takes
+	GLenum readType;
+};
+
+static const CompressionTarget g_compressionTargets[] = {
+	{ GL_SRGB8, BcEncoder::Format::Bc7, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, GL_RGBA, GL_RGBA, GL_UNSIGNED_BYTE },
+	{ GL_SRGB8_ALPHA8, BcEncoder::Format::Bc7, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, GL_RGBA, GL_RGBA, GL_UNSIGNED_BYTE },
+	{ GL_RGB8, BcEncoder::Format::Bc7, GL_COMPRESSED_RGBA_BPTC_UNORM, GL_RGBA, GL_RGBA, GL_UNSIGNED_BYTE },
+	{ GL_RGBA8, BcEncoder::Format::Bc7, GL_COMPRESSED_RGBA_BPTC_UNORM, GL_RGBA, GL_RGBA, GL_UNSIGNED_BYTE },
+	{ GL_RGBA16, BcEncoder::Format::Bc7, GL_COMPRESSED_RGBA_BPTC_UNORM, GL_RGBA, GL_RGBA, GL_UNSIGNED_BYTE },
+	{ GL_R8, BcEncoder::Format::Bc4, GL_COMPRESSED_RED_RGTC1, GL_RED, GL_RED, GL_UNSIGNED_BYTE },
+	{ GL_R16, BcEncoder::Format::Bc4, GL_COMPRESSED_RED_RGTC1, GL_RED, GL_RED, GL_UNSIGNED_BYTE },
+	{ GL_RG8, BcEncoder::Format::Bc5, GL_COMPRESSED_RG_RGTC2, GL_RG, GL_RG, GL_UNSIGNED_BYTE },
+	{ GL_RG16, BcEncoder::Format::Bc5, GL_COMPRESSED_RG_RGTC2, GL_RG, GL_RG, GL_UNSIGNED_BYTE },
+	{ GL_RGB16F, BcEncoder::Format::Bc6h, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, GL_RGB, GL_RGBA, GL_FLOAT },
+	{ GL_RGB32F, BcEncoder::Format::Bc6h, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, GL_RGB, GL_RGBA, GL_FLOAT },
+	{ GL_RGBA16F, BcEncoder::Format::Bc6h, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, GL_RGB, GL_RGBA, GL_FLOAT },
+	{ GL_RGBA32F, BcEncoder::Format::Bc6h, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, GL_RGB, GL_RGBA, GL_FLOAT },
+};
+
+// BC6H has no alpha, and the unsigned variant no negative values
+static bool fitsBc6h(const TextureCache::Image& image)
+{
+	const float* const texels = reinterpret_cast<const float*>(image.levels[0].data());
+	const size_t count = size_t(image.width) * image.height;
+	for (size_t i = 0; i < count; ++i) {
+		const float* const texel = texels + i * 4;
+		if (texel[0] < 0.0f || texel[1] < 0.0f || texel[2] < 0.0f || texel[3] != 1.0f) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Block-compresses a decoded texture and caches the result. Returns an invalid handle
+// if the texture's format has no suitable BC equivalent.
+static TextureHandle compressTexture(const TextureDesc& desc, TextureHandle decoded)
+{
+	const CreatedTexture& source = Resources::get(decoded);
+	const CompressionTarget* target = nullptr;
+	for (const CompressionTarget& it : g_compressionTargets) {
+		if (it.sourceFormat == source.key.format) {
+			target = &it;
+			break;
+		}
+	}
+
+	if (!target) {
+		return TextureHandle();
+	}
+
+	TextureCache::Image image;
+	readTextureLevels(source, target->readFormat, target->readType, &image);
+
+	GLint swizzle[4];
+	glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+
+	if (BcEncoder::Format::Bc6h == target->encoding && !fitsBc6h(image)) {
+		printf("Not compressing %s: BC6H can't store alpha or negative values\n", desc.path.c_str());
+		return TextureHandle();
+	}
+
+	u32 typeBytes;
+	const u32 texelBytes = getTexelBytes(target->readFormat, target->readType, &typeBytes);
+
+	for (u32 level = 0; level < image.levels.size(); ++level) {
+		const u32 width = std::max(1u, image.width >> level);
+		const u32 height = std::max(1u, image.height >> level);
+
+		vector<u8> blocks(BcEncoder::getEncodedSize(target->encoding, width, height));
+		BcEncoder::encodeImage(target->encoding, image.levels[level].data(), width, height, (width * texelBytes + 3) & ~3u, blocks.data());
+		image.levels[level].swap(blocks);
+	}
+
+	image.internalFormat = target->compressedFormat;
+	image.baseFormat = target->baseFormat;
+	image.externalFormat = 0;
+	image.type = 0;
+	image.typeBytes = 1;
+
+	GLuint texId = 0;
+	glGenTextures(1, &texId);
+	GlState::bindTexture(GL_TEXTURE_2D, texId);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(image.levels.size() - 1));
+	glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	glTexStorage2D(GL_TEXTURE_2D, GLsizei(image.levels.size()), image.internalFormat, image.width, image.height);
+
+	for (u32 level = 0; level < image.levels.size(); ++level) {
+		glCompressedTexSubImage2D(
+			GL_TEXTURE_2D, GLint(level), 0, 0, std::max(1u, image.width >> level), std::max(1u, image.height >> level),
+			image.internalFormat, GLsizei(image.levels[level].size()), image.levels[level].data());
+	}
+
+	TextureCache::store(desc.path, getSourcePart(desc), TextureCache::Variant::Compressed, image);
+
+	CreatedTexture tex;
+	tex.key = TextureKey{ image.width, image.height, image.internalFormat };
+	tex.texId = texId;
+	tex.levels = u32(image.levels.size());
+	return Resources::add(tex);
 }
 
-shared_ptr<CreatedTexture> loadTexture(const TextureDesc& desc) {
+// Replaces a texture larger than 'maxSize' by its mip chain from the first level which fits,
+// copied on the GPU. Textures without enough levels are kept as they are.
+static TextureHandle shrinkTexture(TextureHandle handle, u32 maxSize)
+{
+	const CreatedTexture source = Resources::get(handle);
+	const u32 firstLevel = getFirstLevelWithin(source.key.width, source.key.height, source.levels, maxSize);
+	if (0 == firstLevel) {
+		return handle;
+	}
+
+	CreatedTexture tex = source;
+	tex.key.width = std::max(1u, source.key.width >> firstLevel);
+	tex.key.height = std::max(1u, source.key.height >> firstLevel);
+	tex.levels = source.levels - firstLevel;
+
+	GLint swizzle[4];
+	GlState::bindTexture(GL_TEXTURE_2D, source.texId);
+	glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+
+	glGenTextures(1, &tex.texId);
+	GlState::bindTexture(GL_TEXTURE_2D, tex.texId);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(tex.levels - 1));
+	glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	glTexStorage2D(GL_TEXTURE_2D, GLsizei(tex.levels), tex.key.format, tex.key.width, tex.key.height);
+
+	for (u32 level = 0; level < tex.levels; ++level) {
+		glCopyImageSubData(
+			source.texId, GL_TEXTURE_2D, GLint(firstLevel + level), 0, 0, 0,
+			tex.texId, GL_TEXTURE_2D, GLint(level), 0, 0, 0,
+			std::max(1u, tex.key.width >> level), std::max(1u, tex.key.height >> level), 1);
+	}
+
+	Resources::release(handle);
+	return Resources::add(tex);
+}
+
+// PNG/JPEG/EXR etc., from the texture cache if they were decoded before
+static TextureHandle loadDecodedTexture(const TextureDesc& desc, u32 maxSize)
+{
+	TextureHandle result;
+	std::string cachePath;
+
+	if (TextureCache::find(desc.path, getSourcePart(desc), TextureCache::Variant::Decoded, &cachePath) && loadTextureMapped(cachePath.c_str(), maxSize, &result)) {
+		return result;
+	} else if (ends_with(to_lower(desc.path), ".exr")) {
+		return loadTextureExr(desc, maxSize);
+	} else {
+		return loadTextureFreeimage(desc);
+	}
+}
+
+TextureHandle loadTexture(const TextureDesc& desc, u32 maxSize) {
+	// DDS and KTX files are used as they are
+	const bool gpuReadyFile = ends_with(to_lower(desc.path), ".dds") || ends_with(to_lower(desc.path), ".ktx");
+	const bool compress = desc.compress && !gpuReadyFile;
+
+	// Looked up on every compile, so the key's storage is reused
+	static std::string loadedKey;
+	loadedKey = desc.path;
+	if (getSourcePart(desc) > 0) {
+		char partSuffix[16];
+		snprintf(partSuffix, sizeof(partSuffix), "#part%u", desc.exrPart);
+		loadedKey += partSuffix;
+	}
+	const u32 sourceKeyLength = u32(loadedKey.size());
+	if (compress) {
+		loadedKey += "#compressed";
+	}
+	if (maxSize > 0) {
+		char sizeSuffix[16];
+		snprintf(sizeSuffix, sizeof(sizeSuffix), "@%u", maxSize);
+		loadedKey += sizeSuffix;
+	}
+
 	{
-		auto found = g_loadedTextures.find(desc.path);
+		auto found = g_loadedTextures.find(loadedKey);
 		if (found != g_loadedTextures.end()) {
-			return found->second;
+			found->second.used = true;
+			return found->second.tex;
 		}
 	}
 
-	shared_ptr<CreatedTexture> result;
+	GlTrace::Scope traceScope(GlTrace::Subsystem::Upload, desc.path);
+	TextureHandle result;
+	std::string cachePath;
 
-	if (ends_with(to_lower(desc.path), ".exr")) {
-		result = loadTextureExr(desc);
-	} else if (ends_with(to_lower(desc.path), ".dds") || ends_with(to_lower(desc.path), ".ktx")) {
-		result = loadTextureGli(desc);
+	if (gpuReadyFile) {
+		if (!loadTextureMapped(desc.path.c_str(), maxSize, &result)) {
+			result = loadTextureGli(desc);
+		}
+	} else if (compress && TextureCache::find(desc.path, getSourcePart(desc), TextureCache::Variant::Compressed, &cachePath) && loadTextureMapped(cachePath.c_str(), maxSize, &result)) {
+		// Compressed in an earlier session
 	} else {
-		result = loadTextureFreeimage(desc);
+		// Compression caches the whole chain, so it starts from the full resolution
+		result = loadDecodedTexture(desc, compress ? 0 : maxSize);
+
+		if (compress && result.valid()) {
+			const TextureHandle compressed = compressTexture(desc, result);
+			if (compressed.valid()) {
+				Resources::release(result);
+				result = compressed;
+			}
+		}
 	}
 
-	g_loadedTextures[desc.path] = result;
+	if (maxSize > 0 && result.valid()) {
+		result = shrinkTexture(result, maxSize);
+
+		const CreatedTexture& tex = Resources::get(result);
+		if (std::max(tex.key.width, tex.key.height) > maxSize) {
+			fprintf(stderr, "%s has no mip level within the %u texel cap; using %ux%u\n", desc.path.c_str(), maxSize, tex.key.width, tex.key.height);
+		}
+	}
+
+	LoadedTexture& loaded = g_loadedTextures[loadedKey];
+	loaded.tex = result;
+	loaded.sourceKeyLength = sourceKeyLength;
+	loaded.used = true;
+	g_loadedTextureVariantAdded = true;
 	return result;
 }
 
-shared_ptr<CreatedTexture> createTexture(const TextureDesc& desc, const TextureKey& key)
+void releaseReplacedTextureVariants()
+{
+	if (g_loadedTextureVariantAdded) {
+		g_loadedTextureVariantAdded = false;
+
+		std::unordered_set<std::string> usedSources;
+		for (const auto& it : g_loadedTextures) {
+			if (it.second.used) {
+				usedSources.insert(it.first.substr(0, it.second.sourceKeyLength));
+			}
+		}
+
+		for (auto it = g_loadedTextures.begin(); it != g_loadedTextures.end(); ) {
+			if (!it->second.used && usedSources.count(it->first.substr(0, it->second.sourceKeyLength)) > 0) {
+				Resources::release(it->second.tex);
+				it = g_loadedTextures.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	for (auto& it : g_loadedTextures) {
+		it.second.used = false;
+	}
+}
+
+TextureHandle createTexture(const TextureDesc& desc, const TextureKey& key, u32 levels)
 {
+	GlTrace::Scope traceScope(GlTrace::Subsystem::Upload);
+
 	GLuint tex1;
 	glGenTextures(1, &tex1);
-	glBindTexture(GL_TEXTURE_2D, tex1);
-	glTexStorage2D(GL_TEXTURE_2D, 1u, key.format, key.width, key.height);
+	GlState::bindTexture(GL_TEXTURE_2D, tex1);
+	glTexStorage2D(GL_TEXTURE_2D, levels, key.format, key.width, key.height);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	GLuint samplerId;
-	glGenSamplers(1, &samplerId);
-	glSamplerParameteri(samplerId, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glSamplerParameteri(samplerId, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	auto tex = std::make_shared<CreatedTexture>();
-	tex->key = key;
-	tex->texId = tex1;
-	tex->samplerId = samplerId;
-	return tex;
+	CreatedTexture tex;
+	tex.key = key;
+	tex.texId = tex1;
+	tex.levels = levels;
+	return Resources::add(tex);
 }
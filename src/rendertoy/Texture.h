@@ -1,10 +1,13 @@
 #pragma once
 #include "Common.h"
 #include "Math.h"
+#include "ResourceRegistry.h"
 
 #include <string>
 #include <unordered_map>
 
+namespace ExrLoader { struct Image; class Reader; }
+struct FIBITMAP;
 
 struct TextureSize
 {
@@ -35,20 +38,30 @@ struct TextureDesc {
 	TextureDesc()
 		: wrapS(true)
 		, wrapT(true)
+		, compress(false)
 	{}
 
 	enum class Source {
 		Load,
 		Create,
-		Input
+		Input,
+		History,
+		Tiled,		// paged in from disk as needed; see VirtualTexture.h
+		Sequence	// a frame of a numbered image sequence, picked by the playback clock; see ImageSequence.h
 	};
 
 	std::string path;
+	std::string historyOf;	// name of the Created image whose previous frame is read (Source::History)
 	Source source = Source::Input;
 	TextureFormat createFormat = TextureFormat::rgba16f;
 	TextureSize size;
 	bool wrapS : 1;
 	bool wrapT : 1;
+	bool compress : 1;		// block-compress Loaded images which aren't DDS or KTX already
+	u32 exrPart = 0;		// part of a multipart EXR file to Load or read Tiled
+	u32 firstFrame = 0;		// Sequence sources, whose path holds a printf-style frame number, e.g. %04d
+	u32 lastFrame = 0;
+	float frameRate = 24.0f;
 };
 
 struct TextureKey {
@@ -61,17 +74,86 @@ struct TextureKey {
 	}
 };
 
+// Owned by the resource registry, and deleted by Resources::release
 struct CreatedTexture {
 	unsigned int texId = 0;			// GLuint
-	unsigned int samplerId = 0;		// GLuint
-	TextureKey key;
+	u32 levels = 1;
+	TextureKey key = TextureKey { 0, 0, 0 };
+	bool flipY = false;				// stored top-down in a format which can't be flipped on load; shaders see this as [texname]_flipY
+};
 
-	~CreatedTexture();
+struct SamplerDesc {
+	unsigned int minFilter;		// GLenum
+	unsigned int magFilter;		// GLenum
+	unsigned int wrapS;			// GLenum
+	unsigned int wrapT;			// GLenum
+	float maxLod = 1000.0f;
+	float maxAnisotropy = 1.0f;
+
+	bool operator==(const SamplerDesc& other) const {
+		return minFilter == other.minFilter && magFilter == other.magFilter
+			&& wrapS == other.wrapS && wrapT == other.wrapT
+			&& maxLod == other.maxLod && maxAnisotropy == other.maxAnisotropy;
+	}
 };
 
+// The sampler state a param reading 'tex' needs
+SamplerDesc getSamplerDesc(const CreatedTexture& tex, const TextureDesc& desc);
+
+// Sampler objects are shared between all textures with the same state, and live until exit
+unsigned int getSampler(const SamplerDesc& desc);	// GLuint
+
+
+
+struct LoadedTexture {
+	TextureHandle tex;
+	u32 sourceKeyLength = 0;	// of the key up to the variant suffixes
+	bool used = false;			// looked up since the last releaseReplacedTextureVariants
+};
+
+// Loaded textures stay registered until exit, or until another variant of the same source replaces them.
+// Keyed by path, with "#part<N>" appended for later parts of EXR files; variants of the same source add
+// "#compressed" for compressed ones, and "@<maxSize>" for capped ones.
+extern std::unordered_map<std::string, LoadedTexture> g_loadedTextures;
+
+// Returns an invalid handle if the file can't be loaded. Images larger than a non-zero 'maxSize'
+// are scaled down by whole mip levels until they fit; files without enough levels are loaded as they are.
+TextureHandle loadTexture(const TextureDesc& desc, u32 maxSize = 0);
 
+// Once a frame, after rendering. Variants of a source which weren't used this frame are released
+// if another variant of it was, e.g. once the size cap or compression changes.
+void releaseReplacedTextureVariants();
 
-extern std::unordered_map<std::string, shared_ptr<CreatedTexture>> g_loadedTextures;
+TextureHandle createTexture(const TextureDesc& desc, const TextureKey& key, u32 levels = 1);
 
-shared_ptr<CreatedTexture> loadTexture(const TextureDesc& desc);
-shared_ptr<CreatedTexture> createTexture(const TextureDesc& desc, const TextureKey& key);
+// Decodes without touching GL, as linear RGBA16F with rows bottom-up, for sources which split or
+// stream images themselves. Safe to call from worker threads; 'maxThreads' is passed on to ExrLoader::load.
+bool decodeTextureRgba16f(const std::string& path, u32 exrPart, ExrLoader::Image *const res, u32 maxThreads = 0);
+
+// Decodes a source a band of rows at a time, into the texels decodeTextureRgba16f would, for images too large
+// to hold decoded. EXR files are only decoded a band of chunks at a time; other formats stay as FreeImage
+// loaded them, and are converted band by band.
+class TextureRowReader
+{
+public:
+	TextureRowReader();
+	~TextureRowReader();
+
+	TextureRowReader(const TextureRowReader&) = delete;
+	TextureRowReader& operator=(const TextureRowReader&) = delete;
+
+	bool open(const std::string& path, u32 exrPart);
+
+	u32 width() const { return m_width; }
+	u32 height() const { return m_height; }
+
+	// Rows [firstRow, firstRow + rowCount), counted bottom-up; 'texels' is resized to fit
+	bool readRows(u32 firstRow, u32 rowCount, vector<u16> *const texels);
+
+private:
+	std::unique_ptr<ExrLoader::Reader> m_exr;
+	shared_ptr<FIBITMAP> m_bitmap;
+	bool m_srgb = false;
+	u32 m_width = 0;
+	u32 m_height = 0;
+};
@@ -0,0 +1,277 @@
+#include "TextureCache.h"
+#include "FileUtil.h"
+#include "FileWatcher.h"
+#include "Md5.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdlib>
+
+
+namespace TextureCache {
+	const char* const cacheDir = "cache/textures";
+
+	const u8 ktxIdentifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+	struct KtxHeader {
+		u32 endianness;
+		u32 glType;
+		u32 glTypeSize;
+		u32 glFormat;
+		u32 glInternalFormat;
+		u32 glBaseInternalFormat;
+		u32 pixelWidth;
+		u32 pixelHeight;
+		u32 pixelDepth;
+		u32 numberOfArrayElements;
+		u32 numberOfFaces;
+		u32 numberOfMipmapLevels;
+		u32 bytesOfKeyValueData;
+	};
+
+	struct SourceStamp {
+		u64 size = 0;
+		s64 modifiedTime = 0;
+	};
+
+	// Watched source paths, and how many parts have entries
+	std::unordered_map<std::string, u32> g_watchedSources;
+
+	bool getSourceStamp(const std::string& path, SourceStamp *const res) {
+		std::error_code err;
+		res->size = fs::file_size(path, err);
+		if (err) {
+			return false;
+		}
+
+		res->modifiedTime = s64(fs::last_write_time(path, err).time_since_epoch().count());
+		return !err;
+	}
+
+	bool hashFile(const std::string& path, std::string *const res) {
+		MappedFile file;
+		if (!file.open(path.c_str())) {
+			return false;
+		}
+
+		MD5_CTX ctx;
+		MD5Init(&ctx);
+		MD5Update(&ctx, file.data(), file.size());
+		MD5Digest digest;
+		MD5Final(&digest, &ctx);
+
+		char hex[MD5_DIGEST_STRING_LENGTH];
+		for (int i = 0; i < MD5_DIGEST_LENGTH; ++i) {
+			snprintf(hex + i * 2, 3, "%02x", digest.data[i]);
+		}
+
+		*res = hex;
+		return true;
+	}
+
+	// Entries are named after the hash of the source path
+	std::string getEntryPath(const std::string& sourcePath, u32 part, Variant variant) {
+		MD5_CTX ctx;
+		MD5Init(&ctx);
+		MD5Update(&ctx, reinterpret_cast<const u8*>(sourcePath.data()), sourcePath.size());
+		MD5Digest digest;
+		MD5Final(&digest, &ctx);
+
+		std::string res = cacheDir;
+		res += '/';
+		for (int i = 0; i < MD5_DIGEST_LENGTH; ++i) {
+			char hex[3];
+			snprintf(hex, sizeof(hex), "%02x", digest.data[i]);
+			res += hex;
+		}
+
+		if (part > 0) {
+			res += ".p" + std::to_string(part);
+		}
+
+		return res + (Variant::Compressed == variant ? ".bc.ktx" : ".ktx");
+	}
+
+	void watchSource(const std::string& sourcePath, u32 part) {
+		auto inserted = g_watchedSources.emplace(sourcePath, part + 1);
+		if (inserted.second) {
+			FileWatcher::watchFile(sourcePath.c_str(), [sourcePath]()
+			{
+				invalidate(sourcePath);
+			});
+		} else {
+			inserted.first->second = std::max(inserted.first->second, part + 1);
+		}
+	}
+
+	void appendKtxValue(vector<u8>& kvData, const char* const key, const std::string& value) {
+		const size_t keyBytes = strlen(key) + 1;
+		const u32 entryBytes = u32(keyBytes + value.size() + 1);
+
+		const u8* const sizeBytes = reinterpret_cast<const u8*>(&entryBytes);
+		kvData.insert(kvData.end(), sizeBytes, sizeBytes + sizeof(entryBytes));
+		kvData.insert(kvData.end(), key, key + keyBytes);
+		kvData.insert(kvData.end(), value.c_str(), value.c_str() + value.size() + 1);
+		kvData.resize((kvData.size() + 3) & ~size_t(3), u8(0));
+	}
+
+	bool find(const std::string& sourcePath, u32 part, Variant variant, std::string *const entryPath) {
+		SourceStamp stamp;
+		if (!getSourceStamp(sourcePath, &stamp)) {
+			return false;
+		}
+
+		const std::string path = getEntryPath(sourcePath, part, variant);
+		MappedFile file;
+		if (!file.open(path.c_str())) {
+			return false;
+		}
+
+		KtxHeader header;
+		const size_t kvOffset = sizeof(ktxIdentifier) + sizeof(header);
+		if (file.size() < kvOffset || memcmp(file.data(), ktxIdentifier, sizeof(ktxIdentifier)) != 0) {
+			return false;
+		}
+
+		memcpy(&header, file.data() + sizeof(ktxIdentifier), sizeof(header));
+		if (kvOffset + header.bytesOfKeyValueData > file.size()) {
+			return false;
+		}
+
+		const u8* const kvData = file.data() + kvOffset;
+		const char* const source = findKtxValue(kvData, header.bytesOfKeyValueData, "rendertoy.source");
+		const char* const size = findKtxValue(kvData, header.bytesOfKeyValueData, "rendertoy.sourceSize");
+		const char* const time = findKtxValue(kvData, header.bytesOfKeyValueData, "rendertoy.sourceTime");
+		const char* const md5 = findKtxValue(kvData, header.bytesOfKeyValueData, "rendertoy.sourceMd5");
+
+		if (!source || !size || !time || !md5 || sourcePath != source || stamp.size != strtoull(size, nullptr, 10)) {
+			return false;
+		}
+
+		// A touched but otherwise unchanged file still matches by content
+		if (stamp.modifiedTime != strtoll(time, nullptr, 10)) {
+			std::string digest;
+			if (!hashFile(sourcePath, &digest) || digest != md5) {
+				return false;
+			}
+		}
+
+		watchSource(sourcePath, part);
+		*entryPath = path;
+		return true;
+	}
+
+	bool store(const std::string& sourcePath, u32 part, Variant variant, const Image& image) {
+		SourceStamp stamp;
+		std::string digest;
+		if (!getSourceStamp(sourcePath, &stamp) || !hashFile(sourcePath, &digest)) {
+			return false;
+		}
+
+		std::error_code err;
+		fs::create_directories(cacheDir, err);
+		if (err) {
+			return false;
+		}
+
+		vector<u8> kvData;
+		appendKtxValue(kvData, "KTXorientation", "S=r,T=u");
+		if (image.swizzle != "rgba") {
+			appendKtxValue(kvData, "KTXswizzle", image.swizzle);
+		}
+		appendKtxValue(kvData, "rendertoy.source", sourcePath);
+		appendKtxValue(kvData, "rendertoy.sourceSize", std::to_string(stamp.size));
+		appendKtxValue(kvData, "rendertoy.sourceTime", std::to_string(stamp.modifiedTime));
+		appendKtxValue(kvData, "rendertoy.sourceMd5", digest);
+
+		KtxHeader header;
+		header.endianness = 0x04030201;
+		header.glType = image.type;
+		header.glTypeSize = image.typeBytes;
+		header.glFormat = image.externalFormat;
+		header.glInternalFormat = image.internalFormat;
+		header.glBaseInternalFormat = image.baseFormat;
+		header.pixelWidth = image.width;
+		header.pixelHeight = image.height;
+		header.pixelDepth = 0;
+		header.numberOfArrayElements = 0;
+		header.numberOfFaces = 1;
+		header.numberOfMipmapLevels = u32(image.levels.size());
+		header.bytesOfKeyValueData = u32(kvData.size());
+
+		// Written under a temporary name, so that an interrupted write never looks like a valid entry
+		const std::string path = getEntryPath(sourcePath, part, variant);
+		const std::string tempPath = path + ".tmp";
+		FILE* const f = fopen(tempPath.c_str(), "wb");
+		if (!f) {
+			return false;
+		}
+
+		fwrite(ktxIdentifier, sizeof(ktxIdentifier), 1, f);
+		fwrite(&header, sizeof(header), 1, f);
+		fwrite(kvData.data(), kvData.size(), 1, f);
+
+		bool succeeded = true;
+		for (const vector<u8>& level : image.levels) {
+			// Levels are whole rows or blocks, so they need no padding
+			const u32 imageSize = u32(level.size());
+			succeeded = succeeded
+				&& fwrite(&imageSize, sizeof(imageSize), 1, f) == 1
+				&& fwrite(level.data(), imageSize, 1, f) == 1;
+		}
+
+		succeeded = (fclose(f) == 0) && succeeded;
+
+		if (succeeded) {
+			fs::remove(path, err);
+			fs::rename(tempPath, path, err);
+			succeeded = !err;
+		}
+
+		if (!succeeded) {
+			fprintf(stderr, "Could not write texture cache entry for %s\n", sourcePath.c_str());
+			fs::remove(tempPath, err);
+			return false;
+		}
+
+		watchSource(sourcePath, part);
+		return true;
+	}
+
+	void invalidate(const std::string& sourcePath) {
+		auto found = g_watchedSources.find(sourcePath);
+		const u32 partCount = found != g_watchedSources.end() ? found->second : 1;
+
+		std::error_code err;
+		for (u32 part = 0; part < partCount; ++part) {
+			fs::remove(getEntryPath(sourcePath, part, Variant::Decoded), err);
+			fs::remove(getEntryPath(sourcePath, part, Variant::Compressed), err);
+		}
+	}
+}
+
+const char* findKtxValue(const u8* const kvData, const size_t kvSize, const char* const key)
+{
+	const size_t keyBytes = strlen(key) + 1;
+
+	// Each entry is its size, the null-terminated key and the value, padded to 4 bytes
+	for (size_t offset = 0; offset + sizeof(u32) <= kvSize; ) {
+		u32 entryBytes;
+		memcpy(&entryBytes, kvData + offset, sizeof(entryBytes));
+		offset += sizeof(entryBytes);
+
+		if (entryBytes > kvSize - offset) {
+			break;
+		}
+
+		const char* const entry = reinterpret_cast<const char*>(kvData + offset);
+		if (entryBytes > keyBytes && memcmp(entry, key, keyBytes) == 0 && memchr(entry + keyBytes, 0, entryBytes - keyBytes)) {
+			return entry + keyBytes;
+		}
+
+		offset += (entryBytes + 3) & ~size_t(3);
+	}
+
+	return nullptr;
+}
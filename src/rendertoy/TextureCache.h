@@ -0,0 +1,41 @@
+#pragma once
+#include "Common.h"
+#include "Texture.h"
+
+#include <string>
+
+// Disk cache of decoded images, so that PNG/JPEG/EXR sources are only decoded once.
+// Entries are KTX files with the full mip chain, in the GL formats the texture was uploaded with,
+// and are loaded through the same mapped path as other KTX files.
+// An entry is valid while its source keeps the size and modification time, or failing that,
+// the content hash it was written with; it is deleted as soon as FileWatcher sees the source change.
+namespace TextureCache {
+	enum class Variant {
+		Decoded,
+		Compressed,		// block-compressed by BcEncoder
+	};
+
+	// A mip chain with rows bottom-up, as uploaded
+	struct Image {
+		unsigned int internalFormat = 0;	// GLenums
+		unsigned int baseFormat = 0;
+		unsigned int externalFormat = 0;	// 0 for compressed formats
+		unsigned int type = 0;
+		u32 typeBytes = 1;
+		u32 width = 0;
+		u32 height = 0;
+		std::string swizzle = "rgba";		// as in KTXswizzle
+		vector<vector<u8>> levels;			// rows padded to 4 bytes
+	};
+
+	// Returns the path of a valid cache entry for 'sourcePath', if there is one.
+	// 'part' selects the part of multipart EXR files, and is 0 for everything else.
+	bool find(const std::string& sourcePath, u32 part, Variant variant, std::string *const entryPath);
+	bool store(const std::string& sourcePath, u32 part, Variant variant, const Image& image);
+
+	// Drops all variants of all parts
+	void invalidate(const std::string& sourcePath);
+}
+
+// Returns the value stored under 'key' in the key/value data of a KTX file, or nullptr
+const char* findKtxValue(const u8* const kvData, const size_t kvSize, const char* const key);
@@ -0,0 +1,81 @@
+#include "UploadRing.h"
+#include "GlState.h"
+
+#define NOMINMAX
+#include <glad/glad.h>
+#include <cstdio>
+
+namespace UploadRing {
+	enum {
+		SegmentCount = 4,
+		SegmentSize = 16 * 1024 * 1024,
+	};
+
+	GLuint buffer = 0;
+	u8* mapped = nullptr;
+	GLsync fences[SegmentCount] = {};
+	u32 nextSegment = 0;
+	bool inSegment = false;
+
+	static bool init() {
+		if (buffer) {
+			return true;
+		}
+
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		glGenBuffers(1, &buffer);
+		GlState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(SegmentCount) * SegmentSize, nullptr, flags);
+		mapped = static_cast<u8*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(SegmentCount) * SegmentSize, flags));
+		GlState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		if (!mapped) {
+			fprintf(stderr, "Failed to map the texture upload buffer\n");
+			GlState::bufferDeleted(buffer);
+			glDeleteBuffers(1, &buffer);
+			buffer = 0;
+			return false;
+		}
+
+		return true;
+	}
+
+	size_t segmentSize() {
+		return SegmentSize;
+	}
+
+	bool begin(Segment *const segment) {
+		if (!init()) {
+			return false;
+		}
+
+		GLsync& fence = fences[nextSegment];
+		if (fence) {
+			// Loops in case the driver times out; one second per try
+			while (GL_TIMEOUT_EXPIRED == glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull)) {}
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+
+		segment->offset = size_t(nextSegment) * SegmentSize;
+		segment->data = mapped + segment->offset;
+		segment->size = SegmentSize;
+
+		GlState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+		inSegment = true;
+		return true;
+	}
+
+	void end() {
+		if (!inSegment) {
+			return;
+		}
+
+		fences[nextSegment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		nextSegment = (nextSegment + 1) % SegmentCount;
+		inSegment = false;
+
+		GlState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "Common.h"
+
+// Staging memory for streaming texel data to the GPU: a persistently mapped pixel unpack buffer,
+// split into segments which are fenced once their uploads are issued. The CPU only waits when it
+// laps the GPU, and no copy of the data is kept on the heap.
+namespace UploadRing {
+	struct Segment {
+		u8* data = nullptr;		// write-only, coherent
+		size_t offset = 0;		// of 'data' in the unpack buffer; pass as the pixel pointer to glTex*SubImage
+		size_t size = 0;
+	};
+
+	size_t segmentSize();
+
+	// Binds the unpack buffer and returns the next free segment. Calls must be paired with end().
+	bool begin(Segment *const segment);
+
+	// Fences the segment after the uploads which read it, and unbinds the unpack buffer
+	void end();
+}
@@ -0,0 +1,543 @@
+#include "VirtualTexture.h"
+#include "StringUtil.h"
+#include "GlState.h"
+#include "UploadRing.h"
+#include "Md5.h"
+
+#define NOMINMAX
+#include <glad/glad.h>
+#include <glm/gtc/packing.hpp>
+#include <cmath>
+#include <cstdio>
+
+
+namespace {
+	const char* const tileCacheDir = "cache/tiles";
+
+	const u32 tileStride = VirtualTexture::TileSize + 2 * VirtualTexture::TileBorder;
+	const size_t tileBytes = size_t(tileStride) * tileStride * 4 * sizeof(u16);
+
+	struct TileFileHeader {
+		char magic[4];			// "RTVT"
+		u32 version;
+		u32 width;
+		u32 height;
+		u32 tileSize;
+		u32 tileBorder;
+		u32 levelCount;
+		u32 tileCount;			// RGBA16F tiles of tileStride^2 texels follow, level by level, in rows bottom-up
+		u32 padding;
+		u64 sourceSize;
+		s64 sourceTime;
+	};
+
+	const u32 tileFileVersion = 1;
+
+	// Never deleted, like loaded textures; the registry may be gone by the time statics are destroyed
+	std::unordered_map<std::string, VirtualTexture*> g_virtualTextures;
+
+	std::string getTileFilePath(const TextureDesc& desc) {
+		MD5_CTX ctx;
+		MD5Init(&ctx);
+		MD5Update(&ctx, reinterpret_cast<const u8*>(desc.path.data()), desc.path.size());
+		MD5Digest digest;
+		MD5Final(&digest, &ctx);
+
+		std::string res = tileCacheDir;
+		res += '/';
+		for (int i = 0; i < MD5_DIGEST_LENGTH; ++i) {
+			char hex[3];
+			snprintf(hex, sizeof(hex), "%02x", digest.data[i]);
+			res += hex;
+		}
+
+		if (desc.exrPart > 0 && ends_with(to_lower(desc.path), ".exr")) {
+			res += ".p" + std::to_string(desc.exrPart);
+		}
+
+		return res + ".vt";
+	}
+
+	u32 getLevelCount(u32 width, u32 height) {
+		u32 levels = 1;
+		while (std::max(width, height) >> (levels - 1) > VirtualTexture::TileSize) {
+			++levels;
+		}
+		return levels;
+	}
+
+	bool seekFile(FILE* const f, u64 offset) {
+#ifdef _WIN32
+		return 0 == _fseeki64(f, s64(offset), SEEK_SET);
+#else
+		return 0 == fseeko(f, off_t(offset), SEEK_SET);
+#endif
+	}
+
+	// Takes the rows of one level bottom-up, and writes each row of tiles as soon as the rows under it and
+	// its borders are in, keeping no others. Pairs of rows are passed on to the next level downsampled.
+	// Tiles repeat the edge texels of the image in their borders.
+	class LevelWriter {
+	public:
+		LevelWriter(u32 width, u32 height, u64 fileOffset, LevelWriter *const next)
+			: m_width(width)
+			, m_height(height)
+			, m_tilesX((width + VirtualTexture::TileSize - 1) / VirtualTexture::TileSize)
+			, m_tilesY((height + VirtualTexture::TileSize - 1) / VirtualTexture::TileSize)
+			, m_fileOffset(fileOffset)
+			, m_next(next)
+		{
+		}
+
+		void addRow(const u16* const row, FILE* const f, bool *const succeeded) {
+			const size_t rowTexels = size_t(m_width) * 4;
+			m_rows.insert(m_rows.end(), row, row + rowTexels);
+			const u32 y = m_rowCount++;
+
+			if (m_next && (1 == y % 2 || 1 == m_height)) {
+				downsampleRows(&m_rows[(size_t(y & ~1u) - m_firstRow) * rowTexels], &m_rows[(size_t(y) - m_firstRow) * rowTexels]);
+				m_next->addRow(m_downsampled.data(), f, succeeded);
+			}
+
+			while (m_nextTileRow < m_tilesY && m_rowCount >= std::min(m_height, (m_nextTileRow + 1) * VirtualTexture::TileSize + VirtualTexture::TileBorder)) {
+				writeTileRow(m_nextTileRow++, f, succeeded);
+
+				// Rows under the bottom border of the next row of tiles aren't read again
+				const u32 firstKept = std::min(m_rowCount, m_nextTileRow * VirtualTexture::TileSize - VirtualTexture::TileBorder);
+				m_rows.erase(m_rows.begin(), m_rows.begin() + (firstKept - m_firstRow) * rowTexels);
+				m_firstRow = firstKept;
+			}
+		}
+
+		bool finished() const {
+			return m_nextTileRow == m_tilesY;
+		}
+
+	private:
+		// Box filter; odd rows and columns at the end are dropped, as in GL mip levels
+		void downsampleRows(const u16* const lower, const u16* const upper) {
+			const u32 dstWidth = std::max(1u, m_width / 2);
+			m_downsampled.resize(size_t(dstWidth) * 4);
+
+			for (u32 x = 0; x < dstWidth; ++x) {
+				const u32 sx0 = std::min(x * 2, m_width - 1);
+				const u32 sx1 = std::min(x * 2 + 1, m_width - 1);
+				for (u32 c = 0; c < 4; ++c) {
+					const float sum =
+						glm::unpackHalf1x16(lower[sx0 * 4 + c]) + glm::unpackHalf1x16(lower[sx1 * 4 + c]) +
+						glm::unpackHalf1x16(upper[sx0 * 4 + c]) + glm::unpackHalf1x16(upper[sx1 * 4 + c]);
+					m_downsampled[x * 4 + c] = glm::packHalf1x16(sum * 0.25f);
+				}
+			}
+		}
+
+		void writeTileRow(u32 ty, FILE* const f, bool *const succeeded) {
+			m_tiles.resize(m_tilesX * tileBytes / sizeof(u16));
+
+			for (u32 tx = 0; tx < m_tilesX; ++tx) {
+				u16* const tile = &m_tiles[tx * tileBytes / sizeof(u16)];
+				for (u32 y = 0; y < tileStride; ++y) {
+					const int sy = glm::clamp(int(ty * VirtualTexture::TileSize + y) - int(VirtualTexture::TileBorder), 0, int(m_height) - 1);
+					const u16* const src = &m_rows[(size_t(sy) - m_firstRow) * m_width * 4];
+					for (u32 x = 0; x < tileStride; ++x) {
+						const int sx = glm::clamp(int(tx * VirtualTexture::TileSize + x) - int(VirtualTexture::TileBorder), 0, int(m_width) - 1);
+						memcpy(&tile[(y * tileStride + x) * 4], src + size_t(sx) * 4, 4 * sizeof(u16));
+					}
+				}
+			}
+
+			*succeeded = *succeeded
+				&& seekFile(f, m_fileOffset + u64(ty) * m_tilesX * tileBytes)
+				&& fwrite(m_tiles.data(), tileBytes, m_tilesX, f) == m_tilesX;
+		}
+
+		u32 m_width;
+		u32 m_height;
+		u32 m_tilesX;
+		u32 m_tilesY;
+		u64 m_fileOffset;		// of the level's first tile
+		LevelWriter* m_next;
+
+		u32 m_rowCount = 0;		// received so far
+		u32 m_firstRow = 0;		// of those kept in m_rows
+		u32 m_nextTileRow = 0;
+		vector<u16> m_rows;
+		vector<u16> m_tiles;
+		vector<u16> m_downsampled;
+	};
+
+	// The source is read a tile's height of rows at a time, and all levels are written side by side,
+	// so that only a few rows of tiles of each are ever held
+	bool writeTileFile(const TextureDesc& desc, const TileFileHeader& stamp, const std::string& path) {
+		TextureRowReader reader;
+		if (!reader.open(desc.path, desc.exrPart)) {
+			return false;
+		}
+
+		std::error_code err;
+		fs::create_directories(tileCacheDir, err);
+		if (err) {
+			return false;
+		}
+
+		TileFileHeader header = stamp;
+		header.width = reader.width();
+		header.height = reader.height();
+		header.levelCount = getLevelCount(header.width, header.height);
+		header.tileCount = 0;
+
+		vector<std::unique_ptr<LevelWriter>> levels(header.levelCount);
+		vector<u32> levelFirstTile(header.levelCount);
+		for (u32 level = 0; level < header.levelCount; ++level) {
+			const u32 width = std::max(1u, header.width >> level);
+			const u32 height = std::max(1u, header.height >> level);
+			levelFirstTile[level] = header.tileCount;
+			header.tileCount += ((width + VirtualTexture::TileSize - 1) / VirtualTexture::TileSize) * ((height + VirtualTexture::TileSize - 1) / VirtualTexture::TileSize);
+		}
+
+		for (u32 level = header.levelCount; level-- > 0; ) {
+			levels[level].reset(new LevelWriter(
+				std::max(1u, header.width >> level),
+				std::max(1u, header.height >> level),
+				sizeof(header) + u64(levelFirstTile[level]) * tileBytes,
+				level + 1 < header.levelCount ? levels[level + 1].get() : nullptr));
+		}
+
+		// Written under a temporary name, so that an interrupted write never looks like a valid file
+		const std::string tempPath = path + ".tmp";
+		FILE* const f = fopen(tempPath.c_str(), "wb");
+		if (!f) {
+			return false;
+		}
+
+		bool succeeded = fwrite(&header, sizeof(header), 1, f) == 1;
+
+		vector<u16> band;
+		for (u32 row = 0; row < header.height && succeeded; row += VirtualTexture::TileSize) {
+			const u32 rowCount = std::min(u32(VirtualTexture::TileSize), header.height - row);
+			succeeded = reader.readRows(row, rowCount, &band);
+			for (u32 y = 0; y < rowCount && succeeded; ++y) {
+				levels[0]->addRow(band.data() + size_t(y) * header.width * 4, f, &succeeded);
+			}
+		}
+
+		for (const auto& level : levels) {
+			succeeded = succeeded && level->finished();
+		}
+
+		succeeded = (fclose(f) == 0) && succeeded;
+
+		if (succeeded) {
+			fs::remove(path, err);
+			fs::rename(tempPath, path, err);
+			succeeded = !err;
+		}
+
+		if (!succeeded) {
+			fprintf(stderr, "Could not write the tile file for %s\n", desc.path.c_str());
+			fs::remove(tempPath, err);
+		}
+
+		return succeeded;
+	}
+
+	bool isTileFileValid(const MappedFile& file, const TileFileHeader& stamp) {
+		TileFileHeader header;
+		if (file.size() < sizeof(header)) {
+			return false;
+		}
+
+		memcpy(&header, file.data(), sizeof(header));
+		return 0 == memcmp(header.magic, stamp.magic, sizeof(header.magic))
+			&& header.version == stamp.version
+			&& header.tileSize == stamp.tileSize
+			&& header.tileBorder == stamp.tileBorder
+			&& header.sourceSize == stamp.sourceSize
+			&& header.sourceTime == stamp.sourceTime
+			&& header.levelCount == getLevelCount(header.width, header.height)
+			&& file.size() == sizeof(header) + header.tileCount * tileBytes;
+	}
+}
+
+VirtualTexture::~VirtualTexture()
+{
+	if (m_indirection) {
+		GlState::textureDeleted(m_indirection);
+		glDeleteTextures(1, &m_indirection);
+	}
+
+	if (m_pool.valid()) {
+		Resources::release(m_pool);
+	}
+}
+
+bool VirtualTexture::open(const TextureDesc& desc)
+{
+	TileFileHeader stamp = {};
+	memcpy(stamp.magic, "RTVT", sizeof(stamp.magic));
+	stamp.version = tileFileVersion;
+	stamp.tileSize = TileSize;
+	stamp.tileBorder = TileBorder;
+
+	std::error_code err;
+	stamp.sourceSize = fs::file_size(desc.path, err);
+	if (err) {
+		fprintf(stderr, "Could not open %s\n", desc.path.c_str());
+		return false;
+	}
+	stamp.sourceTime = s64(fs::last_write_time(desc.path, err).time_since_epoch().count());
+
+	const std::string path = getTileFilePath(desc);
+	if (!m_file.open(path.c_str()) || !isTileFileValid(m_file, stamp)) {
+		m_file.close();
+		if (!writeTileFile(desc, stamp, path) || !m_file.open(path.c_str()) || !isTileFileValid(m_file, stamp)) {
+			return false;
+		}
+	}
+
+	TileFileHeader header;
+	memcpy(&header, m_file.data(), sizeof(header));
+	m_width = header.width;
+	m_height = header.height;
+	m_levelCount = header.levelCount;
+
+	m_levelFirstTile.resize(m_levelCount);
+	u32 tileCount = 0;
+	for (u32 level = 0; level < m_levelCount; ++level) {
+		m_levelFirstTile[level] = tileCount;
+		tileCount += getTilesX(level) * getTilesY(level);
+	}
+
+	m_pool = createTexture(desc, TextureKey{ PoolTilesPerSide * tileStride, PoolTilesPerSide * tileStride, GL_RGBA16F });
+
+	// Power-of-two sized, so that every level has room for the rounded-up tile counts
+	u32 indirectionWidth = 1;
+	u32 indirectionHeight = 1;
+	while (indirectionWidth < getTilesX(0)) indirectionWidth *= 2;
+	while (indirectionHeight < getTilesY(0)) indirectionHeight *= 2;
+
+	glGenTextures(1, &m_indirection);
+	GlState::bindTexture(GL_TEXTURE_2D, m_indirection);
+	glTexStorage2D(GL_TEXTURE_2D, m_levelCount, GL_RGBA8UI, indirectionWidth, indirectionHeight);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(m_levelCount - 1));
+
+	// The coarsest level is a single tile, and stands in for everything else until it's paged in.
+	// With all slots unused, it goes to slot 0, which is never evicted afterwards.
+	m_slots.assign(PoolTilesPerSide * PoolTilesPerSide, Slot());
+	m_residentTiles.clear();
+	m_staleRanges.assign(m_levelCount, TileRange{ ~0u, ~0u, 0, 0 });
+	m_poolUnit = 0;
+	m_indirectionUnit = 0;
+
+	const u32 rootLevel = m_levelCount - 1;
+	m_missingTiles.assign(1, getTileIndex(rootLevel, 0, 0));
+	pageIn(m_missingTiles);
+
+	for (u32 level = 0; level < m_levelCount; ++level) {
+		updateIndirection(level, TileRange{ 0, 0, getTilesX(level) - 1, getTilesY(level) - 1 });
+	}
+
+	return true;
+}
+
+u32 VirtualTexture::getLevelForDispatch(ivec2 dispatchSize) const
+{
+	u32 level = 0;
+	while (level + 1 < m_levelCount
+		&& int(getLevelWidth(level + 1)) >= dispatchSize.x
+		&& int(getLevelHeight(level + 1)) >= dispatchSize.y)
+	{
+		++level;
+	}
+
+	return level;
+}
+
+void VirtualTexture::bind(u32 poolUnit, u32 indirectionUnit, unsigned int poolSampler)
+{
+	m_poolUnit = poolUnit;
+	m_indirectionUnit = indirectionUnit;
+
+	GlState::bindTexture(poolUnit, GL_TEXTURE_2D, Resources::get(m_pool).texId);
+	GlState::bindSampler(poolUnit, poolSampler);
+	GlState::bindTexture(indirectionUnit, GL_TEXTURE_2D, m_indirection);
+	GlState::bindSampler(indirectionUnit, 0);
+}
+
+VirtualTexture::TileRange VirtualTexture::getTileRange(u32 level, vec2 uvMin, vec2 uvMax) const
+{
+	const vec2 levelSize = vec2(getLevelWidth(level), getLevelHeight(level));
+	const ivec2 lastTile = ivec2(getTilesX(level), getTilesY(level)) - 1;
+
+	// With a tile of margin for filter kernels which reach past the dispatch
+	const ivec2 first = glm::clamp(ivec2(glm::floor(glm::clamp(uvMin, 0.0f, 1.0f) * levelSize)) / int(TileSize) - 1, ivec2(0), lastTile);
+	const ivec2 last = glm::clamp(ivec2(glm::ceil(glm::clamp(uvMax, 0.0f, 1.0f) * levelSize)) / int(TileSize) + 1, ivec2(0), lastTile);
+	return TileRange{ u32(first.x), u32(first.y), u32(last.x), u32(last.y) };
+}
+
+void VirtualTexture::makeResident(u32 level, vec2 uvMin, vec2 uvMax)
+{
+	level = std::min(level, m_levelCount - 1);
+	const TileRange range = getTileRange(level, uvMin, uvMax);
+
+	// Slot 0 is taken by the coarsest tile
+	u32 pageLevel = level;
+	TileRange pageRange = range;
+	while (pageRange.count() > m_slots.size() - 1 && pageLevel + 1 < m_levelCount) {
+		pageRange = getTileRange(++pageLevel, uvMin, uvMax);
+	}
+
+	++m_useCounter;
+	m_missingTiles.clear();
+
+	for (u32 y = pageRange.y0; y <= pageRange.y1; ++y) {
+		for (u32 x = pageRange.x0; x <= pageRange.x1; ++x) {
+			const u32 tile = getTileIndex(pageLevel, x, y);
+			auto found = m_residentTiles.find(tile);
+			if (found != m_residentTiles.end()) {
+				Slot& slot = m_slots[found->second];
+				slot.lastUsed = std::max(slot.lastUsed, m_useCounter);
+			} else {
+				m_missingTiles.push_back(tile);
+			}
+		}
+	}
+
+	if (!m_missingTiles.empty()) {
+		pageIn(m_missingTiles);
+	}
+
+	updateIndirection(level, range);
+}
+
+// Entries of the evicted tile, and of the finer ones it stood in for, still point at its slot
+void VirtualTexture::markEvicted(u32 tile)
+{
+	const u32 level = u32(std::upper_bound(m_levelFirstTile.begin(), m_levelFirstTile.end(), tile) - m_levelFirstTile.begin()) - 1;
+	const u32 x = (tile - m_levelFirstTile[level]) % getTilesX(level);
+	const u32 y = (tile - m_levelFirstTile[level]) / getTilesX(level);
+
+	for (u32 finer = 0; finer <= level; ++finer) {
+		const u32 shift = level - finer;
+		TileRange& stale = m_staleRanges[finer];
+		stale.x0 = std::min(stale.x0, x << shift);
+		stale.y0 = std::min(stale.y0, y << shift);
+		stale.x1 = std::max(stale.x1, std::min(((x + 1) << shift) - 1, getTilesX(finer) - 1));
+		stale.y1 = std::max(stale.y1, std::min(((y + 1) << shift) - 1, getTilesY(finer) - 1));
+	}
+}
+
+// Evicts the least recently used tiles to make room, and repoints the entries which referred to them
+void VirtualTexture::pageIn(const vector<u32>& tiles)
+{
+	const CreatedTexture& pool = Resources::get(m_pool);
+	const u8* const tileData = m_file.data() + sizeof(TileFileHeader);
+
+	for (size_t i = 0; i < tiles.size(); ) {
+		UploadRing::Segment segment;
+		const bool staged = UploadRing::begin(&segment);
+		const size_t batchSize = staged ? std::min(tiles.size() - i, segment.size / tileBytes) : 1;
+
+		GlState::bindTexture(m_poolUnit, GL_TEXTURE_2D, pool.texId);
+
+		for (size_t j = 0; j < batchSize; ++j, ++i) {
+			u32 slotIdx = 0;
+			for (u32 s = 1; s < m_slots.size(); ++s) {
+				if (m_slots[s].lastUsed < m_slots[slotIdx].lastUsed) {
+					slotIdx = s;
+				}
+			}
+
+			Slot& slot = m_slots[slotIdx];
+			if (slot.tile != ~0u) {
+				m_residentTiles.erase(slot.tile);
+				markEvicted(slot.tile);
+			}
+
+			slot.tile = tiles[i];
+			slot.lastUsed = (0 == slotIdx) ? ~0ull : m_useCounter;
+			m_residentTiles[tiles[i]] = slotIdx;
+
+			const u8* const src = tileData + size_t(tiles[i]) * tileBytes;
+			const void* pixels = src;
+			if (staged) {
+				memcpy(segment.data + j * tileBytes, src, tileBytes);
+				pixels = reinterpret_cast<const void*>(segment.offset + j * tileBytes);
+			}
+
+			glTexSubImage2D(
+				GL_TEXTURE_2D, 0,
+				GLint(slotIdx % PoolTilesPerSide * tileStride), GLint(slotIdx / PoolTilesPerSide * tileStride),
+				tileStride, tileStride, GL_RGBA, GL_HALF_FLOAT, pixels);
+		}
+
+		if (staged) {
+			UploadRing::end();
+		}
+	}
+
+	for (u32 level = 0; level < m_levelCount; ++level) {
+		TileRange& stale = m_staleRanges[level];
+		if (stale.x0 <= stale.x1) {
+			updateIndirection(level, stale);
+			stale = TileRange{ ~0u, ~0u, 0, 0 };
+		}
+	}
+}
+
+// Entries of tiles which aren't resident point at their closest resident ancestor
+void VirtualTexture::updateIndirection(u32 level, const TileRange& range)
+{
+	const u32 width = range.x1 - range.x0 + 1;
+	const u32 height = range.y1 - range.y0 + 1;
+	m_indirectionEntries.resize(size_t(width) * height * 4);
+
+	for (u32 y = 0; y < height; ++y) {
+		for (u32 x = 0; x < width; ++x) {
+			u32 residentLevel = level;
+			u32 slotIdx = 0;
+			for (; residentLevel < m_levelCount; ++residentLevel) {
+				const u32 shift = residentLevel - level;
+				auto found = m_residentTiles.find(getTileIndex(residentLevel, (range.x0 + x) >> shift, (range.y0 + y) >> shift));
+				if (found != m_residentTiles.end()) {
+					slotIdx = found->second;
+					break;
+				}
+			}
+
+			u8* const entry = &m_indirectionEntries[(size_t(y) * width + x) * 4];
+			entry[0] = u8(slotIdx % PoolTilesPerSide);
+			entry[1] = u8(slotIdx / PoolTilesPerSide);
+			entry[2] = u8(std::min(residentLevel, m_levelCount - 1));
+			entry[3] = 1;
+		}
+	}
+
+	GlState::bindTexture(m_indirectionUnit, GL_TEXTURE_2D, m_indirection);
+	glTexSubImage2D(GL_TEXTURE_2D, GLint(level), range.x0, range.y0, width, height, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, m_indirectionEntries.data());
+}
+
+VirtualTexture* loadVirtualTexture(const TextureDesc& desc)
+{
+	std::string key = desc.path;
+	if (desc.exrPart > 0) {
+		key += "#part" + std::to_string(desc.exrPart);
+	}
+
+	auto found = g_virtualTextures.find(key);
+	if (found != g_virtualTextures.end()) {
+		return found->second;
+	}
+
+	VirtualTexture* vt = new VirtualTexture();
+	if (!vt->open(desc)) {
+		delete vt;
+		vt = nullptr;
+	}
+
+	// Failures are remembered too, so that a broken source isn't decoded every frame
+	g_virtualTextures[key] = vt;
+	return vt;
+}
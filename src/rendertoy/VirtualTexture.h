@@ -0,0 +1,93 @@
+#pragma once
+#include "Common.h"
+#include "Math.h"
+#include "Texture.h"
+#include "FileUtil.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+// An image which needn't fit in GPU memory: kept on disk as mip levels of fixed-size tiles
+// (cache/tiles/*.vt), and paged into a fixed-size pool texture. Passes make the tiles under each
+// dispatch resident right before running it, evicting the least recently used ones.
+// Tiles which don't fit are stood in for by coarser ones, found via an indirection texture
+// with an entry per tile. Shaders read these as sampleVirtual in data/tiled.glsl does.
+class VirtualTexture
+{
+public:
+	enum {
+		TileSize = 128,				// texels of a tile, excluding the border
+		TileBorder = 4,				// texels copied from neighbouring tiles, so that filtering stays within the tile
+		PoolTilesPerSide = 24,
+	};
+
+	VirtualTexture() {}
+	~VirtualTexture();
+
+	VirtualTexture(const VirtualTexture&) = delete;
+	VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+	// Builds the tile file first if the source changed since it was written
+	bool open(const TextureDesc& desc);
+
+	u32 width() const { return m_width; }
+	u32 height() const { return m_height; }
+	u32 levelCount() const { return m_levelCount; }
+	TextureHandle pool() const { return m_pool; }
+
+	// The coarsest level with at least a texel per invocation of a dispatch over the whole image
+	u32 getLevelForDispatch(ivec2 dispatchSize) const;
+
+	// Binds the pool and indirection textures. Later page-ins upload through the same units.
+	void bind(u32 poolUnit, u32 indirectionUnit, unsigned int poolSampler);
+
+	// Pages in the tiles of 'level' under the uv rectangle, and points their indirection entries at them.
+	// If they don't all fit in the pool, a coarser level is paged in instead.
+	void makeResident(u32 level, vec2 uvMin, vec2 uvMax);
+
+private:
+	struct Slot {
+		u32 tile = ~0u;
+		u64 lastUsed = 0;
+	};
+
+	struct TileRange {
+		u32 x0, y0, x1, y1;		// inclusive
+
+		u32 count() const { return (x1 - x0 + 1) * (y1 - y0 + 1); }
+	};
+
+	u32 getLevelWidth(u32 level) const { return std::max(1u, m_width >> level); }
+	u32 getLevelHeight(u32 level) const { return std::max(1u, m_height >> level); }
+	u32 getTilesX(u32 level) const { return (getLevelWidth(level) + TileSize - 1) / TileSize; }
+	u32 getTilesY(u32 level) const { return (getLevelHeight(level) + TileSize - 1) / TileSize; }
+	u32 getTileIndex(u32 level, u32 x, u32 y) const { return m_levelFirstTile[level] + y * getTilesX(level) + x; }
+	TileRange getTileRange(u32 level, vec2 uvMin, vec2 uvMax) const;
+
+	void pageIn(const vector<u32>& tiles);
+	void markEvicted(u32 tile);
+	void updateIndirection(u32 level, const TileRange& range);
+
+	MappedFile m_file;
+	u32 m_width = 0;
+	u32 m_height = 0;
+	u32 m_levelCount = 0;
+	vector<u32> m_levelFirstTile;
+
+	TextureHandle m_pool;
+	unsigned int m_indirection = 0;		// GLuint; RGBA8UI: pool slot xy, the level resident there, and 1
+	u32 m_poolUnit = 0;
+	u32 m_indirectionUnit = 0;
+
+	vector<Slot> m_slots;							// slot 0 holds the coarsest tile for good
+	std::unordered_map<u32, u32> m_residentTiles;	// tile index to slot
+	u64 m_useCounter = 0;
+	vector<TileRange> m_staleRanges;				// per level, of entries pointing at evicted tiles; empty if x0 > x1
+
+	// Reused between calls
+	vector<u32> m_missingTiles;
+	vector<u8> m_indirectionEntries;
+};
+
+// Tiled sources stay open until exit, keyed by path and EXR part. Returns nullptr if the source can't be read.
+VirtualTexture* loadVirtualTexture(const TextureDesc& desc);
@@ -0,0 +1,426 @@
+// CPU microbenchmarks for the hot paths which don't touch the GPU:
+// annotation parsing, project (de)serialization, node graph edits, texture size resolution and MD5.
+//
+// All inputs are synthetic and no GL context is created, so this runs anywhere:
+//
+//   rendertoy_bench.exe            runs everything
+//   rendertoy_bench.exe graph      runs benchmarks whose name contains "graph"
+
+#include "../rendertoy/Package.h"
+#include "../rendertoy/Md5.h"
+
+#include <rapidjson/document.h>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
+
+static const u32 g_passCount = 1000;
+static const u32 g_extraParamsPerPass = 10;
+static const u32 g_graphNodeCount = 4000;
+static const u32 g_annotatedUniformCount = 4000;
+
+// Results are accumulated here so that the optimizer can't drop the work being measured
+static volatile u64 g_sink = 0;
+
+struct BenchResult
+{
+	double minMs = 0.0;
+	double avgMs = 0.0;
+	u32 iterations = 0;
+};
+
+static const char* g_filter = nullptr;
+
+// Runs 'fn' until at least 'minTotalMs' have passed (and at least 3 times), after one warmup call.
+// 'bytesPerIteration' adds a throughput column.
+static void bench(const char* const name, std::function<void()> fn, double minTotalMs = 500.0, size_t bytesPerIteration = 0)
+{
+	if (g_filter && !strstr(name, g_filter)) {
+		return;
+	}
+
+	typedef std::chrono::high_resolution_clock clock;
+
+	fn();
+
+	BenchResult res;
+	res.minMs = 1e30;
+	double totalMs = 0.0;
+
+	while (totalMs < minTotalMs || res.iterations < 3) {
+		const auto t0 = clock::now();
+		fn();
+		const auto t1 = clock::now();
+
+		const double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+		res.minMs = std::min(res.minMs, ms);
+		totalMs += ms;
+		++res.iterations;
+	}
+
+	res.avgMs = totalMs / res.iterations;
+
+	if (bytesPerIteration > 0) {
+		const double mbPerSec = (bytesPerIteration / (1024.0 * 1024.0)) / (res.minMs / 1000.0);
+		printf("%-40s min %10.4f ms  avg %10.4f ms  (%u iterations)  %10.1f MB/s\n", name, res.minMs, res.avgMs, res.iterations, mbPerSec);
+	} else {
+		printf("%-40s min %10.4f ms  avg %10.4f ms  (%u iterations)\n", name, res.minMs, res.avgMs, res.iterations);
+	}
+}
+
+static std::vector<char> makeAnnotatedShaderSource(u32 uniformCount)
+{
+	std::string src = "#version 430\n";
+
+	char line[256];
+	for (u32 i = 0; i < uniformCount; ++i) {
+		switch (i % 4) {
+		case 0: sprintf(line, "uniform float param%u;\t//@ min(0) max(%u) color\n", i, i + 1); break;
+		case 1: sprintf(line, "uniform sampler2D tex%u;\t//@ input\n", i); break;
+		case 2: sprintf(line, "uniform restrict writeonly image2D img%u;\t//@ relativeTo(tex%u) scale((1 + 2) * 0.5)\n", i, i - 1); break;
+		default: sprintf(line, "uniform ivec2 dir%u;\n", i); break;
+		}
+		src += line;
+	}
+
+	src += "layout (local_size_x = 8, local_size_y = 8) in;\nvoid main() {}\n";
+	return std::vector<char>(src.begin(), src.end());
+}
+
+static void writeParam(JsonWriter& writer, const ShaderParamRefl& refl, const ShaderParamValue& value, u32 uid)
+{
+	writer.StartObject();
+	writer.String("refl");
+	writer.StartObject();
+	serializeShaderParamRefl(refl, writer);
+	writer.EndObject();
+	writer.String("value");
+	serializeShaderParamValue(value, refl, writer);
+	writer.String("uid");
+	writer.Uint(uid);
+	writer.EndObject();
+}
+
+// A chain of compute passes, each with an input texture, a created output texture
+// sized relative to the input, and a bunch of scalar params
+static std::string makeSyntheticProject(u32 passCount, u32 extraParamsPerPass)
+{
+	rapidjson::StringBuffer sb;
+	JsonWriter writer(sb);
+
+	u32 nextUid = 1;
+	const u32 paramsPerPass = 2 + extraParamsPerPass;
+
+	writer.StartObject();
+	writer.String("passes");
+	writer.StartArray();
+
+	for (u32 passIdx = 0; passIdx < passCount; ++passIdx) {
+		writer.StartObject();
+		writer.String("idx");
+		writer.Uint(passIdx);
+		writer.String("type");
+		writer.String("Compute");
+		writer.String("shader");
+		writer.String("synthetic.glsl");
+
+		writer.String("params");
+		writer.StartArray();
+		{
+			ShaderParamRefl refl;
+			ShaderParamValue value;
+
+			refl.name = "outputTex";
+			refl.type = ShaderParamType::Image2d;
+			value.textureValue.source = TextureDesc::Source::Create;
+			value.textureValue.size.scaleRelativeTo = passIdx > 0 ? "inputTex" : "#window";
+			writeParam(writer, refl, value, nextUid++);
+
+			refl.name = "inputTex";
+			refl.type = ShaderParamType::Sampler2d;
+			value = ShaderParamValue();
+			if (passIdx > 0) {
+				value.textureValue.source = TextureDesc::Source::Input;
+			} else {
+				value.textureValue.source = TextureDesc::Source::Load;
+				value.textureValue.path = "synthetic.exr";
+			}
+			writeParam(writer, refl, value, nextUid++);
+
+			for (u32 i = 0; i < extraParamsPerPass; ++i) {
+				char name[32];
+				sprintf(name, "param%u", i);
+				refl.name = name;
+				refl.type = i % 2 ? ShaderParamType::Float3 : ShaderParamType::Int;
+				value = ShaderParamValue();
+				writeParam(writer, refl, value, nextUid++);
+			}
+		}
+		writer.EndArray();
+
+		writer.String("dispatch");
+		writer.StartObject();
+		TextureSize dispatchSize;
+		dispatchSize.scaleRelativeTo = "outputTex";
+		writeTextureSize(dispatchSize, writer);
+		writer.EndObject();
+
+		writer.EndObject();
+	}
+	writer.EndArray();
+
+	// Port indices match the uids, minus one; passes link their output to the next pass' input
+	writer.String("graph");
+	writer.StartObject();
+	writer.String("nodes");
+	writer.StartArray();
+	for (u32 passIdx = 0; passIdx < passCount; ++passIdx) {
+		const u32 outputUid = 1 + passIdx * paramsPerPass;
+		const u32 inputUid = outputUid + 1;
+
+		writer.StartObject();
+		writer.String("idx");
+		writer.Uint(passIdx);
+
+		writer.String("inputs");
+		writer.StartArray();
+		if (passIdx > 0) {
+			writer.StartObject();
+			writer.String("idx");
+			writer.Uint(inputUid - 1);
+			writer.String("uid");
+			writer.Uint(inputUid);
+			writer.String("src");
+			writer.Uint(outputUid - paramsPerPass - 1);
+			writer.EndObject();
+		}
+		writer.EndArray();
+
+		writer.String("outputs");
+		writer.StartArray();
+		writer.StartObject();
+		writer.String("idx");
+		writer.Uint(outputUid - 1);
+		writer.String("uid");
+		writer.Uint(outputUid);
+		writer.EndObject();
+		writer.EndArray();
+
+		writer.EndObject();
+	}
+	writer.EndArray();
+	writer.EndObject();
+
+	writer.EndObject();
+	return std::string(sb.GetString(), sb.GetLength());
+}
+
+static void loadSyntheticProject(Package *const package, const std::string& json)
+{
+	rapidjson::Document doc;
+	doc.Parse(json.c_str());
+	if (doc.HasParseError()) {
+		printf("Synthetic project failed to parse\n");
+		exit(1);
+	}
+
+	DeserializationContext ctx;
+	ctx.compileShaders = false;
+	package->reset();
+	package->deserialize(doc, ctx);
+}
+
+static void benchAnnotations()
+{
+	const std::vector<char> source = makeAnnotatedShaderSource(g_annotatedUniformCount);
+	bench("parseAnnotations (4000 uniforms)", [&]() {
+		g_sink += ComputeShader::parseAnnotations(source).size();
+	});
+
+	const char annot[] = "min(0) max(10 * (2 + 3)) color relativeTo(inputTex) input";
+	bench("parseAnnotation x10000", [&]() {
+		for (int i = 0; i < 10000; ++i) {
+			ParamAnnotation res;
+			parseAnnotation(annot, annot + sizeof(annot) - 1, &res);
+			g_sink += res.items.size();
+		}
+	});
+}
+
+static void benchSerialization()
+{
+	const std::string json = makeSyntheticProject(g_passCount, g_extraParamsPerPass);
+
+	bench("json parse (1000 passes)", [&]() {
+		rapidjson::Document doc;
+		doc.Parse(json.c_str());
+		g_sink += doc["passes"].Size();
+	});
+
+	Package package;
+	bench("Package::deserialize (1000 passes)", [&]() {
+		loadSyntheticProject(&package, json);
+		g_sink += package.m_passes.size();
+	});
+
+	bench("Package::serialize (1000 passes)", [&]() {
+		rapidjson::StringBuffer sb;
+		JsonWriter writer(sb);
+		writer.StartObject();
+		package.serialize(writer);
+		writer.EndObject();
+		g_sink += sb.GetLength();
+	});
+
+	bench("Package::updateGraph (1000 passes)", [&]() {
+		package.updateGraph();
+		g_sink += package.graph.ports.size();
+	});
+
+	package.reset();
+}
+
+static void benchNodeGraph()
+{
+	nodegraph::NodeDesc desc;
+	for (u32 i = 0; i < 4; ++i) {
+		desc.inputs.push_back(1 + i);
+		desc.outputs.push_back(100 + i);
+	}
+
+	auto buildGraph = [&](nodegraph::Graph& graph, vector<nodegraph::node_handle>& nodes) {
+		nodes.clear();
+		for (u32 i = 0; i < g_graphNodeCount; ++i) {
+			nodes.push_back(graph.addNode(desc));
+		}
+	};
+
+	bench("graph addNode (4000 nodes)", [&]() {
+		nodegraph::Graph graph;
+		vector<nodegraph::node_handle> nodes;
+		buildGraph(graph, nodes);
+		g_sink += graph.nodes.size();
+	});
+
+	bench("graph addLink (4000 nodes)", [&]() {
+		nodegraph::Graph graph;
+		vector<nodegraph::node_handle> nodes;
+		buildGraph(graph, nodes);
+
+		for (u32 i = 1; i < g_graphNodeCount; ++i) {
+			const nodegraph::Node& src = graph.nodes[nodes[i - 1].idx];
+			const nodegraph::Node& dst = graph.nodes[nodes[i].idx];
+			graph.addLink(src.firstOutputPort, dst.firstInputPort);
+		}
+		g_sink += graph.links.size();
+	});
+
+	bench("graph updateNode (4000 nodes)", [&]() {
+		nodegraph::Graph graph;
+		vector<nodegraph::node_handle> nodes;
+		buildGraph(graph, nodes);
+
+		// Drop a port and add a new one on every node, as happens when a shader is edited
+		nodegraph::NodeDesc newDesc = desc;
+		newDesc.inputs.erase(newDesc.inputs.begin());
+		newDesc.inputs.push_back(50);
+		for (nodegraph::node_handle h : nodes) {
+			graph.updateNode(h, newDesc);
+		}
+		g_sink += graph.ports.size();
+	});
+
+	bench("graph removeNode (4000 nodes)", [&]() {
+		nodegraph::Graph graph;
+		vector<nodegraph::node_handle> nodes;
+		buildGraph(graph, nodes);
+
+		for (nodegraph::node_handle h : nodes) {
+			graph.removeNode(h);
+		}
+		g_sink += graph.deadNodes.size();
+	});
+}
+
+static void benchTextureSize()
+{
+	// The size is resolved by scanning the pass' params for the one it's relative to,
+	// so use a pass with lots of them
+	Package package;
+	loadSyntheticProject(&package, makeSyntheticProject(2, 2000));
+	RenderPass& pass = *package.m_passes[1];
+
+	u32 paramCount = 0;
+	for (const auto& param : pass.params()) {
+		(void)param;
+		++paramCount;
+	}
+
+	CompiledPass compiled;
+	compiled.compiledImages.resize(paramCount);
+	for (CompiledImage& img : compiled.compiledImages) {
+		// No GL object behind it; compileTextureSize only reads the key
+		CreatedTexture tex;
+		tex.key.width = 1920;
+		tex.key.height = 1080;
+		img.tex = Resources::add(tex);
+	}
+
+	PassCompilerSettings settings;
+	settings.windowSize = ivec2(1920, 1080);
+
+	TextureSize size;
+	size.scaleRelativeTo = "inputTex";
+	size.relativeScale = vec2(0.5f, 0.5f);
+
+	bench("compileTextureSize x1000 (2002 params)", [&]() {
+		for (int i = 0; i < 1000; ++i) {
+			ivec2 res;
+			compileTextureSize(settings, pass, compiled, size, false, &res);
+			g_sink += res.x;
+		}
+	});
+
+	package.reset();
+}
+
+static void benchMd5()
+{
+	const size_t sizes[] = { 4 * 1024, 1024 * 1024 };
+	const char* const names[] = { "MD5 4 KB x256", "MD5 1 MB" };
+	const int repeats[] = { 256, 1 };
+
+	for (int i = 0; i < 2; ++i) {
+		vector<unsigned char> data(sizes[i]);
+		for (size_t j = 0; j < data.size(); ++j) {
+			data[j] = (unsigned char)(j * 31 + (j >> 8));
+		}
+
+		bench(names[i], [&]() {
+			for (int r = 0; r < repeats[i]; ++r) {
+				MD5_CTX ctx;
+				MD5Digest digest;
+				MD5Init(&ctx);
+				MD5Update(&ctx, data.data(), data.size());
+				MD5Final(&digest, &ctx);
+				g_sink += digest.data[0];
+			}
+		}, 500.0, sizes[i] * repeats[i]);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1) {
+		g_filter = argv[1];
+	}
+
+	benchAnnotations();
+	benchSerialization();
+	benchNodeGraph();
+	benchTextureSize();
+	benchMd5();
+
+	return 0;
+}
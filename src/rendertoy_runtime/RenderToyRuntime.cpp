@@ -0,0 +1,265 @@
+#include "RenderToyRuntime.h"
+#include "../rendertoy/Package.h"
+#include "../rendertoy/GlState.h"
+#include "../rendertoy/GlTrace.h"
+#include "../rendertoy/FileWatcher.h"
+#include "../rendertoy/FileUtil.h"
+#include "../rendertoy/Arena.h"
+
+#include <glad/glad.h>
+#include <rapidjson/document.h>
+#include <cstdio>
+
+
+namespace RenderToy {
+	namespace {
+		bool g_watchingFiles = false;
+
+		// The units GlState caches. Passes binding more samplers or images than these leave the rest changed.
+		enum {
+			SavedTextureUnits = 32,
+			SavedImageUnits = 8,
+			SavedBufferBindings = 16,
+		};
+
+		// The caller's state, as far as rendering a frame changes it
+		struct SavedGlState {
+			struct ImageBinding {
+				GLint texture, level, layered, layer, access, format;
+			};
+
+			struct BufferBinding {
+				GLint buffer;
+				GLint64 start, size;
+			};
+
+			GLint program;
+			GLint activeTexture;
+			GLint textures[SavedTextureUnits];
+			GLint samplers[SavedTextureUnits];
+			ImageBinding images[SavedImageUnits];
+			BufferBinding storageBuffers[SavedBufferBindings];
+			GLint storageBuffer;
+			GLint unpackBuffer;
+			GLint unpackAlignment;
+			GLint readFramebuffer;
+			GLint drawFramebuffer;
+			GLboolean scissorTest;
+
+			void save() {
+				glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+				glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+				for (GLuint i = 0; i < SavedTextureUnits; ++i) {
+					glActiveTexture(GL_TEXTURE0 + i);
+					glGetIntegerv(GL_TEXTURE_BINDING_2D, &textures[i]);
+					glGetIntegerv(GL_SAMPLER_BINDING, &samplers[i]);
+				}
+				glActiveTexture(GLenum(activeTexture));
+
+				for (GLuint i = 0; i < SavedImageUnits; ++i) {
+					ImageBinding& img = images[i];
+					glGetIntegeri_v(GL_IMAGE_BINDING_NAME, i, &img.texture);
+					glGetIntegeri_v(GL_IMAGE_BINDING_LEVEL, i, &img.level);
+					glGetIntegeri_v(GL_IMAGE_BINDING_LAYERED, i, &img.layered);
+					glGetIntegeri_v(GL_IMAGE_BINDING_LAYER, i, &img.layer);
+					glGetIntegeri_v(GL_IMAGE_BINDING_ACCESS, i, &img.access);
+					glGetIntegeri_v(GL_IMAGE_BINDING_FORMAT, i, &img.format);
+				}
+
+				for (GLuint i = 0; i < SavedBufferBindings; ++i) {
+					BufferBinding& buf = storageBuffers[i];
+					glGetIntegeri_v(GL_SHADER_STORAGE_BUFFER_BINDING, i, &buf.buffer);
+					glGetInteger64i_v(GL_SHADER_STORAGE_BUFFER_START, i, &buf.start);
+					glGetInteger64i_v(GL_SHADER_STORAGE_BUFFER_SIZE, i, &buf.size);
+				}
+
+				glGetIntegerv(GL_SHADER_STORAGE_BUFFER_BINDING, &storageBuffer);
+				glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &unpackBuffer);
+				glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpackAlignment);
+				glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+				glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+				scissorTest = glIsEnabled(GL_SCISSOR_TEST);
+			}
+
+			void restore() const {
+				glUseProgram(GLuint(program));
+				for (GLuint i = 0; i < SavedTextureUnits; ++i) {
+					glActiveTexture(GL_TEXTURE0 + i);
+					glBindTexture(GL_TEXTURE_2D, GLuint(textures[i]));
+					glBindSampler(i, GLuint(samplers[i]));
+				}
+				glActiveTexture(GLenum(activeTexture));
+
+				for (GLuint i = 0; i < SavedImageUnits; ++i) {
+					const ImageBinding& img = images[i];
+					glBindImageTexture(i, GLuint(img.texture), img.level, GLboolean(img.layered), img.layer, GLenum(img.access), GLenum(img.format));
+				}
+
+				for (GLuint i = 0; i < SavedBufferBindings; ++i) {
+					const BufferBinding& buf = storageBuffers[i];
+					if (buf.buffer != 0 && buf.size > 0) {
+						glBindBufferRange(GL_SHADER_STORAGE_BUFFER, i, GLuint(buf.buffer), GLintptr(buf.start), GLsizeiptr(buf.size));
+					} else {
+						glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, GLuint(buf.buffer));
+					}
+				}
+
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, GLuint(storageBuffer));
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, GLuint(unpackBuffer));
+				glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment);
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, GLuint(readFramebuffer));
+				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(drawFramebuffer));
+				if (scissorTest) {
+					glEnable(GL_SCISSOR_TEST);
+				} else {
+					glDisable(GL_SCISSOR_TEST);
+				}
+
+				// None of it matches what GlState last set any more
+				GlState::invalidate();
+			}
+		};
+	}
+
+	struct Project::Impl {
+		Package package;
+		int dispatchTileSize = 0;
+		int graphTileSize = 0;
+		int maxTextureSize = 0;
+		int outputWidth = 0;
+		int outputHeight = 0;
+
+		// Read and draw framebuffers for copying the output to the target
+		GLuint framebuffers[2] = {};
+	};
+
+	bool init(GetProcAddressFn getProcAddress, bool watchFiles)
+	{
+		const bool loaded = getProcAddress ? 0 != gladLoadGLLoader(getProcAddress) : 0 != gladLoadGL();
+		if (!loaded) {
+			fprintf(stderr, "Could not load the GL entry points\n");
+			return false;
+		}
+
+		GlState::invalidate();
+
+		if (watchFiles && !g_watchingFiles) {
+			FileWatcher::start();
+			g_watchingFiles = true;
+		}
+
+		return true;
+	}
+
+	void shutdown()
+	{
+		if (g_watchingFiles) {
+			FileWatcher::stop();
+			g_watchingFiles = false;
+		}
+	}
+
+	void endFrame()
+	{
+		FileWatcher::update();
+		ShaderDependencies::update();
+		ShaderLibrary::releaseUnused();
+		releaseReplacedTextureVariants();
+
+		// Compiled packages are gone by now
+		FrameArena::reset();
+	}
+
+	Project::Project() : m_impl(new Impl())
+	{
+	}
+
+	Project::~Project()
+	{
+		glDeleteFramebuffers(2, m_impl->framebuffers);
+	}
+
+	std::unique_ptr<Project> Project::load(const char* path)
+	{
+		if (!fs::exists(path)) {
+			fprintf(stderr, "Project file not found: %s\n", path);
+			return nullptr;
+		}
+
+		vector<char> data = loadTextFileZ(path);
+
+		rapidjson::Document doc;
+		doc.Parse(data.data(), data.size());
+		if (doc.HasParseError() || !doc.IsObject()) {
+			fprintf(stderr, "Could not parse project file %s\n", path);
+			return nullptr;
+		}
+
+		std::unique_ptr<Project> project(new Project());
+		Impl& impl = *project->m_impl;
+
+		DeserializationContext ctx;
+		impl.package.reset();
+		impl.package.deserialize(doc, ctx);
+
+		// The editor's node layout under "gui" isn't needed here
+		impl.dispatchTileSize = doc.HasMember("dispatchTileSize") ? doc["dispatchTileSize"].GetInt() : 0;
+		impl.graphTileSize = doc.HasMember("graphTileSize") ? doc["graphTileSize"].GetInt() : 0;
+		impl.maxTextureSize = doc.HasMember("maxTextureSize") ? doc["maxTextureSize"].GetInt() : 0;
+
+		glGenFramebuffers(2, impl.framebuffers);
+		return project;
+	}
+
+	bool Project::renderFrame(const FrameSettings& frameSettings, unsigned int targetTexture)
+	{
+		Impl& impl = *m_impl;
+
+		SavedGlState savedState;
+		savedState.save();
+		GlState::invalidate();
+
+		PassCompilerSettings settings;
+		settings.windowSize = ivec2(frameSettings.width, frameSettings.height);
+		settings.dispatchTileSize = ivec2(impl.dispatchTileSize);
+		settings.graphTileSize = ivec2(impl.graphTileSize);
+		settings.maxTextureSize = u32(impl.maxTextureSize);
+		settings.fullResolutionTextures = frameSettings.fullResolutionTextures;
+		settings.playbackTime = frameSettings.time;
+
+		CompiledPackage compiled;
+		bool compiledOk;
+		{
+			GlTrace::Scope traceScope(GlTrace::Subsystem::Compile);
+			compiledOk = impl.package.compile(settings, &compiled);
+		}
+
+		if (!compiledOk || !compiled.hasOutput()) {
+			compiled.releaseImages();
+			savedState.restore();
+			return false;
+		}
+
+		impl.outputWidth = int(compiled.outputKey.width);
+		impl.outputHeight = int(compiled.outputKey.height);
+
+		// With graph tiles, each tile is stretched straight into its part of the target, so the whole output never exists
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, impl.framebuffers[1]);
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targetTexture, 0);
+		compiled.renderToFramebuffer(ivec4(0, 0, frameSettings.width, frameSettings.height), impl.framebuffers[0]);
+
+		compiled.releaseImages();
+		savedState.restore();
+		return true;
+	}
+
+	int Project::outputWidth() const
+	{
+		return m_impl->outputWidth;
+	}
+
+	int Project::outputHeight() const
+	{
+		return m_impl->outputHeight;
+	}
+}
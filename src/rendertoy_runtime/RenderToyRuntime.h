@@ -0,0 +1,58 @@
+#pragma once
+#include <memory>
+
+// Runs RenderToy projects inside another application: loads an .rtoy file, compiles its graph and renders
+// frames into textures owned by the caller. No window, GUI or file dialogs are involved.
+//
+// The caller creates the GL 4.4 context, and makes all calls with it current. Paths in projects are
+// resolved against the working directory, as they are in the editor, so it should be the RenderToy root.
+namespace RenderToy {
+	typedef void* (*GetProcAddressFn)(const char* name);
+
+	// Loads the GL entry points; without 'getProcAddress', glad looks them up in the system's GL library.
+	// With 'watchFiles', edited shaders and textures are reloaded on the next endFrame.
+	bool init(GetProcAddressFn getProcAddress = nullptr, bool watchFiles = false);
+	void shutdown();
+
+	// Hot reloads, and the release of unused shaders and per-frame memory; once a frame, after all renderFrame calls
+	void endFrame();
+
+	struct FrameSettings {
+		int width = 0;		// of the target texture; passes sized relative to the window use this too
+		int height = 0;
+		double time = 0.0;	// seconds on the playback clock, which picks the frames of Sequence sources
+		bool fullResolutionTextures = false;	// ignores the project's texture size caps
+	};
+
+	class Project
+	{
+	public:
+		// nullptr if the file can't be read or parsed
+		static std::unique_ptr<Project> load(const char* path);
+		~Project();
+
+		Project(const Project&) = delete;
+		Project& operator=(const Project&) = delete;
+
+		// Renders the graph, and stretches its output over the whole of 'targetTexture', a GL texture name.
+		// The target must be color-renderable and not of an integer format.
+		// False if the graph doesn't compile or has no output, in which case the target is left alone.
+		//
+		// The caller's GL state is restored afterwards: the program, active texture unit, GL_TEXTURE_2D and sampler
+		// bindings of units 0-31, image units 0-7, shader storage buffer bindings 0-15 and the generic one,
+		// the pixel unpack buffer, GL_UNPACK_ALIGNMENT, the read and draw framebuffers, and GL_SCISSOR_TEST.
+		// Passes binding more than 32 samplers or 8 images change the units beyond these.
+		// Nothing else is touched; the first frames also create textures, buffers and programs.
+		bool renderFrame(const FrameSettings& settings, unsigned int targetTexture);
+
+		// Resolution of the output image of the last frame rendered
+		int outputWidth() const;
+		int outputHeight() const;
+
+	private:
+		struct Impl;
+
+		Project();
+		std::unique_ptr<Impl> m_impl;
+	};
+}
@@ -0,0 +1,69 @@
+# Writes the large EXR images used by the benchmark projects.
+# They are generated on demand rather than checked in; see genBenchProjects.py for the names.
+
+import math
+import os
+import struct
+
+def writeExr(path, width, height, rowFn):
+	# Minimal scanline EXR writer: half-float RGBA, no compression, one scanline per chunk.
+	# 'rowFn(y)' returns the pixel data of a row as a list of (r, g, b, a) tuples.
+	channels = ['A', 'B', 'G', 'R']	# EXR channel lists are sorted by name
+
+	def attr(name, type, data):
+		return name.encode() + b'\0' + type.encode() + b'\0' + struct.pack('<i', len(data)) + data
+
+	chlist = b''.join(c.encode() + b'\0' + struct.pack('<iB3xii', 1, 0, 1, 1) for c in channels) + b'\0'
+	box = struct.pack('<iiii', 0, 0, width - 1, height - 1)
+
+	header = b'\x76\x2f\x31\x01' + struct.pack('<i', 2)
+	header += attr('channels', 'chlist', chlist)
+	header += attr('compression', 'compression', b'\0')
+	header += attr('dataWindow', 'box2i', box)
+	header += attr('displayWindow', 'box2i', box)
+	header += attr('lineOrder', 'lineOrder', b'\0')
+	header += attr('pixelAspectRatio', 'float', struct.pack('<f', 1.0))
+	header += attr('screenWindowCenter', 'v2f', struct.pack('<ff', 0.0, 0.0))
+	header += attr('screenWindowWidth', 'float', struct.pack('<f', 1.0))
+	header += b'\0'
+
+	rowDataSize = width * 2 * len(channels)
+	chunkSize = 8 + rowDataSize
+	firstChunk = len(header) + 8 * height
+
+	# Rows repeat a lot in the generated images, so cache the encoded ones
+	rowCache = {}
+
+	with open(path, 'wb') as f:
+		f.write(header)
+		f.write(b''.join(struct.pack('<Q', firstChunk + y * chunkSize) for y in range(height)))
+
+		for y in range(height):
+			row = rowFn(y)
+			key = id(row)
+			if key not in rowCache:
+				data = b''
+				for c in (3, 2, 1, 0):	# A, B, G, R
+					data += struct.pack('<%de' % width, *[px[c] for px in row])
+				rowCache[key] = (row, data)
+			f.write(struct.pack('<ii', y, rowDataSize))
+			f.write(rowCache[key][1])
+
+def makeBandedRows(width, height, bandCount):
+	# Horizontal HDR gradients in a few color bands
+	bands = []
+	for band in range(bandCount):
+		hue = band / float(bandCount)
+		tint = [0.5 + 0.5 * math.cos(2.0 * math.pi * (hue + offset)) for offset in (0.0, 0.33, 0.67)]
+		bands.append([(tint[0] * 8.0 * x / width, tint[1] * 8.0 * x / width, tint[2] * 8.0 * x / width, 1.0) for x in range(width)])
+
+	bandHeight = max(1, height // bandCount)
+	return lambda y: bands[min(bandCount - 1, y // bandHeight)]
+
+def ensureExr(path, width, height):
+	if os.path.exists(path):
+		return
+
+	os.makedirs(os.path.dirname(path), exist_ok=True)
+	print('Generating %s (%dx%d)' % (path, width, height))
+	writeExr(path, width, height, makeBandedRows(width, height, 16))
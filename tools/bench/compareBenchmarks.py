@@ -0,0 +1,83 @@
+# Compares two benchmark result files and reports regressions beyond a threshold.
+# Accepts either suite files written by runBenchmarks.py, or single results written by --benchmark.
+#
+#   python tools/bench/compareBenchmarks.py bench/results/master.json bench/results/mybranch.json
+#
+# Exits with 1 if anything got slower than allowed, so it can gate a build.
+
+import argparse
+import json
+import sys
+
+def loadResults(path):
+	with open(path) as f:
+		doc = json.load(f)
+
+	if 'results' in doc:
+		return doc['results']
+
+	# A single project's results
+	name = doc.get('project') or path
+	return { name: doc }
+
+def collectMetrics(result, stats, includePasses):
+	metrics = {}
+	for frameMetric in ('gpuFrameMs', 'cpuFrameMs'):
+		for stat in stats:
+			metrics['%s.%s' % (frameMetric, stat)] = result[frameMetric][stat]
+
+	if includePasses:
+		for p in result.get('passes', []):
+			for stat in stats:
+				metrics['pass %s.%s' % (p['name'], stat)] = p['gpuMs'][stat]
+
+	return metrics
+
+def main():
+	parser = argparse.ArgumentParser(description='Compare two RenderToy benchmark results')
+	parser.add_argument('base')
+	parser.add_argument('new')
+	parser.add_argument('--stats', default='p50,p95', help='comma-separated stats to compare (min, avg, p50, p95, p99)')
+	parser.add_argument('--threshold', type=float, default=5.0, help='allowed slowdown in percent')
+	parser.add_argument('--min-delta', type=float, default=0.05, help='ignore differences below this many milliseconds')
+	parser.add_argument('--passes', action='store_true', help='also compare per-pass GPU times')
+	args = parser.parse_args()
+
+	stats = [s.strip() for s in args.stats.split(',') if s.strip()]
+	base = loadResults(args.base)
+	new = loadResults(args.new)
+
+	regressions = 0
+	print('%-16s %-40s %10s %10s %8s' % ('project', 'metric', 'base', 'new', 'change'))
+
+	for name in sorted(set(base) | set(new)):
+		if name not in base or name not in new:
+			print('%-16s missing from %s' % (name, args.base if name not in base else args.new))
+			continue
+
+		baseMetrics = collectMetrics(base[name], stats, args.passes)
+		newMetrics = collectMetrics(new[name], stats, args.passes)
+
+		for metric in sorted(set(baseMetrics) & set(newMetrics)):
+			b = baseMetrics[metric]
+			n = newMetrics[metric]
+			change = 100.0 * (n - b) / b if b > 0 else 0.0
+
+			flag = ''
+			if n - b > args.min_delta and change > args.threshold:
+				flag = '  REGRESSION'
+				regressions += 1
+			elif b - n > args.min_delta and -change > args.threshold:
+				flag = '  improved'
+
+			print('%-16s %-40s %10.3f %10.3f %+7.1f%%%s' % (name, metric, b, n, change, flag))
+
+	if regressions > 0:
+		print('%d regression(s) beyond %.1f%%' % (regressions, args.threshold))
+		return 1
+
+	print('No regressions beyond %.1f%%' % args.threshold)
+	return 0
+
+if __name__ == '__main__':
+	sys.exit(main())
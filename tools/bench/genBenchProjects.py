@@ -0,0 +1,252 @@
+# Generates the reference benchmark projects into bench/generated.
+# Run from the repository root: python tools/bench/genBenchProjects.py
+#
+# runBenchmarks.py regenerates them on every run, so they always match this script, and aren't
+# checked in. Running this alone is only needed to open a project in the editor. Large EXR inputs
+# are written by runBenchmarks.py too, through benchExr.ensureExr.
+
+import json
+import os
+
+benchDir = 'bench'
+shaderDir = benchDir + '/shaders'
+projectDir = benchDir + '/generated'
+
+# Loaded by the largeExr project, generated by benchExr.ensureExr
+generatedExrs = {
+	benchDir + '/generated/large4k.exr': (4096, 4096),
+}
+
+def relativeSize(relativeTo, scale=(1.0, 1.0)):
+	return { 'useRelativeScale': True, 'scaleRelativeTo': relativeTo, 'relativeScale': list(scale) }
+
+def fixedSize(resolution):
+	return { 'useRelativeScale': False, 'resolution': list(resolution) }
+
+class Param:
+	def __init__(self, name, type, value, port=None, src=None):
+		self.name = name
+		self.type = type
+		self.value = value
+		self.port = port	# None, 'input' or 'output'
+		self.src = src	# (Pass, param name) which an input is linked to
+
+def floatParam(name, value):
+	return Param(name, 'Float', value)
+
+def intParam(name, value):
+	return Param(name, 'Int', value)
+
+def int2Param(name, value):
+	return Param(name, 'Int2', list(value))
+
+def float3Param(name, value):
+	return Param(name, 'Float3', list(value))
+
+def inputTex(name, src, type='Sampler2d'):
+	value = { 'source': 'Input' }
+	if type == 'Sampler2d':
+		value.update({ 'wrapS': False, 'wrapT': False })
+	return Param(name, type, value, 'input', src)
+
+def loadedTex(name, path):
+	return Param(name, 'Sampler2d', { 'source': 'Load', 'path': path, 'wrapS': False, 'wrapT': False })
+
+def createdImage(name, size, format='rgba16f'):
+	value = { 'source': 'Create', 'createFormat': format }
+	value.update(size)
+	return Param(name, 'Image2d', value, 'output')
+
+def inputBuffer(name, src):
+	return Param(name, 'Buffer', { 'source': 'Input' }, 'input', src)
+
+def createdBuffer(name, size):
+	value = { 'source': 'Create' }
+	value.update(size)
+	return Param(name, 'Buffer', value, 'output')
+
+class Pass:
+	def __init__(self, idx):
+		self.idx = idx
+		self.outputPorts = {}
+
+class Project:
+	def __init__(self):
+		self.passes = []
+		self.graphNodes = []
+		self.guiNodes = []
+		self.nextUid = 1
+		self.nextPort = 0
+
+	def addPass(self, shader, params, pos, dispatchRelativeTo='outputTex'):
+		p = Pass(len(self.passes))
+		jsonParams = []
+		inputs = []
+		outputs = []
+
+		for param in params:
+			uid = self.nextUid
+			self.nextUid += 1
+			jsonParams.append({ 'refl': { 'name': param.name, 'type': param.type }, 'value': param.value, 'uid': uid })
+
+			if param.port is None:
+				continue
+
+			port = { 'idx': self.nextPort, 'uid': uid }
+			self.nextPort += 1
+
+			if param.port == 'input':
+				srcPass, srcParam = param.src
+				port['src'] = srcPass.outputPorts[srcParam]
+				inputs.append(port)
+			else:
+				p.outputPorts[param.name] = port['idx']
+				outputs.append(port)
+
+		if shader is None:
+			self.passes.append({ 'idx': p.idx, 'type': 'Output', 'params': jsonParams })
+		else:
+			self.passes.append({
+				'idx': p.idx,
+				'type': 'Compute',
+				'shader': shaderDir + '/' + shader + '.glsl',
+				'params': jsonParams,
+				'dispatch': relativeSize(dispatchRelativeTo),
+			})
+
+		self.graphNodes.append({ 'idx': p.idx, 'inputs': inputs, 'outputs': outputs })
+		self.guiNodes.append({ 'idx': p.idx, 'pos': [float(pos[0]), float(pos[1])] })
+		return p
+
+	def addOutput(self, src, pos):
+		return self.addPass(None, [inputTex('image', (src, 'outputTex'))], pos)
+
+	def write(self, path):
+		doc = {
+			'passes': self.passes,
+			'graph': { 'nodes': self.graphNodes },
+			'gui': { 'nodes': self.guiNodes },
+			'dispatchTileSize': 0,
+		}
+		with open(path, 'w') as f:
+			json.dump(doc, f, indent=4)
+			f.write('\n')
+
+# Grid layout for the node graph GUI
+def gridPos(col, row=0):
+	return (40 + col * 180, 40 + row * 90)
+
+def addPattern(proj, pos, size=relativeSize('#window')):
+	return proj.addPass('pattern', [createdImage('outputTex', size)], pos)
+
+def addBlur(proj, src, radius, dir, pos, srcParam='outputTex'):
+	return proj.addPass('blur', [
+		createdImage('outputTex', relativeSize('inputTex')),
+		intParam('blurRadius', radius),
+		int2Param('blurDir', dir),
+		inputTex('inputTex', (src, srcParam)),
+	], pos)
+
+def addTint(proj, src, ev, tint, pos, srcParam='outputTex'):
+	return proj.addPass('tint', [
+		createdImage('outputTex', relativeSize('inputTex')),
+		floatParam('EV', ev),
+		float3Param('tint', tint),
+		inputTex('inputTex', (src, srcParam)),
+	], pos)
+
+def addAdd(proj, src1, src2, pos):
+	return proj.addPass('add', [
+		createdImage('outputTex', relativeSize('inputTex1')),
+		inputTex('inputTex1', (src1, 'outputTex')),
+		inputTex('inputTex2', (src2, 'outputTex')),
+	], pos)
+
+def blurChain():
+	# Long dependency chain of separable blurs at full resolution
+	proj = Project()
+	prev = addPattern(proj, gridPos(0))
+	for i in range(24):
+		prev = addBlur(proj, prev, 8, (1, 0) if i % 2 == 0 else (0, 1), gridPos(1 + i % 8, i // 8))
+	proj.addOutput(prev, gridPos(9))
+	return proj
+
+def fanOut():
+	# One source feeding many independent passes, reduced back with a tree of adds
+	proj = Project()
+	src = addPattern(proj, gridPos(0))
+
+	width = 32
+	level = [addTint(proj, src, -5.0, (1.0, 0.5 + 0.5 * i / width, 1.0 - 0.5 * i / width), gridPos(1, i)) for i in range(width)]
+
+	col = 2
+	while len(level) > 1:
+		level = [addAdd(proj, level[i], level[i + 1], gridPos(col, i)) for i in range(0, len(level), 2)]
+		col += 1
+
+	proj.addOutput(level[0], gridPos(col))
+	return proj
+
+def bufferHeavy():
+	# Round trips through shader storage buffers, with wide neighborhood reads
+	proj = Project()
+	prev = addPattern(proj, gridPos(0))
+	for i in range(8):
+		scatter = proj.addPass('scatter', [
+			inputTex('inputTex', (prev, 'outputTex')),
+			createdBuffer('Samples', relativeSize('inputTex')),
+		], gridPos(1 + 2 * i), dispatchRelativeTo='inputTex')
+
+		prev = proj.addPass('gather', [
+			createdImage('outputTex', relativeSize('#window')),
+			inputBuffer('Samples', (scatter, 'Samples')),
+		], gridPos(2 + 2 * i))
+	proj.addOutput(prev, gridPos(17))
+	return proj
+
+def largeExr():
+	# Bandwidth-bound filtering of a large loaded image, independent of the window size
+	proj = Project()
+	exrPath = benchDir + '/generated/large4k.exr'
+	src = proj.addPass('tint', [
+		createdImage('outputTex', relativeSize('inputTex')),
+		floatParam('EV', 0.0),
+		float3Param('tint', (1.0, 1.0, 1.0)),
+		loadedTex('inputTex', exrPath),
+	], gridPos(0))
+	blurH = addBlur(proj, src, 4, (1, 0), gridPos(1))
+	blurV = addBlur(proj, blurH, 4, (0, 1), gridPos(2))
+	tonemap = addTint(proj, blurV, -1.0, (1.0, 1.0, 1.0), gridPos(3))
+	proj.addOutput(tonemap, gridPos(4))
+	return proj
+
+def manyTinyPasses():
+	# Per-pass overhead: a long chain of passes with almost no GPU work each
+	proj = Project()
+	prev = addPattern(proj, gridPos(0), fixedSize((64, 64)))
+	for i in range(128):
+		prev = addTint(proj, prev, 0.0, (1.0, 1.0, 1.0), gridPos(1 + i % 16, i // 16))
+	proj.addOutput(prev, gridPos(17))
+	return proj
+
+projects = {
+	'blurChain': blurChain,
+	'fanOut': fanOut,
+	'bufferHeavy': bufferHeavy,
+	'largeExr': largeExr,
+	'manyTinyPasses': manyTinyPasses,
+}
+
+# Returns the paths of the projects, in name order
+def writeProjects():
+	os.makedirs(projectDir, exist_ok=True)
+	paths = []
+	for name, build in sorted(projects.items()):
+		path = os.path.join(projectDir, name + '.rtoy')
+		build().write(path)
+		paths.append(path)
+	return paths
+
+if __name__ == '__main__':
+	for path in writeProjects():
+		print('Wrote ' + path)
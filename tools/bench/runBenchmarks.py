@@ -0,0 +1,128 @@
+# Generates the benchmark projects (see genBenchProjects.py), runs them, and gathers the results
+# into a single JSON file.
+# Run from the repository root:
+#
+#   python tools/bench/runBenchmarks.py --label mybranch
+#   python tools/bench/runBenchmarks.py --label mybranch-llvmpipe --llvmpipe path/to/mesa
+#
+# With --llvmpipe, the executable is copied next to Mesa's opengl32.dll, so that the suite
+# can run on machines without a GPU (build agents, VMs).
+
+import argparse
+import fnmatch
+import glob
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import benchExr
+import genBenchProjects
+
+defaultExe = 't2-output/win64-msvc-release-default/rendertoy.exe'
+
+def prepareLlvmpipe(exe, mesaDir):
+	# Windows picks up opengl32.dll from the executable's directory before the system one
+	runDir = tempfile.mkdtemp(prefix='rendertoy_llvmpipe_')
+	for f in glob.glob(os.path.join(os.path.dirname(exe), '*.dll')) + [exe]:
+		shutil.copy(f, runDir)
+	for f in glob.glob(os.path.join(mesaDir, '*.dll')):
+		shutil.copy(f, runDir)
+	return os.path.join(runDir, os.path.basename(exe)), runDir
+
+def llvmpipeEnv(threads):
+	env = dict(os.environ)
+	env['GALLIUM_DRIVER'] = 'llvmpipe'
+	env['LIBGL_ALWAYS_SOFTWARE'] = '1'
+	# RenderToy asks for a 4.4 compatibility context, which older Mesa builds don't advertise
+	env['MESA_GL_VERSION_OVERRIDE'] = '4.5COMPAT'
+	env['MESA_GLSL_VERSION_OVERRIDE'] = '450'
+	if threads:
+		env['LP_NUM_THREADS'] = str(threads)
+	return env
+
+def main():
+	parser = argparse.ArgumentParser(description='Run the RenderToy benchmark suite')
+	parser.add_argument('--exe', default=defaultExe)
+	parser.add_argument('--label', default='results', help='name of the result set')
+	parser.add_argument('--out', default='bench/results', help='directory for the result files')
+	parser.add_argument('--filter', default='*', help='only run projects matching this pattern')
+	parser.add_argument('--warmup', type=int, default=60)
+	parser.add_argument('--frames', type=int, default=300)
+	parser.add_argument('--resolution', default='1920x1080')
+	parser.add_argument('--timeout', type=int, default=600, help='seconds per project')
+	parser.add_argument('--llvmpipe', metavar='MESA_DIR', help='run on llvmpipe, using the Mesa DLLs in this directory')
+	parser.add_argument('--llvmpipe-threads', type=int, default=0)
+	args = parser.parse_args()
+
+	if not os.path.exists(args.exe):
+		print('Executable not found: ' + args.exe)
+		return 1
+
+	for path, size in genBenchProjects.generatedExrs.items():
+		benchExr.ensureExr(path, size[0], size[1])
+
+	exe = os.path.abspath(args.exe)
+	env = None
+	runDir = None
+	if args.llvmpipe:
+		exe, runDir = prepareLlvmpipe(exe, args.llvmpipe)
+		env = llvmpipeEnv(args.llvmpipe_threads)
+
+	resultDir = os.path.join(args.out, args.label)
+	os.makedirs(resultDir, exist_ok=True)
+
+	projects = genBenchProjects.writeProjects()
+	projects = [p for p in projects if fnmatch.fnmatch(os.path.splitext(os.path.basename(p))[0], args.filter)]
+
+	suite = { 'label': args.label, 'llvmpipe': bool(args.llvmpipe), 'results': {} }
+	failed = []
+
+	for project in projects:
+		name = os.path.splitext(os.path.basename(project))[0]
+		resultPath = os.path.join(resultDir, name + '.json')
+		if os.path.exists(resultPath):
+			os.remove(resultPath)
+
+		cmd = [
+			exe, '--hidden',
+			'--benchmark', project.replace('\\', '/'),
+			'--warmup', str(args.warmup),
+			'--frames', str(args.frames),
+			'--resolution', args.resolution,
+			'--out', resultPath,
+		]
+
+		print('Running ' + name)
+		try:
+			# The working directory must be the repository root, since projects use relative paths
+			ret = subprocess.call(cmd, env=env, timeout=args.timeout)
+		except subprocess.TimeoutExpired:
+			ret = 'timeout'
+
+		if ret != 0 or not os.path.exists(resultPath):
+			print('  failed (%s)' % ret)
+			failed.append(name)
+			continue
+
+		with open(resultPath) as f:
+			suite['results'][name] = json.load(f)
+
+	if runDir:
+		shutil.rmtree(runDir, ignore_errors=True)
+
+	suitePath = os.path.join(args.out, args.label + '.json')
+	with open(suitePath, 'w') as f:
+		json.dump(suite, f, indent=4)
+	print('Wrote ' + suitePath)
+
+	if failed:
+		print('Failed: ' + ', '.join(failed))
+		return 1
+	return 0
+
+if __name__ == '__main__':
+	sys.exit(main())
@@ -1,16 +1,83 @@
 import sublime, sublime_plugin
 import functools
 import html
+import json
 import os.path
 import re
+import socket
 import sys, traceback
+import threading
+import time
+
+# Must match EventServer::DefaultPort
+EVENT_SERVER_PORT = 47321
 
 pluginInstances = []
 
+# Shader logs pushed by RenderToy, by normalized file path. Only valid while connected;
+# otherwise the .errors files written next to the shaders are used.
+pushedLogs = {}
+eventClient = None
+
+def normalizePath(path):
+    return os.path.normcase(os.path.abspath(path))
+
+def refreshAllInstances():
+    for instance in pluginInstances:
+        if not instance.shouldUnload:
+            instance.onUpdate()
+
+class EventClient(threading.Thread):
+    def __init__(self):
+        super().__init__()
+        self.daemon = True
+        self.connected = False
+        self.stopping = False
+
+    def run(self):
+        while not self.stopping:
+            try:
+                with socket.create_connection(('127.0.0.1', EVENT_SERVER_PORT), timeout=1) as s:
+                    self.connected = True
+                    received = b''
+                    while not self.stopping:
+                        try:
+                            data = s.recv(65536)
+                        except socket.timeout:
+                            continue
+                        if not data:
+                            break
+                        received += data
+                        while b'\n' in received:
+                            line, received = received.split(b'\n', 1)
+                            self.handleEvent(json.loads(line.decode('utf-8')))
+            except (OSError, ValueError):
+                pass
+
+            if self.connected:
+                self.connected = False
+                pushedLogs.clear()
+                sublime.set_timeout(refreshAllInstances, 0)
+
+            time.sleep(1)
+
+    def handleEvent(self, event):
+        if event.get('type') == 'build':
+            for f in event['files']:
+                pushedLogs[normalizePath(f['path'])] = f['log']
+            sublime.set_timeout(refreshAllInstances, 0)
+
+def plugin_loaded():
+    global eventClient
+    eventClient = EventClient()
+    eventClient.start()
+
 def plugin_unloaded():
     global pluginInstances
     for i in range(len(pluginInstances)):
         pluginInstances[i].shouldUnload = True
+    if eventClient:
+        eventClient.stopping = True
   
 class RenderToy(sublime_plugin.ViewEventListener):  
     show_errors_inline = True
@@ -71,7 +138,39 @@ class RenderToy(sublime_plugin.ViewEventListener):
     def on_phantom_navigate(self, url):
         self.hide_phantoms()
 
+    def showErrors(self, errors):
+        errors = [x.strip() for x in errors if len(x.strip()) > 0]
+        self.errors = {}
+
+        def parseError(e, regex):
+            m = regex.match(e)
+            if m:
+                column = int(m.group(1))
+                line = int(m.group(2))
+                text = m.group(3)
+                if line in self.errors:
+                    self.errors[line].append([column, text])
+                else:
+                    self.errors[line] = [[column, text],]
+                return True
+            else:
+                return False
+
+        for e in errors:
+            parseError(e, self.errorReIntel) or parseError(e, self.errorReNvidia)
+
+        self.update_phantoms()
+
     def onUpdate(self):
+        if eventClient and eventClient.connected:
+            log = pushedLogs.get(normalizePath(self.view.file_name()))
+            if log is not self.prevLog:
+                self.prevLog = log
+                self.prevMtime = 0
+                self.showErrors(log or [])
+            return
+
+        self.prevLog = None
         errorsFilePath = self.view.file_name() + '.errors'
 
         if not os.path.isfile(errorsFilePath):
@@ -84,30 +183,8 @@ class RenderToy(sublime_plugin.ViewEventListener):
             if self.prevMtime == mtime:
                 return
             with open(errorsFilePath) as f:
-                errors = f.readlines()
-                errors = [x.strip() for x in errors if len(x.strip()) > 0]
-
                 self.prevMtime = mtime
-                self.errors = {}
-
-                def parseError(e, regex):
-                    m = regex.match(e)
-                    if m:
-                        column = int(m.group(1))
-                        line = int(m.group(2))
-                        text = m.group(3)
-                        if line in self.errors:
-                            self.errors[line].append([column, text])
-                        else:
-                            self.errors[line] = [[column, text],]
-                        return True
-                    else:
-                        return False
-
-                for e in errors:
-                    parseError(e, self.errorReIntel) or parseError(e, self.errorReNvidia)
-
-                self.update_phantoms()
+                self.showErrors(f.readlines())
         except BaseException as e:
             print('Could not parse "%s": %s' % (errorsFilePath, e))
             traceback.print_exc(file=sys.stdout)
@@ -127,6 +204,7 @@ class RenderToy(sublime_plugin.ViewEventListener):
             self.shouldUnload = False
             self.view = view
             self.prevMtime = 0
+            self.prevLog = None
             self.errorReIntel = re.compile(r'ERROR: (\d+):(\d+): (.*)')
             self.errorReNvidia = re.compile(r'(\d+)\((\d+)\) : (.*)')
             self.handleTimeout(self.view)
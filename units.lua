@@ -74,6 +74,72 @@ local rendertoy = Program {
 			"shell32.lib",
 			"comdlg32.lib",
 			"gdi32.lib",
+			"opengl32.lib",
+			"ws2_32.lib",
+			"src/ext/freeimage/win64/FreeImage.lib",
+			Config = {"win*"}
+		},
+	},
+}
+
+-- The graph runtime without the editor, for embedding in other applications; see src/rendertoy_runtime/RenderToyRuntime.h.
+-- Programs using it link opengl32.lib and FreeImage.lib too.
+local rendertoy_runtime = StaticLibrary {
+	Name = "rendertoy_runtime",
+	Depends = { glad, tinyexr },
+	Defines = { "RENDERTOY_RUNTIME" },
+	Includes = {
+		"src/ext/glad/include",
+		"src/ext/rapidjson/include",
+		"src/ext/glm/include",
+		"src/ext/tinyexr",
+		"src/ext/freeimage/include",
+		"src/ext/gli",
+	},
+	Sources = {
+		Glob { Dir = "src/rendertoy_runtime", Extensions = {".cpp", ".h"} },
+		"src/rendertoy/Package.cpp",
+		"src/rendertoy/Shader.cpp",
+		"src/rendertoy/NodeGraph.cpp",
+		"src/rendertoy/Texture.cpp",
+		"src/rendertoy/FileWatcher.cpp",
+		"src/rendertoy/FileUtil.cpp",
+		"src/rendertoy/Md5.cpp",
+		"src/rendertoy/GlState.cpp",
+		"src/rendertoy/GlTrace.cpp",
+		"src/rendertoy/GpuProfiler.cpp",
+		"src/rendertoy/ReloadLatency.cpp",
+		"src/rendertoy/Arena.cpp",
+		"src/rendertoy/ResourceRegistry.cpp",
+		"src/rendertoy/UploadRing.cpp",
+		"src/rendertoy/TextureCache.cpp",
+		"src/rendertoy/BcEncoder.cpp",
+		"src/rendertoy/ExrLoader.cpp",
+		"src/rendertoy/VirtualTexture.cpp",
+		"src/rendertoy/ImageSequence.cpp",
+	},
+}
+
+-- CPU-side microbenchmarks; see src/rendertoy_bench/BenchMain.cpp
+local rendertoy_bench = Program {
+	Name = "rendertoy_bench",
+	Depends = {
+		rendertoy_runtime, glad, tinyexr,
+		{ copy_freeimage_win64; Config = {"win*"} },
+	},
+	Includes = {
+		"src/ext/glad/include",
+		"src/ext/rapidjson/include",
+		"src/ext/glm/include",
+		"src/ext/tinyexr",
+		"src/ext/freeimage/include",
+		"src/ext/gli",
+	},
+	Sources = {
+		Glob { Dir = "src/rendertoy_bench", Extensions = {".cpp", ".h"} },
+	},
+	Libs = {
+		{
 			"opengl32.lib",
 			"src/ext/freeimage/win64/FreeImage.lib",
 			Config = {"win*"}